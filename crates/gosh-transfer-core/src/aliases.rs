@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Loopback aliases for relayed peers
+//
+// Transfers carried over a relay transport reach the engine from, or are
+// sent by the engine to, a loopback address. Each remote peer gets its own
+// address in 127.77.0.0/16 so the engine still tells peers apart, and the
+// real address is restored wherever an address is shown or stored.
+
+use std::collections::HashMap;
+use std::net::{IpAddr, Ipv4Addr};
+use std::sync::RwLock;
+
+/// Number of aliases before slots are reused, oldest first
+const MAX_ALIASES: u32 = 65_534;
+
+#[derive(Debug, Default)]
+struct AliasTable {
+    by_peer: HashMap<IpAddr, Ipv4Addr>,
+    by_alias: HashMap<Ipv4Addr, IpAddr>,
+    next: u32,
+}
+
+/// Two-way mapping between remote peers and their loopback aliases
+#[derive(Debug, Default)]
+pub struct PeerAliases {
+    table: RwLock<AliasTable>,
+}
+
+impl PeerAliases {
+    /// Get the loopback alias of a peer, allocating one on first use
+    pub fn alias_for(&self, peer: IpAddr) -> Ipv4Addr {
+        if let Some(alias) = self.table.read().unwrap().by_peer.get(&peer) {
+            return *alias;
+        }
+
+        let mut table = self.table.write().unwrap();
+        if let Some(alias) = table.by_peer.get(&peer) {
+            return *alias;
+        }
+        let slot = table.next % MAX_ALIASES + 1;
+        table.next = table.next.wrapping_add(1);
+
+        let alias = Ipv4Addr::new(127, 77, (slot >> 8) as u8, (slot & 0xff) as u8);
+        if let Some(previous) = table.by_alias.insert(alias, peer) {
+            table.by_peer.remove(&previous);
+        }
+        table.by_peer.insert(peer, alias);
+        alias
+    }
+
+    /// Get the real peer behind an alias address, if it is one
+    pub fn peer_of(&self, address: &str) -> Option<IpAddr> {
+        let alias: Ipv4Addr = address.parse().ok()?;
+        self.table.read().unwrap().by_alias.get(&alias).copied()
+    }
+
+    /// Replace an alias address with the real peer address in place
+    pub fn restore(&self, address: &mut String) {
+        if let Some(peer) = self.peer_of(address) {
+            *address = peer.to_string();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_alias_is_stable_and_restorable() {
+        let aliases = PeerAliases::default();
+        let a: IpAddr = "10.0.0.5".parse().unwrap();
+        let b: IpAddr = "fd7a::1".parse().unwrap();
+
+        let alias_a = aliases.alias_for(a);
+        assert_eq!(alias_a, Ipv4Addr::new(127, 77, 0, 1));
+        assert_eq!(aliases.alias_for(a), alias_a);
+        assert_ne!(aliases.alias_for(b), alias_a);
+
+        let mut address = alias_a.to_string();
+        aliases.restore(&mut address);
+        assert_eq!(address, "10.0.0.5");
+
+        let mut direct = "192.168.1.2".to_string();
+        aliases.restore(&mut direct);
+        assert_eq!(direct, "192.168.1.2");
+    }
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Time-boxed approval sessions
+//
+// A session auto-accepts requests from one peer until it expires or a
+// transfer budget runs out, so back-to-back sends from the same person
+// only need to be approved once. Sessions are in-memory only.
+
+use crate::types::AppError;
+use chrono::{DateTime, Duration, Utc};
+use serde::Serialize;
+use std::collections::HashMap;
+
+/// An active approval session, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ApprovalSession {
+    pub peer_address: String,
+    pub started_at: DateTime<Utc>,
+    /// Session ends at this time, if time-boxed
+    pub expires_at: Option<DateTime<Utc>>,
+    /// Transfers still accepted before the session ends, if count-boxed
+    pub remaining_transfers: Option<u32>,
+    /// Transfers accepted through this session so far
+    pub accepted_transfers: u32,
+}
+
+impl ApprovalSession {
+    fn is_live(&self, now: DateTime<Utc>) -> bool {
+        self.expires_at.map_or(true, |at| now < at) && self.remaining_transfers != Some(0)
+    }
+}
+
+/// Approval sessions keyed by peer address
+#[derive(Debug, Default)]
+pub struct ApprovalSessions {
+    sessions: HashMap<String, ApprovalSession>,
+}
+
+impl ApprovalSessions {
+    /// Start (or replace) a session for a peer.
+    ///
+    /// At least one of `minutes` or `transfers` must be given; open-ended
+    /// approval is what trusted hosts are for.
+    pub fn start(
+        &mut self,
+        peer_address: &str,
+        minutes: Option<u32>,
+        transfers: Option<u32>,
+        now: DateTime<Utc>,
+    ) -> Result<ApprovalSession, AppError> {
+        if minutes.unwrap_or(0) == 0 && transfers.unwrap_or(0) == 0 {
+            return Err(AppError::InvalidConfig(
+                "Approval session needs a duration or a transfer count".to_string(),
+            ));
+        }
+
+        let session = ApprovalSession {
+            peer_address: peer_address.to_string(),
+            started_at: now,
+            expires_at: minutes
+                .filter(|m| *m > 0)
+                .map(|m| now + Duration::minutes(i64::from(m))),
+            remaining_transfers: transfers.filter(|t| *t > 0),
+            accepted_transfers: 0,
+        };
+        self.sessions
+            .insert(peer_address.to_string(), session.clone());
+        Ok(session)
+    }
+
+    /// Check whether a request from `peer_address` is covered by a live session
+    pub fn covers(&self, peer_address: &str, now: DateTime<Utc>) -> bool {
+        self.sessions
+            .get(peer_address)
+            .map_or(false, |s| s.is_live(now))
+    }
+
+    /// Charge one accepted transfer to the peer's session, ending it when spent
+    pub fn record_accept(&mut self, peer_address: &str) {
+        if let Some(session) = self.sessions.get_mut(peer_address) {
+            session.accepted_transfers += 1;
+            if let Some(remaining) = session.remaining_transfers.as_mut() {
+                *remaining = remaining.saturating_sub(1);
+            }
+        }
+    }
+
+    /// Live sessions, dropping any that have ended
+    pub fn list(&mut self, now: DateTime<Utc>) -> Vec<ApprovalSession> {
+        self.sessions.retain(|_, s| s.is_live(now));
+        let mut sessions: Vec<_> = self.sessions.values().cloned().collect();
+        sessions.sort_by(|a, b| a.started_at.cmp(&b.started_at));
+        sessions
+    }
+
+    /// End a peer's session, returning whether one existed
+    pub fn revoke(&mut self, peer_address: &str) -> bool {
+        self.sessions.remove(peer_address).is_some()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_transfer_budget_ends_session() {
+        let now = Utc::now();
+        let mut sessions = ApprovalSessions::default();
+        sessions.start("10.0.0.5", None, Some(2), now).unwrap();
+
+        for _ in 0..2 {
+            assert!(sessions.covers("10.0.0.5", now));
+            sessions.record_accept("10.0.0.5");
+        }
+        assert!(!sessions.covers("10.0.0.5", now));
+        assert!(sessions.list(now).is_empty());
+    }
+
+    #[test]
+    fn test_session_expires() {
+        let now = Utc::now();
+        let mut sessions = ApprovalSessions::default();
+        sessions.start("10.0.0.5", Some(10), None, now).unwrap();
+
+        assert!(sessions.covers("10.0.0.5", now + Duration::minutes(9)));
+        assert!(!sessions.covers("10.0.0.5", now + Duration::minutes(10)));
+        assert!(!sessions.covers("10.0.0.6", now));
+        assert!(sessions.start("10.0.0.6", Some(0), None, now).is_err());
+    }
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Cancellation
+//
+// One token is shared by every stage of a send. Blocking stages such as
+// directory walks poll it between entries; async stages race it, so a
+// cancel takes effect at the next entry or await point instead of when the
+// stage would have finished.
+
+use crate::types::AppError;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+use tokio::sync::Notify;
+
+#[derive(Debug, Default)]
+struct Inner {
+    cancelled: AtomicBool,
+    /// When cancel was called, to report how long stages took to stop
+    at: Mutex<Option<Instant>>,
+    notify: Notify,
+}
+
+/// Cancellation signal shared by the stages of one operation
+#[derive(Debug, Clone, Default)]
+pub struct CancelToken(Arc<Inner>);
+
+impl CancelToken {
+    pub fn cancel(&self) {
+        if !self.0.cancelled.swap(true, Ordering::AcqRel) {
+            *self.0.at.lock().unwrap() = Some(Instant::now());
+        }
+        self.0.notify.notify_waiters();
+    }
+
+    pub fn is_cancelled(&self) -> bool {
+        self.0.cancelled.load(Ordering::Acquire)
+    }
+
+    /// Fail with `AppError::Cancelled` once cancelled, for blocking loops
+    pub fn check(&self) -> Result<(), AppError> {
+        if self.is_cancelled() {
+            Err(AppError::Cancelled)
+        } else {
+            Ok(())
+        }
+    }
+
+    /// Wait until cancelled
+    pub async fn cancelled(&self) {
+        loop {
+            let notified = self.0.notify.notified();
+            if self.is_cancelled() {
+                return;
+            }
+            notified.await;
+        }
+    }
+
+    /// Time since cancel was called
+    pub fn elapsed(&self) -> Option<Duration> {
+        self.0.at.lock().unwrap().map(|at| at.elapsed())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[tokio::test]
+    async fn test_cancel_wakes_waiters() {
+        let token = CancelToken::default();
+        assert!(token.check().is_ok());
+
+        let waiter = tokio::spawn({
+            let token = token.clone();
+            async move { token.cancelled().await }
+        });
+        tokio::task::yield_now().await;
+        token.cancel();
+        tokio::time::timeout(Duration::from_millis(100), waiter)
+            .await
+            .expect("waiter was not woken")
+            .unwrap();
+
+        assert!(matches!(token.check(), Err(AppError::Cancelled)));
+        assert!(token.elapsed().is_some());
+    }
+}
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Chained replication
+//
+// A chain sends a dataset through an ordered list of receivers: each hop
+// keeps a copy and forwards it to the next, so the sender's uplink carries
+// the data once. Files travel one transfer each, together with a small
+// manifest naming the hops still to go; a hop forwards a file as soon as
+// it has arrived, so the hops work in a pipeline.
+
+use crate::types::AppError;
+use chrono::{DateTime, Utc};
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::RwLock;
+
+/// File name prefix marking a chain manifest inside a transfer
+pub const MANIFEST_PREFIX: &str = ".gosh-chain-";
+
+/// A receiver in a chain
+#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ChainHop {
+    pub address: String,
+    pub port: u16,
+}
+
+/// Routing data sent along with each file of a chain
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ChainManifest {
+    pub chain_id: String,
+    /// Position of the file within the chain, from 0
+    pub seq: u32,
+    /// Number of files in the chain
+    pub total: u32,
+    /// Position of the receiving hop, from 1
+    pub hop: u32,
+    /// Hops after the receiving one, in order
+    pub next: Vec<ChainHop>,
+}
+
+impl ChainManifest {
+    /// Name of the manifest file; unique per file of the chain
+    pub fn file_name(&self) -> String {
+        format!("{}{}-{}.json", MANIFEST_PREFIX, self.chain_id, self.seq)
+    }
+
+    /// Check whether a transferred file name is a chain manifest
+    pub fn is_manifest(name: &str) -> bool {
+        name.starts_with(MANIFEST_PREFIX) && name.ends_with(".json") && !name.contains('/')
+    }
+
+    /// The next hop and the manifest to send it, if the chain continues
+    pub fn forwarded(&self) -> Option<(ChainHop, ChainManifest)> {
+        let (hop, rest) = self.next.split_first()?;
+        let manifest = ChainManifest {
+            hop: self.hop + 1,
+            next: rest.to_vec(),
+            ..self.clone()
+        };
+        Some((hop.clone(), manifest))
+    }
+
+    /// Write the manifest into `dir`, returning its path
+    pub fn write(&self, dir: &Path) -> Result<PathBuf, AppError> {
+        let content = serde_json::to_string(self).map_err(|e| {
+            AppError::Serialization(format!("Failed to serialize chain manifest: {}", e))
+        })?;
+        fs::create_dir_all(dir)?;
+        let path = dir.join(self.file_name());
+        fs::write(&path, content)?;
+        Ok(path)
+    }
+
+    /// Read a received manifest
+    pub fn read(path: &Path) -> Result<Self, AppError> {
+        let content = fs::read_to_string(path)?;
+        serde_json::from_str(&content)
+            .map_err(|e| AppError::Serialization(format!("Invalid chain manifest: {}", e)))
+    }
+}
+
+/// Progress of a chain at this device, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ChainStatus {
+    pub chain_id: String,
+    /// Position of this device in the chain; 0 for the sender
+    pub hop: u32,
+    pub total_files: u32,
+    pub received_files: u32,
+    /// Files handed to the next hop
+    pub forwarded_files: u32,
+    pub failed_files: u32,
+    pub next_hop: Option<String>,
+    pub updated_at: DateTime<Utc>,
+}
+
+/// Chains this device takes part in, keyed by chain id
+#[derive(Debug, Default)]
+pub struct ChainProgress {
+    chains: RwLock<HashMap<String, ChainStatus>>,
+}
+
+impl ChainProgress {
+    fn update(&self, manifest: &ChainManifest, apply: impl FnOnce(&mut ChainStatus)) {
+        let mut chains = self.chains.write().unwrap();
+        let status = chains
+            .entry(manifest.chain_id.clone())
+            .or_insert_with(|| ChainStatus {
+                chain_id: manifest.chain_id.clone(),
+                hop: manifest.hop,
+                total_files: manifest.total,
+                received_files: 0,
+                forwarded_files: 0,
+                failed_files: 0,
+                next_hop: manifest.next.first().map(|h| h.address.clone()),
+                updated_at: Utc::now(),
+            });
+        apply(status);
+        status.updated_at = Utc::now();
+    }
+
+    /// Register a chain started by this device towards `first`
+    pub fn start(&self, chain_id: &str, total: u32, first: &ChainHop) {
+        let manifest = ChainManifest {
+            chain_id: chain_id.to_string(),
+            seq: 0,
+            total,
+            hop: 0,
+            next: vec![first.clone()],
+        };
+        self.update(&manifest, |_| {});
+    }
+
+    /// Note a file of the chain received by this device
+    pub fn record_received(&self, manifest: &ChainManifest) {
+        self.update(manifest, |s| s.received_files += 1);
+    }
+
+    /// Note a file handed to the next hop
+    pub fn record_forwarded(&self, manifest: &ChainManifest) {
+        self.update(manifest, |s| s.forwarded_files += 1);
+    }
+
+    /// Note a file that could not be received or forwarded
+    pub fn record_failed(&self, manifest: &ChainManifest) {
+        self.update(manifest, |s| s.failed_files += 1);
+    }
+
+    /// Chains seen here, most recently active first
+    pub fn list(&self) -> Vec<ChainStatus> {
+        let mut chains: Vec<_> = self.chains.read().unwrap().values().cloned().collect();
+        chains.sort_by(|a, b| b.updated_at.cmp(&a.updated_at));
+        chains
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_manifest_walks_the_chain() {
+        let hop = |address: &str| ChainHop {
+            address: address.to_string(),
+            port: 53317,
+        };
+        let manifest = ChainManifest {
+            chain_id: "abc".to_string(),
+            seq: 3,
+            total: 10,
+            hop: 1,
+            next: vec![hop("10.0.0.2"), hop("10.0.0.3")],
+        };
+        assert!(ChainManifest::is_manifest(&manifest.file_name()));
+        assert!(!ChainManifest::is_manifest("data.json"));
+
+        let (second, manifest) = manifest.forwarded().unwrap();
+        assert_eq!(second, hop("10.0.0.2"));
+        assert_eq!(manifest.hop, 2);
+        let (third, manifest) = manifest.forwarded().unwrap();
+        assert_eq!(third, hop("10.0.0.3"));
+        assert!(manifest.forwarded().is_none());
+        assert_eq!(manifest.seq, 3);
+    }
+}
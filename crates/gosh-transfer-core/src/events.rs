@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Engine events for the frontend
+//
+// Events reach the web frontend as JSON with a "type" tag and camelCase
+// fields. They are serialized straight from the engine's own data, with
+// no serde_json::Value tree built per event; progress events arrive many
+// times a second per transfer, so that tree was most of their cost.
+
+use gosh_lan_transfer::{EngineEvent, PendingTransfer, TransferProgress};
+use serde::Serialize;
+
+/// Engine event as the frontend receives it. It borrows from the event and
+/// serializes straight to the emitted bytes, with no `serde_json::Value`
+/// built in between.
+#[derive(Clone, Serialize)]
+#[serde(tag = "type")]
+pub enum FrontendEvent<'a> {
+    TransferRequest {
+        transfer: &'a PendingTransfer,
+    },
+    TransferProgress {
+        progress: &'a TransferProgress,
+    },
+    #[serde(rename_all = "camelCase")]
+    TransferComplete {
+        transfer_id: &'a str,
+    },
+    #[serde(rename_all = "camelCase")]
+    TransferFailed {
+        transfer_id: &'a str,
+        error: &'a str,
+    },
+    #[serde(rename_all = "camelCase")]
+    TransferRetry {
+        transfer_id: &'a str,
+        attempt: u32,
+        max_attempts: u32,
+        error: &'a str,
+    },
+    ServerStarted {
+        port: u16,
+    },
+    ServerStopped,
+    #[serde(rename_all = "camelCase")]
+    PortChanged {
+        old_port: u16,
+        new_port: u16,
+    },
+}
+
+impl<'a> From<&'a EngineEvent> for FrontendEvent<'a> {
+    fn from(event: &'a EngineEvent) -> Self {
+        match event {
+            EngineEvent::TransferRequest(transfer) => Self::TransferRequest { transfer },
+            EngineEvent::TransferProgress(progress) => Self::TransferProgress { progress },
+            EngineEvent::TransferComplete { transfer_id } => Self::TransferComplete { transfer_id },
+            EngineEvent::TransferFailed { transfer_id, error } => {
+                Self::TransferFailed { transfer_id, error }
+            }
+            EngineEvent::TransferRetry {
+                transfer_id,
+                attempt,
+                max_attempts,
+                error,
+            } => Self::TransferRetry {
+                transfer_id,
+                attempt: *attempt,
+                max_attempts: *max_attempts,
+                error,
+            },
+            EngineEvent::ServerStarted { port } => Self::ServerStarted { port: *port },
+            EngineEvent::ServerStopped => Self::ServerStopped,
+            EngineEvent::PortChanged { old_port, new_port } => Self::PortChanged {
+                old_port: *old_port,
+                new_port: *new_port,
+            },
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::{json, Value};
+    use std::time::Instant;
+
+    /// Tree the frontend used to receive each event as
+    fn value_of(event: &EngineEvent) -> Value {
+        match event {
+            EngineEvent::TransferRequest(transfer) => {
+                json!({ "type": "TransferRequest", "transfer": transfer })
+            }
+            EngineEvent::TransferProgress(progress) => {
+                json!({ "type": "TransferProgress", "progress": progress })
+            }
+            EngineEvent::TransferComplete { transfer_id } => {
+                json!({ "type": "TransferComplete", "transferId": transfer_id })
+            }
+            EngineEvent::TransferFailed { transfer_id, error } => {
+                json!({ "type": "TransferFailed", "transferId": transfer_id, "error": error })
+            }
+            EngineEvent::TransferRetry {
+                transfer_id,
+                attempt,
+                max_attempts,
+                error,
+            } => json!({
+                "type": "TransferRetry",
+                "transferId": transfer_id,
+                "attempt": attempt,
+                "maxAttempts": max_attempts,
+                "error": error
+            }),
+            EngineEvent::ServerStarted { port } => json!({ "type": "ServerStarted", "port": port }),
+            EngineEvent::ServerStopped => json!({ "type": "ServerStopped" }),
+            EngineEvent::PortChanged { old_port, new_port } => {
+                json!({ "type": "PortChanged", "oldPort": old_port, "newPort": new_port })
+            }
+        }
+    }
+
+    fn progress() -> TransferProgress {
+        serde_json::from_value(json!({
+            "transfer_id": "3f2a9c1e-transfer",
+            "current_file": "photos/2024/IMG_0001.jpg",
+            "current_file_index": 3,
+            "total_files": 120,
+            "bytes_transferred": 48_234_496u64,
+            "total_bytes": 734_003_200u64,
+            "speed_bps": 11_534_336u64
+        }))
+        .unwrap()
+    }
+
+    fn events() -> Vec<EngineEvent> {
+        let transfer: PendingTransfer = serde_json::from_value(json!({
+            "id": "3f2a9c1e-transfer",
+            "peer_address": "192.168.1.20",
+            "peer_hostname": "desk",
+            "files": [{ "name": "a.txt", "size": 12, "is_directory": false }],
+            "total_size": 12,
+            "created_at": "2026-01-01T00:00:00Z"
+        }))
+        .unwrap();
+        let id = "3f2a9c1e-transfer".to_string();
+        vec![
+            EngineEvent::TransferRequest(transfer),
+            EngineEvent::TransferProgress(progress()),
+            EngineEvent::TransferComplete {
+                transfer_id: id.clone(),
+            },
+            EngineEvent::TransferFailed {
+                transfer_id: id.clone(),
+                error: "reset".to_string(),
+            },
+            EngineEvent::TransferRetry {
+                transfer_id: id,
+                attempt: 2,
+                max_attempts: 5,
+                error: "timed out".to_string(),
+            },
+            EngineEvent::ServerStarted { port: 53317 },
+            EngineEvent::ServerStopped,
+            EngineEvent::PortChanged {
+                old_port: 53317,
+                new_port: 53318,
+            },
+        ]
+    }
+
+    #[test]
+    fn test_events_serialize_as_before() {
+        for event in events() {
+            let direct: Value = serde_json::to_value(FrontendEvent::from(&event)).unwrap();
+            assert_eq!(direct, value_of(&event));
+        }
+    }
+
+    /// Serializing a progress event directly against building its tree
+    /// first, as the frontend emit does. Run with
+    ///
+    ///   cargo test --release -p gosh-transfer-core -- --ignored --nocapture bench_event_serialization
+    #[test]
+    #[ignore]
+    fn bench_event_serialization() {
+        const EVENTS: u32 = 1_000_000;
+        let event = EngineEvent::TransferProgress(progress());
+
+        let start = Instant::now();
+        for _ in 0..EVENTS {
+            std::hint::black_box(serde_json::to_vec(&value_of(&event)).unwrap());
+        }
+        let tree = start.elapsed();
+
+        let start = Instant::now();
+        for _ in 0..EVENTS {
+            std::hint::black_box(serde_json::to_vec(&FrontendEvent::from(&event)).unwrap());
+        }
+        let direct = start.elapsed();
+
+        println!(
+            "bench: progress event through Value {} ns, direct {} ns",
+            tree.as_nanos() / u128::from(EVENTS),
+            direct.as_nanos() / u128::from(EVENTS)
+        );
+    }
+}
@@ -3,22 +3,37 @@
 //
 // Favorites are stored in a local JSON file.
 // Implements the engine's FavoritesPersistence trait.
+// Filters and extra addresses are kept beside the engine's favorites.
 
+use crate::filter::TransferFilter;
+use crate::json;
+use crate::routes::FavoriteRoutes;
 use crate::types::AppError;
 use gosh_lan_transfer::{EngineResult, Favorite, FavoritesPersistence};
+use std::collections::HashMap;
 use std::fs;
+use std::net::IpAddr;
 use std::path::PathBuf;
 use std::sync::RwLock;
+use std::time::Duration;
 
 /// File-based favorites store implementing the engine's FavoritesPersistence trait
 pub struct FileFavoritesStore {
     favorites: RwLock<Vec<Favorite>>,
+    /// Saved directory-send filters, keyed by favorite id
+    filters: RwLock<HashMap<String, TransferFilter>>,
+    /// Extra addresses and their measurements, keyed by favorite id
+    routes: RwLock<HashMap<String, FavoriteRoutes>>,
     file_path: PathBuf,
 }
 
 #[derive(serde::Serialize, serde::Deserialize)]
 struct FavoritesFile {
     favorites: Vec<Favorite>,
+    #[serde(default, skip_serializing_if = "HashMap::is_empty")]
+    filters: HashMap<String, TransferFilter>,
+    #[serde(default, skip_serializing_if = "HashMap::is_empty")]
+    routes: HashMap<String, FavoriteRoutes>,
 }
 
 impl FileFavoritesStore {
@@ -26,21 +41,22 @@ impl FileFavoritesStore {
     pub fn new() -> Result<Self, AppError> {
         let file_path = Self::get_favorites_path()?;
 
-        let favorites = if file_path.exists() {
-            let content = fs::read_to_string(&file_path)
-                .map_err(|e| AppError::FileIo(format!("Failed to read favorites: {}", e)))?;
-
-            let file: FavoritesFile = serde_json::from_str(&content).map_err(|e| {
-                AppError::Serialization(format!("Failed to parse favorites: {}", e))
-            })?;
-
-            file.favorites
+        let file = if file_path.exists() {
+            json::read_file(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read favorites: {}", e)))?
+                .map_err(|e| AppError::Serialization(format!("Failed to parse favorites: {}", e)))?
         } else {
-            Vec::new()
+            FavoritesFile {
+                favorites: Vec::new(),
+                filters: HashMap::new(),
+                routes: HashMap::new(),
+            }
         };
 
         Ok(Self {
-            favorites: RwLock::new(favorites),
+            favorites: RwLock::new(file.favorites),
+            filters: RwLock::new(file.filters),
+            routes: RwLock::new(file.routes),
             file_path,
         })
     }
@@ -62,8 +78,12 @@ impl FileFavoritesStore {
     /// Persist favorites to disk
     fn persist(&self) -> Result<(), AppError> {
         let favorites = self.favorites.read().unwrap();
+        let filters = self.filters.read().unwrap();
+        let routes = self.routes.read().unwrap();
         let file = FavoritesFile {
             favorites: favorites.clone(),
+            filters: filters.clone(),
+            routes: routes.clone(),
         };
 
         let content = serde_json::to_string_pretty(&file).map_err(|e| {
@@ -104,6 +124,139 @@ impl FileFavoritesStore {
         self.persist()?;
         Ok(())
     }
+
+    /// Get the directory-send filter saved for a favorite
+    pub fn filter(&self, id: &str) -> Option<TransferFilter> {
+        self.filters.read().unwrap().get(id).cloned()
+    }
+
+    /// Save (or clear, with `None` or an empty filter) a favorite's directory-send filter
+    pub fn set_filter(&self, id: &str, filter: Option<TransferFilter>) -> Result<(), AppError> {
+        if !self.favorites.read().unwrap().iter().any(|f| f.id == id) {
+            return Err(AppError::InvalidConfig(format!(
+                "Favorite not found: {}",
+                id
+            )));
+        }
+        {
+            let mut filters = self.filters.write().unwrap();
+            match filter.filter(|f| !f.is_empty()) {
+                Some(filter) => filters.insert(id.to_string(), filter),
+                None => filters.remove(id),
+            };
+        }
+        self.persist()
+    }
+
+    /// Get a favorite's extra addresses and their measurements
+    pub fn routes(&self, id: &str) -> FavoriteRoutes {
+        self.routes
+            .read()
+            .unwrap()
+            .get(id)
+            .cloned()
+            .unwrap_or_default()
+    }
+
+    /// Replace the addresses a favorite is tried at besides its own.
+    /// Measurements of addresses still listed are kept.
+    pub fn set_addresses(&self, id: &str, addresses: Vec<String>) -> Result<(), AppError> {
+        let primary = self
+            .favorites
+            .read()
+            .unwrap()
+            .iter()
+            .find(|f| f.id == id)
+            .map(|f| f.address.clone())
+            .ok_or_else(|| AppError::InvalidConfig(format!("Favorite not found: {}", id)))?;
+        let mut kept: Vec<String> = Vec::new();
+        for address in addresses.iter().map(|a| a.trim()) {
+            if !address.is_empty() && address != primary && !kept.iter().any(|k| k == address) {
+                kept.push(address.to_string());
+            }
+        }
+        {
+            let mut routes = self.routes.write().unwrap();
+            if kept.is_empty() {
+                routes.remove(id);
+            } else {
+                let routes = routes.entry(id.to_string()).or_default();
+                routes
+                    .stats
+                    .retain(|address, _| *address == primary || kept.contains(address));
+                routes.addresses = kept;
+            }
+        }
+        self.persist()
+    }
+
+    /// The favorite reached at `address` through any of its addresses, with
+    /// all of them best first. `None` unless it has more than one.
+    pub fn candidates(&self, address: &str) -> Option<(String, Vec<String>)> {
+        let favorites = self.favorites.read().unwrap();
+        let routes = self.routes.read().unwrap();
+        favorites.iter().find_map(|favorite| {
+            let extra = routes.get(&favorite.id)?;
+            (favorite.address == address || extra.addresses.iter().any(|a| a == address)).then(
+                || {
+                    let ranked = extra.ranked(&favorite.address, chrono::Utc::now());
+                    (favorite.id.clone(), ranked)
+                },
+            )
+        })
+    }
+
+    /// Record the outcome of a race between a favorite's addresses: the
+    /// winning address with the IP it resolved to and its connect time,
+    /// and the addresses that failed. The winner's IP becomes the
+    /// favorite's last resolved IP.
+    ///
+    /// The file is only written when the winning address or its IP
+    /// changes. Connect times and failures of other races are kept in
+    /// memory and go out with the next write, so a send to a favorite
+    /// does not rewrite the whole file each time.
+    pub fn record_race(
+        &self,
+        id: &str,
+        winner: Option<(&str, IpAddr, Duration)>,
+        failed: &[String],
+    ) -> Result<(), AppError> {
+        let now = chrono::Utc::now();
+        let mut changed = false;
+        {
+            let mut routes = self.routes.write().unwrap();
+            let Some(routes) = routes.get_mut(id) else {
+                return Ok(());
+            };
+            for address in failed {
+                routes.record_failure(address, now);
+            }
+            if let Some((address, _, rtt)) = winner {
+                changed |= routes.last_winner.as_deref() != Some(address);
+                let rtt_ms = u32::try_from(rtt.as_millis()).unwrap_or(u32::MAX);
+                routes.record_success(address, rtt_ms, now);
+            }
+        }
+        if let Some((_, ip, _)) = winner {
+            if let Some(favorite) = self
+                .favorites
+                .write()
+                .unwrap()
+                .iter_mut()
+                .find(|f| f.id == id)
+            {
+                let ip = ip.to_string();
+                if favorite.last_resolved_ip.as_ref() != Some(&ip) {
+                    favorite.last_resolved_ip = Some(ip);
+                    changed = true;
+                }
+            }
+        }
+        if changed {
+            self.persist()?;
+        }
+        Ok(())
+    }
 }
 
 // Implement the engine's FavoritesPersistence trait
@@ -165,6 +318,8 @@ impl FavoritesPersistence for FileFavoritesStore {
                     id
                 )));
             }
+            self.filters.write().unwrap().remove(id);
+            self.routes.write().unwrap().remove(id);
         }
 
         self.persist()
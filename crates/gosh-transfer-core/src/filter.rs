@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Include/exclude filtering for directory sends
+//
+// Include, exclude and .gitignore patterns are compiled into a single
+// GlobSet and applied while walking, so excluded subtrees are pruned
+// before they are ever descended into.
+
+use crate::cancel::CancelToken;
+use crate::paths::PathList;
+use crate::types::AppError;
+use globset::{GlobBuilder, GlobSet, GlobSetBuilder};
+use serde::{Deserialize, Serialize};
+use std::fs;
+use std::path::{Path, PathBuf};
+
+/// User-facing filter for a directory send, saveable per favorite
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct TransferFilter {
+    /// Only send files matching one of these patterns (empty sends everything)
+    #[serde(default)]
+    pub include: Vec<String>,
+    /// Skip files and directories matching any of these patterns
+    #[serde(default)]
+    pub exclude: Vec<String>,
+    /// Also skip paths ignored by the `.gitignore` at the directory root
+    #[serde(default)]
+    pub respect_gitignore: bool,
+}
+
+impl TransferFilter {
+    /// Check whether the filter would send everything unchanged
+    pub fn is_empty(&self) -> bool {
+        self.include.is_empty() && self.exclude.is_empty() && !self.respect_gitignore
+    }
+}
+
+/// What a compiled glob means when it matches
+#[derive(Debug, Clone, Copy)]
+enum Rule {
+    /// Ignore the path (exclude pattern or .gitignore line)
+    Ignore { dir_only: bool },
+    /// Un-ignore the path (negated .gitignore line)
+    Unignore { dir_only: bool },
+    /// Path is wanted when include patterns are present
+    Include,
+}
+
+/// What a filtered walk went through
+#[derive(Debug, Clone, Default)]
+pub struct Walked {
+    /// Root-relative files to send
+    pub files: PathList,
+    /// Root-relative directories listed on the way, with or without kept
+    /// files; a file added to any of them can change the selection
+    pub dirs: PathList,
+}
+
+/// Compiled form of a `TransferFilter`
+pub struct PathFilter {
+    set: GlobSet,
+    rules: Vec<Rule>,
+    has_includes: bool,
+}
+
+impl PathFilter {
+    /// Compile a filter for a walk rooted at `root`.
+    ///
+    /// Exclude patterns follow .gitignore conventions: a pattern without `/`
+    /// matches at any depth, a leading `/` anchors it to the root and a
+    /// trailing `/` restricts it to directories. Later rules win, so user
+    /// excludes override negations in `.gitignore`.
+    pub fn compile(filter: &TransferFilter, root: &Path) -> Result<Self, AppError> {
+        let mut builder = GlobSetBuilder::new();
+        let mut rules = Vec::new();
+
+        if filter.respect_gitignore {
+            if let Ok(content) = fs::read_to_string(root.join(".gitignore")) {
+                for line in content.lines() {
+                    let line = line.trim();
+                    if line.is_empty() || line.starts_with('#') {
+                        continue;
+                    }
+                    match line.strip_prefix('!') {
+                        Some(pattern) => add_ignore(&mut builder, &mut rules, pattern, true)?,
+                        None => add_ignore(&mut builder, &mut rules, line, false)?,
+                    }
+                }
+            }
+        }
+
+        for pattern in &filter.exclude {
+            add_ignore(&mut builder, &mut rules, pattern.trim(), false)?;
+        }
+
+        for pattern in &filter.include {
+            let (glob, _) = normalize(pattern.trim());
+            if glob.is_empty() {
+                continue;
+            }
+            for glob in [glob.clone(), format!("{}/**", glob)] {
+                builder.add(build_glob(&glob)?);
+                rules.push(Rule::Include);
+            }
+        }
+
+        let set = builder
+            .build()
+            .map_err(|e| AppError::InvalidConfig(format!("Invalid filter: {}", e)))?;
+        let has_includes = rules.iter().any(|r| matches!(r, Rule::Include));
+
+        Ok(Self {
+            set,
+            rules,
+            has_includes,
+        })
+    }
+
+    /// Classify a root-relative, `/`-separated path as (excluded, included)
+    fn classify(&self, rel: &str, is_dir: bool, matches: &mut Vec<usize>) -> (bool, bool) {
+        self.set.matches_into(rel, matches);
+
+        let mut ignored = false;
+        let mut included = !self.has_includes;
+        // Indices come back in ascending order, so the last ignore rule wins
+        for &index in matches.iter() {
+            match self.rules[index] {
+                Rule::Ignore { dir_only } if !dir_only || is_dir => ignored = true,
+                Rule::Unignore { dir_only } if !dir_only || is_dir => ignored = false,
+                Rule::Include => included = true,
+                _ => {}
+            }
+        }
+
+        (ignored, included)
+    }
+
+    /// Walk `root`, returning root-relative paths of the files to send in
+    /// sorted order.
+    ///
+    /// Entry types come from the directory listing itself, so excluded
+    /// entries are dropped (and excluded directories never opened) without
+    /// a stat call. Each directory's entries are sorted and descended into
+    /// in order, so paths go straight into the front-coded list and only
+    /// the open directories' listings are held at once. Stops with
+    /// `AppError::Cancelled` between entries once `cancel` fires.
+    pub fn walk(&self, root: &Path, cancel: &CancelToken) -> Result<PathList, AppError> {
+        self.walk_tree(root, cancel).map(|walked| walked.files)
+    }
+
+    /// Walk `root` like `walk`, also noting every directory listed
+    pub fn walk_tree(&self, root: &Path, cancel: &CancelToken) -> Result<Walked, AppError> {
+        let mut walked = Walked::default();
+        let mut matches = Vec::new();
+        let mut open = vec![self.list_dir(root, PathBuf::new(), cancel, &mut matches)?];
+
+        while let Some(entries) = open.last_mut() {
+            match entries.next() {
+                None => {
+                    open.pop();
+                }
+                Some((rel, true)) => {
+                    let listed = self.list_dir(root, rel.clone(), cancel, &mut matches)?;
+                    walked.dirs.push(rel);
+                    open.push(listed);
+                }
+                Some((rel, false)) => walked.files.push(rel),
+            }
+        }
+
+        Ok(walked)
+    }
+
+    /// Sorted entries of one directory that survive the filter, with
+    /// whether each is a directory
+    fn list_dir(
+        &self,
+        root: &Path,
+        rel_dir: PathBuf,
+        cancel: &CancelToken,
+        matches: &mut Vec<usize>,
+    ) -> Result<std::vec::IntoIter<(PathBuf, bool)>, AppError> {
+        let entries = fs::read_dir(root.join(&rel_dir)).map_err(|e| {
+            AppError::FileIo(format!("Failed to read {}: {}", rel_dir.display(), e))
+        })?;
+
+        let mut kept = Vec::new();
+        for entry in entries {
+            cancel.check()?;
+            let entry = entry?;
+            let rel = rel_dir.join(entry.file_name());
+            let is_dir = entry.file_type()?.is_dir();
+
+            let (excluded, included) = self.classify(&rel.to_string_lossy(), is_dir, matches);
+            if !excluded && (is_dir || included) {
+                kept.push((rel, is_dir));
+            }
+        }
+
+        kept.sort();
+        Ok(kept.into_iter())
+    }
+}
+
+/// Strip anchors and directory markers, returning (glob, dir_only)
+fn normalize(pattern: &str) -> (String, bool) {
+    let dir_only = pattern.ends_with('/');
+    let pattern = pattern.trim_end_matches('/');
+    let anchored = pattern.contains('/');
+    let pattern = pattern.trim_start_matches('/');
+
+    if pattern.is_empty() {
+        (String::new(), dir_only)
+    } else if anchored || pattern.starts_with("**") {
+        (pattern.to_string(), dir_only)
+    } else {
+        (format!("**/{}", pattern), dir_only)
+    }
+}
+
+fn add_ignore(
+    builder: &mut GlobSetBuilder,
+    rules: &mut Vec<Rule>,
+    pattern: &str,
+    negated: bool,
+) -> Result<(), AppError> {
+    let (glob, dir_only) = normalize(pattern);
+    if glob.is_empty() {
+        return Ok(());
+    }
+    builder.add(build_glob(&glob)?);
+    rules.push(if negated {
+        Rule::Unignore { dir_only }
+    } else {
+        Rule::Ignore { dir_only }
+    });
+    Ok(())
+}
+
+fn build_glob(glob: &str) -> Result<globset::Glob, AppError> {
+    GlobBuilder::new(glob)
+        .literal_separator(true)
+        .build()
+        .map_err(|e| AppError::InvalidConfig(format!("Invalid pattern '{}': {}", glob, e)))
+}
+
+/// Directory holding staged copies of filtered directory sends
+pub fn staging_root() -> Result<PathBuf, AppError> {
+    let cache_dir = directories::ProjectDirs::from("com", "gosh", "transfer")
+        .ok_or_else(|| AppError::FileIo("Could not determine cache directory".to_string()))?
+        .cache_dir()
+        .to_path_buf();
+
+    Ok(cache_dir.join("staging"))
+}
+
+/// Mirror the filtered files of `root` into a fresh staging directory.
+///
+/// Files are hard-linked so no data is copied; when the staging area is on
+/// another filesystem a symlink is used instead. Returns the staged root,
+/// which keeps the original directory name so the receiver sees the same
+/// layout as an unfiltered send.
+pub fn stage_filtered(
+    root: &Path,
+    files: &PathList,
+    cancel: &CancelToken,
+) -> Result<PathBuf, AppError> {
+    let name = root
+        .file_name()
+        .ok_or_else(|| AppError::InvalidConfig(format!("Not a directory: {}", root.display())))?;
+    let unique = format!(
+        "{}-{}",
+        std::process::id(),
+        chrono::Utc::now().timestamp_nanos_opt().unwrap_or_default()
+    );
+    let staged_root = staging_root()?.join(unique).join(name);
+    fs::create_dir_all(&staged_root)?;
+
+    for rel in files {
+        if let Err(e) = cancel.check() {
+            remove_staged(&staged_root);
+            return Err(e);
+        }
+        let source = root.join(&rel);
+        let target = staged_root.join(&rel);
+        if let Some(parent) = target.parent() {
+            fs::create_dir_all(parent)?;
+        }
+        if fs::hard_link(&source, &target).is_err() {
+            std::os::unix::fs::symlink(&source, &target)?;
+        }
+    }
+
+    Ok(staged_root)
+}
+
+/// Remove a staged directory created by `stage_filtered`
+pub fn remove_staged(staged_root: &Path) {
+    if let Some(unique_dir) = staged_root.parent() {
+        if let Err(e) = fs::remove_dir_all(unique_dir) {
+            tracing::warn!("Failed to remove staging dir {:?}: {}", unique_dir, e);
+        }
+    }
+}
+
+/// Remove staging directories left behind by a previous run
+pub fn clear_staging() {
+    if let Ok(root) = staging_root() {
+        if root.exists() {
+            let _ = fs::remove_dir_all(&root);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn compile(exclude: &[&str], include: &[&str]) -> PathFilter {
+        let filter = TransferFilter {
+            include: include.iter().map(|s| s.to_string()).collect(),
+            exclude: exclude.iter().map(|s| s.to_string()).collect(),
+            respect_gitignore: false,
+        };
+        PathFilter::compile(&filter, Path::new(".")).unwrap()
+    }
+
+    #[test]
+    fn test_unanchored_exclude_matches_at_any_depth() {
+        let filter = compile(&["node_modules/", "*.swp"], &[]);
+        let mut matches = Vec::new();
+        assert!(filter.classify("node_modules", true, &mut matches).0);
+        assert!(filter.classify("web/node_modules", true, &mut matches).0);
+        assert!(filter.classify("src/.main.rs.swp", false, &mut matches).0);
+        // Directory-only pattern does not hit a file of the same name
+        assert!(!filter.classify("node_modules", false, &mut matches).0);
+    }
+
+    #[test]
+    fn test_include_restricts_files() {
+        let filter = compile(&["target/"], &["*.rs"]);
+        let mut matches = Vec::new();
+        assert_eq!(
+            filter.classify("src/lib.rs", false, &mut matches),
+            (false, true)
+        );
+        assert_eq!(
+            filter.classify("README.md", false, &mut matches),
+            (false, false)
+        );
+        assert!(filter.classify("target", true, &mut matches).0);
+    }
+
+    /// Run `stage` on its own thread, cancel it after `after`, and return
+    /// how long it took to stop, or `None` if it finished first
+    fn cancel_latency(
+        after: std::time::Duration,
+        stage: impl FnOnce(&CancelToken) -> Result<(), AppError> + Send + 'static,
+    ) -> Option<std::time::Duration> {
+        let cancel = CancelToken::default();
+        let worker = std::thread::spawn({
+            let cancel = cancel.clone();
+            move || {
+                let result = stage(&cancel);
+                (result, cancel.elapsed())
+            }
+        });
+        std::thread::sleep(after);
+        cancel.cancel();
+        match worker.join().unwrap() {
+            (Err(AppError::Cancelled), Some(latency)) => Some(latency),
+            _ => None,
+        }
+    }
+
+    /// Cancel latency of the walk and the staging copy while every core is
+    /// kept busy. Run with
+    /// `cargo test -p gosh-transfer-core --release -- --ignored --nocapture bench_cancel`.
+    #[test]
+    #[ignore]
+    fn bench_cancel_latency() {
+        use std::sync::atomic::{AtomicBool, Ordering};
+        use std::sync::Arc;
+        use std::time::Duration;
+
+        const RUNS: usize = 20;
+        let root = std::env::temp_dir().join(format!("gosh-cancel-{}", std::process::id()));
+        for dir in 0..200 {
+            let dir = root.join(format!("d{:03}", dir));
+            fs::create_dir_all(&dir).unwrap();
+            for file in 0..200 {
+                fs::write(dir.join(format!("f{:03}.txt", file)), b"").unwrap();
+            }
+        }
+        let filter = Arc::new(PathFilter::compile(&TransferFilter::default(), &root).unwrap());
+        let files = Arc::new(filter.walk(&root, &CancelToken::default()).unwrap());
+
+        let stop = Arc::new(AtomicBool::new(false));
+        let load: Vec<_> = (0..std::thread::available_parallelism().map_or(1, |n| n.get()))
+            .map(|_| {
+                let stop = stop.clone();
+                std::thread::spawn(move || {
+                    while !stop.load(Ordering::Relaxed) {
+                        std::hint::spin_loop();
+                    }
+                })
+            })
+            .collect();
+
+        let mut walk = Vec::new();
+        let mut stage = Vec::new();
+        for _ in 0..RUNS {
+            let (filter, walked) = (filter.clone(), root.clone());
+            walk.extend(cancel_latency(Duration::from_millis(10), move |cancel| {
+                filter.walk(&walked, cancel).map(drop)
+            }));
+            let (files, staged) = (files.clone(), root.clone());
+            stage.extend(cancel_latency(Duration::from_millis(10), move |cancel| {
+                stage_filtered(&staged, &files, cancel).map(|s| remove_staged(&s))
+            }));
+        }
+        stop.store(true, Ordering::Relaxed);
+        load.into_iter().for_each(|t| t.join().unwrap());
+        fs::remove_dir_all(&root).unwrap();
+
+        for (name, mut latencies) in [("walk", walk), ("stage", stage)] {
+            latencies.sort();
+            let (median, max) = (
+                latencies[latencies.len() / 2],
+                latencies[latencies.len() - 1],
+            );
+            println!(
+                "bench: cancel {} {} runs, median {:?}, max {:?}",
+                name,
+                latencies.len(),
+                median,
+                max
+            );
+            assert!(max < Duration::from_millis(100), "{} took {:?}", name, max);
+        }
+    }
+}
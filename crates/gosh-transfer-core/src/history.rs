@@ -1,51 +1,103 @@
 // SPDX-License-Identifier: AGPL-3.0
 // Gosh Transfer Core - Transfer history persistence
 //
-// Stores completed transfer records in a local JSON file.
+// Stores completed transfer records in a local JSON file. Each record's
+// file list is kept apart from it, front-coded, and put back when records
+// are read.
 
+use crate::aliases::PeerAliases;
+use crate::json;
+use crate::paths::FileList;
 use crate::types::AppError;
 use gosh_lan_transfer::{EngineResult, HistoryPersistence, TransferRecord};
+use serde::Serialize;
+use std::collections::HashMap;
 use std::fs;
 use std::path::PathBuf;
-use std::sync::RwLock;
+use std::sync::{Arc, Mutex, RwLock};
+use std::time::{Duration, Instant};
 
 /// Maximum number of history entries to keep
 const MAX_HISTORY_ENTRIES: usize = 100;
 
+/// How long skipped files wait for their transfer's record; a transfer that
+/// is never recorded, such as one that fails before any data, would
+/// otherwise keep its entry for the life of the process
+const PENDING_SKIP_TTL: Duration = Duration::from_secs(24 * 60 * 60);
+
 /// File-based transfer history storage
 pub struct TransferHistory {
+    /// Records with their file lists moved to `manifests`
     records: RwLock<Vec<TransferRecord>>,
+    /// File list of each record, keyed by transfer id
+    manifests: RwLock<HashMap<String, FileList>>,
+    /// Files left out of selectively accepted transfers, keyed by transfer id
+    skipped: RwLock<HashMap<String, Vec<String>>>,
+    /// Skipped files registered at accept time, applied when the record arrives
+    pending_skips: Mutex<HashMap<String, (Instant, Vec<String>)>>,
+    /// Loopback aliases to replace with real peer addresses on record
+    aliases: Arc<PeerAliases>,
     file_path: PathBuf,
 }
 
 #[derive(serde::Serialize, serde::Deserialize)]
 struct HistoryFile {
     records: Vec<TransferRecord>,
+    #[serde(default, skip_serializing_if = "HashMap::is_empty")]
+    manifests: HashMap<String, FileList>,
+    #[serde(default, skip_serializing_if = "HashMap::is_empty")]
+    skipped: HashMap<String, Vec<String>>,
+}
+
+/// A history record together with the files the receiver chose to skip
+#[derive(Debug, Clone, Serialize)]
+pub struct HistoryEntry {
+    #[serde(flatten)]
+    pub record: TransferRecord,
+    #[serde(skip_serializing_if = "Vec::is_empty")]
+    pub skipped_files: Vec<String>,
 }
 
 impl TransferHistory {
     /// Create a new history store, loading from disk if available
     pub fn new() -> Result<Self, AppError> {
-        let file_path = Self::get_history_path()?;
-
-        let records = if file_path.exists() {
-            let content = fs::read_to_string(&file_path)
-                .map_err(|e| AppError::FileIo(format!("Failed to read history: {}", e)))?;
+        Self::with_aliases(Arc::default())
+    }
 
-            let file: HistoryFile = serde_json::from_str(&content).unwrap_or_else(|e| {
-                tracing::warn!("Failed to parse history, starting fresh: {}", e);
-                HistoryFile {
-                    records: Vec::new(),
-                }
-            });
+    /// Create a history store that records relayed peers by their real address
+    pub fn with_aliases(aliases: Arc<PeerAliases>) -> Result<Self, AppError> {
+        let file_path = Self::get_history_path()?;
 
-            file.records
+        let mut file = if file_path.exists() {
+            json::read_file(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read history: {}", e)))?
+                .unwrap_or_else(|e| {
+                    tracing::warn!("Failed to parse history, starting fresh: {}", e);
+                    HistoryFile {
+                        records: Vec::new(),
+                        manifests: HashMap::new(),
+                        skipped: HashMap::new(),
+                    }
+                })
         } else {
-            Vec::new()
+            HistoryFile {
+                records: Vec::new(),
+                manifests: HashMap::new(),
+                skipped: HashMap::new(),
+            }
         };
+        // Files written before manifests hold the lists in the records
+        for record in file.records.iter_mut().filter(|r| !r.files.is_empty()) {
+            let files = FileList::new(std::mem::take(&mut record.files));
+            file.manifests.insert(record.id.clone(), files);
+        }
 
         Ok(Self {
-            records: RwLock::new(records),
+            records: RwLock::new(file.records),
+            manifests: RwLock::new(file.manifests),
+            skipped: RwLock::new(file.skipped),
+            pending_skips: Mutex::new(HashMap::new()),
+            aliases,
             file_path,
         })
     }
@@ -67,11 +119,16 @@ impl TransferHistory {
     /// Persist history to disk
     fn persist(&self) -> Result<(), AppError> {
         let records = self.records.read().unwrap();
+        let manifests = self.manifests.read().unwrap();
+        let skipped = self.skipped.read().unwrap();
         let file = HistoryFile {
             records: records.clone(),
+            manifests: manifests.clone(),
+            skipped: skipped.clone(),
         };
 
-        let content = serde_json::to_string_pretty(&file)
+        // Compact, as front-coded lists would otherwise take a line per part
+        let content = serde_json::to_string(&file)
             .map_err(|e| AppError::Serialization(format!("Failed to serialize history: {}", e)))?;
 
         fs::write(&self.file_path, content)
@@ -82,20 +139,87 @@ impl TransferHistory {
 
     /// Get all transfer records
     pub fn list(&self) -> Vec<TransferRecord> {
-        self.records.read().unwrap().clone()
+        self.expand(&self.records.read().unwrap())
+    }
+
+    /// Get all transfer records along with their skipped files
+    pub fn list_entries(&self) -> Vec<HistoryEntry> {
+        let records = self.list();
+        let skipped = self.skipped.read().unwrap();
+        records
+            .into_iter()
+            .map(|record| HistoryEntry {
+                skipped_files: skipped.get(&record.id).cloned().unwrap_or_default(),
+                record,
+            })
+            .collect()
+    }
+
+    /// Copies of `records` with their file lists put back
+    fn expand(&self, records: &[TransferRecord]) -> Vec<TransferRecord> {
+        let manifests = self.manifests.read().unwrap();
+        records
+            .iter()
+            .map(|record| {
+                let mut record = record.clone();
+                if let Some(files) = manifests.get(&record.id) {
+                    record.files = files.to_files();
+                }
+                record
+            })
+            .collect()
+    }
+
+    /// Register files skipped by a selective accept.
+    ///
+    /// The engine records the transfer later; when it does, the skipped files
+    /// are kept alongside the record. They were still received, so the
+    /// record's own file list is left whole.
+    pub fn record_skipped(&self, transfer_id: &str, skipped: Vec<String>) {
+        if skipped.is_empty() {
+            return;
+        }
+        let now = Instant::now();
+        let mut pending = self.pending_skips.lock().unwrap();
+        pending.retain(|_, (registered, _)| now.duration_since(*registered) < PENDING_SKIP_TTL);
+        pending.insert(transfer_id.to_string(), (now, skipped));
+    }
+
+    /// Drop skipped files registered for a transfer that will not be recorded
+    pub fn forget_skipped(&self, transfer_id: &str) {
+        self.pending_skips.lock().unwrap().remove(transfer_id);
     }
 
     /// Add a new transfer record
-    pub fn add(&self, record: TransferRecord) -> Result<(), AppError> {
+    pub fn add(&self, mut record: TransferRecord) -> Result<(), AppError> {
+        let skipped = self
+            .pending_skips
+            .lock()
+            .unwrap()
+            .remove(&record.id)
+            .map(|(_, skipped)| skipped);
+        self.aliases.restore(&mut record.peer_address);
+
         {
             let mut records = self.records.write().unwrap();
+            let mut manifests = self.manifests.write().unwrap();
+            let mut skipped_map = self.skipped.write().unwrap();
+
+            if let Some(skipped) = skipped {
+                skipped_map.insert(record.id.clone(), skipped);
+            }
+            let files = FileList::new(std::mem::take(&mut record.files));
+            manifests.insert(record.id.clone(), files);
 
             // Add new record at the beginning (most recent first)
             records.insert(0, record);
 
             // Trim to max entries
             if records.len() > MAX_HISTORY_ENTRIES {
-                records.truncate(MAX_HISTORY_ENTRIES);
+                for evicted in records.drain(MAX_HISTORY_ENTRIES..) {
+                    manifests.remove(&evicted.id);
+                    skipped_map.remove(&evicted.id);
+                }
             }
         }
 
@@ -107,6 +231,8 @@ impl TransferHistory {
         {
             let mut records = self.records.write().unwrap();
             records.clear();
+            self.manifests.write().unwrap().clear();
+            self.skipped.write().unwrap().clear();
         }
 
         self.persist()
@@ -116,12 +242,22 @@ impl TransferHistory {
     pub fn count(&self) -> usize {
         self.records.read().unwrap().len()
     }
+
+    /// Peer of the transfer `transfer_id`, without expanding any file list
+    pub fn peer_of(&self, transfer_id: &str) -> Option<String> {
+        let records = self.records.read().unwrap();
+        // Newest first, so a transfer that just ended is found early
+        records
+            .iter()
+            .find(|r| r.id == transfer_id)
+            .map(|r| r.peer_address.clone())
+    }
 }
 
 // Implement engine HistoryPersistence trait for automatic recording.
 impl HistoryPersistence for TransferHistory {
     fn list(&self) -> EngineResult<Vec<TransferRecord>> {
-        Ok(self.records.read().unwrap().clone())
+        Ok(TransferHistory::list(self))
     }
 
     fn list_paginated(&self, offset: usize, limit: usize) -> EngineResult<Vec<TransferRecord>> {
@@ -130,17 +266,13 @@ impl HistoryPersistence for TransferHistory {
         if offset >= records.len() {
             return Ok(Vec::new());
         }
-        Ok(records[offset..end].to_vec())
+        Ok(self.expand(&records[offset..end]))
     }
 
     fn get(&self, transfer_id: &str) -> EngineResult<Option<TransferRecord>> {
-        Ok(self
-            .records
-            .read()
-            .unwrap()
-            .iter()
-            .find(|r| r.id == transfer_id)
-            .cloned())
+        let records = self.records.read().unwrap();
+        let found = records.iter().position(|r| r.id == transfer_id);
+        Ok(found.and_then(|i| self.expand(&records[i..=i]).pop()))
     }
 
     fn add(&self, record: TransferRecord) -> EngineResult<()> {
@@ -159,6 +291,8 @@ impl HistoryPersistence for TransferHistory {
                     transfer_id
                 )));
             }
+            self.manifests.write().unwrap().remove(transfer_id);
+            self.skipped.write().unwrap().remove(transfer_id);
         }
         self.persist()
             .map_err(|e| gosh_lan_transfer::EngineError::FileIo(e.to_string()))
@@ -178,6 +312,10 @@ impl Default for TransferHistory {
     fn default() -> Self {
         Self::new().unwrap_or_else(|_| Self {
             records: RwLock::new(Vec::new()),
+            manifests: RwLock::new(HashMap::new()),
+            skipped: RwLock::new(HashMap::new()),
+            pending_skips: Mutex::new(HashMap::new()),
+            aliases: Arc::default(),
             file_path: PathBuf::from("history.json"),
         })
     }
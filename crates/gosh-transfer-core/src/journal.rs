@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - In-flight transfer journal
+//
+// Records the sends and receives that are running, so a quit or crash does
+// not lose them. Sends are journaled when they start and removed when they
+// finish; receives when their first progress arrives, with the received
+// byte count checkpointed as they go. Whatever is left in the journal on
+// the next start was interrupted.
+
+use crate::outbox::QueuedSource;
+use crate::paths::PathList;
+use crate::types::AppError;
+use chrono::{DateTime, Utc};
+use gosh_lan_transfer::{PendingTransfer, TransferProgress};
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+use std::fs;
+use std::path::PathBuf;
+use std::sync::{Mutex, RwLock};
+use std::time::{Duration, Instant};
+
+/// Least time between progress checkpoints
+const CHECKPOINT_INTERVAL: Duration = Duration::from_secs(2);
+/// Requests that never start are forgotten after this long
+const REQUEST_TTL: Duration = Duration::from_secs(60 * 60);
+
+/// A send that was running
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct JournaledSend {
+    pub id: String,
+    pub address: String,
+    pub port: u16,
+    pub source: QueuedSource,
+    pub started_at: DateTime<Utc>,
+}
+
+/// A receive that was running
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct JournaledReceive {
+    pub transfer_id: String,
+    pub peer_address: String,
+    pub files: PathList,
+    pub total_bytes: u64,
+    /// Bytes received at the last checkpoint
+    pub bytes_transferred: u64,
+    pub download_dir: PathBuf,
+    pub updated_at: DateTime<Utc>,
+}
+
+#[derive(Debug, Default, Serialize, Deserialize)]
+struct JournalFile {
+    #[serde(default)]
+    sends: Vec<JournaledSend>,
+    #[serde(default)]
+    receives: Vec<JournaledReceive>,
+}
+
+/// What is kept of a request until it starts
+struct NotedRequest {
+    seen: Instant,
+    peer_address: String,
+    files: PathList,
+    total_bytes: u64,
+}
+
+/// File-based journal of running transfers
+pub struct InFlightJournal {
+    state: RwLock<JournalFile>,
+    /// Requests seen but not yet started, by transfer id
+    requests: Mutex<HashMap<String, NotedRequest>>,
+    last_checkpoint: Mutex<Instant>,
+    file_path: PathBuf,
+}
+
+impl InFlightJournal {
+    /// Create a journal, loading what a previous run left behind
+    pub fn new() -> Result<Self, AppError> {
+        let config_dir = directories::ProjectDirs::from("com", "gosh", "transfer")
+            .ok_or_else(|| AppError::FileIo("Could not determine config directory".to_string()))?
+            .config_dir()
+            .to_path_buf();
+        fs::create_dir_all(&config_dir)
+            .map_err(|e| AppError::FileIo(format!("Failed to create config dir: {}", e)))?;
+        let file_path = config_dir.join("in_flight.json");
+
+        let state = if file_path.exists() {
+            let content = fs::read_to_string(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read journal: {}", e)))?;
+            serde_json::from_str(&content).unwrap_or_else(|e| {
+                tracing::warn!("Failed to parse journal, starting fresh: {}", e);
+                JournalFile::default()
+            })
+        } else {
+            JournalFile::default()
+        };
+
+        Ok(Self::with_state(state, file_path))
+    }
+
+    fn with_state(state: JournalFile, file_path: PathBuf) -> Self {
+        Self {
+            state: RwLock::new(state),
+            requests: Mutex::new(HashMap::new()),
+            last_checkpoint: Mutex::new(Instant::now()),
+            file_path,
+        }
+    }
+
+    /// Write the journal to disk
+    pub fn checkpoint(&self) {
+        *self.last_checkpoint.lock().unwrap() = Instant::now();
+        let state = self.state.read().unwrap();
+        let result = serde_json::to_string(&*state)
+            .map_err(|e| e.to_string())
+            .and_then(|content| {
+                // Replace atomically so a crash mid-write keeps the last checkpoint
+                let tmp = self.file_path.with_extension("json.tmp");
+                fs::write(&tmp, content)
+                    .and_then(|_| fs::rename(&tmp, &self.file_path))
+                    .map_err(|e| e.to_string())
+            });
+        if let Err(e) = result {
+            tracing::warn!("Failed to write journal: {}", e);
+        }
+    }
+
+    /// Take what a previous run left in flight, clearing the journal
+    pub fn take_interrupted(&self) -> (Vec<JournaledSend>, Vec<JournaledReceive>) {
+        let taken = std::mem::take(&mut *self.state.write().unwrap());
+        if !taken.sends.is_empty() || !taken.receives.is_empty() {
+            self.checkpoint();
+        }
+        (taken.sends, taken.receives)
+    }
+
+    /// Journal a send as it starts, returning its journal id
+    pub fn begin_send(&self, address: &str, port: u16, source: QueuedSource) -> String {
+        let now = Utc::now();
+        let id = format!("{:x}", now.timestamp_nanos_opt().unwrap_or_default());
+        self.state.write().unwrap().sends.push(JournaledSend {
+            id: id.clone(),
+            address: address.to_string(),
+            port,
+            source,
+            started_at: now,
+        });
+        self.checkpoint();
+        id
+    }
+
+    /// Drop a send that returned, delivered or not
+    pub fn end_send(&self, id: &str) {
+        self.state.write().unwrap().sends.retain(|s| s.id != id);
+        self.checkpoint();
+    }
+
+    /// Remember a transfer request until it starts or ends
+    pub fn note_request(&self, transfer: &PendingTransfer) {
+        let mut requests = self.requests.lock().unwrap();
+        requests.retain(|_, request| request.seen.elapsed() < REQUEST_TTL);
+        requests.insert(
+            transfer.id.clone(),
+            NotedRequest {
+                seen: Instant::now(),
+                peer_address: transfer.peer_address.clone(),
+                files: transfer.files.iter().map(|f| &f.name).collect(),
+                total_bytes: transfer.total_size,
+            },
+        );
+    }
+
+    /// Record receive progress, journaling the receive on its first update.
+    /// Offsets are written at most every couple of seconds.
+    pub fn record_progress(&self, progress: &TransferProgress, download_dir: &std::path::Path) {
+        let started = self.requests.lock().unwrap().remove(&progress.transfer_id);
+        let now = Utc::now();
+        {
+            let mut state = self.state.write().unwrap();
+            if let Some(request) = started {
+                state.receives.push(JournaledReceive {
+                    transfer_id: progress.transfer_id.clone(),
+                    peer_address: request.peer_address,
+                    files: request.files,
+                    total_bytes: request.total_bytes,
+                    bytes_transferred: progress.bytes_transferred,
+                    download_dir: download_dir.to_path_buf(),
+                    updated_at: now,
+                });
+                drop(state);
+                self.checkpoint();
+                return;
+            }
+            match state
+                .receives
+                .iter_mut()
+                .find(|r| r.transfer_id == progress.transfer_id)
+            {
+                Some(receive) => {
+                    receive.bytes_transferred = progress.bytes_transferred;
+                    receive.updated_at = now;
+                }
+                None => return,
+            }
+        }
+        if self.last_checkpoint.lock().unwrap().elapsed() >= CHECKPOINT_INTERVAL {
+            self.checkpoint();
+        }
+    }
+
+    /// Drop a transfer that completed or failed
+    pub fn end_transfer(&self, transfer_id: &str) {
+        self.requests.lock().unwrap().remove(transfer_id);
+        let removed = {
+            let mut state = self.state.write().unwrap();
+            let before = state.receives.len();
+            state.receives.retain(|r| r.transfer_id != transfer_id);
+            state.receives.len() != before
+        };
+        if removed {
+            self.checkpoint();
+        }
+    }
+
+    /// Ids of the receives still running
+    pub fn receive_ids(&self) -> Vec<String> {
+        let state = self.state.read().unwrap();
+        state
+            .receives
+            .iter()
+            .map(|r| r.transfer_id.clone())
+            .collect()
+    }
+
+    /// Number of sends and receives still running
+    pub fn in_flight(&self) -> usize {
+        let state = self.state.read().unwrap();
+        state.sends.len() + state.receives.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_unfinished_transfers_survive_restart() {
+        let path = std::env::temp_dir().join(format!("gosh-journal-{}.json", std::process::id()));
+        let journal = InFlightJournal::with_state(JournalFile::default(), path.clone());
+
+        let source = QueuedSource::Files {
+            paths: vec![PathBuf::from("/tmp/a")],
+        };
+        let done = journal.begin_send("10.0.0.2", 53317, source.clone());
+        journal.begin_send("10.0.0.3", 53317, source);
+        journal.end_send(&done);
+        assert_eq!(journal.in_flight(), 1);
+
+        let content = fs::read_to_string(&path).unwrap();
+        let restarted = InFlightJournal::with_state(serde_json::from_str(&content).unwrap(), path);
+        let (sends, receives) = restarted.take_interrupted();
+        assert_eq!(sends.len(), 1);
+        assert_eq!(sends[0].address, "10.0.0.3");
+        assert!(receives.is_empty());
+        assert_eq!(restarted.in_flight(), 0);
+
+        let _ = fs::remove_file(&restarted.file_path);
+    }
+}
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Store file parsing
+//
+// Stores read and parse their files here. The bytes are checked as UTF-8
+// once and parsed with serde_json; parsing the bytes directly was measured
+// slower, as each string is then validated by the parser.
+
+use serde::de::DeserializeOwned;
+use std::fs;
+use std::path::Path;
+
+/// Read and parse a JSON store file. Read errors and parse errors are
+/// kept apart, as stores recover from a corrupt file but not an unreadable
+/// one.
+pub fn read_file<T: DeserializeOwned>(path: &Path) -> std::io::Result<Result<T, String>> {
+    let bytes = fs::read(path)?;
+    Ok(parse(bytes))
+}
+
+fn parse<T: DeserializeOwned>(bytes: Vec<u8>) -> Result<T, String> {
+    let text = String::from_utf8(bytes).map_err(|e| e.to_string())?;
+    serde_json::from_str(&text).map_err(|e| e.to_string())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::types::AppSettings;
+
+    #[test]
+    fn test_read_file() {
+        let dir = std::env::temp_dir().join(format!("gosh-json-test-{}", std::process::id()));
+        fs::create_dir_all(&dir).unwrap();
+
+        let valid = dir.join("settings.json");
+        let settings = AppSettings {
+            port: 4242,
+            ..AppSettings::default()
+        };
+        fs::write(&valid, serde_json::to_vec(&settings).unwrap()).unwrap();
+        let loaded: AppSettings = read_file(&valid).unwrap().unwrap();
+        assert_eq!(loaded.port, 4242);
+
+        let corrupt = dir.join("corrupt.json");
+        fs::write(&corrupt, b"{\"port\": ").unwrap();
+        assert!(read_file::<AppSettings>(&corrupt).unwrap().is_err());
+
+        assert!(read_file::<AppSettings>(&dir.join("missing.json")).is_err());
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    /// Parsing a large file list after one UTF-8 check, as `read_file`
+    /// does, against parsing the raw bytes. Run with
+    ///
+    ///   cargo test --release -p gosh-transfer-core -- --ignored --nocapture bench_store_parse
+    #[test]
+    #[ignore]
+    fn bench_store_parse() {
+        use gosh_lan_transfer::TransferFile;
+        use std::time::Instant;
+        const FILES: usize = 200_000;
+        const RUNS: u32 = 10;
+
+        let files: Vec<serde_json::Value> = (0..FILES)
+            .map(|i| {
+                serde_json::json!({
+                    "name": format!("projects/site/assets/images/{:03}/photo-{:06}.jpg", i / 1000, i),
+                    "size": 1_048_576 + i,
+                    "is_directory": false
+                })
+            })
+            .collect();
+        let bytes = serde_json::to_vec(&files).unwrap();
+
+        let start = Instant::now();
+        for _ in 0..RUNS {
+            let parsed: Vec<TransferFile> = parse(bytes.clone()).unwrap();
+            assert_eq!(parsed.len(), FILES);
+        }
+        let checked = start.elapsed() / RUNS;
+
+        let start = Instant::now();
+        for _ in 0..RUNS {
+            let parsed: Vec<TransferFile> = serde_json::from_slice(&bytes.clone()).unwrap();
+            assert_eq!(parsed.len(), FILES);
+        }
+        let raw = start.elapsed() / RUNS;
+
+        println!(
+            "bench: {} files, {} KiB: checked then parsed {:?}, raw bytes {:?}",
+            FILES,
+            bytes.len() / 1024,
+            checked,
+            raw
+        );
+    }
+}
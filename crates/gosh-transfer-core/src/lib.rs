@@ -6,19 +6,63 @@
 // - SettingsStore for persistent settings
 // - FileFavoritesStore for persistent favorites
 // - TransferHistory for tracking past transfers
+// - FileSelection for selectively accepting incoming transfers
+// - PathFilter for include/exclude filtering of directory sends
+// - ApprovalSessions for time-boxed auto-acceptance per peer
+// - CancelToken shared by the stages of a send
+// - PeerAliases for peers reached through a relay transport
+// - KnownPeers for pinning peer certificates of encrypted transports
+// - ChainManifest and ChainProgress for chained replication
+// - Multicast packets and block maps for one-to-many distribution
+// - PullOffer and range parsing for receiver-initiated pulls
+// - Outbox for sends waiting on unreachable peers
+// - InFlightJournal for transfers interrupted by a quit or crash
+// - Store file parsing
+// - FrontendEvent, the form engine events are emitted to the frontend in
+// - PathList and FileList for front-coded file lists
+// - FavoriteRoutes for favorites reachable at several addresses
 //
 // Frontend-specific code lives in separate crates.
 
+pub mod aliases;
+pub mod approval;
+pub mod cancel;
+pub mod chain;
+pub mod events;
 pub mod favorites;
+pub mod filter;
 pub mod history;
+pub mod journal;
+pub mod json;
+pub mod multicast;
+pub mod outbox;
+pub mod paths;
+pub mod peer_identity;
+pub mod pull;
+pub mod routes;
+pub mod selection;
 pub mod settings;
 pub mod types;
 
 // Re-export commonly used items
+pub use aliases::PeerAliases;
+pub use approval::{ApprovalSession, ApprovalSessions};
+pub use cancel::CancelToken;
+pub use chain::{ChainHop, ChainManifest, ChainProgress, ChainStatus};
+pub use events::FrontendEvent;
 pub use favorites::FileFavoritesStore;
-pub use history::TransferHistory;
+pub use filter::{PathFilter, TransferFilter};
+pub use history::{HistoryEntry, TransferHistory};
+pub use journal::InFlightJournal;
+pub use multicast::{BlockMap, MulticastAnnouncement};
+pub use outbox::{Outbox, OutboxEntry, QueuedSend, QueuedSource};
+pub use paths::{FileList, PathList};
+pub use peer_identity::{KnownPeer, KnownPeers, PeerIdentity};
+pub use pull::{PullJournal, PullOffer, PullRecord, PullState, PullStatus};
+pub use routes::{FavoriteRoutes, RouteStats};
+pub use selection::{FileSelection, SelectionSummary};
 pub use settings::SettingsStore;
-pub use types::{AppError, AppSettings, InterfaceCategory, InterfaceFilters};
+pub use types::{AppError, AppSettings, InterfaceCategory, InterfaceFilters, TransportMode};
 
 // Re-export engine types for convenience
 pub use gosh_lan_transfer::{
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Multicast distribution
+//
+// One file is pushed to many receivers on a subnet as UDP multicast, so the
+// payload crosses the switch once. Receivers learn about a session from an
+// announcement sent as an ordinary transfer, then report missing blocks to
+// the sender as NACKs; the sender multicasts those blocks again in repair
+// rounds until nobody is missing anything.
+//
+// Datagram layout (big endian), after the "GM" magic and a kind byte:
+//   data:  session u64, block u32, payload
+//   end:   session u64, block count u32
+//   nack:  session u64, then (first block u32, count u32) ranges
+// On the wire each datagram is followed by an HMAC-SHA256 tag keyed by the
+// session key in the announcement, which the sockets side adds and checks.
+
+use crate::types::AppError;
+use serde::{Deserialize, Serialize};
+use std::fs;
+use std::net::Ipv4Addr;
+use std::path::{Path, PathBuf};
+
+/// File name prefix marking a multicast announcement inside a transfer
+pub const ANNOUNCEMENT_PREFIX: &str = ".gosh-multicast-";
+/// Payload bytes per data datagram; keeps packets under a 1500 byte MTU
+pub const BLOCK_SIZE: usize = 1200;
+/// Multicast group used for sessions (organisation-local scope)
+pub const MULTICAST_GROUP: Ipv4Addr = Ipv4Addr::new(239, 255, 77, 77);
+/// Missing ranges reported per NACK datagram
+pub const MAX_NACK_RANGES: usize = 128;
+/// Largest file a session can carry, as block numbers are 32 bits
+pub const MAX_SIZE: u64 = u32::MAX as u64 * BLOCK_SIZE as u64;
+
+const MAGIC: &[u8; 2] = b"GM";
+const KIND_DATA: u8 = 1;
+const KIND_END: u8 = 2;
+const KIND_NACK: u8 = 3;
+const HEADER_LEN: usize = 11;
+
+/// A multicast datagram
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Packet<'a> {
+    Data {
+        session: u64,
+        block: u32,
+        payload: &'a [u8],
+    },
+    /// Sent after each round; receivers answer with a NACK if incomplete
+    End { session: u64, blocks: u32 },
+    Nack {
+        session: u64,
+        ranges: Vec<(u32, u32)>,
+    },
+}
+
+impl<'a> Packet<'a> {
+    pub fn session(&self) -> u64 {
+        match self {
+            Self::Data { session, .. } | Self::End { session, .. } | Self::Nack { session, .. } => {
+                *session
+            }
+        }
+    }
+
+    /// Encode into `buf`, replacing its contents
+    pub fn encode(&self, buf: &mut Vec<u8>) {
+        buf.clear();
+        buf.extend_from_slice(MAGIC);
+        match self {
+            Self::Data {
+                session,
+                block,
+                payload,
+            } => {
+                buf.push(KIND_DATA);
+                buf.extend_from_slice(&session.to_be_bytes());
+                buf.extend_from_slice(&block.to_be_bytes());
+                buf.extend_from_slice(payload);
+            }
+            Self::End { session, blocks } => {
+                buf.push(KIND_END);
+                buf.extend_from_slice(&session.to_be_bytes());
+                buf.extend_from_slice(&blocks.to_be_bytes());
+            }
+            Self::Nack { session, ranges } => {
+                buf.push(KIND_NACK);
+                buf.extend_from_slice(&session.to_be_bytes());
+                for (first, count) in ranges.iter().take(MAX_NACK_RANGES) {
+                    buf.extend_from_slice(&first.to_be_bytes());
+                    buf.extend_from_slice(&count.to_be_bytes());
+                }
+            }
+        }
+    }
+
+    /// Decode a datagram, ignoring anything malformed
+    pub fn decode(datagram: &'a [u8]) -> Option<Self> {
+        if datagram.len() < HEADER_LEN || &datagram[..2] != MAGIC {
+            return None;
+        }
+        let session = u64::from_be_bytes(datagram[3..11].try_into().ok()?);
+        let body = &datagram[HEADER_LEN..];
+        let u32_at = |at: usize| -> Option<u32> {
+            Some(u32::from_be_bytes(body.get(at..at + 4)?.try_into().ok()?))
+        };
+
+        match datagram[2] {
+            KIND_DATA => Some(Self::Data {
+                session,
+                block: u32_at(0)?,
+                payload: &body[4..],
+            }),
+            KIND_END => Some(Self::End {
+                session,
+                blocks: u32_at(0)?,
+            }),
+            KIND_NACK if body.len() % 8 == 0 => Some(Self::Nack {
+                session,
+                ranges: body
+                    .chunks_exact(8)
+                    .map(|range| {
+                        let first = u32::from_be_bytes(range[..4].try_into().unwrap());
+                        let count = u32::from_be_bytes(range[4..].try_into().unwrap());
+                        (first, count)
+                    })
+                    .collect(),
+            }),
+            _ => None,
+        }
+    }
+}
+
+/// Received blocks of a session
+#[derive(Debug, Clone)]
+pub struct BlockMap {
+    bits: Vec<u64>,
+    blocks: u32,
+    missing: u32,
+}
+
+impl BlockMap {
+    pub fn new(blocks: u32) -> Self {
+        Self {
+            bits: vec![0; (blocks as usize).div_ceil(64)],
+            blocks,
+            missing: blocks,
+        }
+    }
+
+    /// Mark a block received, returning whether it was new
+    pub fn insert(&mut self, block: u32) -> bool {
+        if block >= self.blocks {
+            return false;
+        }
+        let (word, bit) = ((block / 64) as usize, block % 64);
+        if self.bits[word] & (1 << bit) != 0 {
+            return false;
+        }
+        self.bits[word] |= 1 << bit;
+        self.missing -= 1;
+        true
+    }
+
+    pub fn contains(&self, block: u32) -> bool {
+        block < self.blocks && self.bits[(block / 64) as usize] & (1 << (block % 64)) != 0
+    }
+
+    pub fn is_complete(&self) -> bool {
+        self.missing == 0
+    }
+
+    /// The bitmap, for keeping the map on disk
+    pub fn words(&self) -> &[u64] {
+        &self.bits
+    }
+
+    /// Rebuild a map kept with `words`, or `None` if they do not fit `blocks`
+    pub fn from_words(blocks: u32, words: Vec<u64>) -> Option<Self> {
+        if words.len() != (blocks as usize).div_ceil(64) {
+            return None;
+        }
+        // Bits past the last block would count as received
+        if blocks % 64 != 0 && words.last()? >> (blocks % 64) != 0 {
+            return None;
+        }
+        let received: u32 = words.iter().map(|w| w.count_ones()).sum();
+        Some(Self {
+            bits: words,
+            blocks,
+            missing: blocks - received,
+        })
+    }
+
+    /// Up to `max` runs of missing blocks as (first, count)
+    pub fn missing_ranges(&self, max: usize) -> Vec<(u32, u32)> {
+        let mut ranges: Vec<(u32, u32)> = Vec::new();
+        let mut block = 0;
+        while block < self.blocks && ranges.len() < max {
+            if self.contains(block) {
+                block += 1;
+                continue;
+            }
+            let first = block;
+            while block < self.blocks && !self.contains(block) {
+                block += 1;
+            }
+            ranges.push((first, block - first));
+        }
+        ranges
+    }
+}
+
+/// Session description delivered to receivers as an ordinary transfer
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct MulticastAnnouncement {
+    pub session: u64,
+    pub group: Ipv4Addr,
+    pub port: u16,
+    /// Sender's unicast UDP port for NACKs
+    pub repair_port: u16,
+    pub file_name: String,
+    pub size: u64,
+    /// Hex HMAC key authenticating the session's datagrams
+    pub key: String,
+    /// Hex SHA-256 of the file, checked once it is reassembled
+    pub sha256: String,
+}
+
+impl MulticastAnnouncement {
+    /// Number of data blocks in the session. Announcements over `MAX_SIZE`
+    /// are refused on both sides, so the count always fits.
+    pub fn blocks(&self) -> u32 {
+        self.size.div_ceil(BLOCK_SIZE as u64) as u32
+    }
+
+    /// Name of the announcement file
+    pub fn announcement_name(&self) -> String {
+        format!("{}{:016x}.json", ANNOUNCEMENT_PREFIX, self.session)
+    }
+
+    /// Check whether a transferred file name is a multicast announcement
+    pub fn is_announcement(name: &str) -> bool {
+        name.starts_with(ANNOUNCEMENT_PREFIX) && name.ends_with(".json") && !name.contains('/')
+    }
+
+    /// Write the announcement into `dir`, returning its path
+    pub fn write(&self, dir: &Path) -> Result<PathBuf, AppError> {
+        let content = serde_json::to_string(self).map_err(|e| {
+            AppError::Serialization(format!("Failed to serialize announcement: {}", e))
+        })?;
+        fs::create_dir_all(dir)?;
+        let path = dir.join(self.announcement_name());
+        fs::write(&path, content)?;
+        Ok(path)
+    }
+
+    /// Read a received announcement, rejecting file names that leave the download directory
+    pub fn read(path: &Path) -> Result<Self, AppError> {
+        let content = fs::read_to_string(path)?;
+        let announcement: Self = serde_json::from_str(&content)
+            .map_err(|e| AppError::Serialization(format!("Invalid announcement: {}", e)))?;
+        let name = Path::new(&announcement.file_name);
+        if name.file_name() != Some(name.as_os_str()) {
+            return Err(AppError::InvalidConfig(format!(
+                "Invalid file name in announcement: {}",
+                announcement.file_name
+            )));
+        }
+        if announcement.size > MAX_SIZE {
+            return Err(AppError::InvalidConfig(format!(
+                "Announced file is too large for multicast: {} bytes",
+                announcement.size
+            )));
+        }
+        Ok(announcement)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_packets_round_trip() {
+        let mut buf = Vec::new();
+        let packets = [
+            Packet::Data {
+                session: 7,
+                block: 42,
+                payload: b"hello",
+            },
+            Packet::End {
+                session: 7,
+                blocks: 100,
+            },
+            Packet::Nack {
+                session: 7,
+                ranges: vec![(0, 3), (10, 1)],
+            },
+        ];
+        for packet in packets {
+            packet.encode(&mut buf);
+            assert_eq!(Packet::decode(&buf), Some(packet));
+        }
+        assert_eq!(Packet::decode(b"GX\x01"), None);
+    }
+
+    #[test]
+    fn test_oversized_announcement_is_refused() {
+        let dir = std::env::temp_dir().join(format!("gosh-multicast-{}", std::process::id()));
+        let mut announcement = MulticastAnnouncement {
+            session: 1,
+            group: MULTICAST_GROUP,
+            port: 53319,
+            repair_port: 40000,
+            file_name: "disk.img".to_string(),
+            size: MAX_SIZE,
+            key: "00".to_string(),
+            sha256: "00".to_string(),
+        };
+        let path = announcement.write(&dir).unwrap();
+        assert_eq!(
+            MulticastAnnouncement::read(&path).unwrap().blocks(),
+            u32::MAX
+        );
+
+        announcement.size = MAX_SIZE + 1;
+        let path = announcement.write(&dir).unwrap();
+        assert!(MulticastAnnouncement::read(&path).is_err());
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_block_map_reports_missing_runs() {
+        let mut map = BlockMap::new(130);
+        for block in (0..130).filter(|b| !(3..6).contains(b) && *b != 129) {
+            assert!(map.insert(block));
+        }
+        assert!(!map.insert(0));
+        assert_eq!(map.missing_ranges(10), vec![(3, 3), (129, 1)]);
+        assert_eq!(map.missing_ranges(1), vec![(3, 3)]);
+
+        let kept = BlockMap::from_words(130, map.words().to_vec()).unwrap();
+        assert_eq!(kept.missing_ranges(10), map.missing_ranges(10));
+        assert!(BlockMap::from_words(128, map.words().to_vec()).is_none());
+        assert!(BlockMap::from_words(129, vec![0, 0, 2]).is_none());
+
+        map.insert(129);
+        for block in 3..6 {
+            map.insert(block);
+        }
+        assert!(map.is_complete());
+    }
+}
@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Store-and-forward outbox
+//
+// Sends that fail because the peer is unreachable are kept on disk instead
+// of being dropped. The peer is probed with exponential backoff and the
+// send is delivered once it answers again. Filtered directory sends keep
+// the file list walked when they were queued, with size and modification
+// stamps, so delivery only re-walks the directory if something changed.
+
+use crate::filter::TransferFilter;
+use crate::paths::PathList;
+use crate::types::AppError;
+use chrono::{DateTime, Duration, Utc};
+use serde::{Deserialize, Serialize};
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::RwLock;
+use std::time::SystemTime;
+
+/// Delay before the first probe of an unreachable peer
+const FIRST_PROBE_SECS: i64 = 15;
+/// Longest delay between probes
+const MAX_PROBE_SECS: i64 = 30 * 60;
+/// Queued sends are dropped after this long
+const MAX_QUEUE_DAYS: i64 = 7;
+
+/// Size and modification time of a source path when it was queued
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct SourceStamp {
+    pub path: PathBuf,
+    pub len: u64,
+    pub modified: Option<SystemTime>,
+}
+
+impl SourceStamp {
+    pub fn of(path: &Path) -> Option<Self> {
+        let meta = fs::metadata(path).ok()?;
+        Some(Self {
+            path: path.to_path_buf(),
+            len: meta.len(),
+            modified: meta.modified().ok(),
+        })
+    }
+
+    /// Check whether the path still has the stamped size and time
+    pub fn is_current(&self) -> bool {
+        Self::of(&self.path).as_ref() == Some(self)
+    }
+}
+
+/// What a queued send delivers
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(tag = "kind", rename_all = "camelCase")]
+pub enum QueuedSource {
+    Files {
+        paths: Vec<PathBuf>,
+    },
+    Directory {
+        path: PathBuf,
+        filter: Option<TransferFilter>,
+        /// Files kept by the filter, relative to `path`
+        #[serde(default)]
+        files: PathList,
+        /// The root, every directory walked, and the kept files
+        #[serde(default)]
+        stamps: Vec<SourceStamp>,
+    },
+}
+
+impl QueuedSource {
+    /// A filtered directory whose walked file list still matches the disk
+    pub fn unchanged_selection(&self) -> Option<(&Path, &PathList)> {
+        match self {
+            Self::Directory {
+                path,
+                filter: Some(_),
+                files,
+                stamps,
+            } if !stamps.is_empty() && stamps.iter().all(SourceStamp::is_current) => {
+                Some((path, files))
+            }
+            _ => None,
+        }
+    }
+}
+
+/// Stamp `root`, every directory the walk listed under it, and each kept
+/// file
+pub fn stamp_selection(root: &Path, dirs: &PathList, files: &PathList) -> Vec<SourceStamp> {
+    let mut paths: Vec<PathBuf> = vec![root.to_path_buf()];
+    paths.extend(dirs.iter().map(|rel| root.join(rel)));
+    paths.extend(files.iter().map(|rel| root.join(rel)));
+    paths.sort();
+    paths.dedup();
+    paths.iter().filter_map(|p| SourceStamp::of(p)).collect()
+}
+
+/// A send waiting for its peer
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct QueuedSend {
+    pub id: String,
+    pub address: String,
+    pub port: u16,
+    pub source: QueuedSource,
+    pub queued_at: DateTime<Utc>,
+    /// Probes that found the peer unreachable or failed to deliver
+    pub attempts: u32,
+    pub next_probe_at: DateTime<Utc>,
+    pub last_error: Option<String>,
+    /// Handed out by `take_due` and not yet back; not kept on disk, since
+    /// nothing is in flight after a restart
+    #[serde(skip)]
+    pub delivering: bool,
+}
+
+/// A queued send, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct OutboxEntry {
+    pub id: String,
+    pub address: String,
+    pub port: u16,
+    pub sources: Vec<String>,
+    pub queued_at: DateTime<Utc>,
+    pub attempts: u32,
+    pub next_probe_at: DateTime<Utc>,
+    pub last_error: Option<String>,
+}
+
+impl From<&QueuedSend> for OutboxEntry {
+    fn from(send: &QueuedSend) -> Self {
+        let sources = match &send.source {
+            QueuedSource::Files { paths } => {
+                paths.iter().map(|p| p.display().to_string()).collect()
+            }
+            QueuedSource::Directory { path, .. } => vec![path.display().to_string()],
+        };
+        Self {
+            id: send.id.clone(),
+            address: send.address.clone(),
+            port: send.port,
+            sources,
+            queued_at: send.queued_at,
+            attempts: send.attempts,
+            next_probe_at: send.next_probe_at,
+            last_error: send.last_error.clone(),
+        }
+    }
+}
+
+/// Delay before the probe following `attempts` failed ones
+pub fn probe_delay(attempts: u32) -> Duration {
+    let secs = FIRST_PROBE_SECS.saturating_mul(1 << attempts.min(16));
+    Duration::seconds(secs.min(MAX_PROBE_SECS))
+}
+
+/// File-based queue of sends to unreachable peers
+pub struct Outbox {
+    sends: RwLock<Vec<QueuedSend>>,
+    file_path: PathBuf,
+}
+
+impl Outbox {
+    /// Create a new outbox, loading from disk if available
+    pub fn new() -> Result<Self, AppError> {
+        let config_dir = directories::ProjectDirs::from("com", "gosh", "transfer")
+            .ok_or_else(|| AppError::FileIo("Could not determine config directory".to_string()))?
+            .config_dir()
+            .to_path_buf();
+        fs::create_dir_all(&config_dir)
+            .map_err(|e| AppError::FileIo(format!("Failed to create config dir: {}", e)))?;
+        let file_path = config_dir.join("outbox.json");
+
+        let sends = if file_path.exists() {
+            let content = fs::read_to_string(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read outbox: {}", e)))?;
+            serde_json::from_str(&content).unwrap_or_else(|e| {
+                tracing::warn!("Failed to parse outbox, starting fresh: {}", e);
+                Vec::new()
+            })
+        } else {
+            Vec::new()
+        };
+
+        Ok(Self {
+            sends: RwLock::new(sends),
+            file_path,
+        })
+    }
+
+    /// Persist the queue to disk
+    fn persist(&self) {
+        let sends = self.sends.read().unwrap();
+        // Compact, as walked file lists would otherwise take a line per part
+        let result = serde_json::to_string(&*sends)
+            .map_err(|e| e.to_string())
+            .and_then(|content| fs::write(&self.file_path, content).map_err(|e| e.to_string()));
+        if let Err(e) = result {
+            tracing::warn!("Failed to write outbox: {}", e);
+        }
+    }
+
+    /// Queue a send for a peer that could not be reached
+    pub fn enqueue(
+        &self,
+        address: String,
+        port: u16,
+        source: QueuedSource,
+        error: String,
+        now: DateTime<Utc>,
+    ) -> String {
+        let id = format!("{:x}", now.timestamp_nanos_opt().unwrap_or_default());
+        self.sends.write().unwrap().push(QueuedSend {
+            id: id.clone(),
+            address,
+            port,
+            source,
+            queued_at: now,
+            attempts: 0,
+            next_probe_at: now + probe_delay(0),
+            last_error: Some(error),
+            delivering: false,
+        });
+        self.persist();
+        id
+    }
+
+    /// Queued sends due for a probe, which is scheduled for the next backoff
+    /// step right away. Each is marked in flight until `record_failure` or
+    /// `remove`, so a slow probe or delivery is never started twice. Sends
+    /// older than the queue limit are dropped.
+    pub fn take_due(&self, now: DateTime<Utc>) -> Vec<QueuedSend> {
+        let mut due = Vec::new();
+        {
+            let mut sends = self.sends.write().unwrap();
+            let before = sends.len();
+            sends.retain(|s| now - s.queued_at < Duration::days(MAX_QUEUE_DAYS));
+            if sends.len() != before {
+                tracing::info!("Dropped {} expired queued send(s)", before - sends.len());
+            }
+            for send in sends
+                .iter_mut()
+                .filter(|s| s.next_probe_at <= now && !s.delivering)
+            {
+                send.delivering = true;
+                send.attempts += 1;
+                send.next_probe_at = now + probe_delay(send.attempts);
+                due.push(send.clone());
+            }
+            if due.is_empty() && sends.len() == before {
+                return due;
+            }
+        }
+        self.persist();
+        due
+    }
+
+    /// Note why the latest probe of a send did not deliver it, making it
+    /// due again at its next probe
+    pub fn record_failure(&self, id: &str, error: String) {
+        if let Some(send) = self.sends.write().unwrap().iter_mut().find(|s| s.id == id) {
+            send.last_error = Some(error);
+            send.delivering = false;
+        }
+        self.persist();
+    }
+
+    /// Drop a send, after delivery or when the user cancels it
+    pub fn remove(&self, id: &str) -> bool {
+        let removed = {
+            let mut sends = self.sends.write().unwrap();
+            let before = sends.len();
+            sends.retain(|s| s.id != id);
+            sends.len() != before
+        };
+        if removed {
+            self.persist();
+        }
+        removed
+    }
+
+    /// Probe every queued send to a peer on the next tick, leaving those
+    /// already in flight alone
+    pub fn probe_now(&self, address: &str, now: DateTime<Utc>) {
+        for send in self.sends.write().unwrap().iter_mut() {
+            if send.address == address && !send.delivering {
+                send.next_probe_at = now;
+            }
+        }
+    }
+
+    /// List queued sends, oldest first
+    pub fn list(&self) -> Vec<OutboxEntry> {
+        self.sends
+            .read()
+            .unwrap()
+            .iter()
+            .map(OutboxEntry::from)
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_probes_back_off() {
+        let outbox = Outbox {
+            sends: RwLock::new(Vec::new()),
+            file_path: std::env::temp_dir().join("gosh-outbox-test.json"),
+        };
+        let start = Utc::now();
+        let source = QueuedSource::Files { paths: vec![] };
+        let id = outbox.enqueue("10.0.0.9".into(), 53317, source, "offline".into(), start);
+
+        assert!(outbox.take_due(start).is_empty());
+        let first = start + probe_delay(0);
+        assert_eq!(outbox.take_due(first).len(), 1);
+        // Rescheduled at once, so the same tick does not probe it twice
+        assert!(outbox.take_due(first).is_empty());
+        assert_eq!(outbox.list()[0].next_probe_at, first + probe_delay(1));
+        // Still in flight, so neither its next step nor the peer showing up
+        // hands it out again
+        outbox.probe_now("10.0.0.9", first);
+        assert!(outbox.take_due(first + probe_delay(1)).is_empty());
+        outbox.record_failure(&id, "offline".into());
+        assert_eq!(outbox.take_due(first + probe_delay(1)).len(), 1);
+        assert!(probe_delay(1) > probe_delay(0));
+        assert_eq!(probe_delay(40), Duration::seconds(MAX_PROBE_SECS));
+
+        assert!(outbox
+            .take_due(start + Duration::days(MAX_QUEUE_DAYS))
+            .is_empty());
+        assert!(!outbox.remove(&id));
+    }
+
+    #[test]
+    fn test_changed_selection_is_walked_again() {
+        let root = std::env::temp_dir().join(format!("gosh-outbox-{}", std::process::id()));
+        fs::create_dir_all(root.join("docs")).unwrap();
+        fs::create_dir_all(root.join("empty")).unwrap();
+        fs::write(root.join("docs/a.txt"), "a").unwrap();
+        let filter = TransferFilter {
+            include: vec!["*.txt".to_string()],
+            ..Default::default()
+        };
+        let walked = crate::PathFilter::compile(&filter, &root)
+            .unwrap()
+            .walk_tree(&root, &crate::CancelToken::default())
+            .unwrap();
+        let source = QueuedSource::Directory {
+            path: root.clone(),
+            filter: Some(filter),
+            stamps: stamp_selection(&root, &walked.dirs, &walked.files),
+            files: walked.files,
+        };
+
+        assert_eq!(source.unchanged_selection().unwrap().1.len(), 1);
+        // A directory without kept files is stamped too, so a file that
+        // now matches in it is noticed
+        fs::write(root.join("empty/b.txt"), "b").unwrap();
+        assert!(source.unchanged_selection().is_none());
+
+        fs::remove_dir_all(&root).unwrap();
+    }
+}
@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Front-coded path lists
+//
+// A directory of a million files repeats the same directory prefixes in
+// every path. Lists of paths are kept front-coded instead: each path stores
+// how many bytes it shares with the one before it and only the rest, so a
+// sorted walk keeps little more than each file name. Sharing is cut after a
+// '/', so every stored tail is whole components and stays valid UTF-8 when
+// the paths were.
+//
+// On disk a list is an array of `[shared, "tail"]` pairs. A plain array of
+// path strings, as older files hold, is still read.
+
+use gosh_lan_transfer::TransferFile;
+use serde::de::{self, Deserializer, SeqAccess, Visitor};
+use serde::ser::{self, SerializeSeq, Serializer};
+use serde::{Deserialize, Serialize};
+use std::ffi::{OsStr, OsString};
+use std::fmt;
+use std::os::unix::ffi::{OsStrExt, OsStringExt};
+use std::path::PathBuf;
+
+/// Paths stored as the difference from the path before each
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct PathList {
+    /// Bytes shared with the previous path, and where the tail ends in `tails`
+    entries: Vec<(u32, u32)>,
+    tails: Vec<u8>,
+    /// The last path pushed, for comparing the next one against
+    last: Vec<u8>,
+}
+
+impl PathList {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Append a path. Paths pushed in sorted order share the most.
+    pub fn push(&mut self, path: impl AsRef<OsStr>) {
+        self.push_bytes(path.as_ref().as_bytes());
+    }
+
+    fn push_bytes(&mut self, path: &[u8]) {
+        let common = self
+            .last
+            .iter()
+            .zip(path)
+            .take_while(|(a, b)| a == b)
+            .count();
+        // Back to just after the last separator both paths have
+        let shared = path[..common]
+            .iter()
+            .rposition(|&b| b == b'/')
+            .map_or(0, |i| i + 1);
+        self.tails.extend_from_slice(&path[shared..]);
+        self.entries.push((shared as u32, self.tails.len() as u32));
+        self.last.truncate(shared);
+        self.last.extend_from_slice(&path[shared..]);
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    /// The paths in the order they were pushed
+    pub fn iter(&self) -> Iter<'_> {
+        Iter {
+            list: self,
+            index: 0,
+            current: Vec::new(),
+        }
+    }
+
+    /// Shared length and tail of each entry
+    fn coded(&self) -> impl Iterator<Item = (u32, &[u8])> {
+        let mut start = 0;
+        self.entries.iter().map(move |&(shared, end)| {
+            let tail = &self.tails[start as usize..end as usize];
+            start = end;
+            (shared, tail)
+        })
+    }
+}
+
+/// Rebuilds each path from the one before it
+pub struct Iter<'a> {
+    list: &'a PathList,
+    index: usize,
+    current: Vec<u8>,
+}
+
+impl Iterator for Iter<'_> {
+    type Item = PathBuf;
+
+    fn next(&mut self) -> Option<PathBuf> {
+        let &(shared, end) = self.list.entries.get(self.index)?;
+        let start = match self.index {
+            0 => 0,
+            i => self.list.entries[i - 1].1,
+        };
+        self.index += 1;
+        self.current.truncate(shared as usize);
+        self.current
+            .extend_from_slice(&self.list.tails[start as usize..end as usize]);
+        Some(PathBuf::from(OsString::from_vec(self.current.clone())))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        let left = self.list.entries.len() - self.index;
+        (left, Some(left))
+    }
+}
+
+impl<'a> IntoIterator for &'a PathList {
+    type Item = PathBuf;
+    type IntoIter = Iter<'a>;
+
+    fn into_iter(self) -> Iter<'a> {
+        self.iter()
+    }
+}
+
+impl<P: AsRef<OsStr>> FromIterator<P> for PathList {
+    fn from_iter<I: IntoIterator<Item = P>>(paths: I) -> Self {
+        let mut list = Self::new();
+        for path in paths {
+            list.push(path);
+        }
+        list
+    }
+}
+
+impl Serialize for PathList {
+    fn serialize<S: Serializer>(&self, serializer: S) -> Result<S::Ok, S::Error> {
+        let mut seq = serializer.serialize_seq(Some(self.len()))?;
+        for (shared, tail) in self.coded() {
+            let tail = std::str::from_utf8(tail)
+                .map_err(|_| ser::Error::custom("path is not valid UTF-8"))?;
+            seq.serialize_element(&(shared, tail))?;
+        }
+        seq.end()
+    }
+}
+
+/// An entry as written now, or a whole path as older files hold
+#[derive(Deserialize)]
+#[serde(untagged)]
+enum StoredPath {
+    Coded(u32, String),
+    Plain(String),
+}
+
+impl<'de> Deserialize<'de> for PathList {
+    fn deserialize<D: Deserializer<'de>>(deserializer: D) -> Result<Self, D::Error> {
+        struct ListVisitor;
+
+        impl<'de> Visitor<'de> for ListVisitor {
+            type Value = PathList;
+
+            fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+                f.write_str("a list of paths")
+            }
+
+            fn visit_seq<A: SeqAccess<'de>>(self, mut seq: A) -> Result<PathList, A::Error> {
+                let mut list = PathList::new();
+                let mut path = Vec::new();
+                while let Some(item) = seq.next_element()? {
+                    match item {
+                        StoredPath::Coded(shared, tail) => {
+                            if shared as usize > path.len() {
+                                return Err(de::Error::custom("shared prefix past previous path"));
+                            }
+                            path.truncate(shared as usize);
+                            path.extend_from_slice(tail.as_bytes());
+                        }
+                        StoredPath::Plain(whole) => path = whole.into_bytes(),
+                    }
+                    list.push_bytes(&path);
+                }
+                Ok(list)
+            }
+        }
+
+        deserializer.deserialize_seq(ListVisitor)
+    }
+}
+
+/// A transfer's file list with front-coded names
+#[derive(Debug, Clone, Default, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(try_from = "FileListParts")]
+pub struct FileList {
+    names: PathList,
+    sizes: Vec<u64>,
+    /// Positions of the entries that are directories
+    #[serde(skip_serializing_if = "Vec::is_empty")]
+    directories: Vec<u32>,
+}
+
+/// A file list as read, checked before it becomes a `FileList`
+#[derive(Deserialize)]
+struct FileListParts {
+    names: PathList,
+    sizes: Vec<u64>,
+    #[serde(default)]
+    directories: Vec<u32>,
+}
+
+impl TryFrom<FileListParts> for FileList {
+    type Error = String;
+
+    /// Refuse lists whose parts disagree, as zipping them would silently
+    /// drop files or mark the wrong ones as directories
+    fn try_from(parts: FileListParts) -> Result<Self, String> {
+        if parts.names.len() != parts.sizes.len() {
+            return Err(format!(
+                "file list has {} names but {} sizes",
+                parts.names.len(),
+                parts.sizes.len()
+            ));
+        }
+        let sorted = parts.directories.windows(2).all(|w| w[0] < w[1]);
+        let in_range = parts
+            .directories
+            .last()
+            .is_none_or(|&last| (last as usize) < parts.sizes.len());
+        if !sorted || !in_range {
+            return Err("file list has invalid directory positions".to_string());
+        }
+        Ok(Self {
+            names: parts.names,
+            sizes: parts.sizes,
+            directories: parts.directories,
+        })
+    }
+}
+
+impl FileList {
+    pub fn new(files: Vec<TransferFile>) -> Self {
+        let mut list = Self::default();
+        for (index, file) in files.into_iter().enumerate() {
+            list.names.push(&file.name);
+            list.sizes.push(file.size);
+            if file.is_directory {
+                list.directories.push(index as u32);
+            }
+        }
+        list
+    }
+
+    /// The files as the engine describes them
+    pub fn to_files(&self) -> Vec<TransferFile> {
+        self.names
+            .iter()
+            .zip(&self.sizes)
+            .enumerate()
+            .map(|(index, (name, &size))| TransferFile {
+                name: name.to_string_lossy().into_owned(),
+                size,
+                is_directory: self.directories.binary_search(&(index as u32)).is_ok(),
+            })
+            .collect()
+    }
+
+    pub fn len(&self) -> usize {
+        self.sizes.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.sizes.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_round_trip_and_size() {
+        let paths: Vec<PathBuf> = (0..1000)
+            .map(|i| {
+                PathBuf::from(format!(
+                    "projects/photos/2024/holiday-album/raw/day-{:02}/IMG_{:05}.CR2",
+                    i / 100,
+                    i
+                ))
+            })
+            .collect();
+        let list: PathList = paths.iter().collect();
+        assert_eq!(list.iter().collect::<Vec<_>>(), paths);
+
+        let coded = serde_json::to_string(&list).unwrap();
+        let plain = serde_json::to_string(&paths).unwrap();
+        assert!(coded.len() * 2 < plain.len());
+        assert_eq!(serde_json::from_str::<PathList>(&coded).unwrap(), list);
+        // Lists written before front coding
+        assert_eq!(serde_json::from_str::<PathList>(&plain).unwrap(), list);
+
+        // Sharing stops at a separator, inside "é" here
+        let list: PathList = ["a/éa", "a/éb/c", "a/èd"].into_iter().collect();
+        assert_eq!(list.coded().map(|(s, _)| s).collect::<Vec<_>>(), [0, 2, 2]);
+        assert!(serde_json::from_str::<PathList>(r#"[[0, "a/b"], [4, "c"]]"#).is_err());
+    }
+
+    #[test]
+    fn test_file_list() {
+        let files = vec![
+            TransferFile {
+                name: "album".to_string(),
+                size: 0,
+                is_directory: true,
+            },
+            TransferFile {
+                name: "album/a.jpg".to_string(),
+                size: 42,
+                is_directory: false,
+            },
+        ];
+        let list = FileList::new(files.clone());
+        let json = serde_json::to_string(&list).unwrap();
+        let restored: FileList = serde_json::from_str(&json).unwrap();
+        let restored = restored.to_files();
+        assert_eq!(restored.len(), 2);
+        assert!(restored[0].is_directory && !restored[1].is_directory);
+        assert_eq!(restored[1].name, files[1].name);
+        assert_eq!(restored[1].size, 42);
+
+        let short = r#"{"names": [[0, "a"], [0, "b"]], "sizes": [1]}"#;
+        assert!(serde_json::from_str::<FileList>(short).is_err());
+        let stray = r#"{"names": [[0, "a"]], "sizes": [1], "directories": [1]}"#;
+        assert!(serde_json::from_str::<FileList>(stray).is_err());
+    }
+}
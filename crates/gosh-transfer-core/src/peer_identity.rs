@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Transport identities
+//
+// Encrypted transports authenticate peers trust-on-first-use: the first
+// certificate seen from an address is pinned, and a different one later
+// fails the handshake until the user forgets the old identity. This
+// device's own certificate is kept so peers' pins stay valid.
+
+use crate::types::AppError;
+use serde::Serialize;
+use std::collections::HashMap;
+use std::fs;
+use std::path::PathBuf;
+use std::sync::RwLock;
+
+/// Result of checking a peer's certificate against its pin
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PeerIdentity {
+    /// Matches the pinned certificate
+    Known,
+    /// First contact; the certificate is now pinned
+    New,
+    /// Differs from the pinned certificate
+    Changed,
+}
+
+/// A pinned peer, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct KnownPeer {
+    pub address: String,
+    /// SHA-256 of the peer's certificate, hex encoded
+    pub fingerprint: String,
+}
+
+/// File-based store of pinned peer certificates
+pub struct KnownPeers {
+    fingerprints: RwLock<HashMap<String, String>>,
+    file_path: PathBuf,
+}
+
+impl KnownPeers {
+    /// Create a new store, loading from disk if available
+    pub fn new() -> Result<Self, AppError> {
+        let file_path = config_dir()?.join("known_peers.json");
+
+        let fingerprints = if file_path.exists() {
+            let content = fs::read_to_string(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read known peers: {}", e)))?;
+            serde_json::from_str(&content).unwrap_or_else(|e| {
+                tracing::warn!("Failed to parse known peers, starting fresh: {}", e);
+                HashMap::new()
+            })
+        } else {
+            HashMap::new()
+        };
+
+        Ok(Self {
+            fingerprints: RwLock::new(fingerprints),
+            file_path,
+        })
+    }
+
+    /// Persist pins to disk
+    fn persist(&self) -> Result<(), AppError> {
+        let fingerprints = self.fingerprints.read().unwrap();
+        let content = serde_json::to_string_pretty(&*fingerprints).map_err(|e| {
+            AppError::Serialization(format!("Failed to serialize known peers: {}", e))
+        })?;
+
+        fs::write(&self.file_path, content)
+            .map_err(|e| AppError::FileIo(format!("Failed to write known peers: {}", e)))?;
+
+        Ok(())
+    }
+
+    /// Check a peer's certificate fingerprint, pinning it on first contact
+    pub fn check(&self, address: &str, fingerprint: &str) -> PeerIdentity {
+        if let Some(pinned) = self.fingerprints.read().unwrap().get(address) {
+            return if pinned == fingerprint {
+                PeerIdentity::Known
+            } else {
+                PeerIdentity::Changed
+            };
+        }
+
+        self.fingerprints
+            .write()
+            .unwrap()
+            .insert(address.to_string(), fingerprint.to_string());
+        if let Err(e) = self.persist() {
+            tracing::warn!("Failed to save identity of {}: {}", address, e);
+        }
+        PeerIdentity::New
+    }
+
+    /// List pinned peers
+    pub fn list(&self) -> Vec<KnownPeer> {
+        let mut peers: Vec<KnownPeer> = self
+            .fingerprints
+            .read()
+            .unwrap()
+            .iter()
+            .map(|(address, fingerprint)| KnownPeer {
+                address: address.clone(),
+                fingerprint: fingerprint.clone(),
+            })
+            .collect();
+        peers.sort_by(|a, b| a.address.cmp(&b.address));
+        peers
+    }
+
+    /// Forget a peer's pinned certificate so its next one is accepted
+    pub fn forget(&self, address: &str) -> Result<bool, AppError> {
+        let removed = self.fingerprints.write().unwrap().remove(address).is_some();
+        if removed {
+            self.persist()?;
+        }
+        Ok(removed)
+    }
+}
+
+/// Load this device's transport certificate and private key (both DER)
+pub fn load_local_identity() -> Option<(Vec<u8>, Vec<u8>)> {
+    let dir = config_dir().ok()?;
+    let cert = fs::read(dir.join("transport_cert.der")).ok()?;
+    let key = fs::read(dir.join("transport_key.der")).ok()?;
+    Some((cert, key))
+}
+
+/// Save this device's transport certificate and private key (both DER)
+pub fn save_local_identity(cert: &[u8], key: &[u8]) -> Result<(), AppError> {
+    use std::io::Write;
+    use std::os::unix::fs::OpenOptionsExt;
+
+    let dir = config_dir()?;
+    fs::write(dir.join("transport_cert.der"), cert)?;
+    // The key is only readable by the user
+    fs::OpenOptions::new()
+        .write(true)
+        .create(true)
+        .truncate(true)
+        .mode(0o600)
+        .open(dir.join("transport_key.der"))?
+        .write_all(key)?;
+    Ok(())
+}
+
+fn config_dir() -> Result<PathBuf, AppError> {
+    let config_dir = directories::ProjectDirs::from("com", "gosh", "transfer")
+        .ok_or_else(|| AppError::FileIo("Could not determine config directory".to_string()))?
+        .config_dir()
+        .to_path_buf();
+
+    fs::create_dir_all(&config_dir)
+        .map_err(|e| AppError::FileIo(format!("Failed to create config dir: {}", e)))?;
+
+    Ok(config_dir)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_first_certificate_is_pinned() {
+        let peers = KnownPeers {
+            fingerprints: RwLock::new(HashMap::new()),
+            file_path: std::env::temp_dir().join("gosh-known-peers-test.json"),
+        };
+
+        assert_eq!(peers.check("10.0.0.5", "aa"), PeerIdentity::New);
+        assert_eq!(peers.check("10.0.0.5", "aa"), PeerIdentity::Known);
+        assert_eq!(peers.check("10.0.0.5", "bb"), PeerIdentity::Changed);
+        assert!(peers.forget("10.0.0.5").unwrap());
+        assert_eq!(peers.check("10.0.0.5", "bb"), PeerIdentity::New);
+    }
+}
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Receiver-initiated pull
+//
+// In pull mode the sender only publishes an offer; the receiver fetches the
+// offered files with HTTP range requests at its own pace, several ranges
+// at a time, and re-requests ranges that fail. Finished ranges are kept on
+// disk, so a failed or interrupted pull can be retried for the ranges it is
+// still missing, and the receiver retires the offer once it has every file.
+
+use crate::types::AppError;
+use chrono::{DateTime, Utc};
+use serde::{Deserialize, Serialize};
+use std::fs;
+use std::hint::black_box;
+use std::path::{Path, PathBuf};
+
+/// File name prefix marking a pull offer inside a transfer
+pub const OFFER_PREFIX: &str = ".gosh-offer-";
+/// Bytes fetched per range request
+pub const RANGE_SIZE: u64 = 8 * 1024 * 1024;
+
+/// A file in an offer
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct OfferFile {
+    pub name: String,
+    pub size: u64,
+}
+
+/// Files a sender published for pulling, delivered as an ordinary transfer
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PullOffer {
+    pub offer_id: String,
+    /// Secret the receiver presents with each range request
+    pub token: String,
+    /// Port of the sender's offer server
+    pub port: u16,
+    pub files: Vec<OfferFile>,
+}
+
+impl PullOffer {
+    /// Name of the offer file
+    pub fn offer_name(&self) -> String {
+        format!("{}{}.json", OFFER_PREFIX, self.offer_id)
+    }
+
+    /// Check whether a transferred file name is a pull offer
+    pub fn is_offer(name: &str) -> bool {
+        name.starts_with(OFFER_PREFIX) && name.ends_with(".json") && !name.contains('/')
+    }
+
+    /// Request path of a file of the offer
+    pub fn file_path(&self, index: usize) -> String {
+        format!("/offer/{}/{}?token={}", self.offer_id, index, self.token)
+    }
+
+    /// Request path that retires the offer once every file is pulled
+    pub fn retire_path(&self) -> String {
+        format!("/offer/{}?token={}", self.offer_id, self.token)
+    }
+
+    /// Write the offer into `dir`, returning its path
+    pub fn write(&self, dir: &Path) -> Result<PathBuf, AppError> {
+        let content = serde_json::to_string(self)
+            .map_err(|e| AppError::Serialization(format!("Failed to serialize offer: {}", e)))?;
+        fs::create_dir_all(dir)?;
+        let path = dir.join(self.offer_name());
+        fs::write(&path, content)?;
+        Ok(path)
+    }
+
+    /// Read a received offer, rejecting file names that leave the download directory
+    pub fn read(path: &Path) -> Result<Self, AppError> {
+        let content = fs::read_to_string(path)?;
+        let offer: Self = serde_json::from_str(&content)
+            .map_err(|e| AppError::Serialization(format!("Invalid offer: {}", e)))?;
+        for file in &offer.files {
+            let name = Path::new(&file.name);
+            if name.file_name() != Some(name.as_os_str()) {
+                return Err(AppError::InvalidConfig(format!(
+                    "Invalid file name in offer: {}",
+                    file.name
+                )));
+            }
+        }
+        Ok(offer)
+    }
+}
+
+/// Number of range requests needed for `size` bytes
+pub fn range_count(size: u64) -> u32 {
+    size.div_ceil(RANGE_SIZE) as u32
+}
+
+/// Inclusive byte span of range `index` of a `size`-byte file
+pub fn range_span(index: u32, size: u64) -> (u64, u64) {
+    let start = u64::from(index) * RANGE_SIZE;
+    (start, (start + RANGE_SIZE).min(size) - 1)
+}
+
+/// A range request for a file of an offer
+#[derive(Debug, PartialEq, Eq)]
+pub struct RangeRequest {
+    pub offer_id: String,
+    pub index: usize,
+    pub token: String,
+    /// Inclusive byte span, if a Range header was sent
+    pub range: Option<(u64, u64)>,
+}
+
+/// Parse the head of `GET /offer/<id>/<index>?token=<token>` with an
+/// optional single `Range: bytes=<start>-<end>` header
+pub fn parse_request(head: &str) -> Option<RangeRequest> {
+    let mut lines = head.lines();
+    let mut request_line = lines.next()?.split(' ');
+    if request_line.next()? != "GET" {
+        return None;
+    }
+    let target = request_line.next()?;
+    let (path, query) = target.split_once('?')?;
+    let mut parts = path.strip_prefix("/offer/")?.split('/');
+    let offer_id = parts.next()?.to_string();
+    let index = parts.next()?.parse().ok()?;
+    let token = query.strip_prefix("token=")?.to_string();
+
+    let range = lines
+        .filter_map(|line| line.split_once(':'))
+        .find(|(name, _)| name.trim().eq_ignore_ascii_case("range"))
+        .and_then(|(_, value)| {
+            let (start, end) = value.trim().strip_prefix("bytes=")?.split_once('-')?;
+            Some((start.parse().ok()?, end.parse().ok()?))
+        });
+
+    Some(RangeRequest {
+        offer_id,
+        index,
+        token,
+        range,
+    })
+}
+
+/// Parse the head of `DELETE /offer/<id>?token=<token>` into the offer id
+/// and token
+pub fn parse_retire(head: &str) -> Option<(String, String)> {
+    let mut request_line = head.lines().next()?.split(' ');
+    if request_line.next()? != "DELETE" {
+        return None;
+    }
+    let (path, query) = request_line.next()?.split_once('?')?;
+    let offer_id = path.strip_prefix("/offer/")?;
+    if offer_id.contains('/') {
+        return None;
+    }
+    let token = query.strip_prefix("token=")?;
+    Some((offer_id.to_string(), token.to_string()))
+}
+
+/// Compare a presented token with an offer's in time that does not depend
+/// on where they differ
+pub fn tokens_match(presented: &str, expected: &str) -> bool {
+    let (a, b) = (presented.as_bytes(), expected.as_bytes());
+    if a.len() != b.len() {
+        return false;
+    }
+    let diff = a
+        .iter()
+        .zip(b)
+        .fold(0u8, |acc, (x, y)| acc | black_box(x ^ y));
+    black_box(diff) == 0
+}
+
+/// State of a pull at the receiver
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub enum PullState {
+    Running,
+    Failed,
+    Complete,
+}
+
+/// Progress of a pull, reported to the frontend
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PullStatus {
+    pub offer_id: String,
+    pub peer_address: String,
+    pub files: Vec<String>,
+    pub total_bytes: u64,
+    pub received_bytes: u64,
+    pub state: PullState,
+    pub error: Option<String>,
+    pub updated_at: DateTime<Utc>,
+}
+
+/// A pull into this device as kept on disk
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PullRecord {
+    pub offer: PullOffer,
+    pub download_dir: PathBuf,
+    /// Finished ranges per file, as `BlockMap` words
+    pub done: Vec<Vec<u64>>,
+    /// Files before this one are complete and in place
+    pub next_file: usize,
+    pub status: PullStatus,
+}
+
+/// File-based record of pulls into this device
+pub struct PullJournal {
+    file_path: PathBuf,
+}
+
+impl PullJournal {
+    pub fn new() -> Result<Self, AppError> {
+        let config_dir = directories::ProjectDirs::from("com", "gosh", "transfer")
+            .ok_or_else(|| AppError::FileIo("Could not determine config directory".to_string()))?
+            .config_dir()
+            .to_path_buf();
+        fs::create_dir_all(&config_dir)
+            .map_err(|e| AppError::FileIo(format!("Failed to create config dir: {}", e)))?;
+        Ok(Self {
+            file_path: config_dir.join("pulls.json"),
+        })
+    }
+
+    /// Pulls a previous run left unfinished. Pulls that were running were cut
+    /// off by the quit and are reported as failed, so they can be retried.
+    pub fn load(&self) -> Vec<PullRecord> {
+        let Ok(content) = fs::read_to_string(&self.file_path) else {
+            return Vec::new();
+        };
+        let records: Vec<PullRecord> = serde_json::from_str(&content).unwrap_or_else(|e| {
+            tracing::warn!("Failed to parse pulls, starting fresh: {}", e);
+            Vec::new()
+        });
+        records
+            .into_iter()
+            .filter(|r| r.status.state != PullState::Complete)
+            .map(|mut r| {
+                if r.status.state == PullState::Running {
+                    r.status.state = PullState::Failed;
+                    r.status.error = Some("Interrupted".to_string());
+                }
+                r
+            })
+            .collect()
+    }
+
+    /// Write the unfinished pulls to disk
+    pub fn save(&self, records: &[PullRecord]) {
+        let result = serde_json::to_string(records)
+            .map_err(|e| e.to_string())
+            .and_then(|content| {
+                // Replace atomically so a crash mid-write keeps the last record
+                let tmp = self.file_path.with_extension("json.tmp");
+                fs::write(&tmp, content)
+                    .and_then(|_| fs::rename(&tmp, &self.file_path))
+                    .map_err(|e| e.to_string())
+            });
+        if let Err(e) = result {
+            tracing::warn!("Failed to write pulls: {}", e);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_range_request() {
+        let head =
+            "GET /offer/ab12/1?token=s3cret HTTP/1.1\r\nHost: x\r\nrange: bytes=0-99\r\n\r\n";
+        assert_eq!(
+            parse_request(head),
+            Some(RangeRequest {
+                offer_id: "ab12".to_string(),
+                index: 1,
+                token: "s3cret".to_string(),
+                range: Some((0, 99)),
+            })
+        );
+        assert!(parse_request("POST /offer/ab12/1?token=x HTTP/1.1\r\n").is_none());
+        assert!(parse_request("GET /offer/ab12/1 HTTP/1.1\r\n").is_none());
+
+        assert_eq!(
+            parse_retire("DELETE /offer/ab12?token=s3cret HTTP/1.1\r\n\r\n"),
+            Some(("ab12".to_string(), "s3cret".to_string()))
+        );
+        assert!(parse_retire("DELETE /offer/ab12/1?token=s3cret HTTP/1.1\r\n").is_none());
+        assert!(parse_retire("GET /offer/ab12?token=s3cret HTTP/1.1\r\n").is_none());
+    }
+
+    #[test]
+    fn test_tokens_match_only_in_full() {
+        assert!(tokens_match("0a1b2c", "0a1b2c"));
+        assert!(!tokens_match("0a1b2d", "0a1b2c"));
+        assert!(!tokens_match("0a1b2", "0a1b2c"));
+        assert!(!tokens_match("", "0a1b2c"));
+    }
+
+    #[test]
+    fn test_interrupted_pulls_come_back_failed() {
+        let dir = std::env::temp_dir().join(format!("gosh-pulls-{}", std::process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let journal = PullJournal {
+            file_path: dir.join("pulls.json"),
+        };
+        let record = |offer_id: &str, state| PullRecord {
+            offer: PullOffer {
+                offer_id: offer_id.to_string(),
+                token: "t".to_string(),
+                port: 53320,
+                files: vec![OfferFile {
+                    name: "a.bin".to_string(),
+                    size: RANGE_SIZE * 2,
+                }],
+            },
+            download_dir: dir.clone(),
+            done: vec![vec![0b01]],
+            next_file: 0,
+            status: PullStatus {
+                offer_id: offer_id.to_string(),
+                peer_address: "10.0.0.9".to_string(),
+                files: vec!["a.bin".to_string()],
+                total_bytes: RANGE_SIZE * 2,
+                received_bytes: RANGE_SIZE,
+                state,
+                error: None,
+                updated_at: Utc::now(),
+            },
+        };
+        journal.save(&[
+            record("running", PullState::Running),
+            record("complete", PullState::Complete),
+        ]);
+
+        let loaded = journal.load();
+        assert_eq!(loaded.len(), 1);
+        assert_eq!(loaded[0].status.state, PullState::Failed);
+        assert_eq!(loaded[0].done, vec![vec![0b01]]);
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_ranges_cover_file() {
+        let size = RANGE_SIZE * 2 + 5;
+        assert_eq!(range_count(size), 3);
+        assert_eq!(range_span(0, size), (0, RANGE_SIZE - 1));
+        assert_eq!(range_span(2, size), (RANGE_SIZE * 2, size - 1));
+        assert_eq!(range_count(0), 0);
+    }
+}
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Favorite addresses
+//
+// The same machine is often reachable several ways: its LAN address, a
+// Tailscale address, a MagicDNS name. A favorite keeps the extra addresses
+// alongside its own, and every send races connections to them. The
+// connect time of the winner and the addresses that failed are recorded
+// here, and the next race starts with whatever answered fastest lately.
+
+use chrono::{DateTime, Duration, Utc};
+use serde::{Deserialize, Serialize};
+use std::collections::HashMap;
+
+/// How long a measurement counts when ranking addresses
+const RECENT_HOURS: i64 = 24;
+
+/// Weight of a new connect time against the running average, in percent
+const RTT_WEIGHT: u32 = 30;
+
+/// What was last seen over one address
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct RouteStats {
+    /// Running average of connect times, in milliseconds
+    pub rtt_ms: Option<u32>,
+    /// Failed attempts since the last connection that worked
+    pub failures: u32,
+    pub updated_at: DateTime<Utc>,
+}
+
+/// A favorite's other addresses and how each has fared
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct FavoriteRoutes {
+    /// Addresses besides the favorite's own, in the user's order
+    #[serde(default)]
+    pub addresses: Vec<String>,
+    #[serde(default, skip_serializing_if = "HashMap::is_empty")]
+    pub stats: HashMap<String, RouteStats>,
+    /// Address that won the last race
+    #[serde(default)]
+    pub last_winner: Option<String>,
+}
+
+impl FavoriteRoutes {
+    /// `primary` and the other addresses, best first: recent failures
+    /// last, then by recent connect time. Unmeasured addresses keep the
+    /// user's order behind measured ones.
+    pub fn ranked(&self, primary: &str, now: DateTime<Utc>) -> Vec<String> {
+        let mut addresses = vec![primary.to_string()];
+        for address in &self.addresses {
+            if !addresses.contains(address) {
+                addresses.push(address.clone());
+            }
+        }
+        let recent = |address: &String| {
+            self.stats
+                .get(address)
+                .filter(|s| now - s.updated_at < Duration::hours(RECENT_HOURS))
+        };
+        addresses.sort_by_key(|address| match recent(address) {
+            Some(stats) => (stats.failures, stats.rtt_ms.unwrap_or(u32::MAX)),
+            None => (0, u32::MAX),
+        });
+        addresses
+    }
+
+    /// Record a connection over `address` that took `rtt_ms`
+    pub fn record_success(&mut self, address: &str, rtt_ms: u32, now: DateTime<Utc>) {
+        let stats = self.entry(address, now);
+        stats.rtt_ms = Some(match stats.rtt_ms {
+            Some(avg) => (avg * (100 - RTT_WEIGHT) + rtt_ms * RTT_WEIGHT) / 100,
+            None => rtt_ms,
+        });
+        stats.failures = 0;
+        self.last_winner = Some(address.to_string());
+    }
+
+    /// Record an attempt over `address` that did not connect
+    pub fn record_failure(&mut self, address: &str, now: DateTime<Utc>) {
+        self.entry(address, now).failures += 1;
+    }
+
+    fn entry(&mut self, address: &str, now: DateTime<Utc>) -> &mut RouteStats {
+        let stats = self
+            .stats
+            .entry(address.to_string())
+            .or_insert_with(|| RouteStats {
+                rtt_ms: None,
+                failures: 0,
+                updated_at: now,
+            });
+        stats.updated_at = now;
+        stats
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_ranking_follows_measurements() {
+        let now = Utc::now();
+        let mut routes = FavoriteRoutes {
+            addresses: vec!["100.64.0.7".to_string(), "desk.tailnet.ts.net".to_string()],
+            ..FavoriteRoutes::default()
+        };
+        assert_eq!(
+            routes.ranked("192.168.1.7", now),
+            ["192.168.1.7", "100.64.0.7", "desk.tailnet.ts.net"]
+        );
+
+        routes.record_failure("192.168.1.7", now);
+        routes.record_success("desk.tailnet.ts.net", 40, now);
+        routes.record_success("100.64.0.7", 12, now);
+        assert_eq!(
+            routes.ranked("192.168.1.7", now),
+            ["100.64.0.7", "desk.tailnet.ts.net", "192.168.1.7"]
+        );
+        assert_eq!(routes.last_winner.as_deref(), Some("100.64.0.7"));
+
+        routes.record_success("100.64.0.7", 112, now);
+        assert_eq!(routes.stats["100.64.0.7"].rtt_ms, Some(42));
+
+        // Old measurements no longer count
+        let later = now + Duration::hours(RECENT_HOURS + 1);
+        assert_eq!(routes.ranked("192.168.1.7", later)[0], "192.168.1.7");
+    }
+}
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Core - Selective acceptance of incoming transfers
+//
+// Lets the receiver pick which files of a pending transfer it wants, either
+// by exact name or by glob pattern. The engine has no way to leave files
+// out of an accepted transfer, so the rest still arrive and are kept; the
+// selection is recorded in history so they can be told apart.
+
+use crate::types::AppError;
+use globset::{GlobBuilder, GlobSet, GlobSetBuilder};
+use gosh_lan_transfer::TransferFile;
+use serde::Serialize;
+
+/// Compiled set of patterns selecting files from a transfer's file list
+pub struct FileSelection {
+    set: GlobSet,
+}
+
+impl FileSelection {
+    /// Compile selection patterns.
+    ///
+    /// Each pattern matches file names relative to the transfer root. A pattern
+    /// naming a directory also selects everything below it, so `photos` keeps
+    /// `photos/2024/a.jpg`. `*` does not cross `/`; use `**` for that.
+    pub fn new(patterns: &[String]) -> Result<Self, AppError> {
+        let mut builder = GlobSetBuilder::new();
+        for pattern in patterns {
+            let pattern = pattern.trim().trim_start_matches("./");
+            if pattern.is_empty() {
+                continue;
+            }
+            let dir = pattern.trim_end_matches('/');
+            for glob in [dir.to_string(), format!("{}/**", dir)] {
+                let glob = GlobBuilder::new(&glob)
+                    .literal_separator(true)
+                    .build()
+                    .map_err(|e| {
+                        AppError::InvalidConfig(format!("Invalid pattern '{}': {}", pattern, e))
+                    })?;
+                builder.add(glob);
+            }
+        }
+
+        let set = builder
+            .build()
+            .map_err(|e| AppError::InvalidConfig(format!("Invalid selection: {}", e)))?;
+        Ok(Self { set })
+    }
+
+    /// Check whether a file name is selected
+    pub fn is_selected(&self, name: &str) -> bool {
+        self.set.is_match(name)
+    }
+
+    /// Split a transfer's files into (selected, skipped)
+    pub fn partition<'a>(
+        &self,
+        files: &'a [TransferFile],
+    ) -> (Vec<&'a TransferFile>, Vec<&'a TransferFile>) {
+        files.iter().partition(|f| self.is_selected(&f.name))
+    }
+}
+
+/// Outcome of a selective accept, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct SelectionSummary {
+    pub selected_files: usize,
+    pub skipped_files: usize,
+    pub skipped_bytes: u64,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_directory_pattern_selects_subtree() {
+        let selection = FileSelection::new(&["photos/".to_string()]).unwrap();
+        assert!(selection.is_selected("photos/2024/a.jpg"));
+        assert!(!selection.is_selected("videos/a.mp4"));
+    }
+
+    #[test]
+    fn test_star_does_not_cross_separator() {
+        let selection = FileSelection::new(&["*.txt".to_string()]).unwrap();
+        assert!(selection.is_selected("notes.txt"));
+        assert!(!selection.is_selected("docs/notes.txt"));
+    }
+}
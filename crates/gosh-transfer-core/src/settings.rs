@@ -4,6 +4,7 @@
 // Settings are stored in a local JSON file.
 // No cloud sync, no tracking, just simple local persistence.
 
+use crate::json;
 use crate::types::{AppError, AppSettings};
 use std::fs;
 use std::path::PathBuf;
@@ -23,13 +24,12 @@ impl SettingsStore {
 
         let settings = if file_path.exists() {
             tracing::info!("Loading settings from disk");
-            let content = fs::read_to_string(&file_path)
-                .map_err(|e| AppError::FileIo(format!("Failed to read settings: {}", e)))?;
-
-            serde_json::from_str(&content).unwrap_or_else(|e| {
-                tracing::warn!("Failed to parse settings, using defaults: {}", e);
-                AppSettings::default()
-            })
+            json::read_file(&file_path)
+                .map_err(|e| AppError::FileIo(format!("Failed to read settings: {}", e)))?
+                .unwrap_or_else(|e| {
+                    tracing::warn!("Failed to parse settings, using defaults: {}", e);
+                    AppSettings::default()
+                })
         } else {
             tracing::info!("No settings file found, using defaults");
             AppSettings::default()
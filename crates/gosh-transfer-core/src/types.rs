@@ -99,6 +99,26 @@ impl InterfaceFilters {
     }
 }
 
+/// How transfers travel between peers
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub enum TransportMode {
+    /// The engine's own HTTP connections
+    #[default]
+    Http,
+    /// HTTP relayed over QUIC streams, falling back to plain HTTP per peer
+    Quic,
+    /// TLS over TCP only: plaintext HTTP is neither sent nor accepted
+    Encrypted,
+}
+
+impl TransportMode {
+    /// Check whether the QUIC endpoints are needed
+    pub fn uses_quic(&self) -> bool {
+        *self == Self::Quic
+    }
+}
+
 /// Application settings (GUI-agnostic)
 #[derive(Debug, Clone, Serialize, Deserialize)]
 #[serde(rename_all = "camelCase")]
@@ -130,6 +150,28 @@ pub struct AppSettings {
     /// Interface category visibility filters
     #[serde(default)]
     pub interface_filters: InterfaceFilters,
+    /// Sends of regular files totalling at most this many bytes skip the
+    /// queue of large sends (0 queues every send)
+    #[serde(default = "default_skip_queue_max_bytes")]
+    pub skip_queue_max_bytes: u64,
+    /// Transport used between peers
+    #[serde(default)]
+    pub transport: TransportMode,
+    /// Join multicast sessions announced by peers
+    #[serde(default)]
+    pub multicast_enabled: bool,
+    /// Minutes without connections or transfers after which a receiver
+    /// started by systemd socket activation exits (0 keeps it running)
+    #[serde(default = "default_idle_exit_minutes")]
+    pub idle_exit_minutes: u32,
+    /// Keep running in the tray when the window is closed, unloading the
+    /// window until it is opened again
+    #[serde(default)]
+    pub tray_mode: bool,
+    /// Log level directives per module, such as
+    /// `gosh_transfer_tauri::acceptors=debug`, on top of the defaults
+    #[serde(default)]
+    pub log_filter: String,
 }
 
 fn default_theme() -> String {
@@ -144,6 +186,14 @@ fn default_retry_delay_ms() -> u64 {
     1000
 }
 
+fn default_skip_queue_max_bytes() -> u64 {
+    64 * 1024
+}
+
+fn default_idle_exit_minutes() -> u32 {
+    10
+}
+
 impl Default for AppSettings {
     fn default() -> Self {
         let download_dir = directories::UserDirs::new()
@@ -164,6 +214,12 @@ impl Default for AppSettings {
             retry_delay_ms: default_retry_delay_ms(),
             bandwidth_limit_bps: None,
             interface_filters: InterfaceFilters::default(),
+            skip_queue_max_bytes: default_skip_queue_max_bytes(),
+            transport: TransportMode::default(),
+            multicast_enabled: false,
+            idle_exit_minutes: default_idle_exit_minutes(),
+            tray_mode: false,
+            log_filter: String::new(),
         }
     }
 }
@@ -171,11 +227,18 @@ impl Default for AppSettings {
 impl AppSettings {
     /// Convert to engine configuration
     pub fn to_engine_config(&self) -> gosh_lan_transfer::EngineConfig {
+        // The engine would accept trusted peers before the bridge can check
+        // that they came through the relay; in encrypted mode the bridge
+        // decides trust alone
+        let trusted_hosts = match self.transport {
+            TransportMode::Encrypted => Vec::new(),
+            _ => self.trusted_hosts.clone(),
+        };
         gosh_lan_transfer::EngineConfig::builder()
             .port(self.port)
             .device_name(&self.device_name)
             .download_dir(&self.download_dir)
-            .trusted_hosts(self.trusted_hosts.clone())
+            .trusted_hosts(trusted_hosts)
             .receive_only(self.receive_only)
             .max_retries(self.max_retries)
             .retry_delay_ms(self.retry_delay_ms)
@@ -213,6 +276,9 @@ pub enum AppError {
 
     #[error("Engine error: {0}")]
     Engine(String),
+
+    #[error("Cancelled")]
+    Cancelled,
 }
 
 impl From<gosh_lan_transfer::EngineError> for AppError {
@@ -245,4 +311,15 @@ mod tests {
         let config = settings.to_engine_config();
         assert_eq!(config.port, 53317);
     }
+
+    #[test]
+    fn test_encrypted_config_trusts_no_one() {
+        let mut settings = AppSettings {
+            trusted_hosts: vec!["192.168.1.7".to_string()],
+            ..AppSettings::default()
+        };
+        assert_eq!(settings.to_engine_config().trusted_hosts.len(), 1);
+        settings.transport = TransportMode::Encrypted;
+        assert!(settings.to_engine_config().trusted_hosts.is_empty());
+    }
 }
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Listeners in front of the engine
+//
+// A receiver started by systemd inherits its listening sockets, which the
+// engine cannot take over, and in encrypted mode the transfer port speaks
+// TLS, which the engine does not. In both cases the engine listens on a
+// port of its own instead, and each connection accepted on the transfer
+// port is spliced to it from the peer's loopback alias, as relayed ones
+// are. A port change binds a listener on the new port the same way.
+
+use crate::tls::{self, TlsTransport};
+use gosh_transfer_core::PeerAliases;
+use std::io;
+use std::net::{Ipv4Addr, SocketAddr, TcpListener as StdTcpListener};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, RwLock};
+use std::time::Duration;
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpSocket};
+use tokio::sync::{mpsc, watch};
+use tokio::task::JoinSet;
+
+/// Pause after a failed accept, such as when out of file descriptors
+pub const ACCEPT_BACKOFF: Duration = Duration::from_millis(100);
+
+/// Copy buffer per direction of a spliced connection. Loopback hops move
+/// several times more per wakeup with large buffers than with tokio's 8 KiB.
+pub const RELAY_BUFFER: usize = 256 * 1024;
+
+/// Listening sockets forwarding to the engine, one task each
+pub struct Acceptors {
+    port: u16,
+    /// Set in encrypted mode, where connections must complete a handshake
+    tls: Arc<RwLock<Option<Arc<TlsTransport>>>>,
+    /// Connections currently spliced to the engine
+    connections: Arc<AtomicUsize>,
+    stop: watch::Sender<bool>,
+    /// Ends once every listener is closed
+    released: mpsc::Receiver<()>,
+}
+
+impl Acceptors {
+    /// Listen on `port` and forward to the engine on loopback `engine_port`
+    pub async fn start(
+        port: u16,
+        engine_port: u16,
+        aliases: Arc<PeerAliases>,
+    ) -> Result<Self, String> {
+        let listener = TcpListener::bind((Ipv4Addr::UNSPECIFIED, port))
+            .await
+            .map_err(|e| format!("Failed to bind port {}: {}", port, e))?;
+        Ok(Self::spawn(port, vec![listener], engine_port, aliases))
+    }
+
+    /// Serve listening sockets bound elsewhere, such as by systemd
+    pub fn adopt(
+        listeners: Vec<StdTcpListener>,
+        engine_port: u16,
+        aliases: Arc<PeerAliases>,
+    ) -> Result<Self, String> {
+        let port = listeners
+            .first()
+            .and_then(|l| l.local_addr().ok())
+            .map(|addr| addr.port())
+            .ok_or_else(|| "No listening socket to adopt".to_string())?;
+        let listeners = listeners
+            .into_iter()
+            .map(|listener| {
+                listener.set_nonblocking(true)?;
+                TcpListener::from_std(listener)
+            })
+            .collect::<io::Result<Vec<_>>>()
+            .map_err(|e| format!("Failed to adopt listener: {}", e))?;
+        Ok(Self::spawn(port, listeners, engine_port, aliases))
+    }
+
+    fn spawn(
+        port: u16,
+        listeners: Vec<TcpListener>,
+        engine_port: u16,
+        aliases: Arc<PeerAliases>,
+    ) -> Self {
+        let tls = Arc::new(RwLock::new(None));
+        let connections = Arc::new(AtomicUsize::new(0));
+        let (stop, stopped) = watch::channel(false);
+        let (release, released) = mpsc::channel(1);
+        tracing::info!(
+            "Accepting on port {} with {} listener(s), engine on {}",
+            port,
+            listeners.len(),
+            engine_port
+        );
+        for listener in listeners {
+            let shared = Shared {
+                engine_port,
+                aliases: aliases.clone(),
+                tls: tls.clone(),
+                connections: connections.clone(),
+            };
+            tokio::spawn(accept_loop(
+                listener,
+                shared,
+                stopped.clone(),
+                release.clone(),
+            ));
+        }
+        Self {
+            port,
+            tls,
+            connections,
+            stop,
+            released,
+        }
+    }
+
+    pub fn port(&self) -> u16 {
+        self.port
+    }
+
+    /// Require a TLS handshake of new connections, or take them plain
+    pub fn set_tls(&self, tls: Option<Arc<TlsTransport>>) {
+        *self.tls.write().unwrap() = tls;
+    }
+
+    /// Connections currently spliced to the engine
+    pub fn connections(&self) -> usize {
+        self.connections.load(Ordering::Relaxed)
+    }
+
+    /// Stop accepting and wait until the port is free to bind again
+    pub async fn close(mut self) {
+        let _ = self.stop.send(true);
+        while self.released.recv().await.is_some() {}
+    }
+}
+
+impl Drop for Acceptors {
+    /// Stop accepting. Connections already spliced run until they end.
+    fn drop(&mut self) {
+        let _ = self.stop.send(true);
+    }
+}
+
+/// What every listener of a set shares
+struct Shared {
+    engine_port: u16,
+    aliases: Arc<PeerAliases>,
+    tls: Arc<RwLock<Option<Arc<TlsTransport>>>>,
+    connections: Arc<AtomicUsize>,
+}
+
+/// Counts a connection for as long as it is spliced
+struct Spliced(Arc<AtomicUsize>);
+
+impl Spliced {
+    fn new(connections: &Arc<AtomicUsize>) -> Self {
+        connections.fetch_add(1, Ordering::Relaxed);
+        Self(connections.clone())
+    }
+}
+
+impl Drop for Spliced {
+    fn drop(&mut self) {
+        self.0.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+/// A free loopback port for the engine to listen on behind the acceptors
+/// or, in encrypted mode, behind the TLS relay
+pub fn engine_port() -> io::Result<u16> {
+    let probe = StdTcpListener::bind((Ipv4Addr::LOCALHOST, 0))?;
+    Ok(probe.local_addr()?.port())
+}
+
+/// Accept on one listener until stopped, then wait for its connections
+async fn accept_loop(
+    listener: TcpListener,
+    shared: Shared,
+    mut stopped: watch::Receiver<bool>,
+    release: mpsc::Sender<()>,
+) {
+    let mut connections = JoinSet::new();
+    loop {
+        tokio::select! {
+            accepted = listener.accept() => match accepted {
+                Ok((stream, peer)) => {
+                    let source = shared.aliases.alias_for(peer.ip());
+                    let tls = shared.tls.read().unwrap().clone();
+                    let (engine_port, spliced) = (shared.engine_port, Spliced::new(&shared.connections));
+                    connections.spawn(async move {
+                        let _spliced = spliced;
+                        let result = match tls {
+                            Some(tls) => match tls.accept(stream, peer.ip()).await {
+                                Ok(stream) => splice(stream, source, engine_port).await,
+                                Err(e) => Err(e),
+                            },
+                            None => match stream.set_nodelay(true) {
+                                Ok(()) => splice(stream, source, engine_port).await,
+                                Err(e) => Err(e),
+                            },
+                        };
+                        if let Err(e) = result {
+                            tracing::debug!("Connection from {} ended: {}", peer, e);
+                        }
+                    });
+                }
+                Err(e) => {
+                    tracing::warn!("Accept failed: {}", e);
+                    tokio::time::sleep(ACCEPT_BACKOFF).await;
+                }
+            },
+            // Finished connections are reaped as they go
+            Some(_) = connections.join_next(), if !connections.is_empty() => {}
+            _ = stopped.changed() => break,
+        }
+    }
+    drop(listener);
+    drop(release);
+    while connections.join_next().await.is_some() {}
+}
+
+/// Copy both ways between a peer and the engine, reaching the engine from
+/// the peer's alias so it can tell peers apart. Connections closed before
+/// sending anything, such as address races and handshake probes, never
+/// reach the engine.
+async fn splice<S>(mut stream: S, source: Ipv4Addr, engine_port: u16) -> io::Result<()>
+where
+    S: AsyncRead + AsyncWrite + Unpin,
+{
+    let mut head = vec![0u8; 4096];
+    let read = stream.read(&mut head).await?;
+    if read == 0 {
+        return Ok(());
+    }
+    let socket = TcpSocket::new_v4()?;
+    socket.bind(SocketAddr::new(source.into(), 0))?;
+    let engine = SocketAddr::new(Ipv4Addr::LOCALHOST.into(), engine_port);
+    let mut engine = socket.connect(engine).await?;
+    engine.set_nodelay(true)?;
+    engine.write_all(&head[..read]).await?;
+    tls::relay(stream, engine).await
+}
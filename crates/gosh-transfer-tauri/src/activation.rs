@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Systemd socket activation
+//
+// A systemd socket unit holds the port while no receiver runs and starts
+// the app on the first connection, passing the listening sockets as file
+// descriptors from 3 on, announced through LISTEN_PID and LISTEN_FDS. The
+// app then runs without a window, serves those sockets through the
+// acceptors, and exits once idle so the next connection starts it again.
+//
+// The unit's socket holds the port even while no receiver runs, so the
+// app started with a window stops the unit, along with a receiver it
+// started, and starts it again on exit.
+
+use socket2::Socket;
+use std::env;
+use std::net::TcpListener;
+use std::os::fd::{FromRawFd, IntoRawFd, RawFd};
+use std::process::{Command, Stdio};
+
+/// First descriptor systemd passes
+const LISTEN_FDS_START: RawFd = 3;
+
+/// User units of the windowless receiver
+const SOCKET_UNIT: &str = "gosh-transfer-receiver.socket";
+const SERVICE_UNIT: &str = "gosh-transfer-receiver.service";
+
+/// Take the listening sockets systemd passed to this process, if any
+pub fn listen_fds() -> Vec<TcpListener> {
+    let pid = env::var("LISTEN_PID")
+        .ok()
+        .and_then(|pid| pid.parse::<u32>().ok());
+    if pid != Some(std::process::id()) {
+        return Vec::new();
+    }
+    let count = env::var("LISTEN_FDS")
+        .ok()
+        .and_then(|count| count.parse::<RawFd>().ok())
+        .unwrap_or(0);
+    // Processes started from here must not take the sockets for their own
+    env::remove_var("LISTEN_PID");
+    env::remove_var("LISTEN_FDS");
+    env::remove_var("LISTEN_FDNAMES");
+
+    (LISTEN_FDS_START..LISTEN_FDS_START + count)
+        .filter_map(|fd| {
+            // SAFETY: systemd passed these descriptors to this process, and
+            // nothing else here claims them
+            let socket = unsafe { Socket::from_raw_fd(fd) };
+            match socket.is_listener() {
+                Ok(true) => {
+                    let _ = socket.set_cloexec(true);
+                    Some(socket.into())
+                }
+                _ => {
+                    tracing::warn!("Ignoring inherited descriptor {}, not a listener", fd);
+                    // Left open, as it was handed over
+                    let _ = socket.into_raw_fd();
+                    None
+                }
+            }
+        })
+        .collect()
+}
+
+/// Stop the socket unit and a receiver it started, so this process can
+/// bind the port. Waits for a running receiver to drain and exit. Returns
+/// whether the unit was listening.
+pub fn stop_receiver() -> bool {
+    if !systemctl(&["is-active", "--quiet", SOCKET_UNIT]) {
+        return false;
+    }
+    tracing::info!("Stopping {} to take over its port", SOCKET_UNIT);
+    if !systemctl(&["stop", SOCKET_UNIT, SERVICE_UNIT]) {
+        tracing::warn!("Failed to stop {}", SOCKET_UNIT);
+    }
+    true
+}
+
+/// Hand the port back to the socket unit
+pub fn start_receiver() {
+    if !systemctl(&["start", "--no-block", SOCKET_UNIT]) {
+        tracing::warn!("Failed to start {}", SOCKET_UNIT);
+    }
+}
+
+fn systemctl(args: &[&str]) -> bool {
+    Command::new("systemctl")
+        .arg("--user")
+        .args(args)
+        .stdin(Stdio::null())
+        .stdout(Stdio::null())
+        .stderr(Stdio::null())
+        .status()
+        .is_ok_and(|status| status.success())
+}
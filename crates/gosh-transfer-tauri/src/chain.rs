@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Chained replication
+//
+// Starts chains from this device and forwards the files of chains passing
+// through it. Only chains arriving from a trusted host are forwarded, so a
+// peer cannot make this device send data elsewhere on its behalf. Every
+// chain file goes out as an ordinary send: listed, cancellable and journaled.
+
+use crate::sends::{self, SendContext};
+use gosh_lan_transfer::{EngineEvent, PendingTransfer};
+use gosh_transfer_core::filter::staging_root;
+use gosh_transfer_core::{ChainHop, ChainManifest, ChainProgress, ChainStatus};
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use tokio::sync::Semaphore;
+
+/// A chain file being received, with the paths it is written to
+struct Incoming {
+    manifest: PathBuf,
+    files: Vec<PathBuf>,
+    forward: bool,
+}
+
+/// Chains started here or passing through
+pub struct Chains {
+    progress: Arc<ChainProgress>,
+    incoming: HashMap<String, Incoming>,
+    /// Chain files go out one at a time, in arrival order
+    sending: Arc<Semaphore>,
+}
+
+impl Default for Chains {
+    fn default() -> Self {
+        Self {
+            progress: Arc::default(),
+            incoming: HashMap::new(),
+            sending: Arc::new(Semaphore::new(1)),
+        }
+    }
+}
+
+impl Chains {
+    /// Progress of every chain seen here
+    pub fn list(&self) -> Vec<ChainStatus> {
+        self.progress.list()
+    }
+
+    /// Start a chain through `hops`, sending each file as its own transfer
+    /// so the first hop can forward it while the next one arrives
+    pub fn start(
+        &self,
+        ctx: SendContext,
+        hops: Vec<ChainHop>,
+        paths: Vec<PathBuf>,
+    ) -> Result<String, String> {
+        let Some((first, next)) = hops.split_first() else {
+            return Err("A chain needs at least one receiver".to_string());
+        };
+        if let Some(path) = paths.iter().find(|p| !p.is_file()) {
+            return Err(format!(
+                "Chains send regular files only: {}",
+                path.display()
+            ));
+        }
+
+        let chain_id = ctx.sends.next_id();
+        let total = paths.len() as u32;
+        self.progress.start(&chain_id, total, first);
+
+        let (first, next) = (first.clone(), next.to_vec());
+        let progress = self.progress.clone();
+        let sending = self.sending.clone();
+        let id = chain_id.clone();
+        tokio::spawn(async move {
+            for (seq, path) in paths.into_iter().enumerate() {
+                let manifest = ChainManifest {
+                    chain_id: id.clone(),
+                    seq: seq as u32,
+                    total,
+                    hop: 1,
+                    next: next.clone(),
+                };
+                let _permit = sending.acquire().await;
+                Self::send(&ctx, &progress, &first, &manifest, vec![path]).await;
+            }
+        });
+        Ok(chain_id)
+    }
+
+    /// Note a request that carries a chain manifest, with the paths its
+    /// files will have in `download_dir`
+    pub fn on_request(&mut self, transfer: &PendingTransfer, trusted: bool, download_dir: &Path) {
+        let Some(manifest) = transfer
+            .files
+            .iter()
+            .find(|f| ChainManifest::is_manifest(&f.name))
+        else {
+            return;
+        };
+        let manifest = download_dir.join(&manifest.name);
+        let files: Vec<PathBuf> = transfer
+            .files
+            .iter()
+            .map(|f| download_dir.join(&f.name))
+            .filter(|path| *path != manifest)
+            .collect();
+        // A taken name is written under another one, which the manifest
+        // would not lead to
+        let taken = |path: &PathBuf| {
+            path.exists()
+                || self
+                    .incoming
+                    .values()
+                    .any(|i| i.manifest == *path || i.files.contains(path))
+        };
+        if taken(&manifest) {
+            tracing::warn!(
+                "Chain transfer {} ignored, its manifest name is taken",
+                transfer.id
+            );
+            return;
+        }
+
+        let forward = if !trusted {
+            tracing::warn!(
+                "Chain transfer {} from untrusted {} will not be forwarded",
+                transfer.id,
+                transfer.peer_address
+            );
+            false
+        } else if transfer
+            .files
+            .iter()
+            .any(|f| f.is_directory || f.name.contains('/'))
+        {
+            tracing::warn!(
+                "Chain transfer {} carries folders and will not be forwarded",
+                transfer.id
+            );
+            false
+        } else if files.iter().any(taken) {
+            tracing::warn!(
+                "Chain transfer {} would not keep its file names and will not be forwarded",
+                transfer.id
+            );
+            false
+        } else {
+            true
+        };
+        self.incoming.insert(
+            transfer.id.clone(),
+            Incoming {
+                manifest,
+                files,
+                forward,
+            },
+        );
+    }
+
+    /// Forward finished chain files to the next hop. `ctx` is only built
+    /// when there is something to forward.
+    pub fn on_event(&mut self, event: &EngineEvent, ctx: impl FnOnce() -> SendContext) {
+        let (transfer_id, complete) = match event {
+            EngineEvent::TransferComplete { transfer_id } => (transfer_id, true),
+            EngineEvent::TransferFailed { transfer_id, .. } => (transfer_id, false),
+            _ => return,
+        };
+        let Some(incoming) = self.incoming.remove(transfer_id) else {
+            return;
+        };
+
+        let manifest = ChainManifest::read(&incoming.manifest);
+        let _ = std::fs::remove_file(&incoming.manifest);
+        let manifest = match manifest {
+            Ok(manifest) => manifest,
+            Err(e) => {
+                tracing::warn!("Dropping chain transfer {}: {}", transfer_id, e);
+                return;
+            }
+        };
+        if !complete {
+            self.progress.record_failed(&manifest);
+            return;
+        }
+        self.progress.record_received(&manifest);
+
+        let Some((hop, next)) = manifest.forwarded().filter(|_| incoming.forward) else {
+            return;
+        };
+        let ctx = ctx();
+        let progress = self.progress.clone();
+        let sending = self.sending.clone();
+        tokio::spawn(async move {
+            let _permit = sending.acquire().await;
+            Self::send(&ctx, &progress, &hop, &next, incoming.files).await;
+        });
+    }
+
+    /// Send `paths` plus `manifest` to `hop`, recording the outcome
+    async fn send(
+        ctx: &SendContext,
+        progress: &ChainProgress,
+        hop: &ChainHop,
+        manifest: &ChainManifest,
+        paths: Vec<PathBuf>,
+    ) {
+        let id = ctx.sends.next_id();
+        let result = async {
+            let dir = staging_root()
+                .map_err(|e| e.to_string())?
+                .join(format!("chain-{}", manifest.chain_id));
+            let manifest_path = manifest.write(&dir).map_err(|e| e.to_string())?;
+
+            let result = sends::run_chained(
+                ctx,
+                &id,
+                &hop.address,
+                hop.port,
+                paths,
+                manifest_path.clone(),
+            )
+            .await;
+            let _ = std::fs::remove_file(&manifest_path);
+            result
+        }
+        .await;
+
+        match result {
+            Ok(()) => progress.record_forwarded(manifest),
+            Err(e) => {
+                tracing::error!(
+                    "Chain {} file {} to {} failed: {}",
+                    manifest.chain_id,
+                    manifest.seq,
+                    hop.address,
+                    e
+                );
+                progress.record_failed(manifest);
+            }
+        }
+    }
+}
@@ -1,10 +1,18 @@
 // SPDX-License-Identifier: AGPL-3.0
 // Gosh Transfer Tauri - Command Handlers
 
-use crate::engine_bridge::EngineCommand;
+use crate::engine_bridge::{BridgeOptions, EngineCommand, TransferActionResult};
+use crate::instance::LaunchRequest;
+use crate::logging;
+use crate::outbox;
+use crate::quic::TransportCapabilities;
+use crate::sends::SendInfo;
+use crate::snapshot::FrontendSnapshot;
 use crate::state::AppState;
 use gosh_transfer_core::{
-    AppSettings, Favorite, FavoritesPersistence, NetworkInterface, PendingTransfer, TransferRecord,
+    AppSettings, ApprovalSession, ChainHop, ChainStatus, Favorite, FavoriteRoutes,
+    FavoritesPersistence, HistoryEntry, KnownPeer, NetworkInterface, OutboxEntry, PendingTransfer,
+    PullStatus, SelectionSummary, TransferFilter,
 };
 use serde_json::Value;
 use std::path::PathBuf;
@@ -104,43 +112,190 @@ pub async fn get_peer_info(
     result.map_err(|e| e.to_string())
 }
 
-/// Send files to a peer
+/// Send files to a peer, returning the send id for cancelling it
 #[tauri::command]
 pub async fn send_files(
     state: State<'_, Arc<AppState>>,
     address: String,
     port: u16,
     paths: Vec<String>,
-) -> CommandResult<()> {
+) -> CommandResult<String> {
     let tx = state.bridge.command_sender();
     let paths: Vec<PathBuf> = paths.into_iter().map(PathBuf::from).collect();
+    let id = state.bridge.next_send_id();
 
     tx.send(EngineCommand::SendFiles {
+        id: id.clone(),
         address,
         port,
         paths,
     })
     .await
-    .map_err(|e| e.to_string())
+    .map_err(|e| e.to_string())?;
+    Ok(id)
 }
 
-/// Send a directory to a peer
+/// Send a directory to a peer, optionally filtered by include/exclude patterns
 #[tauri::command]
 pub async fn send_directory(
     state: State<'_, Arc<AppState>>,
     address: String,
     port: u16,
     path: String,
-) -> CommandResult<()> {
+    filter: Option<TransferFilter>,
+) -> CommandResult<String> {
     let tx = state.bridge.command_sender();
+    let id = state.bridge.next_send_id();
 
     tx.send(EngineCommand::SendDirectory {
+        id: id.clone(),
         address,
         port,
         path: PathBuf::from(path),
+        filter,
     })
     .await
-    .map_err(|e| e.to_string())
+    .map_err(|e| e.to_string())?;
+    Ok(id)
+}
+
+/// List sends still walking, staging or sending
+#[tauri::command]
+pub async fn list_sends(state: State<'_, Arc<AppState>>) -> CommandResult<Vec<SendInfo>> {
+    Ok(state.bridge.active_sends())
+}
+
+/// Look up favorites by id, in the given order
+fn favorite_hops(
+    state: &AppState,
+    favorite_ids: &[String],
+    port: u16,
+) -> CommandResult<Vec<ChainHop>> {
+    let favorites = state.favorites.list().map_err(|e| e.to_string())?;
+    favorite_ids
+        .iter()
+        .map(|id| {
+            favorites
+                .iter()
+                .find(|f| &f.id == id)
+                .map(|f| ChainHop {
+                    address: f.address.clone(),
+                    port,
+                })
+                .ok_or_else(|| format!("Favorite not found: {}", id))
+        })
+        .collect()
+}
+
+/// Replicate files through favorites in order, each receiver forwarding to the next
+#[tauri::command]
+pub async fn send_chain(
+    state: State<'_, Arc<AppState>>,
+    favorite_ids: Vec<String>,
+    port: u16,
+    paths: Vec<String>,
+) -> CommandResult<String> {
+    let hops = favorite_hops(&state, &favorite_ids, port)?;
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::SendChain {
+        hops,
+        paths: paths.into_iter().map(PathBuf::from).collect(),
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
+}
+
+/// Push one file to several favorites at once over LAN multicast
+#[tauri::command]
+pub async fn send_multicast(
+    state: State<'_, Arc<AppState>>,
+    favorite_ids: Vec<String>,
+    port: u16,
+    path: String,
+) -> CommandResult<String> {
+    let receivers = favorite_hops(&state, &favorite_ids, port)?;
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::SendMulticast {
+        receivers,
+        path: PathBuf::from(path),
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
+}
+
+/// List chains started here or passing through, with per-hop progress
+#[tauri::command]
+pub async fn list_chains(state: State<'_, Arc<AppState>>) -> CommandResult<Vec<ChainStatus>> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::ListChains { reply: reply_tx })
+        .await
+        .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// Offer files for a peer to pull with parallel range requests
+#[tauri::command]
+pub async fn send_offer(
+    state: State<'_, Arc<AppState>>,
+    address: String,
+    port: u16,
+    paths: Vec<String>,
+) -> CommandResult<String> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::SendOffer {
+        address,
+        port,
+        paths: paths.into_iter().map(PathBuf::from).collect(),
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
+}
+
+/// List pulls into this device with their progress
+#[tauri::command]
+pub async fn list_pulls(state: State<'_, Arc<AppState>>) -> CommandResult<Vec<PullStatus>> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::ListPulls { reply: reply_tx })
+        .await
+        .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// Retry a failed pull for the ranges it is still missing
+#[tauri::command]
+pub async fn retry_pull(state: State<'_, Arc<AppState>>, offer_id: String) -> CommandResult<()> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::RetryPull {
+        offer_id,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
 }
 
 /// Accept a transfer request
@@ -167,36 +322,207 @@ pub async fn reject_transfer(
         .map_err(|e| e.to_string())
 }
 
+/// Accept only the files of a transfer request matching the given names or glob patterns
+#[tauri::command]
+pub async fn accept_transfer_selection(
+    state: State<'_, Arc<AppState>>,
+    transfer_id: String,
+    patterns: Vec<String>,
+) -> CommandResult<SelectionSummary> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::AcceptTransferSelection {
+        id: transfer_id,
+        patterns,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
+}
+
 /// Accept all pending transfers
 #[tauri::command]
-pub async fn accept_all(state: State<'_, Arc<AppState>>) -> CommandResult<()> {
+pub async fn accept_all(
+    state: State<'_, Arc<AppState>>,
+) -> CommandResult<Vec<TransferActionResult>> {
     let tx = state.bridge.command_sender();
-    tx.send(EngineCommand::AcceptAllTransfers)
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::AcceptAllTransfers { reply: reply_tx })
         .await
-        .map_err(|e| e.to_string())
+        .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
 }
 
 /// Reject all pending transfers
 #[tauri::command]
-pub async fn reject_all(state: State<'_, Arc<AppState>>) -> CommandResult<()> {
+pub async fn reject_all(
+    state: State<'_, Arc<AppState>>,
+) -> CommandResult<Vec<TransferActionResult>> {
     let tx = state.bridge.command_sender();
-    tx.send(EngineCommand::RejectAllTransfers)
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::RejectAllTransfers { reply: reply_tx })
         .await
-        .map_err(|e| e.to_string())
+        .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// Accept a set of transfer requests, returning the outcome for each id
+#[tauri::command]
+pub async fn accept_transfers(
+    state: State<'_, Arc<AppState>>,
+    transfer_ids: Vec<String>,
+) -> CommandResult<Vec<TransferActionResult>> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::AcceptTransfers {
+        ids: transfer_ids,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// Reject a set of transfer requests, returning the outcome for each id
+#[tauri::command]
+pub async fn reject_transfers(
+    state: State<'_, Arc<AppState>>,
+    transfer_ids: Vec<String>,
+) -> CommandResult<Vec<TransferActionResult>> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::RejectTransfers {
+        ids: transfer_ids,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
 }
 
-/// Cancel an active transfer
+/// Auto-accept requests from a peer for the next `minutes` and/or `transfers`
+#[tauri::command]
+pub async fn start_approval_session(
+    state: State<'_, Arc<AppState>>,
+    peer_address: String,
+    minutes: Option<u32>,
+    transfers: Option<u32>,
+) -> CommandResult<ApprovalSession> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::StartApprovalSession {
+        peer_address,
+        minutes,
+        transfers,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())?
+}
+
+/// List active approval sessions
+#[tauri::command]
+pub async fn list_approval_sessions(
+    state: State<'_, Arc<AppState>>,
+) -> CommandResult<Vec<ApprovalSession>> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::ListApprovalSessions { reply: reply_tx })
+        .await
+        .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// End a peer's approval session
+#[tauri::command]
+pub async fn revoke_approval_session(
+    state: State<'_, Arc<AppState>>,
+    peer_address: String,
+) -> CommandResult<bool> {
+    let tx = state.bridge.command_sender();
+    let (reply_tx, reply_rx) = async_channel::bounded(1);
+
+    tx.send(EngineCommand::RevokeApprovalSession {
+        peer_address,
+        reply: reply_tx,
+    })
+    .await
+    .map_err(|e| e.to_string())?;
+
+    reply_rx.recv().await.map_err(|e| e.to_string())
+}
+
+/// Cancel an active transfer or send
 #[tauri::command]
 pub async fn cancel_transfer(
     state: State<'_, Arc<AppState>>,
     transfer_id: String,
 ) -> CommandResult<()> {
+    // Sends are cancelled in place rather than behind queued commands
+    if state.bridge.cancel_send(&transfer_id) {
+        return Ok(());
+    }
+    state.frontend.forget(&transfer_id);
     let tx = state.bridge.command_sender();
     tx.send(EngineCommand::CancelTransfer { id: transfer_id })
         .await
         .map_err(|e| e.to_string())
 }
 
+/// Cancel a set of active transfers, returning the outcome for each id
+#[tauri::command]
+pub async fn cancel_transfers(
+    state: State<'_, Arc<AppState>>,
+    transfer_ids: Vec<String>,
+) -> CommandResult<Vec<TransferActionResult>> {
+    // Sends are cancelled in place, as in cancel_transfer; only engine
+    // transfers go through the command queue
+    let (sends, transfers): (Vec<_>, Vec<_>) = transfer_ids
+        .iter()
+        .cloned()
+        .partition(|id| state.bridge.cancel_send(id));
+
+    let mut results = Vec::new();
+    if !transfers.is_empty() {
+        let tx = state.bridge.command_sender();
+        let (reply_tx, reply_rx) = async_channel::bounded(1);
+        tx.send(EngineCommand::CancelTransfers {
+            ids: transfers,
+            reply: reply_tx,
+        })
+        .await
+        .map_err(|e| e.to_string())?;
+        results = reply_rx.recv().await.map_err(|e| e.to_string())?;
+        for result in results.iter().filter(|r| r.ok) {
+            state.frontend.forget(&result.id);
+        }
+    }
+    results.extend(sends.into_iter().map(|id| TransferActionResult {
+        id,
+        ok: true,
+        error: None,
+    }));
+    // Reported in the order the ids were given
+    results.sort_by_key(|r| transfer_ids.iter().position(|id| *id == r.id));
+    Ok(results)
+}
+
 /// Get pending transfer requests
 #[tauri::command]
 pub async fn get_pending_transfers(
@@ -239,17 +565,31 @@ pub fn save_settings(
     state: State<'_, Arc<AppState>>,
     settings: AppSettings,
 ) -> CommandResult<bool> {
+    let previous = state.settings.get();
+    let previous_port = previous.port;
+    if settings.log_filter != previous.log_filter {
+        logging::set_filter(&settings.log_filter)?;
+    }
+
     // Update settings store
     state
         .settings
         .update(settings.clone())
         .map_err(|e| e.to_string())?;
 
-    // Update engine config
-    let config = settings.to_engine_config();
+    // Update engine config; a new port is handed over separately
+    let mut config = settings.to_engine_config();
+    config.port = previous_port;
+    let options = BridgeOptions::from_settings(&settings);
     let tx = state.bridge.command_sender();
-    tx.try_send(EngineCommand::UpdateConfig { config })
+    tx.try_send(EngineCommand::UpdateConfig { config, options })
         .map_err(|e| e.to_string())?;
+    if settings.port != previous_port {
+        tx.try_send(EngineCommand::ChangePort {
+            config: settings.to_engine_config(),
+        })
+        .map_err(|e| e.to_string())?;
+    }
 
     Ok(true)
 }
@@ -301,10 +641,50 @@ pub fn touch_favorite(state: State<'_, Arc<AppState>>, id: String) -> CommandRes
     Ok(true)
 }
 
+/// Get the directory-send filter saved for a favorite
+#[tauri::command]
+pub fn get_favorite_filter(state: State<'_, Arc<AppState>>, id: String) -> Option<TransferFilter> {
+    state.favorites.filter(&id)
+}
+
+/// Save or clear the directory-send filter for a favorite
+#[tauri::command]
+pub fn set_favorite_filter(
+    state: State<'_, Arc<AppState>>,
+    id: String,
+    filter: Option<TransferFilter>,
+) -> CommandResult<bool> {
+    state
+        .favorites
+        .set_filter(&id, filter)
+        .map_err(|e| e.to_string())?;
+    Ok(true)
+}
+
+/// Get a favorite's other addresses and how each has fared in races
+#[tauri::command]
+pub fn get_favorite_routes(state: State<'_, Arc<AppState>>, id: String) -> FavoriteRoutes {
+    state.favorites.routes(&id)
+}
+
+/// Set the addresses a favorite is also reachable at; sends race them all
+#[tauri::command]
+pub fn set_favorite_addresses(
+    state: State<'_, Arc<AppState>>,
+    id: String,
+    addresses: Vec<String>,
+) -> CommandResult<bool> {
+    state
+        .favorites
+        .set_addresses(&id, addresses)
+        .map_err(|e| e.to_string())?;
+    Ok(true)
+}
+
 /// List transfer history
 #[tauri::command]
-pub fn list_history(state: State<'_, Arc<AppState>>) -> Vec<TransferRecord> {
-    state.history.list()
+pub fn list_history(state: State<'_, Arc<AppState>>) -> Vec<HistoryEntry> {
+    state.history.list_entries()
 }
 
 /// Clear transfer history
@@ -314,22 +694,99 @@ pub fn clear_history(state: State<'_, Arc<AppState>>) -> CommandResult<bool> {
     Ok(true)
 }
 
-/// Change the server port
+/// Report the crypto and UDP offloads available to the QUIC transport
 #[tauri::command]
-pub async fn change_port(
-    state: State<'_, Arc<AppState>>,
-    port: u16,
-    rollback_on_failure: bool,
-) -> CommandResult<()> {
+pub fn get_transport_capabilities() -> CommandResult<TransportCapabilities> {
+    Ok(crate::quic::capabilities())
+}
+
+/// List peers whose transport identity is pinned
+#[tauri::command]
+pub fn list_known_peers(state: State<'_, Arc<AppState>>) -> CommandResult<Vec<KnownPeer>> {
+    Ok(state.known_peers.list())
+}
+
+/// List sends queued for unreachable peers
+#[tauri::command]
+pub fn list_outbox(state: State<'_, Arc<AppState>>) -> CommandResult<Vec<OutboxEntry>> {
+    Ok(state.outbox.list())
+}
+
+/// Drop a queued send, stopping its delivery if one is running
+#[tauri::command]
+pub fn cancel_queued_send(state: State<'_, Arc<AppState>>, id: String) -> CommandResult<bool> {
+    let removed = state.outbox.remove(&id);
+    let stopped = state.bridge.cancel_send(&outbox::delivery_id(&id));
+    Ok(removed || stopped)
+}
+
+/// Forget a peer's pinned identity, e.g. after it was reinstalled
+#[tauri::command]
+pub fn forget_known_peer(state: State<'_, Arc<AppState>>, address: String) -> CommandResult<bool> {
+    state
+        .known_peers
+        .forget(&address)
+        .map_err(|e| e.to_string())
+}
+
+/// Change the server port. Transfers on the old port finish there.
+#[tauri::command]
+pub async fn change_port(state: State<'_, Arc<AppState>>, port: u16) -> CommandResult<()> {
+    let mut settings = state.settings.get();
+    settings.port = port;
+    state
+        .settings
+        .update(settings.clone())
+        .map_err(|e| e.to_string())?;
+
     let tx = state.bridge.command_sender();
     tx.send(EngineCommand::ChangePort {
-        port,
-        rollback_on_failure,
+        config: settings.to_engine_config(),
     })
     .await
     .map_err(|e| e.to_string())
 }
 
+/// Everything a new window loads on start, so a window reopened from the
+/// tray comes back in one round trip
+#[tauri::command]
+pub async fn get_snapshot(state: State<'_, Arc<AppState>>) -> CommandResult<FrontendSnapshot> {
+    let pending_transfers = get_pending_transfers(state.clone()).await?;
+    let interfaces = get_interfaces(state.clone()).await?;
+    Ok(FrontendSnapshot {
+        settings: state.settings.get(),
+        favorites: state.favorites.list().map_err(|e| e.to_string())?,
+        history: state.history.list_entries(),
+        interfaces,
+        pending_transfers,
+        active_transfers: state.frontend.active(),
+        server_port: state.frontend.server_port(),
+        page: state.frontend.page(),
+    })
+}
+
+/// Remember the page shown, for the next window
+#[tauri::command]
+pub fn set_current_page(state: State<'_, Arc<AppState>>, page: String) {
+    state.frontend.set_page(page);
+}
+
+/// Paths and favorite passed on the command line, once
+#[tauri::command]
+pub fn take_launch_request(state: State<'_, Arc<AppState>>) -> Option<LaunchRequest> {
+    state.frontend.take_launch()
+}
+
+/// Change log levels per module while running, such as
+/// `gosh_transfer_tauri::acceptors=debug`, and keep them for the next start
+#[tauri::command]
+pub fn set_log_filter(state: State<'_, Arc<AppState>>, directives: String) -> CommandResult<()> {
+    logging::set_filter(&directives)?;
+    let mut settings = state.settings.get();
+    settings.log_filter = directives;
+    state.settings.update(settings).map_err(|e| e.to_string())
+}
+
 /// Get application version
 #[tauri::command]
 pub fn get_version() -> String {
@@ -3,35 +3,273 @@
 //
 // Bridges the async GoshTransferEngine with the Tauri frontend.
 
+use crate::acceptors::{self, Acceptors};
+use crate::chain::Chains;
+use crate::handover::{RetiredTransport, Retiring};
+use crate::multicast::Multicasts;
+use crate::outbox;
+use crate::pull::Pulls;
+use crate::quic::QuicTransport;
+use crate::race;
+use crate::sends::{ActiveSends, SendContext, SendInfo};
+use crate::tls::TlsTransport;
 use async_channel::{Receiver, Sender};
 use gosh_lan_transfer::{
     EngineConfig, EngineEvent, GoshTransferEngine, NetworkInterface, PendingTransfer, ResolveResult,
 };
-use gosh_transfer_core::TransferHistory;
+use gosh_transfer_core::filter::{self, Walked};
+use gosh_transfer_core::{
+    AppSettings, ApprovalSession, ApprovalSessions, CancelToken, ChainHop, ChainStatus,
+    FileFavoritesStore, FileSelection, InFlightJournal, KnownPeers, Outbox, PathFilter, PathList,
+    PeerAliases, PullStatus, QueuedSource, SelectionSummary, TransferFilter, TransferHistory,
+    TransportMode,
+};
+use serde::Serialize;
 use serde_json::Value;
+use std::collections::{HashMap, HashSet};
+use std::future::Future;
 use std::path::PathBuf;
 use std::sync::Arc;
+use std::task::Poll;
+use std::time::Duration;
 use tokio::runtime::Runtime;
-use tokio::sync::Mutex;
+use tokio::sync::broadcast::{self, error::RecvError};
+use tokio::sync::{RwLock, Semaphore};
+use tokio::task::JoinSet;
+
+/// Maximum number of per-transfer operations a batched command runs at once
+const MAX_PARALLEL_BATCH_OPS: usize = 8;
+/// Multicast has no congestion control; without a bandwidth limit it is
+/// paced to a rate most wired LANs carry without loss
+const DEFAULT_MULTICAST_RATE_BPS: u64 = 40 * 1024 * 1024;
+/// How often the outbox is checked for queued sends due for a probe
+const OUTBOX_TICK: Duration = Duration::from_secs(5);
+/// Extra wait for the shutdown reply, for a bridge busy in a long send
+const SHUTDOWN_GRACE: Duration = Duration::from_secs(2);
+/// How long a socket-activated receiver waits for an answer to a request
+/// before rejecting it, so an unanswered one does not keep it running
+const UNANSWERED_TIMEOUT: Duration = Duration::from_secs(5 * 60);
+
+/// Bridge-side behaviour derived from `AppSettings` that the engine config does not carry
+#[derive(Debug, Clone)]
+pub struct BridgeOptions {
+    /// Sends of regular files up to this many bytes skip the queue of large sends (0 disables)
+    pub skip_queue_max_bytes: u64,
+    /// Transport used to reach peers
+    pub transport: TransportMode,
+    /// Auto-accepted peers; the engine cannot see these behind a relay
+    pub trusted_hosts: Vec<String>,
+    /// Join multicast sessions announced by peers
+    pub multicast_enabled: bool,
+    /// Pacing of multicast sends, in bytes per second
+    pub multicast_rate_bps: u64,
+    /// Pacing of pulls into this device, in bytes per second
+    pub pull_rate_bps: Option<u64>,
+    /// Started by systemd with inherited listeners, read at startup
+    pub socket_activated: bool,
+    /// Exit after this long without connections or transfers, when socket activated
+    pub idle_exit: Option<Duration>,
+}
+
+impl BridgeOptions {
+    pub fn from_settings(settings: &AppSettings) -> Self {
+        Self {
+            skip_queue_max_bytes: settings.skip_queue_max_bytes,
+            transport: settings.transport,
+            trusted_hosts: settings.trusted_hosts.clone(),
+            multicast_enabled: settings.multicast_enabled,
+            multicast_rate_bps: settings
+                .bandwidth_limit_bps
+                .unwrap_or(DEFAULT_MULTICAST_RATE_BPS),
+            pull_rate_bps: settings.bandwidth_limit_bps,
+            socket_activated: false,
+            idle_exit: (settings.idle_exit_minutes > 0)
+                .then(|| Duration::from_secs(u64::from(settings.idle_exit_minutes) * 60)),
+        }
+    }
+}
+
+/// What a task outside the command loop needs to send to a peer
+#[derive(Clone)]
+pub struct SendRoute {
+    pub engine: Arc<RwLock<GoshTransferEngine>>,
+    pub quic: Option<Arc<QuicTransport>>,
+    pub tls: Option<Arc<TlsTransport>>,
+    pub transport: TransportMode,
+    /// Favorites reachable at several addresses are raced
+    pub favorites: Arc<FileFavoritesStore>,
+}
+
+impl SendRoute {
+    /// The address to reach a peer at. For a favorite with several
+    /// addresses, connections to all of them are raced and the winner is
+    /// recorded. A race connection sends nothing, so it never reaches a
+    /// peer's engine, in encrypted mode or not.
+    async fn pick(&self, address: &str, port: u16) -> String {
+        let Some((id, candidates)) = self.favorites.candidates(address) else {
+            return address.to_string();
+        };
+        let (winner, failed) = race::race(&candidates, port).await;
+        let outcome = winner.as_ref().map(|w| (w.address.as_str(), w.ip, w.rtt));
+        if let Err(e) = self.favorites.record_race(&id, outcome, &failed) {
+            tracing::warn!("Failed to record route of {}: {}", id, e);
+        }
+        match winner {
+            Some(winner) => {
+                tracing::info!(
+                    "Reaching {} at {} ({:?}), {} address(es) failed",
+                    address,
+                    winner.address,
+                    winner.rtt,
+                    failed.len()
+                );
+                winner.address
+            }
+            None => address.to_string(),
+        }
+    }
+
+    /// Send `paths` to a peer over the configured transport
+    pub async fn send_files(
+        &self,
+        address: &str,
+        port: u16,
+        paths: Vec<PathBuf>,
+    ) -> Result<(), String> {
+        let (address, port) = EngineBridge::route(
+            self.quic.as_deref(),
+            self.tls.as_deref(),
+            self.transport,
+            self.pick(address, port).await,
+            port,
+        )
+        .await?;
+        let eng = self.engine.read().await;
+        eng.send_files(&address, port, paths)
+            .await
+            .map_err(|e| e.to_string())
+    }
+
+    /// Send a directory to a peer over the configured transport
+    pub async fn send_directory(
+        &self,
+        address: &str,
+        port: u16,
+        path: PathBuf,
+    ) -> Result<(), String> {
+        let (address, port) = EngineBridge::route(
+            self.quic.as_deref(),
+            self.tls.as_deref(),
+            self.transport,
+            self.pick(address, port).await,
+            port,
+        )
+        .await?;
+        let eng = self.engine.read().await;
+        eng.send_directory(&address, port, path)
+            .await
+            .map_err(|e| e.to_string())
+    }
+
+    /// Check whether a peer's server answers, at any of its addresses
+    pub async fn check_peer(&self, address: &str, port: u16) -> bool {
+        let address = self.pick(address, port).await;
+        let Ok((address, port)) =
+            EngineBridge::route(None, self.tls.as_deref(), self.transport, address, port).await
+        else {
+            return false;
+        };
+        let eng = self.engine.read().await;
+        eng.check_peer(&address, port).await.unwrap_or(false)
+    }
+}
+
+/// Control operation applied to each id of a batched command
+#[derive(Debug, Clone, Copy)]
+pub enum TransferAction {
+    Accept,
+    Reject,
+    Cancel,
+}
+
+/// Outcome of a control operation for a single transfer
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct TransferActionResult {
+    pub id: String,
+    pub ok: bool,
+    pub error: Option<String>,
+}
+
+impl TransferActionResult {
+    fn from_result<E: std::fmt::Display>(id: String, result: Result<(), E>) -> Self {
+        match result {
+            Ok(()) => Self {
+                id,
+                ok: true,
+                error: None,
+            },
+            Err(e) => Self {
+                id,
+                ok: false,
+                error: Some(e.to_string()),
+            },
+        }
+    }
+}
 
 /// Commands that can be sent to the engine
 #[derive(Debug)]
 pub enum EngineCommand {
     StartServer,
+    /// Start the server behind listening sockets inherited from systemd
+    StartActivated {
+        listeners: Vec<std::net::TcpListener>,
+    },
     StopServer,
     ResolveAddress {
         address: String,
         reply: Sender<ResolveResult>,
     },
     SendFiles {
+        /// Assigned by `EngineBridge::next_send_id`, for cancelling the send
+        id: String,
         address: String,
         port: u16,
         paths: Vec<PathBuf>,
     },
     SendDirectory {
+        id: String,
         address: String,
         port: u16,
         path: PathBuf,
+        filter: Option<TransferFilter>,
+    },
+    SendChain {
+        hops: Vec<ChainHop>,
+        paths: Vec<PathBuf>,
+        reply: Sender<Result<String, String>>,
+    },
+    ListChains {
+        reply: Sender<Vec<ChainStatus>>,
+    },
+    SendMulticast {
+        receivers: Vec<ChainHop>,
+        path: PathBuf,
+        reply: Sender<Result<String, String>>,
+    },
+    SendOffer {
+        address: String,
+        port: u16,
+        paths: Vec<PathBuf>,
+        reply: Sender<Result<String, String>>,
+    },
+    ListPulls {
+        reply: Sender<Vec<PullStatus>>,
+    },
+    RetryPull {
+        offer_id: String,
+        reply: Sender<Result<(), String>>,
     },
     AcceptTransfer {
         id: String,
@@ -39,11 +277,45 @@ pub enum EngineCommand {
     RejectTransfer {
         id: String,
     },
-    AcceptAllTransfers,
-    RejectAllTransfers,
+    AcceptTransferSelection {
+        id: String,
+        patterns: Vec<String>,
+        reply: Sender<Result<SelectionSummary, String>>,
+    },
+    AcceptAllTransfers {
+        reply: Sender<Vec<TransferActionResult>>,
+    },
+    RejectAllTransfers {
+        reply: Sender<Vec<TransferActionResult>>,
+    },
     CancelTransfer {
         id: String,
     },
+    AcceptTransfers {
+        ids: Vec<String>,
+        reply: Sender<Vec<TransferActionResult>>,
+    },
+    RejectTransfers {
+        ids: Vec<String>,
+        reply: Sender<Vec<TransferActionResult>>,
+    },
+    CancelTransfers {
+        ids: Vec<String>,
+        reply: Sender<Vec<TransferActionResult>>,
+    },
+    StartApprovalSession {
+        peer_address: String,
+        minutes: Option<u32>,
+        transfers: Option<u32>,
+        reply: Sender<Result<ApprovalSession, String>>,
+    },
+    ListApprovalSessions {
+        reply: Sender<Vec<ApprovalSession>>,
+    },
+    RevokeApprovalSession {
+        peer_address: String,
+        reply: Sender<bool>,
+    },
     CheckPeer {
         address: String,
         port: u16,
@@ -62,22 +334,48 @@ pub enum EngineCommand {
     },
     UpdateConfig {
         config: EngineConfig,
+        options: BridgeOptions,
     },
+    /// Move the server to `config.port`, keeping the old port open for the
+    /// transfers already on it
     ChangePort {
-        port: u16,
-        rollback_on_failure: bool,
+        config: EngineConfig,
+    },
+    /// Stop taking new transfers and reply once running ones have finished
+    /// or `deadline` has passed
+    Shutdown {
+        deadline: Duration,
+        reply: Sender<()>,
     },
 }
 
+/// An engine replaced by a port change, with its events and held transfers
+type RetiredEngine = (
+    Arc<RwLock<GoshTransferEngine>>,
+    broadcast::Receiver<EngineEvent>,
+    Vec<String>,
+);
+
 /// Bridge between Tauri frontend and async engine
 pub struct EngineBridge {
     command_tx: Sender<EngineCommand>,
     event_rx: Receiver<EngineEvent>,
-    _runtime: Arc<Runtime>,
+    runtime: Arc<Runtime>,
+    /// Shared with the command loop so cancels do not queue behind commands
+    sends: Arc<ActiveSends>,
 }
 
 impl EngineBridge {
-    pub fn new(config: EngineConfig, history: Option<Arc<TransferHistory>>) -> Self {
+    pub fn new(
+        config: EngineConfig,
+        options: BridgeOptions,
+        history: Option<Arc<TransferHistory>>,
+        aliases: Arc<PeerAliases>,
+        known_peers: Arc<KnownPeers>,
+        outbox: Arc<Outbox>,
+        journal: Arc<InFlightJournal>,
+        favorites: Arc<FileFavoritesStore>,
+    ) -> Self {
         let (command_tx, command_rx) = async_channel::bounded::<EngineCommand>(32);
         let (event_tx, event_rx) = async_channel::bounded::<EngineEvent>(64);
 
@@ -89,133 +387,615 @@ impl EngineBridge {
                 .expect("Failed to create Tokio runtime"),
         );
 
+        let sends = Arc::new(ActiveSends::default());
         let rt = runtime.clone();
+        let loop_sends = sends.clone();
         runtime.spawn(async move {
-            Self::run_engine(config, command_rx, event_tx, history).await;
+            Self::run_engine(
+                config,
+                options,
+                command_rx,
+                event_tx,
+                history,
+                aliases,
+                known_peers,
+                outbox,
+                journal,
+                favorites,
+                loop_sends,
+            )
+            .await;
         });
 
         Self {
             command_tx,
             event_rx,
-            _runtime: rt,
+            runtime: rt,
+            sends,
         }
     }
 
     async fn run_engine(
-        config: EngineConfig,
+        mut config: EngineConfig,
+        mut options: BridgeOptions,
         command_rx: Receiver<EngineCommand>,
         event_tx: Sender<EngineEvent>,
         history: Option<Arc<TransferHistory>>,
+        aliases: Arc<PeerAliases>,
+        known_peers: Arc<KnownPeers>,
+        outbox: Arc<Outbox>,
+        journal: Arc<InFlightJournal>,
+        favorites: Arc<FileFavoritesStore>,
+        active_sends: Arc<ActiveSends>,
     ) {
-        let (engine, mut engine_events) = if let Some(history) = history {
-            GoshTransferEngine::with_channel_events_and_history(config, history)
-        } else {
-            GoshTransferEngine::with_channel_events(config)
+        let mut download_dir = config.download_dir.clone();
+        let mut port = config.port;
+        // Behind inherited sockets, or in encrypted mode behind the TLS
+        // acceptors, the engine listens on an unannounced port of its own.
+        // It still binds every interface; requests that reach it there
+        // directly are refused in encrypted mode, as they are not relayed.
+        let accepting = options.socket_activated;
+        let loopback_port = acceptors::engine_port()
+            .map_err(|e| tracing::error!("No loopback port for the engine: {}", e))
+            .ok();
+        let fronted = |transport: TransportMode| {
+            loopback_port.is_some() && (accepting || transport == TransportMode::Encrypted)
+        };
+        let engine_port = |port: u16, transport: TransportMode| match loopback_port {
+            Some(loopback) if fronted(transport) => loopback,
+            _ => port,
+        };
+        config.port = engine_port(port, options.transport);
+        // Port the engine's server is bound to, or binds on its next start
+        let mut listening = config.port;
+        let mut acceptors: Option<Acceptors> = None;
+        // Acceptors to start once no retired engine holds the port
+        let mut acceptors_due = false;
+        // TLS identity and relays, present in encrypted mode
+        let mut tls = Self::start_tls(&options, &aliases, &known_peers);
+        // A socket-activated receiver exits when idle; systemd starts it again
+        let idle_exit = options.idle_exit.filter(|_| options.socket_activated);
+        let mut idle_since = tokio::time::Instant::now();
+        // Requests waiting on an answer while idle exit is on, by arrival
+        let mut unanswered: HashMap<String, tokio::time::Instant> = HashMap::new();
+        let (engine, mut engine_events) = Self::create_engine(config, &history);
+        let mut engine = Arc::new(RwLock::new(engine));
+        let mut serving = false;
+        // Listeners of previous ports while their transfers finish
+        let mut retiring: Vec<Retiring> = Vec::new();
+        // Transfers that arrived on the live engine and have not ended
+        let mut arrived: HashSet<String> = HashSet::new();
+        // Peers whose requests are accepted without asking, for a while
+        let mut approvals = ApprovalSessions::default();
+        // QUIC endpoints, present while the server runs with the QUIC transport
+        let mut quic: Option<Arc<QuicTransport>> = None;
+        // Endpoints of earlier ports, kept for the streams they relay
+        let mut retired_quic: Vec<RetiredTransport> = Vec::new();
+        // Chained replication started here or passing through
+        let mut chains = Chains::default();
+        // Multicast sessions announced to this device
+        let mut multicasts = Multicasts::default();
+        // Offers published here and pulls into this device
+        let mut pulls = Pulls::new();
+        // Large sends go out one at a time; small ones skip the line
+        let large_sends = Arc::new(Semaphore::new(1));
+        let send_context = |engine: &Arc<RwLock<GoshTransferEngine>>,
+                            quic: &Option<Arc<QuicTransport>>,
+                            tls: &Option<Arc<TlsTransport>>,
+                            options: &BridgeOptions| SendContext {
+            route: Self::send_route(engine, quic, tls, options, &favorites),
+            outbox: outbox.clone(),
+            journal: journal.clone(),
+            sends: active_sends.clone(),
+            large_sends: large_sends.clone(),
+            skip_queue_max_bytes: options.skip_queue_max_bytes,
         };
-        let engine = Arc::new(Mutex::new(engine));
+
+        // Queued sends are probed on each tick; the outbox spaces out the probes
+        let mut outbox_timer = tokio::time::interval(OUTBOX_TICK);
+        // Deadline and reply of a shutdown in progress
+        let mut draining: Option<(tokio::time::Instant, Sender<()>)> = None;
+
+        // Staged trees from filtered sends interrupted by a previous exit
+        let _ = tokio::task::spawn_blocking(filter::clear_staging).await;
+
+        // Sends cut off by the last exit are offered again through the outbox;
+        // receives are up to their senders
+        let (sends, receives) = journal.take_interrupted();
+        for send in sends {
+            tracing::info!(
+                "Offering again a send to {} cut off by the last exit",
+                send.address
+            );
+            let error = "Interrupted by the last exit".to_string();
+            outbox.enqueue(
+                send.address,
+                send.port,
+                send.source,
+                error,
+                chrono::Utc::now(),
+            );
+        }
+        for receive in receives {
+            tracing::warn!(
+                "Receive {} from {} was cut off by the last exit at {} of {} bytes",
+                receive.transfer_id,
+                receive.peer_address,
+                receive.bytes_transferred,
+                receive.total_bytes
+            );
+        }
 
         loop {
+            if draining.is_some() && journal.in_flight() == 0 {
+                tracing::info!("All transfers finished, shutting down");
+                break;
+            }
+            if retiring.iter().any(Retiring::is_done) {
+                let (done, left) = std::mem::take(&mut retiring)
+                    .into_iter()
+                    .partition(Retiring::is_done);
+                retiring = left;
+                for retired in done {
+                    retired.close().await;
+                }
+            }
+            retired_quic.retain(|r| !r.is_done());
+            if acceptors_due && !retiring.iter().any(|r| r.port() == port) {
+                acceptors_due = false;
+                if let Some(loopback) = loopback_port {
+                    acceptors = Acceptors::start(port, loopback, aliases.clone())
+                        .await
+                        .map_err(|e| tracing::error!("{}", e))
+                        .ok();
+                    if let Some(acceptors) = &acceptors {
+                        acceptors.set_tls(tls.clone());
+                    }
+                }
+            }
+            let drain_deadline = draining
+                .as_ref()
+                .map_or_else(tokio::time::Instant::now, |(deadline, _)| *deadline);
+            let retire_deadline = retiring
+                .iter()
+                .map(Retiring::deadline)
+                .min()
+                .unwrap_or_else(tokio::time::Instant::now);
+
             tokio::select! {
                 cmd = command_rx.recv() => {
                     match cmd {
+                        // A window opened again from the tray starts it again
+                        Ok(EngineCommand::StartServer) if serving => {}
                         Ok(EngineCommand::StartServer) => {
-                            let mut eng = engine.lock().await;
+                            let mut eng = engine.write().await;
+                            match eng.start_server().await {
+                                Ok(()) => {
+                                    serving = true;
+                                    acceptors_due = fronted(options.transport);
+                                    quic = Self::start_transport(&options, port, listening, &aliases, &known_peers)
+                                }
+                                Err(e) => tracing::error!("Failed to start server: {}", e),
+                            }
+                        }
+                        Ok(EngineCommand::StartActivated { listeners }) => {
+                            let Some(loopback) = loopback_port else {
+                                tracing::error!("No loopback port for the engine, cannot serve inherited sockets");
+                                continue;
+                            };
+                            let mut eng = engine.write().await;
                             if let Err(e) = eng.start_server().await {
                                 tracing::error!("Failed to start server: {}", e);
+                                continue;
+                            }
+                            serving = true;
+                            match Acceptors::adopt(listeners, loopback, aliases.clone()) {
+                                Ok(adopted) => {
+                                    port = adopted.port();
+                                    adopted.set_tls(tls.clone());
+                                    acceptors = Some(adopted);
+                                }
+                                Err(e) => tracing::error!("{}", e),
                             }
+                            quic = Self::start_transport(&options, port, loopback, &aliases, &known_peers);
                         }
                         Ok(EngineCommand::StopServer) => {
-                            let mut eng = engine.lock().await;
+                            quic = None;
+                            retired_quic.clear();
+                            acceptors = None;
+                            acceptors_due = false;
+                            serving = false;
+                            for retired in retiring.drain(..) {
+                                retired.close().await;
+                            }
+                            let mut eng = engine.write().await;
                             let _ = eng.stop_server().await;
                         }
                         Ok(EngineCommand::ResolveAddress { address, reply }) => {
                             let result = GoshTransferEngine::resolve_address(&address);
                             let _ = reply.send(result).await;
                         }
-                        Ok(EngineCommand::SendFiles { address, port, paths }) => {
-                            let eng = engine.lock().await;
-                            if let Err(e) = eng.send_files(&address, port, paths).await {
-                                tracing::error!("Send failed: {}", e);
+                        Ok(EngineCommand::SendFiles { id, address, port, paths }) => {
+                            let source = QueuedSource::Files { paths };
+                            tokio::spawn(crate::sends::run(send_context(&engine, &quic, &tls, &options), id, address, port, source));
+                        }
+                        Ok(EngineCommand::SendDirectory { id, address, port, path, filter }) => {
+                            let source = if path.is_file() {
+                                // A single file picked for a "directory" send goes through the file path
+                                QueuedSource::Files { paths: vec![path] }
+                            } else {
+                                QueuedSource::Directory { path, filter, files: PathList::new(), stamps: Vec::new() }
+                            };
+                            tokio::spawn(crate::sends::run(send_context(&engine, &quic, &tls, &options), id, address, port, source));
+                        }
+                        Ok(EngineCommand::SendChain { hops, paths, reply }) => {
+                            let ctx = send_context(&engine, &quic, &tls, &options);
+                            let result = Self::resolve_hops(hops).and_then(|hops| chains.start(ctx, hops, paths));
+                            if let Err(e) = &result {
+                                tracing::error!("Chain send failed: {}", e);
                             }
+                            let _ = reply.send(result).await;
                         }
-                        Ok(EngineCommand::SendDirectory { address, port, path }) => {
-                            let eng = engine.lock().await;
-                            if let Err(e) = eng.send_directory(&address, port, path).await {
-                                tracing::error!("Send directory failed: {}", e);
+                        Ok(EngineCommand::ListChains { reply }) => {
+                            let _ = reply.send(chains.list()).await;
+                        }
+                        Ok(EngineCommand::SendMulticast { receivers, path, reply }) => {
+                            let result = if options.transport == TransportMode::Encrypted {
+                                Err("Multicast is unencrypted and disabled in encrypted mode".to_string())
+                            } else {
+                                let route = Self::send_route(&engine, &quic, &tls, &options, &favorites);
+                                let rate = options.multicast_rate_bps;
+                                Self::resolve_hops(receivers)
+                                    .and_then(|receivers| multicasts.start(route, receivers, path, rate))
+                            };
+                            if let Err(e) = &result {
+                                tracing::error!("Multicast send failed: {}", e);
                             }
+                            let _ = reply.send(result).await;
+                        }
+                        Ok(EngineCommand::SendOffer { address, port, paths, reply }) => {
+                            let result = if options.transport == TransportMode::Encrypted {
+                                Err("Pulls are unencrypted and disabled in encrypted mode".to_string())
+                            } else {
+                                let route = Self::send_route(&engine, &quic, &tls, &options, &favorites);
+                                match Self::resolve_hops(vec![ChainHop { address, port }]) {
+                                    Ok(mut hops) => {
+                                        let hop = hops.remove(0);
+                                        pulls.offer(route, hop.address, hop.port, paths).await
+                                    }
+                                    Err(e) => Err(e),
+                                }
+                            };
+                            if let Err(e) = &result {
+                                tracing::error!("Pull offer failed: {}", e);
+                            }
+                            let _ = reply.send(result).await;
+                        }
+                        Ok(EngineCommand::ListPulls { reply }) => {
+                            let _ = reply.send(pulls.list()).await;
+                        }
+                        Ok(EngineCommand::RetryPull { offer_id, reply }) => {
+                            let _ = reply.send(pulls.retry(&offer_id, options.pull_rate_bps)).await;
                         }
                         Ok(EngineCommand::AcceptTransfer { id }) => {
-                            let eng = engine.lock().await;
+                            let engine = Self::engine_for(&engine, &retiring, &id);
+                            let eng = engine.read().await;
                             if let Err(e) = eng.accept_transfer(&id).await {
                                 tracing::error!("Accept failed: {}", e);
                             }
                         }
                         Ok(EngineCommand::RejectTransfer { id }) => {
-                            let eng = engine.lock().await;
+                            let engine = Self::engine_for(&engine, &retiring, &id);
+                            Self::forget(&mut retiring, &mut arrived, &id);
+                            let eng = engine.read().await;
                             if let Err(e) = eng.reject_transfer(&id).await {
                                 tracing::error!("Reject failed: {}", e);
                             }
                         }
-                        Ok(EngineCommand::AcceptAllTransfers) => {
-                            let eng = engine.lock().await;
-                            let results = eng.accept_all_transfers().await;
-                            for (id, result) in results {
-                                if let Err(e) = result {
-                                    tracing::error!("Accept {} failed: {}", id, e);
-                                }
+                        Ok(EngineCommand::AcceptTransferSelection { id, patterns, reply }) => {
+                            let engine = Self::engine_for(&engine, &retiring, &id);
+                            let eng = engine.read().await;
+                            let result = Self::accept_selection(
+                                &eng,
+                                &id,
+                                &patterns,
+                                history.as_deref(),
+                            )
+                            .await;
+                            if let Err(e) = &result {
+                                tracing::error!("Selective accept failed: {}", e);
                             }
+                            let _ = reply.send(result).await;
                         }
-                        Ok(EngineCommand::RejectAllTransfers) => {
-                            let eng = engine.lock().await;
-                            let results = eng.reject_all_transfers().await;
-                            for (id, result) in results {
-                                if let Err(e) = result {
-                                    tracing::error!("Reject {} failed: {}", id, e);
-                                }
-                            }
+                        Ok(EngineCommand::AcceptAllTransfers { reply }) => {
+                            // Requests still held by a retired port are accepted there
+                            let ids = Self::pending_ids(&engine, &retiring).await;
+                            let targets = Self::batch_targets(&engine, &mut retiring, &mut arrived, TransferAction::Accept, ids);
+                            Self::spawn_batch(targets, TransferAction::Accept, reply);
+                        }
+                        Ok(EngineCommand::RejectAllTransfers { reply }) => {
+                            let ids = Self::pending_ids(&engine, &retiring).await;
+                            let targets = Self::batch_targets(&engine, &mut retiring, &mut arrived, TransferAction::Reject, ids);
+                            Self::spawn_batch(targets, TransferAction::Reject, reply);
                         }
                         Ok(EngineCommand::CancelTransfer { id }) => {
-                            let eng = engine.lock().await;
-                            if let Err(e) = eng.cancel_transfer(&id).await {
-                                tracing::error!("Cancel failed: {}", e);
-                            }
+                            // Off the loop, so a slow engine cancel holds up nothing else
+                            let engine = Self::engine_for(&engine, &retiring, &id);
+                            Self::forget(&mut retiring, &mut arrived, &id);
+                            tokio::spawn(async move {
+                                if let Err(e) = engine.read().await.cancel_transfer(&id).await {
+                                    tracing::error!("Cancel failed: {}", e);
+                                }
+                            });
+                        }
+                        Ok(EngineCommand::AcceptTransfers { ids, reply }) => {
+                            let targets = Self::batch_targets(&engine, &mut retiring, &mut arrived, TransferAction::Accept, ids);
+                            Self::spawn_batch(targets, TransferAction::Accept, reply);
+                        }
+                        Ok(EngineCommand::RejectTransfers { ids, reply }) => {
+                            let targets = Self::batch_targets(&engine, &mut retiring, &mut arrived, TransferAction::Reject, ids);
+                            Self::spawn_batch(targets, TransferAction::Reject, reply);
+                        }
+                        Ok(EngineCommand::CancelTransfers { ids, reply }) => {
+                            let targets = Self::batch_targets(&engine, &mut retiring, &mut arrived, TransferAction::Cancel, ids);
+                            Self::spawn_batch(targets, TransferAction::Cancel, reply);
+                        }
+                        Ok(EngineCommand::StartApprovalSession { peer_address, minutes, transfers, reply }) => {
+                            let result = approvals
+                                .start(&peer_address, minutes, transfers, chrono::Utc::now())
+                                .map_err(|e| e.to_string());
+                            let _ = reply.send(result).await;
+                        }
+                        Ok(EngineCommand::ListApprovalSessions { reply }) => {
+                            let _ = reply.send(approvals.list(chrono::Utc::now())).await;
+                        }
+                        Ok(EngineCommand::RevokeApprovalSession { peer_address, reply }) => {
+                            let _ = reply.send(approvals.revoke(&peer_address)).await;
                         }
                         Ok(EngineCommand::CheckPeer { address, port, reply }) => {
-                            let eng = engine.lock().await;
-                            let reachable = eng.check_peer(&address, port).await.unwrap_or(false);
+                            let reachable = match Self::route(None, tls.as_deref(), options.transport, address, port).await {
+                                Ok((address, port)) => engine.read().await.check_peer(&address, port).await.unwrap_or(false),
+                                Err(_) => false,
+                            };
                             let _ = reply.send(reachable).await;
                         }
                         Ok(EngineCommand::GetPeerInfo { address, port, reply }) => {
-                            let eng = engine.lock().await;
-                            let result = eng.get_peer_info(&address, port).await.map_err(|e| e.to_string());
+                            let result = match Self::route(None, tls.as_deref(), options.transport, address, port).await {
+                                Ok((address, port)) => {
+                                    engine.read().await.get_peer_info(&address, port).await.map_err(|e| e.to_string())
+                                }
+                                Err(e) => Err(e),
+                            };
                             let _ = reply.send(result).await;
                         }
                         Ok(EngineCommand::GetPendingTransfers { reply }) => {
-                            let eng = engine.lock().await;
-                            let pending = eng.get_pending_transfers().await;
+                            let eng = engine.read().await;
+                            let mut pending = eng.get_pending_transfers().await;
+                            for retired in &retiring {
+                                pending.extend(retired.engine().read().await.get_pending_transfers().await);
+                            }
+                            for transfer in &mut pending {
+                                aliases.restore(&mut transfer.peer_address);
+                            }
                             let _ = reply.send(pending).await;
                         }
                         Ok(EngineCommand::GetInterfaces { reply }) => {
                             let interfaces = GoshTransferEngine::get_network_interfaces();
                             let _ = reply.send(interfaces).await;
                         }
-                        Ok(EngineCommand::UpdateConfig { config }) => {
-                            let mut eng = engine.lock().await;
-                            eng.update_config(config).await;
+                        Ok(EngineCommand::UpdateConfig { mut config, options: new_options }) => {
+                            download_dir = config.download_dir.clone();
+                            port = config.port;
+                            config.port = engine_port(port, new_options.transport);
+                            let encrypted = |options: &BridgeOptions| options.transport == TransportMode::Encrypted;
+                            if encrypted(&options) != encrypted(&new_options) {
+                                tls = Self::start_tls(&new_options, &aliases, &known_peers);
+                            }
+                            options = new_options;
+                            if let Some(acceptors) = &acceptors {
+                                // Plain connections must not pass as relayed ones
+                                acceptors.set_tls(tls.clone());
+                            }
+                            if serving && config.port != listening {
+                                // Into or out of encrypted mode, the engine moves between
+                                // the transfer port and one behind the acceptors
+                                if !fronted(options.transport) {
+                                    // The acceptors give the transfer port back to the engine
+                                    if let Some(acceptors) = acceptors.take() {
+                                        acceptors.close().await;
+                                    }
+                                }
+                                let next_port = config.port;
+                                match Self::hand_over(config, &history, &mut engine, &mut engine_events, &mut arrived).await {
+                                    Ok((old_engine, old_events, held)) => {
+                                        retiring.push(Retiring::new(old_engine, old_events, listening, held));
+                                        listening = next_port;
+                                        // Into encrypted mode, the acceptors wait for the old engine
+                                        // to release the transfer port
+                                        acceptors_due = fronted(options.transport) && acceptors.is_none();
+                                    }
+                                    Err(e) => {
+                                        tracing::error!("Could not move the engine to port {}: {}", next_port, e);
+                                        // Whatever listened in front of the engine before takes over again
+                                        acceptors_due = listening != port && acceptors.is_none();
+                                    }
+                                }
+                            } else {
+                                listening = config.port;
+                                engine.write().await.update_config(config).await;
+                            }
+                            if quic.is_some() || options.transport.uses_quic() {
+                                Self::move_transport(&mut quic, &mut retired_quic, &options, port, listening, &aliases, &known_peers);
+                            }
                         }
-                        Ok(EngineCommand::ChangePort { port, rollback_on_failure }) => {
-                            let mut eng = engine.lock().await;
-                            if rollback_on_failure {
-                                let _ = eng.change_port(port).await;
+                        Ok(EngineCommand::ChangePort { mut config }) => {
+                            let new_port = config.port;
+                            config.port = engine_port(new_port, options.transport);
+                            if !serving {
+                                // Taken up by the next start
+                                listening = config.port;
+                                engine.write().await.update_config(config).await;
+                                port = new_port;
+                                continue;
+                            }
+                            if new_port == port {
+                                continue;
+                            }
+                            let next_port = config.port;
+                            let result = if next_port == listening {
+                                // An engine on loopback stays; only what listens in front of it
+                                // moves, and accepted connections outlive the listeners
+                                if acceptors.is_some() || acceptors_due {
+                                    Acceptors::start(new_port, listening, aliases.clone()).await.map(|next| {
+                                        next.set_tls(tls.clone());
+                                        acceptors = Some(next);
+                                        acceptors_due = false;
+                                    })
+                                } else {
+                                    Ok(())
+                                }
                             } else {
-                                let _ = eng.change_port_with_options(port, false).await;
+                                match Self::hand_over(config, &history, &mut engine, &mut engine_events, &mut arrived).await {
+                                    Ok((old_engine, old_events, held)) => {
+                                        // Earlier ports stay open until their own transfers end
+                                        retiring.push(Retiring::new(old_engine, old_events, listening, held));
+                                        listening = next_port;
+                                        Ok(())
+                                    }
+                                    Err(e) => Err(e),
+                                }
+                            };
+                            match result {
+                                Ok(()) => {
+                                    let old_port = std::mem::replace(&mut port, new_port);
+                                    if quic.is_some() {
+                                        Self::move_transport(&mut quic, &mut retired_quic, &options, port, listening, &aliases, &known_peers);
+                                    }
+                                    tracing::info!("Listening on port {}", new_port);
+                                    let _ = event_tx.send(EngineEvent::PortChanged { old_port, new_port }).await;
+                                }
+                                Err(e) => tracing::error!("Could not listen on port {}, staying on {}: {}", new_port, port, e),
                             }
                         }
+                        Ok(EngineCommand::Shutdown { deadline, reply }) => {
+                            tracing::info!("Waiting up to {:?} for {} transfer(s)", deadline, journal.in_flight());
+                            draining = Some((tokio::time::Instant::now() + deadline, reply));
+                        }
                         Err(_) => break,
                     }
                 }
-                event = engine_events.recv() => {
-                    if let Ok(event) = event {
+                _ = tokio::time::sleep_until(drain_deadline), if draining.is_some() => {
+                    tracing::warn!("{} transfer(s) still running at shutdown", journal.in_flight());
+                    break;
+                }
+                _ = tokio::time::sleep_until(retire_deadline), if !retiring.is_empty() => {}
+                _ = outbox_timer.tick(), if draining.is_none() => {
+                    let route = Self::send_route(&engine, &quic, &tls, &options, &favorites);
+                    outbox::deliver_due(&route, &outbox, &active_sends);
+
+                    if let Some(limit) = idle_exit {
+                        if !unanswered.is_empty() {
+                            let pending: HashSet<String> = Self::pending_ids(&engine, &retiring).await.into_iter().collect();
+                            unanswered.retain(|id, _| pending.contains(id));
+                            let expired: Vec<String> = unanswered
+                                .iter()
+                                .filter(|(_, since)| since.elapsed() >= UNANSWERED_TIMEOUT)
+                                .map(|(id, _)| id.clone())
+                                .collect();
+                            for id in expired {
+                                unanswered.remove(&id);
+                                tracing::info!("No answer to transfer {} in {:?}, rejecting it", id, UNANSWERED_TIMEOUT);
+                                let target = Self::engine_for(&engine, &retiring, &id);
+                                Self::forget(&mut retiring, &mut arrived, &id);
+                                let result = target.read().await.reject_transfer(&id).await;
+                                if let Err(e) = result {
+                                    tracing::warn!("Reject of {} failed: {}", id, e);
+                                }
+                            }
+                        }
+                        let busy = acceptors.as_ref().is_some_and(|a| a.connections() > 0)
+                            || journal.in_flight() > 0
+                            || !active_sends.list().is_empty()
+                            || !retiring.is_empty()
+                            || !retired_quic.is_empty()
+                            || !engine.read().await.get_pending_transfers().await.is_empty();
+                        if busy {
+                            idle_since = tokio::time::Instant::now();
+                        } else if idle_since.elapsed() >= limit {
+                            tracing::info!("Idle for {:?}, exiting until the next connection", limit);
+                            break;
+                        }
+                    }
+                }
+                (event, retired) = Self::next_event(&mut engine_events, &mut retiring) => {
+                    if let Some(index) = retired {
+                        let handled = match &event {
+                            Ok(event) => retiring[index].on_event(event).await,
+                            Err(_) => false,
+                        };
+                        if matches!(event, Err(RecvError::Closed)) {
+                            retiring.remove(index);
+                        }
+                        if !handled {
+                            continue;
+                        }
+                    } else {
+                        match &event {
+                            Ok(EngineEvent::TransferComplete { transfer_id })
+                            | Ok(EngineEvent::TransferFailed { transfer_id, .. }) => {
+                                arrived.remove(transfer_id);
+                            }
+                            _ => {}
+                        }
+                    }
+                    if let Ok(mut event) = event {
+                        if let EngineEvent::TransferRequest(transfer) = &mut event {
+                            // Relayed peers reach the engine from a loopback alias
+                            let relayed = aliases.peer_of(&transfer.peer_address).is_some();
+                            aliases.restore(&mut transfer.peer_address);
+                            let trusted = relayed && options.trusted_hosts.contains(&transfer.peer_address);
+
+                            let eng = engine.read().await;
+                            if options.transport == TransportMode::Encrypted && !relayed {
+                                tracing::warn!(
+                                    "Refusing unencrypted transfer {} from {}",
+                                    transfer.id,
+                                    transfer.peer_address
+                                );
+                                let _ = eng.reject_transfer(&transfer.id).await;
+                                continue;
+                            }
+                            if draining.is_some() {
+                                tracing::info!("Refusing transfer {} while shutting down", transfer.id);
+                                let _ = eng.reject_transfer(&transfer.id).await;
+                                continue;
+                            }
+                            journal.note_request(transfer);
+                            arrived.insert(transfer.id.clone());
+                            chains.on_request(transfer, options.trusted_hosts.contains(&transfer.peer_address), &download_dir);
+                            multicasts.on_request(transfer);
+                            pulls.on_request(transfer);
+                            // A peer that sends to us is awake
+                            outbox.probe_now(&transfer.peer_address, chrono::Utc::now());
+                            if Self::auto_accept(&eng, &mut approvals, transfer, trusted).await {
+                                // Progress events announce it to the frontend instead
+                                continue;
+                            }
+                            if idle_exit.is_some() {
+                                unanswered.insert(transfer.id.clone(), tokio::time::Instant::now());
+                            }
+                        }
+                        match &event {
+                            EngineEvent::TransferProgress(progress) => journal.record_progress(progress, &download_dir),
+                            EngineEvent::TransferComplete { transfer_id }
+                            | EngineEvent::TransferFailed { transfer_id, .. } => journal.end_transfer(transfer_id),
+                            _ => {}
+                        }
+                        chains.on_event(&event, || send_context(&engine, &quic, &tls, &options));
+                        let multicast = options.multicast_enabled && options.transport != TransportMode::Encrypted;
+                        multicasts.on_event(&event, &download_dir, multicast);
+                        let pull = options.transport != TransportMode::Encrypted;
+                        pulls.on_event(&event, &download_dir, pull, options.pull_rate_bps);
                         if event_tx.send(event).await.is_err() {
                             break;
                         }
@@ -223,6 +1003,485 @@ impl EngineBridge {
                 }
             }
         }
+
+        if let Some((_, reply)) = draining {
+            // Whatever is still running is picked up on the next start
+            journal.checkpoint();
+            let _ = reply.send(()).await;
+        }
+    }
+
+    fn create_engine(
+        config: EngineConfig,
+        history: &Option<Arc<TransferHistory>>,
+    ) -> (GoshTransferEngine, broadcast::Receiver<EngineEvent>) {
+        match history.clone() {
+            Some(history) => GoshTransferEngine::with_channel_events_and_history(config, history),
+            None => GoshTransferEngine::with_channel_events(config),
+        }
+    }
+
+    /// Start a server on `config.port` and make it the live engine. Returns
+    /// the previous engine, its events, and the transfers that arrived on
+    /// it and are still held; on failure the previous engine stays live.
+    async fn hand_over(
+        config: EngineConfig,
+        history: &Option<Arc<TransferHistory>>,
+        engine: &mut Arc<RwLock<GoshTransferEngine>>,
+        engine_events: &mut broadcast::Receiver<EngineEvent>,
+        arrived: &mut HashSet<String>,
+    ) -> Result<RetiredEngine, String> {
+        let (mut next, next_events) = Self::create_engine(config, history);
+        next.start_server().await.map_err(|e| e.to_string())?;
+
+        let previous = std::mem::replace(engine, Arc::new(RwLock::new(next)));
+        let previous_events = std::mem::replace(engine_events, next_events);
+        let held = arrived.drain().collect();
+        Ok((previous, previous_events, held))
+    }
+
+    /// The engine holding transfer `id`, which is a retired one for
+    /// transfers that arrived before a port change
+    fn engine_for(
+        engine: &Arc<RwLock<GoshTransferEngine>>,
+        retiring: &[Retiring],
+        id: &str,
+    ) -> Arc<RwLock<GoshTransferEngine>> {
+        retiring
+            .iter()
+            .find_map(|r| r.engine_for(id))
+            .unwrap_or_else(|| engine.clone())
+    }
+
+    /// Stop waiting for a transfer the user rejected or cancelled
+    fn forget(retiring: &mut [Retiring], arrived: &mut HashSet<String>, id: &str) {
+        arrived.remove(id);
+        for retired in retiring {
+            retired.forget(id);
+        }
+    }
+
+    /// Next event of the live engine or of a retired one, and the position
+    /// of the retired one it came from
+    async fn next_event(
+        events: &mut broadcast::Receiver<EngineEvent>,
+        retiring: &mut [Retiring],
+    ) -> (Result<EngineEvent, RecvError>, Option<usize>) {
+        if retiring.is_empty() {
+            return (events.recv().await, None);
+        }
+        let mut retired: Vec<_> = retiring.iter_mut().map(|r| Box::pin(r.recv())).collect();
+        let retired = std::future::poll_fn(|cx| {
+            retired
+                .iter_mut()
+                .enumerate()
+                .find_map(|(index, recv)| match recv.as_mut().poll(cx) {
+                    Poll::Ready(event) => Some((event, Some(index))),
+                    Poll::Pending => None,
+                })
+                .map_or(Poll::Pending, Poll::Ready)
+        });
+        tokio::select! {
+            event = events.recv() => (event, None),
+            event = retired => event,
+        }
+    }
+
+    /// Point the QUIC endpoint at the transfer and engine ports now in use.
+    ///
+    /// On the same UDP port only new streams go to the new engine. On
+    /// another, the old endpoint is retired and keeps relaying its streams,
+    /// like a retired engine keeps its transfers.
+    fn move_transport(
+        quic: &mut Option<Arc<QuicTransport>>,
+        retired: &mut Vec<RetiredTransport>,
+        options: &BridgeOptions,
+        port: u16,
+        engine_port: u16,
+        aliases: &Arc<PeerAliases>,
+        known_peers: &Arc<KnownPeers>,
+    ) {
+        if let Some(current) = quic.as_ref() {
+            if options.transport.uses_quic() && current.port() == Some(port) {
+                current.set_engine_port(engine_port);
+                return;
+            }
+        }
+        if let Some(old) = quic.take() {
+            retired.push(RetiredTransport::new(old));
+        }
+        if options.transport.uses_quic() {
+            // Returning to an earlier port takes it back from its old endpoint
+            retired.retain(|r| r.port() != Some(port));
+        }
+        *quic = Self::start_transport(options, port, engine_port, aliases, known_peers);
+    }
+
+    /// Start the QUIC endpoints when the settings ask for them
+    fn start_transport(
+        options: &BridgeOptions,
+        port: u16,
+        engine_port: u16,
+        aliases: &Arc<PeerAliases>,
+        known_peers: &Arc<KnownPeers>,
+    ) -> Option<Arc<QuicTransport>> {
+        if !options.transport.uses_quic() {
+            return None;
+        }
+        match QuicTransport::start(port, engine_port, aliases.clone(), known_peers.clone()) {
+            Ok(transport) => Some(Arc::new(transport)),
+            Err(e) => {
+                tracing::error!("QUIC transport unavailable, using HTTP: {}", e);
+                None
+            }
+        }
+    }
+
+    /// Load the TLS identity when the settings ask for encrypted mode
+    fn start_tls(
+        options: &BridgeOptions,
+        aliases: &Arc<PeerAliases>,
+        known_peers: &Arc<KnownPeers>,
+    ) -> Option<Arc<TlsTransport>> {
+        if options.transport != TransportMode::Encrypted {
+            return None;
+        }
+        match TlsTransport::new(aliases.clone(), known_peers.clone()) {
+            Ok(transport) => Some(Arc::new(transport)),
+            Err(e) => {
+                tracing::error!("TLS transport unavailable, nothing can be sent: {}", e);
+                None
+            }
+        }
+    }
+
+    /// Resolve hop addresses to IPs, which the relay and manifests need
+    fn resolve_hops(hops: Vec<ChainHop>) -> Result<Vec<ChainHop>, String> {
+        hops.into_iter()
+            .map(
+                |hop| match GoshTransferEngine::resolve_address(&hop.address).ip {
+                    Some(ip) => Ok(ChainHop {
+                        address: ip,
+                        port: hop.port,
+                    }),
+                    None => Err(format!("Could not resolve {}", hop.address)),
+                },
+            )
+            .collect()
+    }
+
+    /// Snapshot of the current transport for sends made outside the command loop
+    fn send_route(
+        engine: &Arc<RwLock<GoshTransferEngine>>,
+        quic: &Option<Arc<QuicTransport>>,
+        tls: &Option<Arc<TlsTransport>>,
+        options: &BridgeOptions,
+        favorites: &Arc<FileFavoritesStore>,
+    ) -> SendRoute {
+        SendRoute {
+            engine: engine.clone(),
+            quic: quic.clone(),
+            tls: tls.clone(),
+            transport: options.transport,
+            favorites: favorites.clone(),
+        }
+    }
+
+    /// Resolve the address the engine should send to, going through the
+    /// TLS relay in encrypted mode and the QUIC relay when the peer has one.
+    ///
+    /// Fails instead of falling back to plain HTTP in encrypted mode.
+    async fn route(
+        quic: Option<&QuicTransport>,
+        tls: Option<&TlsTransport>,
+        transport: TransportMode,
+        address: String,
+        port: u16,
+    ) -> Result<(String, u16), String> {
+        let relay = match (transport, tls, quic) {
+            (TransportMode::Encrypted, Some(tls), _) => tls.route(&address, port).await,
+            (TransportMode::Encrypted, None, _) => None,
+            (_, _, Some(quic)) => quic.route(&address, port).await,
+            (_, _, None) => None,
+        };
+        match relay {
+            Some(relay) => Ok((relay.ip().to_string(), relay.port())),
+            None if transport == TransportMode::Encrypted => Err(format!(
+                "{} cannot be reached over an encrypted transport",
+                address
+            )),
+            None => Ok((address, port)),
+        }
+    }
+
+    /// Check whether `paths` are regular files totalling at most `max_bytes`
+    pub(crate) async fn is_small_send(paths: &[PathBuf], max_bytes: u64) -> bool {
+        if max_bytes == 0 || paths.is_empty() {
+            return false;
+        }
+        let paths = paths.to_vec();
+        tokio::task::spawn_blocking(move || {
+            let mut total: u64 = 0;
+            for path in &paths {
+                match std::fs::metadata(path) {
+                    Ok(meta) if meta.is_file() => {
+                        total = total.saturating_add(meta.len());
+                        if total > max_bytes {
+                            return false;
+                        }
+                    }
+                    _ => return false,
+                }
+            }
+            true
+        })
+        .await
+        .unwrap_or(false)
+    }
+
+    /// Walk `root` through the compiled filter and stage the kept files.
+    ///
+    /// Runs on the blocking pool; excluded subtrees are pruned during the walk,
+    /// and both the walk and the staging stop at the next entry once `cancel`
+    /// fires. Returns the staged root and the kept files relative to `root`.
+    pub(crate) async fn stage_filtered_directory(
+        root: PathBuf,
+        filter: TransferFilter,
+        cancel: CancelToken,
+    ) -> Result<(PathBuf, Walked), String> {
+        tokio::task::spawn_blocking(move || {
+            let compiled = PathFilter::compile(&filter, &root)?;
+            let walked = compiled.walk_tree(&root, &cancel)?;
+            tracing::info!(
+                "Filter kept {} file(s) under {:?}",
+                walked.files.len(),
+                root
+            );
+            filter::stage_filtered(&root, &walked.files, &cancel).map(|staged| (staged, walked))
+        })
+        .await
+        .map_err(|e| e.to_string())?
+        .map_err(|e| e.to_string())
+    }
+
+    /// Accept only the files of a pending transfer that match `patterns`.
+    ///
+    /// An empty selection rejects the transfer. Otherwise the whole transfer
+    /// is accepted and the skipped files are noted in history; they are
+    /// still received, since the engine cannot leave them out.
+    async fn accept_selection(
+        eng: &GoshTransferEngine,
+        id: &str,
+        patterns: &[String],
+        history: Option<&TransferHistory>,
+    ) -> Result<SelectionSummary, String> {
+        let selection = FileSelection::new(patterns).map_err(|e| e.to_string())?;
+        let pending = eng.get_pending_transfers().await;
+        let transfer = pending
+            .iter()
+            .find(|t| t.id == id)
+            .ok_or_else(|| format!("Transfer not found: {}", id))?;
+
+        let (selected, skipped) = selection.partition(&transfer.files);
+        let summary = SelectionSummary {
+            selected_files: selected.iter().filter(|f| !f.is_directory).count(),
+            skipped_files: skipped.iter().filter(|f| !f.is_directory).count(),
+            skipped_bytes: skipped.iter().map(|f| f.size).sum(),
+        };
+
+        if summary.selected_files == 0 {
+            eng.reject_transfer(id).await.map_err(|e| e.to_string())?;
+            return Ok(summary);
+        }
+
+        if let Some(history) = history.filter(|_| !skipped.is_empty()) {
+            history.record_skipped(id, skipped.iter().map(|f| f.name.clone()).collect());
+        }
+
+        if let Err(e) = eng.accept_transfer(id).await {
+            if let Some(history) = history {
+                history.forget_skipped(id);
+            }
+            return Err(e.to_string());
+        }
+        Ok(summary)
+    }
+
+    /// Accept a request from a trusted peer or one covered by an approval
+    /// session, returning whether it was accepted
+    async fn auto_accept(
+        eng: &GoshTransferEngine,
+        approvals: &mut ApprovalSessions,
+        transfer: &PendingTransfer,
+        trusted: bool,
+    ) -> bool {
+        if !trusted && !approvals.covers(&transfer.peer_address, chrono::Utc::now()) {
+            return false;
+        }
+        match eng.accept_transfer(&transfer.id).await {
+            Ok(()) => {
+                if !trusted {
+                    approvals.record_accept(&transfer.peer_address);
+                }
+                tracing::info!(
+                    "Auto-accepted {} from {}",
+                    transfer.id,
+                    transfer.peer_address
+                );
+                true
+            }
+            Err(e) => {
+                tracing::warn!("Auto-accept of {} failed: {}", transfer.id, e);
+                false
+            }
+        }
+    }
+
+    /// Ids of the requests pending on the live engine and on retired ones
+    async fn pending_ids(
+        engine: &Arc<RwLock<GoshTransferEngine>>,
+        retiring: &[Retiring],
+    ) -> Vec<String> {
+        let mut ids: Vec<String> = engine
+            .read()
+            .await
+            .get_pending_transfers()
+            .await
+            .into_iter()
+            .map(|t| t.id)
+            .collect();
+        for retired in retiring {
+            let pending = retired.engine().read().await.get_pending_transfers().await;
+            ids.extend(pending.into_iter().map(|t| t.id));
+        }
+        ids
+    }
+
+    /// Pair each id of a batch with the engine holding it, forgetting the
+    /// ones a reject or cancel ends
+    fn batch_targets(
+        engine: &Arc<RwLock<GoshTransferEngine>>,
+        retiring: &mut [Retiring],
+        arrived: &mut HashSet<String>,
+        action: TransferAction,
+        ids: Vec<String>,
+    ) -> Vec<(String, Arc<RwLock<GoshTransferEngine>>)> {
+        ids.into_iter()
+            .map(|id| {
+                let target = Self::engine_for(engine, retiring, &id);
+                if !matches!(action, TransferAction::Accept) {
+                    Self::forget(retiring, arrived, &id);
+                }
+                (id, target)
+            })
+            .collect()
+    }
+
+    /// Run a batched control command off the command loop and reply with per-id results.
+    ///
+    /// Operations run concurrently (bounded by `MAX_PARALLEL_BATCH_OPS`) under a shared
+    /// read lock, so a slow peer does not serialize the rest of the batch.
+    fn spawn_batch(
+        targets: Vec<(String, Arc<RwLock<GoshTransferEngine>>)>,
+        action: TransferAction,
+        reply: Sender<Vec<TransferActionResult>>,
+    ) {
+        tokio::spawn(async move {
+            let results = Self::run_batch(targets, action).await;
+            let _ = reply.send(results).await;
+        });
+    }
+
+    async fn run_batch(
+        targets: Vec<(String, Arc<RwLock<GoshTransferEngine>>)>,
+        action: TransferAction,
+    ) -> Vec<TransferActionResult> {
+        let limit = Arc::new(Semaphore::new(MAX_PARALLEL_BATCH_OPS));
+        let mut tasks = JoinSet::new();
+
+        let ids: Vec<String> = targets.iter().map(|(id, _)| id.clone()).collect();
+        for (index, (id, engine)) in targets.into_iter().enumerate() {
+            let limit = limit.clone();
+            tasks.spawn(async move {
+                let _permit = limit.acquire_owned().await;
+                let eng = engine.read().await;
+                let result = match action {
+                    TransferAction::Accept => eng.accept_transfer(&id).await,
+                    TransferAction::Reject => eng.reject_transfer(&id).await,
+                    TransferAction::Cancel => eng.cancel_transfer(&id).await,
+                };
+                if let Err(e) = &result {
+                    tracing::error!("{:?} {} failed: {}", action, id, e);
+                }
+                (index, TransferActionResult::from_result(id, result))
+            });
+        }
+
+        // Keep results in request order; a task that panicked still reports its id
+        let mut results: Vec<Option<TransferActionResult>> = vec![None; ids.len()];
+        while let Some(joined) = tasks.join_next().await {
+            if let Ok((index, result)) = joined {
+                results[index] = Some(result);
+            }
+        }
+
+        results
+            .into_iter()
+            .zip(ids)
+            .map(|(result, id)| {
+                result.unwrap_or_else(|| TransferActionResult {
+                    id,
+                    ok: false,
+                    error: Some("Operation aborted".to_string()),
+                })
+            })
+            .collect()
+    }
+
+    /// Let running transfers finish for up to `deadline`, then journal what
+    /// is still running so the next start can pick it up
+    pub fn shutdown(&self, deadline: Duration) {
+        let (reply_tx, reply_rx) = async_channel::bounded(1);
+        let command_tx = self.command_tx.clone();
+        let runtime = self.runtime.clone();
+        // The caller may be on a thread that already drives a runtime
+        let answered = std::thread::spawn(move || {
+            runtime.block_on(async move {
+                let shutdown = async {
+                    let command = EngineCommand::Shutdown {
+                        deadline,
+                        reply: reply_tx,
+                    };
+                    command_tx.send(command).await.ok()?;
+                    reply_rx.recv().await.ok()
+                };
+                tokio::time::timeout(deadline + SHUTDOWN_GRACE, shutdown)
+                    .await
+                    .ok()
+                    .flatten()
+            })
+        })
+        .join()
+        .ok()
+        .flatten();
+        if answered.is_none() {
+            tracing::warn!("Engine did not confirm shutdown in time");
+        }
+    }
+
+    /// Id for a send about to be issued
+    pub fn next_send_id(&self) -> String {
+        self.sends.next_id()
+    }
+
+    /// Cancel a running send, returning false if no send has this id
+    pub fn cancel_send(&self, id: &str) -> bool {
+        self.sends.cancel(id)
+    }
+
+    /// Sends still walking, staging or sending
+    pub fn active_sends(&self) -> Vec<SendInfo> {
+        self.sends.list()
     }
 
     pub fn command_sender(&self) -> Sender<EngineCommand> {
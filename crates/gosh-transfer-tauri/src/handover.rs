@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Port handover
+//
+// A port change starts a second engine on the new port before the old one
+// is touched, so a failed bind leaves the old listener as it was. Once the
+// new listener is live, the old engine is retired: it refuses new requests
+// but keeps the transfers it holds until they end or a timeout passes, and
+// only then is its server stopped. A QUIC endpoint on the old port is
+// retired the same way, kept until the streams it relays have ended.
+
+use crate::quic::QuicTransport;
+use gosh_lan_transfer::{EngineEvent, GoshTransferEngine};
+use std::collections::HashSet;
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::sync::broadcast::{self, error::RecvError};
+use tokio::sync::RwLock;
+use tokio::time::Instant;
+
+/// Longest time a retired listener is kept for its transfers
+const HANDOVER_TIMEOUT: Duration = Duration::from_secs(10 * 60);
+
+/// The engine of a previous port, kept until its transfers end
+pub struct Retiring {
+    engine: Arc<RwLock<GoshTransferEngine>>,
+    events: broadcast::Receiver<EngineEvent>,
+    port: u16,
+    /// Pending and running transfers that arrived on the old port
+    transfers: HashSet<String>,
+    deadline: Instant,
+}
+
+impl Retiring {
+    pub fn new(
+        engine: Arc<RwLock<GoshTransferEngine>>,
+        events: broadcast::Receiver<EngineEvent>,
+        port: u16,
+        transfers: impl IntoIterator<Item = String>,
+    ) -> Self {
+        let transfers: HashSet<String> = transfers.into_iter().collect();
+        tracing::info!(
+            "Keeping port {} open for {} transfer(s)",
+            port,
+            transfers.len()
+        );
+        Self {
+            engine,
+            events,
+            port,
+            transfers,
+            deadline: Instant::now() + HANDOVER_TIMEOUT,
+        }
+    }
+
+    /// The engine holding `id`, if it arrived on the old port
+    pub fn engine_for(&self, id: &str) -> Option<Arc<RwLock<GoshTransferEngine>>> {
+        self.transfers.contains(id).then(|| self.engine.clone())
+    }
+
+    pub fn engine(&self) -> &Arc<RwLock<GoshTransferEngine>> {
+        &self.engine
+    }
+
+    /// Stop waiting for a transfer the user rejected or cancelled
+    pub fn forget(&mut self, id: &str) {
+        self.transfers.remove(id);
+    }
+
+    pub async fn recv(&mut self) -> Result<EngineEvent, RecvError> {
+        self.events.recv().await
+    }
+
+    /// Track an event of the old engine, returning whether it should be
+    /// handled like one from the live engine. New requests are refused.
+    pub async fn on_event(&mut self, event: &EngineEvent) -> bool {
+        match event {
+            EngineEvent::TransferRequest(transfer) => {
+                tracing::info!(
+                    "Refusing transfer {} on retired port {}",
+                    transfer.id,
+                    self.port
+                );
+                let _ = self.engine.read().await.reject_transfer(&transfer.id).await;
+                false
+            }
+            EngineEvent::TransferComplete { transfer_id }
+            | EngineEvent::TransferFailed { transfer_id, .. } => {
+                self.transfers.remove(transfer_id);
+                true
+            }
+            // The live server reports its own state
+            EngineEvent::ServerStarted { .. }
+            | EngineEvent::ServerStopped
+            | EngineEvent::PortChanged { .. } => false,
+            _ => true,
+        }
+    }
+
+    /// Port the old engine still listens on
+    pub fn port(&self) -> u16 {
+        self.port
+    }
+
+    pub fn deadline(&self) -> Instant {
+        self.deadline
+    }
+
+    pub fn is_done(&self) -> bool {
+        self.transfers.is_empty() || Instant::now() >= self.deadline
+    }
+
+    /// Stop the old server, cutting off whatever is still running on it
+    pub async fn close(self) {
+        if !self.transfers.is_empty() {
+            tracing::warn!(
+                "Closing port {} with {} transfer(s) unfinished",
+                self.port,
+                self.transfers.len()
+            );
+        }
+        if let Err(e) = self.engine.write().await.stop_server().await {
+            tracing::error!("Failed to stop server on port {}: {}", self.port, e);
+        }
+        tracing::info!("Closed retired port {}", self.port);
+    }
+}
+
+/// The QUIC endpoint of a previous port, kept until its streams end
+pub struct RetiredTransport {
+    transport: Arc<QuicTransport>,
+    deadline: Instant,
+}
+
+impl RetiredTransport {
+    pub fn new(transport: Arc<QuicTransport>) -> Self {
+        transport.retire();
+        tracing::info!(
+            "Keeping QUIC port {:?} open for {} stream(s)",
+            transport.port(),
+            transport.streams()
+        );
+        Self {
+            transport,
+            deadline: Instant::now() + HANDOVER_TIMEOUT,
+        }
+    }
+
+    /// UDP port the old endpoint still holds
+    pub fn port(&self) -> Option<u16> {
+        self.transport.port()
+    }
+
+    pub fn is_done(&self) -> bool {
+        self.transport.streams() == 0 || Instant::now() >= self.deadline
+    }
+}
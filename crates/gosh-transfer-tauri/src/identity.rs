@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Transport identities
+//
+// Encrypted transports present a self-signed Ed25519 certificate, in both
+// directions, and each side pins the other's on first contact. Nothing
+// checks the certificate's names or dates, so it is the smallest X.509 v3
+// structure rustls will parse, built here with ring rather than through a
+// certificate library.
+//
+// A server learns who a client claims to be only from its address, which
+// rustls does not hand to client certificate verifiers. Client
+// certificates are therefore required but only signature-checked during
+// the handshake, and pinned by the server once it completes.
+
+use gosh_transfer_core::peer_identity::{load_local_identity, save_local_identity};
+use gosh_transfer_core::{KnownPeers, PeerIdentity};
+use ring::rand::{SecureRandom, SystemRandom};
+use ring::signature::{Ed25519KeyPair, KeyPair};
+use rustls::client::danger::{HandshakeSignatureValid, ServerCertVerified, ServerCertVerifier};
+use rustls::crypto::CryptoProvider;
+use rustls::pki_types::{CertificateDer, PrivateKeyDer, PrivatePkcs8KeyDer, ServerName, UnixTime};
+use rustls::server::danger::{ClientCertVerified, ClientCertVerifier};
+use rustls::{CipherSuite, DigitallySignedStruct, DistinguishedName, SignatureScheme};
+use std::net::IpAddr;
+use std::sync::Arc;
+
+/// Subject name of the self-signed device certificate
+const CERT_NAME: &str = "gosh-transfer";
+/// DER of the Ed25519 algorithm identifier, OID 1.3.101.112
+const ED25519_ALGORITHM: &[u8] = &[0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70];
+/// DER of the common name attribute type, OID 2.5.4.3
+const COMMON_NAME: &[u8] = &[0x06, 0x03, 0x55, 0x04, 0x03];
+/// DER of the subject alternative name extension id, OID 2.5.29.17
+const SUBJECT_ALT_NAME: &[u8] = &[0x06, 0x03, 0x55, 0x1d, 0x11];
+/// Validity start, as a UTCTime
+const NOT_BEFORE: &str = "700101000000Z";
+/// RFC 5280's value for a certificate without an expiry, as a GeneralizedTime
+const NOT_AFTER: &str = "99991231235959Z";
+
+/// Load the device certificate, creating it on first use
+pub fn local_identity() -> Result<(CertificateDer<'static>, PrivateKeyDer<'static>), String> {
+    let (cert, key) = match load_local_identity() {
+        Some(identity) => identity,
+        None => {
+            let (cert, key) = self_signed()?;
+            // Without a stable certificate every restart would trip peers' pins
+            if let Err(e) = save_local_identity(&cert, &key) {
+                tracing::warn!("Failed to save transport identity: {}", e);
+            }
+            (cert, key)
+        }
+    };
+    Ok((
+        CertificateDer::from(cert),
+        PrivateKeyDer::Pkcs8(PrivatePkcs8KeyDer::from(key)),
+    ))
+}
+
+/// Hex SHA-256 of a certificate
+pub fn fingerprint(cert: &CertificateDer<'_>) -> String {
+    ring::digest::digest(&ring::digest::SHA256, cert.as_ref())
+        .as_ref()
+        .iter()
+        .map(|byte| format!("{:02x}", byte))
+        .collect()
+}
+
+/// Check whether the CPU has AES and carry-less multiply instructions
+pub fn has_aes_hardware() -> bool {
+    #[cfg(target_arch = "x86_64")]
+    {
+        std::arch::is_x86_feature_detected!("aes")
+            && std::arch::is_x86_feature_detected!("pclmulqdq")
+    }
+    #[cfg(target_arch = "aarch64")]
+    {
+        std::arch::is_aarch64_feature_detected!("aes")
+            && std::arch::is_aarch64_feature_detected!("pmull")
+    }
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+    {
+        false
+    }
+}
+
+/// Crypto provider with cipher suites ordered for this CPU
+pub fn crypto_provider() -> CryptoProvider {
+    let mut provider = rustls::crypto::ring::default_provider();
+    let preferred = if has_aes_hardware() {
+        // ring lists AES-256 first; AES-128 is as safe here and faster
+        CipherSuite::TLS13_AES_128_GCM_SHA256
+    } else {
+        // Software AES-GCM is several times slower than ChaCha20-Poly1305.
+        // AES-128-GCM stays in the list: QUIC needs it for initial packets.
+        CipherSuite::TLS13_CHACHA20_POLY1305_SHA256
+    };
+    provider
+        .cipher_suites
+        .sort_by_key(|suite| suite.suite() != preferred);
+    provider
+}
+
+/// Check a peer's certificate against its pin, pinning it on first contact
+pub fn check_pin(known_peers: &KnownPeers, peer: IpAddr, cert: &CertificateDer<'_>) -> bool {
+    let address = peer.to_string();
+    match known_peers.check(&address, &fingerprint(cert)) {
+        PeerIdentity::Known => true,
+        PeerIdentity::New => {
+            tracing::info!("Pinned transport identity of {}", address);
+            true
+        }
+        PeerIdentity::Changed => {
+            tracing::warn!("Transport identity of {} changed, refusing", address);
+            false
+        }
+    }
+}
+
+/// Verifies a server's self-signed certificate against its first-seen pin
+pub struct PinnedCertificate {
+    provider: Arc<CryptoProvider>,
+    known_peers: Arc<KnownPeers>,
+}
+
+impl PinnedCertificate {
+    pub fn new(provider: Arc<CryptoProvider>, known_peers: Arc<KnownPeers>) -> Self {
+        Self {
+            provider,
+            known_peers,
+        }
+    }
+}
+
+impl std::fmt::Debug for PinnedCertificate {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str("PinnedCertificate")
+    }
+}
+
+impl ServerCertVerifier for PinnedCertificate {
+    fn verify_server_cert(
+        &self,
+        end_entity: &CertificateDer<'_>,
+        _intermediates: &[CertificateDer<'_>],
+        server_name: &ServerName<'_>,
+        _ocsp_response: &[u8],
+        _now: UnixTime,
+    ) -> Result<ServerCertVerified, rustls::Error> {
+        let ServerName::IpAddress(ip) = server_name else {
+            return Err(rustls::Error::General(
+                "Peer must be addressed by IP".to_string(),
+            ));
+        };
+        if check_pin(&self.known_peers, IpAddr::from(*ip), end_entity) {
+            Ok(ServerCertVerified::assertion())
+        } else {
+            Err(rustls::Error::InvalidCertificate(
+                rustls::CertificateError::ApplicationVerificationFailure,
+            ))
+        }
+    }
+
+    fn verify_tls12_signature(
+        &self,
+        message: &[u8],
+        cert: &CertificateDer<'_>,
+        dss: &DigitallySignedStruct,
+    ) -> Result<HandshakeSignatureValid, rustls::Error> {
+        rustls::crypto::verify_tls12_signature(
+            message,
+            cert,
+            dss,
+            &self.provider.signature_verification_algorithms,
+        )
+    }
+
+    fn verify_tls13_signature(
+        &self,
+        message: &[u8],
+        cert: &CertificateDer<'_>,
+        dss: &DigitallySignedStruct,
+    ) -> Result<HandshakeSignatureValid, rustls::Error> {
+        rustls::crypto::verify_tls13_signature(
+            message,
+            cert,
+            dss,
+            &self.provider.signature_verification_algorithms,
+        )
+    }
+
+    fn supported_verify_schemes(&self) -> Vec<SignatureScheme> {
+        self.provider
+            .signature_verification_algorithms
+            .supported_schemes()
+    }
+}
+
+/// Requires a client certificate and checks the handshake signature made
+/// with it; the server checks the pin once the handshake is done
+pub struct PeerCertificate {
+    provider: Arc<CryptoProvider>,
+}
+
+impl PeerCertificate {
+    pub fn new(provider: Arc<CryptoProvider>) -> Self {
+        Self { provider }
+    }
+}
+
+impl std::fmt::Debug for PeerCertificate {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str("PeerCertificate")
+    }
+}
+
+impl ClientCertVerifier for PeerCertificate {
+    fn root_hint_subjects(&self) -> &[DistinguishedName] {
+        &[]
+    }
+
+    fn client_auth_mandatory(&self) -> bool {
+        true
+    }
+
+    fn verify_client_cert(
+        &self,
+        _end_entity: &CertificateDer<'_>,
+        _intermediates: &[CertificateDer<'_>],
+        _now: UnixTime,
+    ) -> Result<ClientCertVerified, rustls::Error> {
+        Ok(ClientCertVerified::assertion())
+    }
+
+    fn verify_tls12_signature(
+        &self,
+        message: &[u8],
+        cert: &CertificateDer<'_>,
+        dss: &DigitallySignedStruct,
+    ) -> Result<HandshakeSignatureValid, rustls::Error> {
+        rustls::crypto::verify_tls12_signature(
+            message,
+            cert,
+            dss,
+            &self.provider.signature_verification_algorithms,
+        )
+    }
+
+    fn verify_tls13_signature(
+        &self,
+        message: &[u8],
+        cert: &CertificateDer<'_>,
+        dss: &DigitallySignedStruct,
+    ) -> Result<HandshakeSignatureValid, rustls::Error> {
+        rustls::crypto::verify_tls13_signature(
+            message,
+            cert,
+            dss,
+            &self.provider.signature_verification_algorithms,
+        )
+    }
+
+    fn supported_verify_schemes(&self) -> Vec<SignatureScheme> {
+        self.provider
+            .signature_verification_algorithms
+            .supported_schemes()
+    }
+}
+
+/// Generate a key pair and a certificate for it signed by itself, both DER
+fn self_signed() -> Result<(Vec<u8>, Vec<u8>), String> {
+    let rng = SystemRandom::new();
+    let pkcs8 = Ed25519KeyPair::generate_pkcs8(&rng)
+        .map_err(|_| "Failed to generate key pair".to_string())?;
+    let key_pair = Ed25519KeyPair::from_pkcs8(pkcs8.as_ref())
+        .map_err(|_| "Failed to load generated key pair".to_string())?;
+
+    let mut serial = [0u8; 16];
+    rng.fill(&mut serial)
+        .map_err(|_| "Failed to generate serial number".to_string())?;
+    // Positive and without a leading zero byte, as DER integers must be
+    serial[0] = (serial[0] & 0x7f) | 0x01;
+
+    let name = der(
+        0x30,
+        &der(
+            0x31,
+            &der(
+                0x30,
+                &[COMMON_NAME, &der(0x0c, CERT_NAME.as_bytes())].concat(),
+            ),
+        ),
+    );
+    let validity = der(
+        0x30,
+        &[
+            der(0x17, NOT_BEFORE.as_bytes()),
+            der(0x18, NOT_AFTER.as_bytes()),
+        ]
+        .concat(),
+    );
+    let public_key = der(
+        0x30,
+        &[
+            ED25519_ALGORITHM,
+            &der(0x03, &[&[0u8][..], key_pair.public_key().as_ref()].concat()),
+        ]
+        .concat(),
+    );
+    let alt_names = der(0x30, &der(0x82, CERT_NAME.as_bytes()));
+    let extensions = der(
+        0xa3,
+        &der(
+            0x30,
+            &der(0x30, &[SUBJECT_ALT_NAME, &der(0x04, &alt_names)].concat()),
+        ),
+    );
+    let tbs = der(
+        0x30,
+        &[
+            &der(0xa0, &der(0x02, &[2]))[..],
+            &der(0x02, &serial),
+            ED25519_ALGORITHM,
+            &name,
+            &validity,
+            &name,
+            &public_key,
+            &extensions,
+        ]
+        .concat(),
+    );
+
+    let signature = key_pair.sign(&tbs);
+    let cert = der(
+        0x30,
+        &[
+            &tbs[..],
+            ED25519_ALGORITHM,
+            &der(0x03, &[&[0u8][..], signature.as_ref()].concat()),
+        ]
+        .concat(),
+    );
+    Ok((cert, pkcs8.as_ref().to_vec()))
+}
+
+/// Encode one DER element
+fn der(tag: u8, content: &[u8]) -> Vec<u8> {
+    let mut out = vec![tag];
+    let len = content.len();
+    if len < 0x80 {
+        out.push(len as u8);
+    } else {
+        let bytes = len.to_be_bytes();
+        let skip = bytes.iter().take_while(|b| **b == 0).count();
+        out.push(0x80 | (bytes.len() - skip) as u8);
+        out.extend_from_slice(&bytes[skip..]);
+    }
+    out.extend_from_slice(content);
+    out
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Accepts any certificate but checks the handshake signature made with it
+    #[derive(Debug)]
+    struct SignatureOnly(Arc<CryptoProvider>);
+
+    impl ServerCertVerifier for SignatureOnly {
+        fn verify_server_cert(
+            &self,
+            _end_entity: &CertificateDer<'_>,
+            _intermediates: &[CertificateDer<'_>],
+            _server_name: &ServerName<'_>,
+            _ocsp_response: &[u8],
+            _now: UnixTime,
+        ) -> Result<ServerCertVerified, rustls::Error> {
+            Ok(ServerCertVerified::assertion())
+        }
+
+        fn verify_tls12_signature(
+            &self,
+            _message: &[u8],
+            _cert: &CertificateDer<'_>,
+            _dss: &DigitallySignedStruct,
+        ) -> Result<HandshakeSignatureValid, rustls::Error> {
+            Err(rustls::Error::General("TLS 1.2 is not used".to_string()))
+        }
+
+        fn verify_tls13_signature(
+            &self,
+            message: &[u8],
+            cert: &CertificateDer<'_>,
+            dss: &DigitallySignedStruct,
+        ) -> Result<HandshakeSignatureValid, rustls::Error> {
+            rustls::crypto::verify_tls13_signature(
+                message,
+                cert,
+                dss,
+                &self.0.signature_verification_algorithms,
+            )
+        }
+
+        fn supported_verify_schemes(&self) -> Vec<SignatureScheme> {
+            self.0.signature_verification_algorithms.supported_schemes()
+        }
+    }
+
+    fn identity() -> (CertificateDer<'static>, PrivateKeyDer<'static>) {
+        let (cert, key) = self_signed().unwrap();
+        (
+            CertificateDer::from(cert),
+            PrivateKeyDer::Pkcs8(PrivatePkcs8KeyDer::from(key)),
+        )
+    }
+
+    /// Run a handshake in memory, with a client certificate if given
+    fn handshake(
+        client_identity: Option<(CertificateDer<'static>, PrivateKeyDer<'static>)>,
+    ) -> Result<rustls::ServerConnection, rustls::Error> {
+        let provider = Arc::new(crypto_provider());
+        let (cert, key) = identity();
+
+        let server = rustls::ServerConfig::builder_with_provider(provider.clone())
+            .with_protocol_versions(&[&rustls::version::TLS13])?
+            .with_client_cert_verifier(Arc::new(PeerCertificate::new(provider.clone())))
+            .with_single_cert(vec![cert], key)?;
+        let client = rustls::ClientConfig::builder_with_provider(provider.clone())
+            .with_protocol_versions(&[&rustls::version::TLS13])?
+            .dangerous()
+            .with_custom_certificate_verifier(Arc::new(SignatureOnly(provider)));
+        let client = match client_identity {
+            Some((cert, key)) => client.with_client_auth_cert(vec![cert], key)?,
+            None => client.with_no_client_auth(),
+        };
+
+        let name = ServerName::try_from(CERT_NAME).unwrap();
+        let mut client = rustls::ClientConnection::new(Arc::new(client), name)?;
+        let mut server = rustls::ServerConnection::new(Arc::new(server))?;
+        let mut wire = Vec::new();
+        while client.is_handshaking() || server.is_handshaking() {
+            wire.clear();
+            client.write_tls(&mut wire).unwrap();
+            server.read_tls(&mut wire.as_slice()).unwrap();
+            server.process_new_packets()?;
+            wire.clear();
+            server.write_tls(&mut wire).unwrap();
+            client.read_tls(&mut wire.as_slice()).unwrap();
+            client.process_new_packets()?;
+        }
+        Ok(server)
+    }
+
+    #[test]
+    fn test_self_signed_certificates_complete_a_mutual_handshake() {
+        let (cert, key) = identity();
+        let server = handshake(Some((cert.clone(), key))).unwrap();
+        assert_eq!(server.peer_certificates(), Some(&[cert][..]));
+    }
+
+    #[test]
+    fn test_client_without_certificate_is_refused() {
+        assert!(handshake(None).is_err());
+    }
+}
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Single instance
+//
+// The first process listens on a Unix socket in the user's runtime
+// directory. A later launch, such as a file manager's "Send to" action,
+// connects there first, writes its arguments as one JSON line and exits
+// once they are acknowledged, before any runtime, webview or port is set
+// up. The running instance then brings its window forward with the paths
+// and favorite filled in on the Send page.
+//
+// Launches take an flock on a file next to the socket while they look for
+// an instance, so two started together cannot both become it. The socket
+// is only replaced when connecting to it is refused, which means no
+// process listens there any more.
+//
+// A socket-activated receiver claims the instance too, so it never runs
+// beside a window. It has no window to bring forward, so it declines
+// launches; the launch then stops it and takes its place.
+
+use serde::{Deserialize, Serialize};
+use std::ffi::OsString;
+use std::fs::{File, OpenOptions};
+use std::io::{self, BufRead, BufReader, Read, Write};
+use std::os::unix::fs::{MetadataExt, OpenOptionsExt};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+use std::time::Duration;
+
+/// How long either side waits on the other to read or write
+const TIMEOUT: Duration = Duration::from_secs(2);
+
+/// How long a launch waits for its acknowledgement; an instance that has
+/// just started takes requests only once its window is set up
+const ACK_TIMEOUT: Duration = Duration::from_secs(15);
+
+/// Longest request line read from a launch
+const MAX_REQUEST_BYTES: u64 = 1024 * 1024;
+
+/// Reply of an instance that took the request
+const ACK: &[u8] = b"ok\n";
+/// Reply of a windowless receiver, which cannot take one
+const DECLINE: &[u8] = b"receiver\n";
+
+/// What a launch asks of the running instance
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct LaunchRequest {
+    /// Files and directories to send, as absolute paths
+    #[serde(default)]
+    pub paths: Vec<PathBuf>,
+    /// Favorite to send to, by id or name
+    #[serde(default)]
+    pub favorite: Option<String>,
+    /// Open on the Send page even without paths
+    #[serde(default)]
+    pub send: bool,
+}
+
+impl LaunchRequest {
+    /// Parse `[--send] [--favorite NAME] [PATH...]`. Relative paths are
+    /// resolved here, as the running instance has its own working directory.
+    pub fn from_args(args: impl IntoIterator<Item = OsString>) -> Self {
+        let cwd = std::env::current_dir().unwrap_or_default();
+        let mut request = Self::default();
+        let mut args = args.into_iter();
+        while let Some(arg) = args.next() {
+            match arg.to_str() {
+                Some("--send") => request.send = true,
+                Some("--favorite") => {
+                    request.favorite = args.next().map(|f| f.to_string_lossy().into_owned())
+                }
+                Some(arg) if arg.starts_with("--favorite=") => {
+                    request.favorite = Some(arg["--favorite=".len()..].to_string())
+                }
+                _ => request.paths.push(cwd.join(arg)),
+            }
+        }
+        request
+    }
+
+    /// A plain launch, which only brings the window forward
+    pub fn is_empty(&self) -> bool {
+        self.paths.is_empty() && self.favorite.is_none() && !self.send
+    }
+
+    /// Fold in a request that arrived before this one was picked up
+    pub fn merge(&mut self, other: LaunchRequest) {
+        self.paths.extend(other.paths);
+        if other.favorite.is_some() {
+            self.favorite = other.favorite;
+        }
+        self.send |= other.send;
+    }
+}
+
+/// Outcome of trying to become the running instance
+pub enum Claim {
+    /// Another instance took the request, so this process can exit
+    Forwarded,
+    /// Another instance listens but did not take the request; this process
+    /// exits rather than run beside it
+    Unanswered,
+    /// A windowless receiver runs and declined the request
+    Receiver,
+    /// This process is the running instance, listening unless the socket
+    /// could not be bound
+    Primary(Option<UnixListener>),
+}
+
+/// Hand `request` to a running instance, or become it
+pub fn claim(request: &LaunchRequest) -> Claim {
+    claim_with(|path| forward(path, request))
+}
+
+/// Become the running instance as a windowless receiver. An instance that
+/// already runs is left alone, with nothing forwarded to it.
+pub fn claim_receiver() -> Claim {
+    claim_with(|path| UnixStream::connect(path).map(|_| Claim::Unanswered))
+}
+
+fn claim_with(reach: impl FnOnce(&Path) -> io::Result<Claim>) -> Claim {
+    let path = socket_path();
+    // Held until the socket is bound or the request forwarded
+    let _lock = lock(&path)
+        .map_err(|e| tracing::warn!("Claiming the instance without a lock: {}", e))
+        .ok();
+
+    match reach(&path) {
+        Ok(claim) => return claim,
+        Err(e) if e.kind() == io::ErrorKind::NotFound => {}
+        // Left behind by an instance that did not exit cleanly
+        Err(e) if e.kind() == io::ErrorKind::ConnectionRefused => {
+            tracing::debug!("Replacing stale socket {}", path.display());
+            if let Err(e) = std::fs::remove_file(&path) {
+                tracing::warn!("Failed to remove stale socket: {}", e);
+            }
+        }
+        Err(e) => {
+            tracing::error!(
+                "Running instance at {} did not take the request: {}",
+                path.display(),
+                e
+            );
+            return Claim::Unanswered;
+        }
+    }
+
+    match UnixListener::bind(&path) {
+        Ok(listener) => Claim::Primary(Some(listener)),
+        Err(e) => {
+            tracing::warn!("Single-instance socket unavailable: {}", e);
+            Claim::Primary(None)
+        }
+    }
+}
+
+/// Remove the socket when the running instance exits
+pub fn release() {
+    let _ = std::fs::remove_file(socket_path());
+}
+
+/// Take requests from later launches on a thread of their own
+pub fn serve(listener: UnixListener, on_request: impl Fn(LaunchRequest) + Send + 'static) {
+    serve_with(listener, ACK, on_request);
+}
+
+/// Decline launches on a thread of their own, for a windowless receiver
+pub fn decline(listener: UnixListener) {
+    serve_with(listener, DECLINE, |_| {});
+}
+
+fn serve_with(
+    listener: UnixListener,
+    reply: &'static [u8],
+    on_request: impl Fn(LaunchRequest) + Send + 'static,
+) {
+    let spawned = std::thread::Builder::new()
+        .name("gosh-instance".to_string())
+        .spawn(move || {
+            for stream in listener.incoming() {
+                let request = stream.and_then(|stream| receive(&stream).map(|r| (stream, r)));
+                match request {
+                    Ok((mut stream, request)) => {
+                        let _ = stream.write_all(reply);
+                        on_request(request);
+                    }
+                    // A receiver checking whether an instance runs
+                    Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => {}
+                    Err(e) => tracing::warn!("Dropped launch request: {}", e),
+                }
+            }
+        });
+    if let Err(e) = spawned {
+        tracing::error!("Failed to start instance listener: {}", e);
+    }
+}
+
+/// Wait for the exclusive lock on the file next to the socket
+fn lock(socket: &Path) -> io::Result<File> {
+    let file = OpenOptions::new()
+        .create(true)
+        .truncate(false)
+        .write(true)
+        .mode(0o600)
+        .open(socket.with_extension("lock"))?;
+    file.lock()?;
+    Ok(file)
+}
+
+fn forward(path: &Path, request: &LaunchRequest) -> io::Result<Claim> {
+    let mut stream = UnixStream::connect(path)?;
+    stream.set_read_timeout(Some(ACK_TIMEOUT))?;
+    stream.set_write_timeout(Some(TIMEOUT))?;
+    let mut line = serde_json::to_vec(request)?;
+    line.push(b'\n');
+    stream.write_all(&line)?;
+
+    let mut ack = String::new();
+    BufReader::new(&stream).read_line(&mut ack)?;
+    match ack.as_bytes() {
+        ACK => Ok(Claim::Forwarded),
+        DECLINE => Ok(Claim::Receiver),
+        _ => Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "no acknowledgement",
+        )),
+    }
+}
+
+fn receive(stream: &UnixStream) -> io::Result<LaunchRequest> {
+    stream.set_read_timeout(Some(TIMEOUT))?;
+    stream.set_write_timeout(Some(TIMEOUT))?;
+    let mut line = String::new();
+    if BufReader::new(stream.take(MAX_REQUEST_BYTES)).read_line(&mut line)? == 0 {
+        return Err(io::ErrorKind::UnexpectedEof.into());
+    }
+    serde_json::from_str(&line).map_err(io::Error::from)
+}
+
+/// Socket in the per-user runtime directory, or a per-user name in the
+/// temporary directory where there is none
+fn socket_path() -> PathBuf {
+    match std::env::var_os("XDG_RUNTIME_DIR") {
+        Some(dir) => PathBuf::from(dir).join("gosh-transfer.sock"),
+        None => {
+            let uid = std::fs::metadata("/proc/self").map_or(0, |m| m.uid());
+            std::env::temp_dir().join(format!("gosh-transfer-{}.sock", uid))
+        }
+    }
+}
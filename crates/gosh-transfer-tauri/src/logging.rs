@@ -0,0 +1,403 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Logging
+//
+// Formatted lines are handed to a writer thread through a bounded queue, so
+// a thread that logs never waits on stdout or the disk; when the queue is
+// full the line is dropped and counted. The writer copies lines to stdout
+// and to a log file that is rotated by size. Debug and trace events are
+// sampled per call site, so a hot path logging on every chunk keeps only
+// a burst per second. The level filter sits behind a reload handle and can
+// be changed per module while the app runs; sampling comes after it, so
+// only events the filter lets through are counted.
+
+use std::collections::HashMap;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{self, Receiver, SyncSender, TrySendError};
+use std::sync::{Arc, OnceLock, PoisonError, RwLock};
+use std::time::{Duration, Instant};
+use tracing::callsite::Identifier;
+use tracing::level_filters::LevelFilter;
+use tracing::{Level, Metadata};
+use tracing_subscriber::filter::FilterExt;
+use tracing_subscriber::fmt::MakeWriter;
+use tracing_subscriber::layer::{Context, Filter, SubscriberExt};
+use tracing_subscriber::util::SubscriberInitExt;
+use tracing_subscriber::{reload, EnvFilter, Layer, Registry};
+
+/// Directives applied before `RUST_LOG` and the user's own
+const DEFAULT_DIRECTIVES: &str = "gosh_transfer_tauri=info,gosh_lan_transfer=info";
+
+/// Lines queued for the writer before new ones are dropped
+const QUEUE: usize = 8192;
+
+/// Size at which the log file is rotated
+const MAX_FILE_BYTES: u64 = 10 * 1024 * 1024;
+
+/// Rotated files kept next to the current one
+const KEEP_FILES: usize = 3;
+
+/// Debug and trace events let through per call site each second
+const SAMPLE_BURST: u64 = 20;
+
+/// How often the writer reports lines it dropped or sampled out
+const REPORT_INTERVAL: Duration = Duration::from_secs(60);
+
+/// How long a quit waits for queued lines to be written
+const FLUSH_TIMEOUT: Duration = Duration::from_secs(1);
+
+enum Message {
+    Line(Vec<u8>),
+    Flush(SyncSender<()>),
+}
+
+/// Lines lost on the way to the writer
+#[derive(Default)]
+struct Counters {
+    dropped: AtomicU64,
+    sampled_out: AtomicU64,
+}
+
+struct Logging {
+    filter: reload::Handle<EnvFilter, Registry>,
+    queue: SyncSender<Message>,
+}
+
+static LOGGING: OnceLock<Logging> = OnceLock::new();
+
+/// Install the global subscriber and start the writer thread
+pub fn init() {
+    let counters = Arc::new(Counters::default());
+    let (queue, lines) = mpsc::sync_channel(QUEUE);
+    let file = log_dir().map(|dir| dir.join("gosh-transfer.log"));
+    let writer_counters = counters.clone();
+    let spawned = std::thread::Builder::new()
+        .name("gosh-log".to_string())
+        .spawn(move || write_lines(lines, file, writer_counters));
+
+    let (filter, handle) = reload::Layer::new(env_filter(""));
+    let writer = QueueWriter {
+        queue: queue.clone(),
+        counters: counters.clone(),
+    };
+    tracing_subscriber::registry()
+        .with(
+            tracing_subscriber::fmt::layer()
+                .with_ansi(false)
+                .with_writer(writer)
+                // The sampler is only asked about events the level filter passes
+                .with_filter(filter.and(Sampler::new(counters))),
+        )
+        .init();
+
+    if let Err(e) = spawned {
+        eprintln!("Failed to start log writer: {}", e);
+    }
+    let _ = LOGGING.set(Logging {
+        filter: handle,
+        queue,
+    });
+}
+
+/// Replace the user's level directives, such as
+/// `gosh_transfer_tauri::acceptors=debug`. An empty string restores the
+/// defaults.
+pub fn set_filter(directives: &str) -> Result<(), String> {
+    let logging = LOGGING.get().ok_or("Logging is not initialized")?;
+    // Checked first, as building the filter skips invalid directives
+    for directive in directives.split(',').filter(|d| !d.trim().is_empty()) {
+        directive
+            .trim()
+            .parse::<tracing_subscriber::filter::Directive>()
+            .map_err(|e| format!("Invalid log directive '{}': {}", directive, e))?;
+    }
+    logging
+        .filter
+        .reload(env_filter(directives))
+        .map_err(|e| e.to_string())?;
+    tracing::info!("Log filter set to '{}'", directives);
+    Ok(())
+}
+
+/// Write out queued lines before the process exits
+pub fn flush() {
+    let Some(logging) = LOGGING.get() else {
+        return;
+    };
+    let (done, flushed) = mpsc::sync_channel(1);
+    if logging.queue.send(Message::Flush(done)).is_ok() {
+        let _ = flushed.recv_timeout(FLUSH_TIMEOUT);
+    }
+}
+
+fn env_filter(directives: &str) -> EnvFilter {
+    let mut filter = EnvFilter::new(DEFAULT_DIRECTIVES);
+    let env = std::env::var(EnvFilter::DEFAULT_ENV).unwrap_or_default();
+    for directive in env.split(',').chain(directives.split(',')) {
+        if let Ok(directive) = directive.trim().parse() {
+            filter = filter.add_directive(directive);
+        }
+    }
+    filter
+}
+
+fn log_dir() -> Option<PathBuf> {
+    let dir = directories::ProjectDirs::from("com", "gosh", "transfer")?
+        .data_local_dir()
+        .join("logs");
+    fs::create_dir_all(&dir).ok()?;
+    Some(dir)
+}
+
+/// Hands each formatted line to the writer thread
+#[derive(Clone)]
+struct QueueWriter {
+    queue: SyncSender<Message>,
+    counters: Arc<Counters>,
+}
+
+impl<'a> MakeWriter<'a> for QueueWriter {
+    type Writer = QueuedLine;
+
+    fn make_writer(&'a self) -> Self::Writer {
+        QueuedLine {
+            line: Vec::new(),
+            writer: self.clone(),
+        }
+    }
+}
+
+/// One event's output, queued when dropped
+struct QueuedLine {
+    line: Vec<u8>,
+    writer: QueueWriter,
+}
+
+impl Write for QueuedLine {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.line.extend_from_slice(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Drop for QueuedLine {
+    fn drop(&mut self) {
+        if self.line.is_empty() {
+            return;
+        }
+        let line = std::mem::take(&mut self.line);
+        if let Err(TrySendError::Full(_)) = self.writer.queue.try_send(Message::Line(line)) {
+            self.writer.counters.dropped.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+fn write_lines(lines: Receiver<Message>, path: Option<PathBuf>, counters: Arc<Counters>) {
+    let mut file = path
+        .as_deref()
+        .and_then(|path| RotatingFile::open(path).ok());
+    let mut stdout = io::stdout();
+    let mut reported = Instant::now();
+
+    loop {
+        let message = match lines.recv_timeout(REPORT_INTERVAL) {
+            Ok(message) => Some(message),
+            Err(mpsc::RecvTimeoutError::Timeout) => None,
+            Err(mpsc::RecvTimeoutError::Disconnected) => break,
+        };
+        match message {
+            Some(Message::Line(line)) => {
+                let _ = stdout.write_all(&line);
+                if let Some(file) = &mut file {
+                    file.write(&line);
+                }
+            }
+            Some(Message::Flush(done)) => {
+                let _ = stdout.flush();
+                if let Some(file) = &mut file {
+                    file.flush();
+                }
+                let _ = done.send(());
+            }
+            None => {}
+        }
+
+        if reported.elapsed() >= REPORT_INTERVAL {
+            reported = Instant::now();
+            let dropped = counters.dropped.swap(0, Ordering::Relaxed);
+            let sampled_out = counters.sampled_out.swap(0, Ordering::Relaxed);
+            if dropped > 0 || sampled_out > 0 {
+                let line = format!(
+                    "{} gosh_transfer_tauri::logging: {} line(s) dropped, {} sampled out\n",
+                    chrono::Utc::now().to_rfc3339(),
+                    dropped,
+                    sampled_out
+                );
+                let _ = stdout.write_all(line.as_bytes());
+                if let Some(file) = &mut file {
+                    file.write(line.as_bytes());
+                }
+            }
+        }
+    }
+}
+
+/// Log file that moves aside once it grows past `MAX_FILE_BYTES`
+struct RotatingFile {
+    path: PathBuf,
+    file: File,
+    len: u64,
+}
+
+impl RotatingFile {
+    fn open(path: &Path) -> io::Result<Self> {
+        let file = OpenOptions::new().create(true).append(true).open(path)?;
+        let len = file.metadata()?.len();
+        Ok(Self {
+            path: path.to_path_buf(),
+            file,
+            len,
+        })
+    }
+
+    fn write(&mut self, line: &[u8]) {
+        if self.len + line.len() as u64 > MAX_FILE_BYTES {
+            if let Err(e) = self.rotate() {
+                eprintln!("Failed to rotate {}: {}", self.path.display(), e);
+            }
+        }
+        if self.file.write_all(line).is_ok() {
+            self.len += line.len() as u64;
+        }
+    }
+
+    fn flush(&mut self) {
+        let _ = self.file.flush();
+    }
+
+    /// Shift `log.1` to `log.2` and so on, dropping the oldest
+    fn rotate(&mut self) -> io::Result<()> {
+        self.file.flush()?;
+        let rotated = |n: usize| PathBuf::from(format!("{}.{}", self.path.display(), n));
+        for n in (1..KEEP_FILES).rev() {
+            let _ = fs::rename(rotated(n), rotated(n + 1));
+        }
+        fs::rename(&self.path, rotated(1))?;
+        *self = Self::open(&self.path)?;
+        Ok(())
+    }
+}
+
+/// Lets at most `SAMPLE_BURST` debug and trace events through per call
+/// site each second. Each call site has a counter of its own, holding the
+/// current second and its count; the map of them is only written when a
+/// call site is first sampled.
+struct Sampler {
+    sites: RwLock<HashMap<Identifier, AtomicU64>>,
+    started: Instant,
+    counters: Arc<Counters>,
+}
+
+impl Sampler {
+    fn new(counters: Arc<Counters>) -> Self {
+        Self {
+            sites: RwLock::new(HashMap::new()),
+            started: Instant::now(),
+            counters,
+        }
+    }
+
+    fn sampled(meta: &Metadata<'_>) -> bool {
+        meta.is_event() && *meta.level() > Level::INFO
+    }
+
+    /// Count an event against its call site's burst
+    fn admit(&self, site: &AtomicU64) -> bool {
+        let second = self.started.elapsed().as_secs() & 0xffff_ffff;
+        let mut current = site.load(Ordering::Relaxed);
+        loop {
+            let next = match (current >> 32, current & 0xffff_ffff) {
+                (at, count) if at == second && count >= SAMPLE_BURST => {
+                    self.counters.sampled_out.fetch_add(1, Ordering::Relaxed);
+                    return false;
+                }
+                (at, _) if at == second => current + 1,
+                _ => (second << 32) | 1,
+            };
+            match site.compare_exchange_weak(current, next, Ordering::Relaxed, Ordering::Relaxed) {
+                Ok(_) => return true,
+                Err(actual) => current = actual,
+            }
+        }
+    }
+}
+
+impl<S> Filter<S> for Sampler {
+    fn enabled(&self, meta: &Metadata<'_>, _: &Context<'_, S>) -> bool {
+        if !Self::sampled(meta) {
+            return true;
+        }
+        let callsite = meta.callsite();
+        {
+            let sites = self.sites.read().unwrap_or_else(PoisonError::into_inner);
+            if let Some(site) = sites.get(&callsite) {
+                return self.admit(site);
+            }
+        }
+        let mut sites = self.sites.write().unwrap_or_else(PoisonError::into_inner);
+        self.admit(sites.entry(callsite).or_default())
+    }
+
+    fn callsite_enabled(&self, meta: &'static Metadata<'static>) -> tracing::subscriber::Interest {
+        // Sampled call sites are asked about on every event
+        if Self::sampled(meta) {
+            tracing::subscriber::Interest::sometimes()
+        } else {
+            tracing::subscriber::Interest::always()
+        }
+    }
+
+    /// Sampling thins events out but never hides a level
+    fn max_level_hint(&self) -> Option<LevelFilter> {
+        Some(LevelFilter::TRACE)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_sampler_counts_only_events_the_filter_passes() {
+        let counters = Arc::new(Counters::default());
+        let (filter, handle) = reload::Layer::new(EnvFilter::new("info"));
+        let subscriber = tracing_subscriber::registry().with(
+            tracing_subscriber::fmt::layer()
+                .with_test_writer()
+                .with_filter(filter.and(Sampler::new(counters.clone()))),
+        );
+
+        tracing::subscriber::with_default(subscriber, || {
+            for _ in 0..100 {
+                tracing::debug!("filtered out");
+            }
+            assert_eq!(counters.sampled_out.load(Ordering::Relaxed), 0);
+
+            handle.reload(EnvFilter::new("debug")).unwrap();
+            for _ in 0..SAMPLE_BURST + 10 {
+                tracing::debug!("sampled");
+            }
+            // Another call site has a burst of its own
+            for _ in 0..5 {
+                tracing::debug!("elsewhere");
+            }
+            assert_eq!(counters.sampled_out.load(Ordering::Relaxed), 10);
+        });
+    }
+}
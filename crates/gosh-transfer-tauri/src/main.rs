@@ -8,28 +8,74 @@
     windows_subsystem = "windows"
 )]
 
+mod acceptors;
+mod activation;
+mod chain;
 mod commands;
 mod engine_bridge;
+mod handover;
+mod identity;
+mod instance;
+mod logging;
+mod multicast;
+mod notify;
+mod outbox;
+mod prompt;
+mod pull;
+mod quic;
+mod race;
+mod sends;
+mod snapshot;
 mod state;
+mod tls;
+mod tray;
 
 use gosh_lan_transfer::EngineEvent;
+use gosh_transfer_core::FrontendEvent;
 use state::AppState;
 use std::sync::Arc;
 use std::thread;
+use std::time::Duration;
 use tauri::Emitter;
+use tauri_plugin_notification::NotificationExt;
+
+/// How long running transfers may take to finish when the app quits
+const SHUTDOWN_DEADLINE: Duration = Duration::from_secs(10);
 
 fn main() {
     // Initialize tracing
-    tracing_subscriber::fmt()
-        .with_env_filter(
-            tracing_subscriber::EnvFilter::from_default_env()
-                .add_directive("gosh_transfer_tauri=info".parse().unwrap())
-                .add_directive("gosh_lan_transfer=info".parse().unwrap()),
-        )
-        .init();
+    logging::init();
+
+    // Started by a systemd socket unit: receive without a window
+    let listeners = activation::listen_fds();
+    if !listeners.is_empty() {
+        run_activated(listeners);
+        return;
+    }
+
+    // Hand the arguments to a running instance if there is one
+    let launch = instance::LaunchRequest::from_args(std::env::args_os().skip(1));
+    let mut claim = instance::claim(&launch);
+    // A windowless receiver has no window to take the request; this
+    // process replaces it
+    let mut socket_unit = false;
+    if let instance::Claim::Receiver = claim {
+        socket_unit = activation::stop_receiver();
+        claim = instance::claim(&launch);
+    }
+    let instance_listener = match claim {
+        instance::Claim::Forwarded | instance::Claim::Unanswered | instance::Claim::Receiver => {
+            return
+        }
+        instance::Claim::Primary(listener) => listener,
+    };
+    let primary = instance_listener.is_some();
+    // The socket unit holds the port while it listens, receiver or not
+    socket_unit |= activation::stop_receiver();
 
     // Create application state
-    let app_state = Arc::new(AppState::new().expect("Failed to initialize application state"));
+    let app_state = Arc::new(AppState::new(false).expect("Failed to initialize application state"));
+    let exit_state = app_state.clone();
 
     tauri::Builder::default()
         .plugin(tauri_plugin_shell::init())
@@ -39,12 +85,53 @@ fn main() {
         .setup(move |app| {
             let handle = app.handle().clone();
             let event_rx = app_state.bridge.event_receiver();
+            tray::install(&handle)?;
+
+            if !launch.is_empty() {
+                app_state.frontend.set_launch(launch);
+            }
+            if let Some(listener) = instance_listener {
+                let state = app_state.clone();
+                let handle = handle.clone();
+                instance::serve(listener, move |request| {
+                    let requested = !request.is_empty();
+                    if requested {
+                        state.frontend.set_launch(request);
+                    }
+                    let shown = handle.clone();
+                    let _ = handle.run_on_main_thread(move || tray::show_window(&shown));
+                    if requested {
+                        let _ = handle.emit("launch-request", ());
+                    }
+                });
+            }
+
+            // Completions are summarized per burst rather than shown one by one
+            let settings_state = app_state.clone();
+            let notify_handle = handle.clone();
+            let notifier = notify::Notifier::start(
+                app_state.history.clone(),
+                move || settings_state.settings.get().notifications_enabled,
+                move |title, body| {
+                    if let Err(e) = notify_handle
+                        .notification()
+                        .builder()
+                        .title(title)
+                        .body(body)
+                        .show()
+                    {
+                        tracing::warn!("Failed to show notification: {}", e);
+                    }
+                },
+            );
 
             // Spawn event listener thread
+            let state = app_state.clone();
             thread::spawn(move || {
                 while let Ok(event) = event_rx.recv_blocking() {
-                    let event_json = engine_event_to_json(&event);
-                    let _ = handle.emit("engine-event", event_json);
+                    state.frontend.record(&event);
+                    notifier.observe(&event);
+                    let _ = handle.emit("engine-event", FrontendEvent::from(&event));
                 }
             });
 
@@ -63,11 +150,24 @@ fn main() {
             commands::get_peer_info,
             commands::send_files,
             commands::send_directory,
+            commands::send_chain,
+            commands::list_chains,
+            commands::send_multicast,
+            commands::send_offer,
+            commands::list_pulls,
+            commands::retry_pull,
             commands::accept_transfer,
             commands::reject_transfer,
+            commands::accept_transfer_selection,
             commands::accept_all,
             commands::reject_all,
             commands::cancel_transfer,
+            commands::accept_transfers,
+            commands::reject_transfers,
+            commands::cancel_transfers,
+            commands::start_approval_session,
+            commands::list_approval_sessions,
+            commands::revoke_approval_session,
             commands::get_pending_transfers,
             commands::get_interfaces,
             commands::get_settings,
@@ -77,74 +177,116 @@ fn main() {
             commands::update_favorite,
             commands::delete_favorite,
             commands::touch_favorite,
+            commands::get_favorite_filter,
+            commands::set_favorite_filter,
+            commands::get_favorite_routes,
+            commands::set_favorite_addresses,
             commands::list_history,
             commands::clear_history,
+            commands::list_known_peers,
+            commands::get_transport_capabilities,
+            commands::forget_known_peer,
+            commands::list_outbox,
+            commands::list_sends,
+            commands::cancel_queued_send,
             commands::change_port,
+            commands::get_snapshot,
+            commands::set_current_page,
+            commands::take_launch_request,
+            commands::set_log_filter,
             commands::get_version,
         ])
-        .run(tauri::generate_context!())
-        .expect("error while running tauri application");
+        .build(tauri::generate_context!())
+        .expect("error while building tauri application")
+        .run(move |_, event| match event {
+            // The window was closed rather than the app quit from the tray
+            tauri::RunEvent::ExitRequested {
+                code: None, api, ..
+            } if exit_state.settings.get().tray_mode => {
+                api.prevent_exit();
+                tracing::info!("Window closed, still receiving from the tray");
+            }
+            tauri::RunEvent::Exit => {
+                if primary {
+                    instance::release();
+                }
+                exit_state.bridge.shutdown(SHUTDOWN_DEADLINE);
+                if socket_unit {
+                    activation::start_receiver();
+                }
+                logging::flush();
+            }
+            _ => {}
+        });
 }
 
-/// Convert engine event to JSON for frontend
-fn engine_event_to_json(event: &EngineEvent) -> serde_json::Value {
-    match event {
-        EngineEvent::TransferRequest(transfer) => {
-            serde_json::json!({
-                "type": "TransferRequest",
-                "transfer": transfer
-            })
+/// Serve sockets inherited from systemd until the bridge exits when idle,
+/// or until systemd stops the service
+fn run_activated(listeners: Vec<std::net::TcpListener>) {
+    tracing::info!("Socket activated with {} listener(s)", listeners.len());
+    // Never beside a window, which owns the port while it runs
+    let instance_listener = match instance::claim_receiver() {
+        instance::Claim::Primary(listener) => listener,
+        _ => {
+            tracing::info!("Gosh Transfer is already running, leaving the connection to it");
+            return;
         }
-        EngineEvent::TransferProgress(progress) => {
-            serde_json::json!({
-                "type": "TransferProgress",
-                "progress": progress
-            })
-        }
-        EngineEvent::TransferComplete { transfer_id } => {
-            serde_json::json!({
-                "type": "TransferComplete",
-                "transferId": transfer_id
-            })
-        }
-        EngineEvent::TransferFailed { transfer_id, error } => {
-            serde_json::json!({
-                "type": "TransferFailed",
-                "transferId": transfer_id,
-                "error": error
-            })
-        }
-        EngineEvent::TransferRetry {
-            transfer_id,
-            attempt,
-            max_attempts,
-            error,
-        } => {
-            serde_json::json!({
-                "type": "TransferRetry",
-                "transferId": transfer_id,
-                "attempt": attempt,
-                "maxAttempts": max_attempts,
-                "error": error
-            })
-        }
-        EngineEvent::ServerStarted { port } => {
-            serde_json::json!({
-                "type": "ServerStarted",
-                "port": port
-            })
-        }
-        EngineEvent::ServerStopped => {
-            serde_json::json!({
-                "type": "ServerStopped"
-            })
+    };
+    let primary = instance_listener.is_some();
+    if let Some(listener) = instance_listener {
+        instance::decline(listener);
+    }
+
+    let app_state = AppState::new(true).expect("Failed to initialize application state");
+    let event_rx = app_state.bridge.event_receiver();
+    let commands = app_state.bridge.command_sender();
+    let _ = commands.try_send(engine_bridge::EngineCommand::StartActivated { listeners });
+
+    let runtime = tokio::runtime::Builder::new_current_thread()
+        .enable_all()
+        .build()
+        .expect("Failed to create Tokio runtime");
+    // Trusted and approved peers were accepted by the bridge; the rest
+    // are asked about
+    let ask = |event: EngineEvent| {
+        if let EngineEvent::TransferRequest(transfer) = event {
+            let commands = commands.clone();
+            let id = transfer.id.clone();
+            prompt::ask(&transfer, move |accept| {
+                let command = if accept {
+                    engine_bridge::EngineCommand::AcceptTransfer { id }
+                } else {
+                    engine_bridge::EngineCommand::RejectTransfer { id }
+                };
+                let _ = commands.try_send(command);
+            });
         }
-        EngineEvent::PortChanged { old_port, new_port } => {
-            serde_json::json!({
-                "type": "PortChanged",
-                "oldPort": old_port,
-                "newPort": new_port
-            })
+    };
+    let stopped = runtime.block_on(async {
+        let Ok(mut terminate) =
+            tokio::signal::unix::signal(tokio::signal::unix::SignalKind::terminate())
+        else {
+            while let Ok(event) = event_rx.recv().await {
+                ask(event);
+            }
+            return false;
+        };
+        loop {
+            tokio::select! {
+                _ = terminate.recv() => return true,
+                // The bridge closes its events when it exits
+                event = event_rx.recv() => match event {
+                    Ok(event) => ask(event),
+                    Err(_) => return false,
+                },
+            }
         }
+    });
+    if stopped {
+        app_state.bridge.shutdown(SHUTDOWN_DEADLINE);
+    }
+    if primary {
+        instance::release();
     }
+    logging::flush();
 }
@@ -0,0 +1,704 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Multicast distribution
+//
+// Sends one file to many receivers as UDP multicast. The session is
+// announced to each receiver as an ordinary transfer; receivers that opted
+// in join the group when the announcement arrives, and NACK missing blocks
+// to the sender's repair port after each round. An empty NACK confirms a
+// complete copy. Sockets are blocking and run on the blocking pool, so
+// disk and pacing waits never hold up the engine's runtime.
+//
+// Every datagram carries an HMAC keyed by a random session key that only
+// travels in the announcement. Receivers take datagrams only from the
+// address the announcement came from, the sender counts confirmations only
+// from receivers that took it, and the reassembled file must match the
+// announced SHA-256 before it is moved into place.
+
+use crate::engine_bridge::SendRoute;
+use gosh_lan_transfer::{EngineEvent, PendingTransfer};
+use gosh_transfer_core::filter::staging_root;
+use gosh_transfer_core::multicast::{
+    Packet, BLOCK_SIZE, MAX_NACK_RANGES, MAX_SIZE, MULTICAST_GROUP,
+};
+use gosh_transfer_core::{BlockMap, ChainHop, MulticastAnnouncement};
+use ring::hmac;
+use ring::rand::{SecureRandom, SystemRandom};
+use socket2::{Domain, Protocol, Socket, Type};
+use std::collections::{BTreeSet, HashMap, HashSet};
+use std::fs::File;
+use std::io::{self, Read};
+use std::net::{IpAddr, Ipv4Addr, SocketAddr, UdpSocket};
+use std::os::unix::fs::FileExt;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+/// UDP port data datagrams are multicast to
+const MULTICAST_PORT: u16 = 53319;
+/// Time for receivers to join the group after their announcement arrived
+const JOIN_DELAY: Duration = Duration::from_millis(500);
+/// How long the sender waits for NACKs after a round
+const REPAIR_WINDOW: Duration = Duration::from_secs(1);
+/// Rounds before the sender gives up on receivers that have not confirmed
+const MAX_ROUNDS: u32 = 50;
+/// Silence after which a receiver NACKs on its own, in case an end was lost
+const RECEIVE_IDLE: Duration = Duration::from_secs(2);
+/// Unanswered idle NACKs before a receiver gives up
+const MAX_IDLE_NACKS: u32 = 10;
+/// Blocks read from disk per batch while sending
+const READ_BATCH: usize = 256;
+/// Bytes of the session key
+const KEY_LEN: usize = 32;
+/// Bytes of the HMAC-SHA256 tag after each datagram
+const TAG_LEN: usize = 32;
+/// Room for a datagram's header and tag around its payload
+const DATAGRAM_OVERHEAD: usize = 64 + TAG_LEN;
+
+/// Multicast sessions announced to this device
+#[derive(Default)]
+pub struct Multicasts {
+    /// Announcement file name and sender, by transfer id
+    incoming: HashMap<String, (String, String)>,
+}
+
+impl Multicasts {
+    /// Start a session sending `path` to `receivers`, returning its id
+    pub fn start(
+        &self,
+        route: SendRoute,
+        receivers: Vec<ChainHop>,
+        path: PathBuf,
+        rate_bps: u64,
+    ) -> Result<String, String> {
+        if receivers.is_empty() {
+            return Err("Multicast needs at least one receiver".to_string());
+        }
+        let meta = std::fs::metadata(&path).map_err(|e| e.to_string())?;
+        if !meta.is_file() {
+            return Err(format!("Multicast sends a single file: {}", path.display()));
+        }
+        if meta.len() > MAX_SIZE {
+            return Err(format!(
+                "Multicast carries files up to {} bytes: {}",
+                MAX_SIZE,
+                path.display()
+            ));
+        }
+        let file_name = path
+            .file_name()
+            .map(|n| n.to_string_lossy().to_string())
+            .ok_or_else(|| format!("Invalid file: {}", path.display()))?;
+
+        let repair = UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))
+            .map_err(|e| format!("Failed to open repair socket: {}", e))?;
+        let mut key = [0u8; KEY_LEN];
+        SystemRandom::new()
+            .fill(&mut key)
+            .map_err(|_| "No randomness for a session key".to_string())?;
+        let mut announcement = MulticastAnnouncement {
+            session: session_id(),
+            group: MULTICAST_GROUP,
+            port: MULTICAST_PORT,
+            repair_port: repair.local_addr().map_err(|e| e.to_string())?.port(),
+            file_name,
+            size: meta.len(),
+            key: to_hex(&key),
+            sha256: String::new(),
+        };
+        let id = format!("{:016x}", announcement.session);
+
+        tokio::spawn(async move {
+            let session = announcement.session;
+            let source = path.clone();
+            match tokio::task::spawn_blocking(move || file_sha256(&source)).await {
+                Ok(Ok(sha256)) => announcement.sha256 = sha256,
+                Ok(Err(e)) => return tracing::error!("Multicast {:016x} failed: {}", session, e),
+                Err(e) => return tracing::error!("Multicast {:016x} failed: {}", session, e),
+            }
+            let announced = announce(&route, &receivers, &announcement).await;
+            if announced.is_empty() {
+                tracing::error!(
+                    "Multicast {:016x}: no receiver took the announcement",
+                    session
+                );
+                return;
+            }
+            tokio::time::sleep(JOIN_DELAY).await;
+
+            let expected = announced.len();
+            let sent = tokio::task::spawn_blocking(move || {
+                send_blocking(&announcement, &path, repair, &announced, rate_bps)
+            })
+            .await;
+            match sent {
+                Ok(Ok(confirmed)) if confirmed == expected => {
+                    tracing::info!(
+                        "Multicast {:016x}: all {} receivers complete",
+                        session,
+                        expected
+                    )
+                }
+                Ok(Ok(confirmed)) => tracing::warn!(
+                    "Multicast {:016x}: {} of {} receivers confirmed",
+                    session,
+                    confirmed,
+                    expected
+                ),
+                Ok(Err(e)) => tracing::error!("Multicast {:016x} failed: {}", session, e),
+                Err(e) => tracing::error!("Multicast {:016x} failed: {}", session, e),
+            }
+        });
+        Ok(id)
+    }
+
+    /// Note a request that carries a multicast announcement
+    pub fn on_request(&mut self, transfer: &PendingTransfer) {
+        if let Some(file) = transfer
+            .files
+            .iter()
+            .find(|f| MulticastAnnouncement::is_announcement(&f.name))
+        {
+            self.incoming.insert(
+                transfer.id.clone(),
+                (file.name.clone(), transfer.peer_address.clone()),
+            );
+        }
+    }
+
+    /// Join the session once its announcement has arrived
+    pub fn on_event(&mut self, event: &EngineEvent, download_dir: &Path, enabled: bool) {
+        let (transfer_id, complete) = match event {
+            EngineEvent::TransferComplete { transfer_id } => (transfer_id, true),
+            EngineEvent::TransferFailed { transfer_id, .. } => (transfer_id, false),
+            _ => return,
+        };
+        let Some((name, sender)) = self.incoming.remove(transfer_id) else {
+            return;
+        };
+        let path = download_dir.join(&name);
+        let announcement = MulticastAnnouncement::read(&path);
+        let _ = std::fs::remove_file(&path);
+        if !complete {
+            return;
+        }
+        if !enabled {
+            tracing::info!("Ignoring multicast from {}: multicast is off", sender);
+            return;
+        }
+        let announcement = match announcement {
+            Ok(announcement) => announcement,
+            Err(e) => {
+                tracing::warn!("Ignoring multicast from {}: {}", sender, e);
+                return;
+            }
+        };
+        let Ok(sender) = sender.parse::<IpAddr>() else {
+            return;
+        };
+
+        let download_dir = download_dir.to_path_buf();
+        tokio::task::spawn_blocking(move || {
+            let session = announcement.session;
+            match receive_blocking(&announcement, sender, &download_dir) {
+                Ok(path) => tracing::info!("Multicast {:016x} received: {:?}", session, path),
+                Err(e) => tracing::error!("Multicast {:016x} failed: {}", session, e),
+            }
+        });
+    }
+}
+
+fn session_id() -> u64 {
+    let nanos = std::time::SystemTime::now()
+        .duration_since(std::time::UNIX_EPOCH)
+        .map(|d| d.as_nanos() as u64)
+        .unwrap_or(0);
+    nanos ^ (u64::from(std::process::id()) << 32)
+}
+
+/// Send the announcement to every receiver, returning the addresses of
+/// those that took it
+async fn announce(
+    route: &SendRoute,
+    receivers: &[ChainHop],
+    announcement: &MulticastAnnouncement,
+) -> Vec<IpAddr> {
+    let dir = match staging_root() {
+        Ok(root) => root.join(format!("multicast-{:016x}", announcement.session)),
+        Err(e) => {
+            tracing::error!("Multicast announcement failed: {}", e);
+            return Vec::new();
+        }
+    };
+    let path = match announcement.write(&dir) {
+        Ok(path) => path,
+        Err(e) => {
+            tracing::error!("Multicast announcement failed: {}", e);
+            return Vec::new();
+        }
+    };
+
+    let mut sends = tokio::task::JoinSet::new();
+    for receiver in receivers.iter().cloned() {
+        let (route, path) = (route.clone(), path.clone());
+        sends.spawn(async move {
+            let result = route
+                .send_files(&receiver.address, receiver.port, vec![path])
+                .await;
+            if let Err(e) = &result {
+                tracing::warn!(
+                    "Multicast announcement to {} failed: {}",
+                    receiver.address,
+                    e
+                );
+            }
+            // Hops are resolved to IPs before a session starts
+            result
+                .ok()
+                .and_then(|()| receiver.address.parse::<IpAddr>().ok())
+        });
+    }
+    let mut announced = Vec::new();
+    while let Some(result) = sends.join_next().await {
+        if let Ok(Some(address)) = result {
+            announced.push(address);
+        }
+    }
+    let _ = std::fs::remove_dir_all(&dir);
+    announced
+}
+
+/// Multicast the file in rounds until every receiver confirmed or rounds run
+/// out, returning the number of confirmed receivers
+fn send_blocking(
+    announcement: &MulticastAnnouncement,
+    path: &Path,
+    repair: UdpSocket,
+    receivers: &[IpAddr],
+    rate_bps: u64,
+) -> io::Result<usize> {
+    let key = session_key(announcement)?;
+    let file = File::open(path)?;
+    let data = UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))?;
+    data.set_multicast_ttl_v4(1)?;
+    data.set_multicast_loop_v4(true)?;
+    // Leave from the interface the receivers are reached through, so the
+    // source address is the one their announcement came from
+    if let Some(&receiver) = receivers.first() {
+        socket2::SockRef::from(&data).set_multicast_if_v4(&local_address_toward(receiver)?)?;
+    }
+    repair.set_read_timeout(Some(REPAIR_WINDOW))?;
+
+    let group = SocketAddr::new(announcement.group.into(), announcement.port);
+    let blocks = announcement.blocks();
+    let mut pending: Vec<u32> = (0..blocks).collect();
+    let mut confirmed = HashSet::new();
+
+    for round in 1..=MAX_ROUNDS {
+        send_round(announcement, &key, &file, &data, group, &pending, rate_bps)?;
+
+        let end = encoded(
+            &Packet::End {
+                session: announcement.session,
+                blocks,
+            },
+            &key,
+        );
+        for _ in 0..3 {
+            data.send_to(&end, group)?;
+        }
+
+        // Gather NACKs until the repair window passes quietly
+        let mut missing = BTreeSet::new();
+        let mut buf = [0u8; 2048];
+        loop {
+            let (len, from) = match repair.recv_from(&mut buf) {
+                Ok(received) => received,
+                Err(e)
+                    if matches!(
+                        e.kind(),
+                        io::ErrorKind::WouldBlock | io::ErrorKind::TimedOut
+                    ) =>
+                {
+                    break
+                }
+                Err(e) => return Err(e),
+            };
+            if !receivers.contains(&from.ip()) {
+                continue;
+            }
+            let Some(Packet::Nack { session, ranges }) =
+                open(&key, &buf[..len]).and_then(Packet::decode)
+            else {
+                continue;
+            };
+            if session != announcement.session {
+                continue;
+            }
+            if ranges.is_empty() {
+                confirmed.insert(from);
+                continue;
+            }
+            for (first, count) in ranges {
+                missing.extend(first.min(blocks)..first.saturating_add(count).min(blocks));
+            }
+        }
+
+        if confirmed.len() >= receivers.len() {
+            return Ok(confirmed.len());
+        }
+        // With nothing to repair the next round only repeats the end, for
+        // receivers whose end or confirmation was lost
+        tracing::info!(
+            "Multicast {:016x} round {}: repairing {} block(s), {} of {} receivers confirmed",
+            announcement.session,
+            round,
+            missing.len(),
+            confirmed.len(),
+            receivers.len()
+        );
+        pending = missing.into_iter().collect();
+    }
+    Ok(confirmed.len())
+}
+
+/// Multicast `blocks` of the file, paced to `rate_bps`
+fn send_round(
+    announcement: &MulticastAnnouncement,
+    key: &hmac::Key,
+    file: &File,
+    socket: &UdpSocket,
+    group: SocketAddr,
+    blocks: &[u32],
+    rate_bps: u64,
+) -> io::Result<()> {
+    let started = Instant::now();
+    let mut sent: u64 = 0;
+    let mut payload = vec![0u8; BLOCK_SIZE * READ_BATCH];
+    let mut datagram = Vec::with_capacity(BLOCK_SIZE + DATAGRAM_OVERHEAD);
+
+    for batch in blocks.chunks(READ_BATCH) {
+        for (i, &block) in batch.iter().enumerate() {
+            let offset = u64::from(block) * BLOCK_SIZE as u64;
+            let len = (announcement.size - offset).min(BLOCK_SIZE as u64) as usize;
+            let chunk = &mut payload[i * BLOCK_SIZE..i * BLOCK_SIZE + len];
+            file.read_exact_at(chunk, offset)?;
+
+            Packet::Data {
+                session: announcement.session,
+                block,
+                payload: chunk,
+            }
+            .encode(&mut datagram);
+            seal(key, &mut datagram);
+            socket.send_to(&datagram, group)?;
+            sent += len as u64;
+        }
+
+        let due = Duration::from_secs_f64(sent as f64 / rate_bps.max(1) as f64);
+        if let Some(wait) = due.checked_sub(started.elapsed()) {
+            std::thread::sleep(wait);
+        }
+    }
+    Ok(())
+}
+
+/// Receive a session into the download directory, returning the file's path
+fn receive_blocking(
+    announcement: &MulticastAnnouncement,
+    sender: IpAddr,
+    download_dir: &Path,
+) -> io::Result<PathBuf> {
+    let key = session_key(announcement)?;
+    let interface = local_address_toward(sender)?;
+    let socket = join_group(announcement.group, announcement.port, interface)?;
+    // NACKs leave from their own port so the sender tells receivers on one host apart
+    let control = UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))?;
+    let repair_to = SocketAddr::new(sender, announcement.repair_port);
+
+    let part = download_dir.join(format!(
+        ".{}.{:016x}.part",
+        announcement.file_name, announcement.session
+    ));
+    let file = File::create(&part)?;
+    file.set_len(announcement.size)?;
+
+    let mut map = BlockMap::new(announcement.blocks());
+    let mut buf = vec![0u8; BLOCK_SIZE + DATAGRAM_OVERHEAD];
+    let mut idle_nacks = 0;
+
+    let result = loop {
+        let len = match socket.recv_from(&mut buf) {
+            Ok((len, from)) if from.ip() == sender => len,
+            Ok(_) => continue,
+            Err(e)
+                if matches!(
+                    e.kind(),
+                    io::ErrorKind::WouldBlock | io::ErrorKind::TimedOut
+                ) =>
+            {
+                // The end of a round may have been lost; ask on our own
+                idle_nacks += 1;
+                if idle_nacks > MAX_IDLE_NACKS {
+                    break Err(io::Error::new(
+                        io::ErrorKind::TimedOut,
+                        "sender went silent",
+                    ));
+                }
+                send_nack(&control, &key, repair_to, announcement.session, &map)?;
+                if map.is_complete() {
+                    break Ok(());
+                }
+                continue;
+            }
+            Err(e) => break Err(e),
+        };
+        match open(&key, &buf[..len]).and_then(Packet::decode) {
+            Some(Packet::Data {
+                session,
+                block,
+                payload,
+            }) if session == announcement.session => {
+                // Anything but the block's exact length would write past the
+                // file or leave a hole marked as received
+                let offset = u64::from(block) * BLOCK_SIZE as u64;
+                let expected = announcement
+                    .size
+                    .saturating_sub(offset)
+                    .min(BLOCK_SIZE as u64);
+                if block >= announcement.blocks() || payload.len() as u64 != expected {
+                    continue;
+                }
+                idle_nacks = 0;
+                if !map.contains(block) {
+                    file.write_all_at(payload, offset)?;
+                    map.insert(block);
+                }
+            }
+            Some(Packet::End { session, .. }) if session == announcement.session => {
+                idle_nacks = 0;
+                send_nack(&control, &key, repair_to, announcement.session, &map)?;
+                if map.is_complete() {
+                    break Ok(());
+                }
+            }
+            _ => {}
+        }
+    };
+
+    let result = result.and_then(|()| {
+        file.sync_all()?;
+        if file_sha256(&part)? != announcement.sha256 {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "file does not match the announced hash",
+            ));
+        }
+        Ok(())
+    });
+    if let Err(e) = result {
+        let _ = std::fs::remove_file(&part);
+        return Err(e);
+    }
+    let target = available_path(download_dir, &announcement.file_name);
+    std::fs::rename(&part, &target)?;
+    Ok(target)
+}
+
+/// Report missing blocks to the sender; an empty list confirms completion
+fn send_nack(
+    socket: &UdpSocket,
+    key: &hmac::Key,
+    to: SocketAddr,
+    session: u64,
+    map: &BlockMap,
+) -> io::Result<()> {
+    let ranges = map.missing_ranges(MAX_NACK_RANGES);
+    socket.send_to(&encoded(&Packet::Nack { session, ranges }, key), to)?;
+    Ok(())
+}
+
+/// Bind to the group so several receivers on one host can share the port,
+/// joining it on the interface that faces the sender
+fn join_group(group: Ipv4Addr, port: u16, interface: Ipv4Addr) -> io::Result<UdpSocket> {
+    let socket = Socket::new(Domain::IPV4, Type::DGRAM, Some(Protocol::UDP))?;
+    socket.set_reuse_address(true)?;
+    // Bursts arrive faster than a busy disk drains them
+    let _ = socket.set_recv_buffer_size(8 * 1024 * 1024);
+    socket.bind(&SocketAddr::new(group.into(), port).into())?;
+    socket.join_multicast_v4(&group, &interface)?;
+    socket.set_read_timeout(Some(RECEIVE_IDLE))?;
+    Ok(socket.into())
+}
+
+/// Local IPv4 address that traffic to `peer` leaves from
+fn local_address_toward(peer: IpAddr) -> io::Result<Ipv4Addr> {
+    let probe = UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))?;
+    // Connecting a UDP socket only picks a route; nothing is sent
+    probe.connect(SocketAddr::new(peer, MULTICAST_PORT))?;
+    match probe.local_addr()?.ip() {
+        IpAddr::V4(address) => Ok(address),
+        IpAddr::V6(_) => Err(io::Error::new(
+            io::ErrorKind::Unsupported,
+            "multicast needs an IPv4 peer",
+        )),
+    }
+}
+
+fn session_key(announcement: &MulticastAnnouncement) -> io::Result<hmac::Key> {
+    from_hex(&announcement.key)
+        .filter(|key| key.len() == KEY_LEN)
+        .map(|key| hmac::Key::new(hmac::HMAC_SHA256, &key))
+        .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidData, "invalid session key"))
+}
+
+/// Append the session's tag to an encoded datagram
+fn seal(key: &hmac::Key, datagram: &mut Vec<u8>) {
+    let tag = hmac::sign(key, datagram);
+    datagram.extend_from_slice(tag.as_ref());
+}
+
+/// The datagram without its tag, if the tag is the session's
+fn open<'a>(key: &hmac::Key, datagram: &'a [u8]) -> Option<&'a [u8]> {
+    let (body, tag) = datagram.split_at(datagram.len().checked_sub(TAG_LEN)?);
+    hmac::verify(key, body, tag).ok()?;
+    Some(body)
+}
+
+fn encoded(packet: &Packet<'_>, key: &hmac::Key) -> Vec<u8> {
+    let mut buf = Vec::new();
+    packet.encode(&mut buf);
+    seal(key, &mut buf);
+    buf
+}
+
+/// Hex SHA-256 of a file's contents
+fn file_sha256(path: &Path) -> io::Result<String> {
+    let mut file = File::open(path)?;
+    let mut context = ring::digest::Context::new(&ring::digest::SHA256);
+    let mut buf = vec![0u8; 1024 * 1024];
+    loop {
+        let read = file.read(&mut buf)?;
+        if read == 0 {
+            break;
+        }
+        context.update(&buf[..read]);
+    }
+    Ok(to_hex(context.finish().as_ref()))
+}
+
+fn to_hex(bytes: &[u8]) -> String {
+    bytes.iter().map(|byte| format!("{:02x}", byte)).collect()
+}
+
+fn from_hex(hex: &str) -> Option<Vec<u8>> {
+    if hex.len() % 2 != 0 {
+        return None;
+    }
+    (0..hex.len())
+        .step_by(2)
+        .map(|at| u8::from_str_radix(hex.get(at..at + 2)?, 16).ok())
+        .collect()
+}
+
+/// `name` in `dir`, numbered if a file of that name exists
+pub(crate) fn available_path(dir: &Path, name: &str) -> PathBuf {
+    let candidate = dir.join(name);
+    if !candidate.exists() {
+        return candidate;
+    }
+    let (stem, ext) = match name.rsplit_once('.') {
+        Some((stem, ext)) if !stem.is_empty() => (stem, format!(".{}", ext)),
+        _ => (name, String::new()),
+    };
+    (1..)
+        .map(|n| dir.join(format!("{} ({}){}", stem, n, ext)))
+        .find(|path| !path.exists())
+        .unwrap()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn announcement(dir: &Path, size: u64, port: u16) -> MulticastAnnouncement {
+        let mut key = [0u8; KEY_LEN];
+        SystemRandom::new().fill(&mut key).unwrap();
+        MulticastAnnouncement {
+            session: session_id(),
+            group: MULTICAST_GROUP,
+            port,
+            repair_port: 0,
+            file_name: "payload.bin".to_string(),
+            size,
+            key: to_hex(&key),
+            sha256: file_sha256(&dir.join("payload.bin")).unwrap(),
+        }
+    }
+
+    #[test]
+    fn test_datagrams_need_the_session_tag() {
+        let key = hmac::Key::new(hmac::HMAC_SHA256, &[1; KEY_LEN]);
+        let other = hmac::Key::new(hmac::HMAC_SHA256, &[2; KEY_LEN]);
+        let datagram = encoded(
+            &Packet::End {
+                session: 7,
+                blocks: 3,
+            },
+            &key,
+        );
+
+        assert!(matches!(
+            open(&key, &datagram).and_then(Packet::decode),
+            Some(Packet::End {
+                session: 7,
+                blocks: 3
+            })
+        ));
+        assert!(open(&other, &datagram).is_none());
+        let mut forged = datagram.clone();
+        forged[0] ^= 1;
+        assert!(open(&key, &forged).is_none());
+        assert!(open(&key, &datagram[..TAG_LEN - 1]).is_none());
+    }
+
+    #[test]
+    fn test_loopback_session_reaches_every_receiver() {
+        let root = std::env::temp_dir().join(format!("gosh-multicast-{:016x}", session_id()));
+        std::fs::create_dir_all(&root).unwrap();
+        // Not a whole number of blocks, so the last one is short
+        let content: Vec<u8> = (0..BLOCK_SIZE * 300 + 77)
+            .map(|i| (i % 251) as u8)
+            .collect();
+        std::fs::write(root.join("payload.bin"), &content).unwrap();
+
+        let port = UdpSocket::bind((Ipv4Addr::LOCALHOST, 0))
+            .unwrap()
+            .local_addr()
+            .unwrap()
+            .port();
+        let repair = UdpSocket::bind((Ipv4Addr::UNSPECIFIED, 0)).unwrap();
+        let mut announcement = announcement(&root, content.len() as u64, port);
+        announcement.repair_port = repair.local_addr().unwrap().port();
+
+        let sender = IpAddr::from(Ipv4Addr::LOCALHOST);
+        let receivers: Vec<_> = (0..3)
+            .map(|n| {
+                let dir = root.join(format!("receiver-{}", n));
+                std::fs::create_dir_all(&dir).unwrap();
+                let announcement = announcement.clone();
+                std::thread::spawn(move || receive_blocking(&announcement, sender, &dir))
+            })
+            .collect();
+        std::thread::sleep(Duration::from_millis(200));
+
+        let addresses = [sender; 3];
+        let source = root.join("payload.bin");
+        let confirmed =
+            send_blocking(&announcement, &source, repair, &addresses, 200 << 20).unwrap();
+        assert_eq!(confirmed, 3);
+        for receiver in receivers {
+            let path = receiver.join().unwrap().unwrap();
+            assert_eq!(std::fs::read(path).unwrap(), content);
+        }
+        std::fs::remove_dir_all(&root).unwrap();
+    }
+}
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Notification coalescing
+//
+// Transfers finish in bursts when many small ones run at once, and a
+// desktop notification for each would flood the notification daemon. The
+// outcomes are gathered on a thread of their own instead: the first one
+// opens a short window, and when it closes one summary per peer is shown,
+// such as "27 transfers completed from 10.0.0.5, 3 failed".
+
+use gosh_lan_transfer::EngineEvent;
+use gosh_transfer_core::TransferHistory;
+use std::collections::{BTreeMap, HashMap};
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::time::Instant;
+
+/// How long outcomes are gathered after the first one of a burst
+const WINDOW: Duration = Duration::from_secs(2);
+
+/// Peers given a notification each; more are folded into one summary
+const MAX_PEER_NOTICES: usize = 3;
+
+/// Events held for the thread before new ones are dropped
+const QUEUE: usize = 1024;
+
+/// Requests remembered for their peer address before the map is cleared
+const MAX_PEERS: usize = 4096;
+
+/// How a transfer ended
+struct Outcome {
+    id: String,
+    peer: Option<String>,
+    error: Option<String>,
+}
+
+/// Completed and failed counts for one peer
+#[derive(Default)]
+struct Tally {
+    completed: usize,
+    failed: usize,
+    error: Option<String>,
+}
+
+/// Feeds transfer outcomes to the coalescing thread
+pub struct Notifier {
+    tx: async_channel::Sender<EngineEvent>,
+}
+
+impl Notifier {
+    /// Start the coalescing thread. `enabled` is checked before each
+    /// summary, and `show` puts one on screen as a title and body.
+    pub fn start(
+        history: Arc<TransferHistory>,
+        enabled: impl Fn() -> bool + Send + 'static,
+        show: impl Fn(&str, &str) + Send + 'static,
+    ) -> Self {
+        let (tx, rx) = async_channel::bounded(QUEUE);
+        let spawned = std::thread::Builder::new()
+            .name("gosh-notify".to_string())
+            .spawn(move || {
+                let runtime = match tokio::runtime::Builder::new_current_thread()
+                    .enable_time()
+                    .build()
+                {
+                    Ok(runtime) => runtime,
+                    Err(e) => {
+                        tracing::error!("Failed to start notification runtime: {}", e);
+                        return;
+                    }
+                };
+                runtime.block_on(coalesce(rx, history, enabled, show));
+            });
+        if let Err(e) = spawned {
+            tracing::error!("Failed to start notification thread: {}", e);
+        }
+        Self { tx }
+    }
+
+    /// Pass an event along without waiting. Under a flood the excess is
+    /// dropped, as a notification is not worth slowing the events for.
+    pub fn observe(&self, event: &EngineEvent) {
+        match event {
+            EngineEvent::TransferRequest(_)
+            | EngineEvent::TransferComplete { .. }
+            | EngineEvent::TransferFailed { .. } => {
+                let _ = self.tx.try_send(event.clone());
+            }
+            _ => {}
+        }
+    }
+}
+
+async fn coalesce(
+    rx: async_channel::Receiver<EngineEvent>,
+    history: Arc<TransferHistory>,
+    enabled: impl Fn() -> bool,
+    show: impl Fn(&str, &str),
+) {
+    // Peer of each request, as outcome events only carry the id
+    let mut peers: HashMap<String, String> = HashMap::new();
+    let mut burst: Vec<Outcome> = Vec::new();
+    let mut deadline: Option<Instant> = None;
+
+    loop {
+        let event = match deadline {
+            Some(at) => match tokio::time::timeout_at(at, rx.recv()).await {
+                Ok(event) => event,
+                Err(_) => {
+                    deadline = None;
+                    flush(std::mem::take(&mut burst), &history, &enabled, &show);
+                    continue;
+                }
+            },
+            None => rx.recv().await,
+        };
+        let Ok(event) = event else {
+            break;
+        };
+
+        match event {
+            EngineEvent::TransferRequest(transfer) => {
+                if peers.len() >= MAX_PEERS {
+                    peers.clear();
+                }
+                peers.insert(transfer.id, transfer.peer_address);
+            }
+            EngineEvent::TransferComplete { transfer_id } => burst.push(Outcome {
+                peer: peers.remove(&transfer_id),
+                id: transfer_id,
+                error: None,
+            }),
+            EngineEvent::TransferFailed { transfer_id, error } => burst.push(Outcome {
+                peer: peers.remove(&transfer_id),
+                id: transfer_id,
+                error: Some(error),
+            }),
+            _ => {}
+        }
+        if deadline.is_none() && !burst.is_empty() {
+            deadline = Some(Instant::now() + WINDOW);
+        }
+    }
+    flush(burst, &history, &enabled, &show);
+}
+
+/// Show the summaries of one burst
+fn flush(
+    mut burst: Vec<Outcome>,
+    history: &TransferHistory,
+    enabled: &impl Fn() -> bool,
+    show: &impl Fn(&str, &str),
+) {
+    if burst.is_empty() || !enabled() {
+        return;
+    }
+    // Sends never raised a request here; history knows their peer
+    for outcome in burst.iter_mut().filter(|o| o.peer.is_none()) {
+        outcome.peer = history.peer_of(&outcome.id);
+    }
+
+    let notices = summarize(&burst);
+    tracing::debug!(
+        "{} transfer outcome(s) shown as {} notification(s)",
+        burst.len(),
+        notices.len()
+    );
+    for (title, body) in notices {
+        show(&title, &body);
+    }
+}
+
+/// Title and body of each notification for a burst
+fn summarize(burst: &[Outcome]) -> Vec<(String, String)> {
+    let mut tallies: BTreeMap<&str, Tally> = BTreeMap::new();
+    for outcome in burst {
+        let tally = tallies
+            .entry(outcome.peer.as_deref().unwrap_or("a peer"))
+            .or_default();
+        match &outcome.error {
+            None => tally.completed += 1,
+            Some(error) => {
+                tally.failed += 1;
+                tally.error.get_or_insert_with(|| error.clone());
+            }
+        }
+    }
+
+    if tallies.len() > MAX_PEER_NOTICES {
+        let completed: usize = tallies.values().map(|t| t.completed).sum();
+        let failed: usize = tallies.values().map(|t| t.failed).sum();
+        let peers = format!("{} peers", tallies.len());
+        return vec![(
+            "Transfers finished".to_string(),
+            counts(completed, failed, &peers),
+        )];
+    }
+
+    tallies
+        .into_iter()
+        .map(|(peer, tally)| match (tally.completed, tally.failed) {
+            (1, 0) => (
+                "Transfer complete".to_string(),
+                format!("1 transfer completed from {}", peer),
+            ),
+            (0, 1) => (
+                "Transfer failed".to_string(),
+                format!(
+                    "Transfer from {} failed: {}",
+                    peer,
+                    tally.error.unwrap_or_default()
+                ),
+            ),
+            (completed, failed) => (
+                "Transfers finished".to_string(),
+                counts(completed, failed, peer),
+            ),
+        })
+        .collect()
+}
+
+fn counts(completed: usize, failed: usize, from: &str) -> String {
+    let plural = |n: usize| if n == 1 { "transfer" } else { "transfers" };
+    match (completed, failed) {
+        (0, failed) => format!("{} {} from {} failed", failed, plural(failed), from),
+        (completed, 0) => format!(
+            "{} {} completed from {}",
+            completed,
+            plural(completed),
+            from
+        ),
+        (completed, failed) => format!(
+            "{} {} completed from {}, {} failed",
+            completed,
+            plural(completed),
+            from,
+            failed
+        ),
+    }
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Store-and-forward delivery
+//
+// Failed sends to peers that do not answer a health check are queued in
+// the outbox. Due entries are probed the same cheap way and delivered once
+// the peer is back; a send that fails while the peer answers is dropped,
+// since waiting would not help. A delivery is listed with the running sends
+// under `outbox-<id>`, so cancelling the queued send stops it.
+
+use crate::engine_bridge::{EngineBridge, SendRoute};
+use crate::sends::{ActiveSends, SendStage, Staged};
+use gosh_transfer_core::filter;
+use gosh_transfer_core::outbox::stamp_selection;
+use gosh_transfer_core::{CancelToken, Outbox, PathList, QueuedSend, QueuedSource, TransferFilter};
+use std::path::PathBuf;
+use std::sync::Arc;
+
+/// Running-send id of the delivery of a queued send
+pub fn delivery_id(id: &str) -> String {
+    format!("outbox-{}", id)
+}
+
+/// Queue a failed send if its peer is unreachable. `dirs` are the
+/// directories its walk listed, stamped with the kept files.
+pub async fn queue_if_unreachable(
+    route: &SendRoute,
+    outbox: &Outbox,
+    address: String,
+    port: u16,
+    source: QueuedSource,
+    dirs: PathList,
+    error: String,
+) {
+    if route.check_peer(&address, port).await {
+        return;
+    }
+    let source = match source {
+        QueuedSource::Directory {
+            path,
+            filter: Some(filter),
+            files,
+            ..
+        } if !files.is_empty() => {
+            // Stamp the walked selection so delivery can skip walking it again
+            let stamped = tokio::task::spawn_blocking(move || {
+                let stamps = stamp_selection(&path, &dirs, &files);
+                QueuedSource::Directory {
+                    path,
+                    filter: Some(filter),
+                    files,
+                    stamps,
+                }
+            })
+            .await;
+            match stamped {
+                Ok(source) => source,
+                Err(e) => {
+                    tracing::error!("Failed to queue send to {}: {}", address, e);
+                    return;
+                }
+            }
+        }
+        source => source,
+    };
+    tracing::info!("{} is unreachable, queued send until it is back", address);
+    outbox.enqueue(address, port, source, error, chrono::Utc::now());
+}
+
+/// Probe the peers of due queued sends, delivering to those that answer
+pub fn deliver_due(route: &SendRoute, outbox: &Arc<Outbox>, sends: &Arc<ActiveSends>) {
+    for send in outbox.take_due(chrono::Utc::now()) {
+        tokio::spawn(deliver(route.clone(), outbox.clone(), sends.clone(), send));
+    }
+}
+
+async fn deliver(route: SendRoute, outbox: Arc<Outbox>, sends: Arc<ActiveSends>, send: QueuedSend) {
+    let id = delivery_id(&send.id);
+    let cancel = sends.begin(&id, &send.address);
+    let result = tokio::select! {
+        result = attempt(&route, &sends, &id, &send, &cancel) => result,
+        _ = cancel.cancelled() => Err("Cancelled".to_string()),
+    };
+    sends.end(&id);
+
+    match result {
+        // Cancelled with the queued send, which is already gone
+        _ if cancel.is_cancelled() => {
+            tracing::info!("Delivery of queued send {} cancelled", send.id);
+        }
+        Ok(true) => {
+            outbox.remove(&send.id);
+        }
+        Ok(false) => {
+            outbox.record_failure(&send.id, format!("{} is unreachable", send.address));
+        }
+        Err(e) if route.check_peer(&send.address, send.port).await => {
+            tracing::error!("Queued send {} failed, dropping it: {}", send.id, e);
+            outbox.remove(&send.id);
+        }
+        Err(e) => outbox.record_failure(&send.id, e),
+    }
+}
+
+/// Probe the peer and deliver the send, returning false if the peer did not
+/// answer
+async fn attempt(
+    route: &SendRoute,
+    sends: &ActiveSends,
+    id: &str,
+    send: &QueuedSend,
+    cancel: &CancelToken,
+) -> Result<bool, String> {
+    if !route.check_peer(&send.address, send.port).await {
+        return Ok(false);
+    }
+    tracing::info!(
+        "{} is back, delivering queued send {}",
+        send.address,
+        send.id
+    );
+
+    match &send.source {
+        QueuedSource::Files { paths } => {
+            sends.set_stage(id, SendStage::Sending);
+            route
+                .send_files(&send.address, send.port, paths.clone())
+                .await
+        }
+        QueuedSource::Directory { path, filter, .. } => {
+            sends.set_stage(id, SendStage::Preparing);
+            let staged = match (send.source.unchanged_selection(), filter) {
+                (Some((root, files)), _) => {
+                    let (root, files, cancel) = (root.to_path_buf(), files.clone(), cancel.clone());
+                    tokio::task::spawn_blocking(move || {
+                        filter::stage_filtered(&root, &files, &cancel)
+                    })
+                    .await
+                    .map_err(|e| e.to_string())?
+                    .map(|staged| Some(Staged(staged)))
+                    .map_err(|e| e.to_string())?
+                }
+                (None, Some(filter)) => Some(Staged(
+                    restage(path.clone(), filter.clone(), cancel.clone()).await?,
+                )),
+                (None, None) => None,
+            };
+            sends.set_stage(id, SendStage::Sending);
+            let source = staged.as_ref().map_or(path.clone(), |s| s.0.clone());
+            route.send_directory(&send.address, send.port, source).await
+        }
+    }
+    .map(|()| true)
+}
+
+/// Walk a directory whose selection changed since it was queued
+async fn restage(
+    root: PathBuf,
+    filter: TransferFilter,
+    cancel: CancelToken,
+) -> Result<PathBuf, String> {
+    EngineBridge::stage_filtered_directory(root, filter, cancel)
+        .await
+        .map(|(staged, _)| staged)
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Request prompts of the windowless receiver
+//
+// A socket-activated receiver has no window to show a request in, and no
+// Tauri app for the notification plugin. Requests from peers that are not
+// trusted are asked about in a desktop notification with Accept and Reject
+// actions instead, sent straight to the notification daemon. A prompt that
+// is dismissed or never answered leaves the request pending, and the
+// bridge rejects it once it has waited too long.
+
+use gosh_lan_transfer::PendingTransfer;
+use notify_rust::{Notification, Timeout};
+
+const ACCEPT: &str = "accept";
+const REJECT: &str = "reject";
+
+/// Ask whether to take `transfer`, on a thread of its own. `answer` is
+/// called with the choice, if one is made.
+pub fn ask(transfer: &PendingTransfer, answer: impl FnOnce(bool) + Send + 'static) {
+    let files = transfer.files.iter().filter(|f| !f.is_directory).count();
+    let body = format!(
+        "{} ({}) wants to send {} file{}",
+        transfer.peer_hostname,
+        transfer.peer_address,
+        files,
+        if files == 1 { "" } else { "s" }
+    );
+    let id = transfer.id.clone();
+
+    let spawned = std::thread::Builder::new()
+        .name("gosh-prompt".to_string())
+        .spawn(move || {
+            let shown = Notification::new()
+                .appname("Gosh Transfer")
+                .summary("Incoming transfer")
+                .body(&body)
+                .action(ACCEPT, "Accept")
+                .action(REJECT, "Reject")
+                .timeout(Timeout::Never)
+                .show();
+            let handle = match shown {
+                Ok(handle) => handle,
+                Err(e) => {
+                    tracing::warn!("Failed to ask about transfer {}: {}", id, e);
+                    return;
+                }
+            };
+            handle.wait_for_action(|action| match action {
+                ACCEPT => answer(true),
+                REJECT => answer(false),
+                _ => tracing::debug!("Prompt for transfer {} closed unanswered", id),
+            });
+        });
+    if let Err(e) = spawned {
+        tracing::error!("Failed to start prompt thread: {}", e);
+    }
+}
@@ -0,0 +1,825 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Receiver-initiated pull
+//
+// The sender publishes an offer on a small HTTP server of its own, since
+// the engine cannot serve byte ranges, and announces it as an ordinary
+// transfer. The receiver then fetches each file with parallel range
+// requests, retrying failed ranges, and retires the offer once it has every
+// file. Finished ranges are kept on disk, so a failed pull, or one cut off
+// by the receiver quitting, can be retried for the ranges it is missing.
+//
+// The offer server is plain HTTP on every interface, listening only while
+// an offer is left to pull. An offer is served only to the address it was
+// sent to, and only with its token.
+
+use crate::acceptors::ACCEPT_BACKOFF;
+use crate::engine_bridge::SendRoute;
+use crate::multicast::available_path;
+use gosh_lan_transfer::{EngineEvent, PendingTransfer};
+use gosh_transfer_core::filter::staging_root;
+use gosh_transfer_core::pull::{self, tokens_match, OfferFile, RangeRequest};
+use gosh_transfer_core::{BlockMap, PullJournal, PullOffer, PullRecord, PullState, PullStatus};
+use ring::rand::{SecureRandom, SystemRandom};
+use std::collections::{HashMap, VecDeque};
+use std::io::{self, SeekFrom};
+use std::net::{IpAddr, Ipv4Addr, SocketAddr, TcpListener as StdTcpListener};
+use std::os::unix::fs::FileExt;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex, RwLock};
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream};
+use tokio::task::JoinHandle;
+
+/// TCP port of the offer server
+const OFFER_PORT: u16 = 53320;
+/// How long a published offer can be pulled
+const OFFER_TTL: Duration = Duration::from_secs(24 * 60 * 60);
+/// How often the offer server checks for offers left while idle
+const OFFER_CHECK: Duration = Duration::from_secs(60);
+/// Range requests a receiver keeps in flight per file
+const PARALLEL_RANGES: usize = 4;
+/// Attempts per range before the pull fails
+const MAX_RANGE_ATTEMPTS: u32 = 5;
+/// Time allowed for one range request
+const RANGE_TIMEOUT: Duration = Duration::from_secs(60);
+/// Largest request head the offer server reads
+const MAX_HEAD: usize = 8 * 1024;
+
+/// A published offer at the sender
+struct Offer {
+    files: Vec<PathBuf>,
+    token: String,
+    /// The only address the offer is served to
+    peer: IpAddr,
+    expires: Instant,
+}
+
+/// A pull at the receiver
+struct Download {
+    offer: PullOffer,
+    peer: IpAddr,
+    download_dir: PathBuf,
+    /// Finished ranges per file
+    done: Vec<BlockMap>,
+    /// Files before this one are complete and in place
+    next_file: usize,
+    status: PullStatus,
+}
+
+impl Download {
+    fn new(offer: PullOffer, peer: IpAddr, peer_address: String, download_dir: &Path) -> Self {
+        Self {
+            done: offer
+                .files
+                .iter()
+                .map(|f| BlockMap::new(pull::range_count(f.size)))
+                .collect(),
+            next_file: 0,
+            status: PullStatus {
+                offer_id: offer.offer_id.clone(),
+                peer_address,
+                files: offer.files.iter().map(|f| f.name.clone()).collect(),
+                total_bytes: offer.files.iter().map(|f| f.size).sum(),
+                received_bytes: 0,
+                state: PullState::Running,
+                error: None,
+                updated_at: chrono::Utc::now(),
+            },
+            offer,
+            peer,
+            download_dir: download_dir.to_path_buf(),
+        }
+    }
+
+    fn record(&self) -> PullRecord {
+        PullRecord {
+            offer: self.offer.clone(),
+            download_dir: self.download_dir.clone(),
+            done: self.done.iter().map(|d| d.words().to_vec()).collect(),
+            next_file: self.next_file,
+            status: self.status.clone(),
+        }
+    }
+
+    /// Rebuild a pull kept on disk, or `None` if the record does not fit
+    /// its offer
+    fn from_record(record: PullRecord) -> Option<Self> {
+        let peer = record.status.peer_address.parse().ok()?;
+        if record.done.len() != record.offer.files.len() {
+            return None;
+        }
+        let done = record
+            .offer
+            .files
+            .iter()
+            .zip(record.done)
+            .map(|(file, words)| BlockMap::from_words(pull::range_count(file.size), words))
+            .collect::<Option<Vec<_>>>()?;
+        Some(Self {
+            offer: record.offer,
+            peer,
+            download_dir: record.download_dir,
+            done,
+            next_file: record.next_file,
+            status: record.status,
+        })
+    }
+}
+
+/// Pulls into this device, written to disk as they change
+#[derive(Default)]
+struct Downloads {
+    pulls: Mutex<HashMap<String, Download>>,
+    journal: Option<PullJournal>,
+}
+
+impl Downloads {
+    fn insert(&self, download: Download) {
+        let mut pulls = self.pulls.lock().unwrap();
+        pulls.insert(download.offer.offer_id.clone(), download);
+        self.save(&pulls);
+    }
+
+    /// Change a pull and write the result to disk
+    fn update<R>(&self, offer_id: &str, change: impl FnOnce(&mut Download) -> R) -> Option<R> {
+        let mut pulls = self.pulls.lock().unwrap();
+        let result = change(pulls.get_mut(offer_id)?);
+        self.save(&pulls);
+        Some(result)
+    }
+
+    /// Write every unfinished pull to disk
+    fn save(&self, pulls: &HashMap<String, Download>) {
+        if let Some(journal) = &self.journal {
+            let records: Vec<_> = pulls
+                .values()
+                .filter(|d| d.status.state != PullState::Complete)
+                .map(Download::record)
+                .collect();
+            journal.save(&records);
+        }
+    }
+}
+
+/// Offers published here, by offer id
+#[derive(Default)]
+struct Published {
+    offers: HashMap<String, Offer>,
+    /// Whether the offer server is accepting. Changed under the lock, so an
+    /// offer published as the server stops starts a new one.
+    listening: bool,
+}
+
+/// Offers published here and pulls in progress
+pub struct Pulls {
+    published: Arc<RwLock<Published>>,
+    server: Option<JoinHandle<()>>,
+    /// Offer file name and sender, by transfer id
+    incoming: HashMap<String, (String, String)>,
+    downloads: Arc<Downloads>,
+}
+
+impl Drop for Pulls {
+    fn drop(&mut self) {
+        if let Some(server) = self.server.take() {
+            server.abort();
+        }
+    }
+}
+
+impl Pulls {
+    /// Start with the pulls a previous run left unfinished
+    pub fn new() -> Self {
+        let journal = PullJournal::new()
+            .map_err(|e| tracing::warn!("Pulls will not be kept on disk: {}", e))
+            .ok();
+        let mut pulls = HashMap::new();
+        for record in journal.iter().flat_map(PullJournal::load) {
+            let offer_id = record.offer.offer_id.clone();
+            match Download::from_record(record) {
+                Some(download) => {
+                    pulls.insert(offer_id, download);
+                }
+                None => tracing::warn!("Dropping unreadable pull {}", offer_id),
+            }
+        }
+        Self {
+            published: Arc::default(),
+            server: None,
+            incoming: HashMap::new(),
+            downloads: Arc::new(Downloads {
+                pulls: Mutex::new(pulls),
+                journal,
+            }),
+        }
+    }
+
+    /// Publish `paths` and announce the offer to a peer at a resolved
+    /// address
+    pub async fn offer(
+        &mut self,
+        route: SendRoute,
+        address: String,
+        port: u16,
+        paths: Vec<PathBuf>,
+    ) -> Result<String, String> {
+        let peer: IpAddr = address
+            .parse()
+            .map_err(|_| format!("Not an IP address: {}", address))?;
+        let mut files = Vec::new();
+        for path in &paths {
+            let meta = tokio::fs::metadata(path).await.map_err(|e| e.to_string())?;
+            let name = path.file_name().map(|n| n.to_string_lossy().to_string());
+            match name {
+                Some(name) if meta.is_file() => files.push(OfferFile {
+                    name,
+                    size: meta.len(),
+                }),
+                _ => {
+                    return Err(format!(
+                        "Pull offers regular files only: {}",
+                        path.display()
+                    ))
+                }
+            }
+        }
+        let offer = PullOffer {
+            offer_id: random_hex(8),
+            token: random_hex(16),
+            port: OFFER_PORT,
+            files,
+        };
+        let dir = staging_root()
+            .map_err(|e| e.to_string())?
+            .join(format!("offer-{}", offer.offer_id));
+        let offer_path = offer.write(&dir).map_err(|e| e.to_string())?;
+        let published = Offer {
+            files: paths,
+            token: offer.token.clone(),
+            peer,
+            expires: Instant::now() + OFFER_TTL,
+        };
+        if let Err(e) = self.publish(offer.offer_id.clone(), published) {
+            let _ = std::fs::remove_dir_all(&dir);
+            return Err(e);
+        }
+
+        let published = self.published.clone();
+        let offer_id = offer.offer_id.clone();
+        tokio::spawn(async move {
+            if let Err(e) = route.send_files(&address, port, vec![offer_path]).await {
+                tracing::error!("Offer {} to {} failed: {}", offer_id, address, e);
+                published.write().unwrap().offers.remove(&offer_id);
+            }
+            let _ = tokio::fs::remove_dir_all(&dir).await;
+        });
+        Ok(offer.offer_id)
+    }
+
+    /// Record an offer, starting the offer server if it is not listening
+    fn publish(&mut self, offer_id: String, offer: Offer) -> Result<(), String> {
+        let mut published = self.published.write().unwrap();
+        published.offers.retain(|_, o| o.expires > Instant::now());
+        if !published.listening {
+            let listener = StdTcpListener::bind((Ipv4Addr::UNSPECIFIED, OFFER_PORT))
+                .and_then(|l| l.set_nonblocking(true).map(|_| l))
+                .and_then(TcpListener::from_std)
+                .map_err(|e| format!("Failed to start offer server: {}", e))?;
+            let server = tokio::spawn(serve_offers(listener, self.published.clone()));
+            if let Some(stopped) = self.server.replace(server) {
+                stopped.abort();
+            }
+            published.listening = true;
+            tracing::info!("Offer server listening on port {}", OFFER_PORT);
+        }
+        published.offers.insert(offer_id, offer);
+        Ok(())
+    }
+
+    /// Progress of every pull into this device
+    pub fn list(&self) -> Vec<PullStatus> {
+        let mut pulls: Vec<_> = self
+            .downloads
+            .pulls
+            .lock()
+            .unwrap()
+            .values()
+            .map(|d| d.status.clone())
+            .collect();
+        pulls.sort_by(|a, b| b.updated_at.cmp(&a.updated_at));
+        pulls
+    }
+
+    /// Restart a failed pull, keeping the ranges it already has
+    pub fn retry(&self, offer_id: &str, rate_bps: Option<u64>) -> Result<(), String> {
+        self.downloads
+            .update(offer_id, |download| {
+                if download.status.state != PullState::Failed {
+                    return Err(format!("Pull {} is not failed", offer_id));
+                }
+                download.status.state = PullState::Running;
+                download.status.error = None;
+                Ok(())
+            })
+            .ok_or_else(|| format!("Pull not found: {}", offer_id))??;
+        tokio::spawn(run_pull(
+            self.downloads.clone(),
+            offer_id.to_string(),
+            rate_bps,
+        ));
+        Ok(())
+    }
+
+    /// Note a request that carries an offer
+    pub fn on_request(&mut self, transfer: &PendingTransfer) {
+        if let Some(file) = transfer.files.iter().find(|f| PullOffer::is_offer(&f.name)) {
+            self.incoming.insert(
+                transfer.id.clone(),
+                (file.name.clone(), transfer.peer_address.clone()),
+            );
+        }
+    }
+
+    /// Start pulling once an accepted offer has arrived
+    pub fn on_event(
+        &mut self,
+        event: &EngineEvent,
+        download_dir: &Path,
+        enabled: bool,
+        rate_bps: Option<u64>,
+    ) {
+        let EngineEvent::TransferComplete { transfer_id } = event else {
+            if let EngineEvent::TransferFailed { transfer_id, .. } = event {
+                self.incoming.remove(transfer_id);
+            }
+            return;
+        };
+        let Some((name, peer_address)) = self.incoming.remove(transfer_id) else {
+            return;
+        };
+        let path = download_dir.join(&name);
+        let offer = PullOffer::read(&path);
+        let _ = std::fs::remove_file(&path);
+        if !enabled {
+            tracing::warn!(
+                "Ignoring offer from {}: pulls are unencrypted",
+                peer_address
+            );
+            return;
+        }
+        let (offer, peer) = match (offer, peer_address.parse::<IpAddr>()) {
+            (Ok(offer), Ok(peer)) => (offer, peer),
+            (Err(e), _) => {
+                tracing::warn!("Ignoring offer from {}: {}", peer_address, e);
+                return;
+            }
+            (_, Err(_)) => return,
+        };
+
+        let offer_id = offer.offer_id.clone();
+        self.downloads
+            .insert(Download::new(offer, peer, peer_address, download_dir));
+        tokio::spawn(run_pull(self.downloads.clone(), offer_id, rate_bps));
+    }
+}
+
+fn random_hex(bytes: usize) -> String {
+    let mut buf = vec![0u8; bytes];
+    SystemRandom::new()
+        .fill(&mut buf)
+        .expect("system random source unavailable");
+    buf.iter().map(|b| format!("{:02x}", b)).collect()
+}
+
+/// Accept range requests until no offer is left to pull
+async fn serve_offers(listener: TcpListener, published: Arc<RwLock<Published>>) {
+    loop {
+        tokio::select! {
+            accepted = listener.accept() => match accepted {
+                Ok((stream, from)) => {
+                    let published = published.clone();
+                    tokio::spawn(async move {
+                        if let Err(e) = serve(stream, from.ip(), &published).await {
+                            tracing::debug!("Offer request failed: {}", e);
+                        }
+                    });
+                }
+                Err(e) => {
+                    tracing::warn!("Offer server accept failed: {}", e);
+                    tokio::time::sleep(ACCEPT_BACKOFF).await;
+                }
+            },
+            _ = tokio::time::sleep(OFFER_CHECK) => {}
+        }
+
+        let mut live = published.write().unwrap();
+        live.offers.retain(|_, o| o.expires > Instant::now());
+        if live.offers.is_empty() {
+            // Closed before the lock is released, so the next offer can bind
+            live.listening = false;
+            drop(listener);
+            tracing::info!("No offers left, offer server stopped");
+            return;
+        }
+    }
+}
+
+/// Answer one range or retire request from the offer server
+async fn serve(
+    mut stream: TcpStream,
+    peer: IpAddr,
+    published: &RwLock<Published>,
+) -> io::Result<()> {
+    let mut head = Vec::with_capacity(1024);
+    let mut buf = [0u8; 1024];
+    while !head.windows(4).any(|w| w == b"\r\n\r\n") {
+        let n = tokio::time::timeout(RANGE_TIMEOUT, stream.read(&mut buf))
+            .await
+            .map_err(|_| io::Error::from(io::ErrorKind::TimedOut))??;
+        if n == 0 || head.len() + n > MAX_HEAD {
+            return Ok(());
+        }
+        head.extend_from_slice(&buf[..n]);
+    }
+
+    let head = String::from_utf8_lossy(&head);
+    if let Some((offer_id, token)) = pull::parse_retire(&head) {
+        let retired = {
+            let mut published = published.write().unwrap();
+            let owned = published
+                .offers
+                .get(&offer_id)
+                .is_some_and(|o| o.peer == peer && tokens_match(&token, &o.token));
+            owned && published.offers.remove(&offer_id).is_some()
+        };
+        if !retired {
+            return respond(&mut stream, "404 Not Found", &[]).await;
+        }
+        tracing::info!("Offer {} pulled by {}, retired", offer_id, peer);
+        return respond(&mut stream, "204 No Content", &[]).await;
+    }
+
+    let request = pull::parse_request(&head);
+    let file = request.as_ref().and_then(
+        |RangeRequest {
+             offer_id,
+             index,
+             token,
+             ..
+         }| {
+            let published = published.read().unwrap();
+            let offer = published.offers.get(offer_id)?;
+            let allowed = offer.peer == peer
+                && tokens_match(token, &offer.token)
+                && offer.expires > Instant::now();
+            allowed.then(|| offer.files.get(*index).cloned()).flatten()
+        },
+    );
+    let (Some(request), Some(path)) = (request, file) else {
+        return respond(&mut stream, "404 Not Found", &[]).await;
+    };
+
+    let mut file = tokio::fs::File::open(&path).await?;
+    let size = file.metadata().await?.len();
+    let (start, end) = match request.range {
+        Some((start, end)) if start <= end && end < size => (start, end),
+        Some(_) => {
+            let range = format!("Content-Range: bytes */{}", size);
+            return respond(&mut stream, "416 Range Not Satisfiable", &[&range]).await;
+        }
+        None if size == 0 => return respond(&mut stream, "200 OK", &["Content-Length: 0"]).await,
+        None => (0, size - 1),
+    };
+
+    let length = end - start + 1;
+    let content_length = format!("Content-Length: {}", length);
+    let content_range = format!("Content-Range: bytes {}-{}/{}", start, end, size);
+    let status = if request.range.is_some() {
+        "206 Partial Content"
+    } else {
+        "200 OK"
+    };
+    respond(&mut stream, status, &[&content_length, &content_range]).await?;
+    file.seek(SeekFrom::Start(start)).await?;
+    tokio::io::copy(&mut file.take(length), &mut stream).await?;
+    stream.shutdown().await
+}
+
+async fn respond(stream: &mut TcpStream, status: &str, headers: &[&str]) -> io::Result<()> {
+    let mut head = format!("HTTP/1.1 {}\r\nConnection: close\r\n", status);
+    for header in headers {
+        head.push_str(header);
+        head.push_str("\r\n");
+    }
+    head.push_str("\r\n");
+    stream.write_all(head.as_bytes()).await
+}
+
+/// Fetch one inclusive byte span of an offered file
+async fn fetch_range(
+    peer: SocketAddr,
+    path: &str,
+    (start, end): (u64, u64),
+) -> io::Result<Vec<u8>> {
+    let fetch = async {
+        let mut stream = TcpStream::connect(peer).await?;
+        let request = format!(
+            "GET {} HTTP/1.1\r\nHost: {}\r\nRange: bytes={}-{}\r\nConnection: close\r\n\r\n",
+            path, peer, start, end
+        );
+        stream.write_all(request.as_bytes()).await?;
+
+        let mut response = Vec::with_capacity((end - start + 1) as usize + 256);
+        stream.read_to_end(&mut response).await?;
+        let head_len = response
+            .windows(4)
+            .position(|w| w == b"\r\n\r\n")
+            .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidData, "truncated response"))?
+            + 4;
+        if !response.starts_with(b"HTTP/1.1 206 ") {
+            let status = String::from_utf8_lossy(&response[..head_len.min(64)]).to_string();
+            return Err(io::Error::new(io::ErrorKind::Other, status));
+        }
+        response.drain(..head_len);
+        if response.len() as u64 != end - start + 1 {
+            return Err(io::Error::new(io::ErrorKind::UnexpectedEof, "short range"));
+        }
+        Ok(response)
+    };
+    tokio::time::timeout(RANGE_TIMEOUT, fetch)
+        .await
+        .map_err(|_| io::Error::from(io::ErrorKind::TimedOut))?
+}
+
+/// Tell the sender every file is pulled, so it stops serving the offer
+async fn retire(peer: SocketAddr, path: &str) -> io::Result<()> {
+    let retire = async {
+        let mut stream = TcpStream::connect(peer).await?;
+        let request = format!(
+            "DELETE {} HTTP/1.1\r\nHost: {}\r\nConnection: close\r\n\r\n",
+            path, peer
+        );
+        stream.write_all(request.as_bytes()).await?;
+        let mut response = Vec::new();
+        stream.read_to_end(&mut response).await?;
+        if !response.starts_with(b"HTTP/1.1 204 ") {
+            return Err(io::Error::other("offer not retired"));
+        }
+        Ok(())
+    };
+    tokio::time::timeout(RANGE_TIMEOUT, retire)
+        .await
+        .map_err(|_| io::Error::from(io::ErrorKind::TimedOut))?
+}
+
+/// Keeps a pull under the receiver's bandwidth limit
+struct Pacer {
+    rate_bps: Option<u64>,
+    started: Instant,
+    bytes: Mutex<u64>,
+}
+
+impl Pacer {
+    async fn account(&self, bytes: u64) {
+        let Some(rate) = self.rate_bps.filter(|r| *r > 0) else {
+            return;
+        };
+        let total = {
+            let mut total = self.bytes.lock().unwrap();
+            *total += bytes;
+            *total
+        };
+        let due = Duration::from_secs_f64(total as f64 / rate as f64);
+        if let Some(wait) = due.checked_sub(self.started.elapsed()) {
+            tokio::time::sleep(wait).await;
+        }
+    }
+}
+
+/// Pull every file of an offer, moving each into place, then retire the offer
+async fn run_pull(downloads: Arc<Downloads>, offer_id: String, rate_bps: Option<u64>) {
+    let pacer = Arc::new(Pacer {
+        rate_bps,
+        started: Instant::now(),
+        bytes: Mutex::new(0),
+    });
+    let result = pull_files(&downloads, &offer_id, &pacer).await;
+
+    let retire_at = downloads.update(&offer_id, |download| {
+        download.status.updated_at = chrono::Utc::now();
+        match result {
+            Ok(()) => {
+                download.status.state = PullState::Complete;
+                Some((
+                    SocketAddr::new(download.peer, download.offer.port),
+                    download.offer.retire_path(),
+                ))
+            }
+            Err(e) => {
+                tracing::error!("Pull {} failed: {}", offer_id, e);
+                download.status.state = PullState::Failed;
+                download.status.error = Some(e);
+                None
+            }
+        }
+    });
+    if let Some(Some((peer, path))) = retire_at {
+        // The offer expires on its own if this does not get through
+        if let Err(e) = retire(peer, &path).await {
+            tracing::debug!("Failed to retire offer {}: {}", offer_id, e);
+        }
+    }
+}
+
+async fn pull_files(
+    downloads: &Arc<Downloads>,
+    offer_id: &str,
+    pacer: &Arc<Pacer>,
+) -> Result<(), String> {
+    let (offer, peer, dir, first) = downloads
+        .update(offer_id, |download| {
+            (
+                download.offer.clone(),
+                download.peer,
+                download.download_dir.clone(),
+                download.next_file,
+            )
+        })
+        .ok_or("Pull vanished")?;
+    let peer = SocketAddr::new(peer, offer.port);
+
+    for (index, file) in offer.files.iter().enumerate().skip(first) {
+        let part = dir.join(format!(".{}.{}.part", file.name, offer.offer_id));
+        let handle = std::fs::OpenOptions::new()
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(&part)
+            .and_then(|f| f.set_len(file.size).map(|_| f))
+            .map_err(|e| e.to_string())?;
+        let handle = Arc::new(handle);
+
+        let queue: VecDeque<(u32, u32)> = downloads
+            .update(offer_id, |download| {
+                let done = &download.done[index];
+                (0..pull::range_count(file.size))
+                    .filter(|r| !done.contains(*r))
+                    .map(|r| (r, 0))
+                    .collect()
+            })
+            .ok_or("Pull vanished")?;
+        let queue = Arc::new(Mutex::new(queue));
+
+        let mut workers = tokio::task::JoinSet::new();
+        for _ in 0..PARALLEL_RANGES {
+            let (queue, handle, pacer) = (queue.clone(), handle.clone(), pacer.clone());
+            let (downloads, offer_id) = (downloads.clone(), offer_id.to_string());
+            let (path, size) = (offer.file_path(index), file.size);
+            workers.spawn(async move {
+                loop {
+                    let Some((range, attempts)) = queue.lock().unwrap().pop_front() else {
+                        return Ok(());
+                    };
+                    let span = pull::range_span(range, size);
+                    let fetched = match fetch_range(peer, &path, span).await {
+                        Ok(data) => {
+                            let handle = handle.clone();
+                            tokio::task::spawn_blocking(move || handle.write_all_at(&data, span.0))
+                                .await
+                                .map_err(io::Error::other)
+                                .and_then(|r| r)
+                        }
+                        Err(e) => Err(e),
+                    };
+                    match fetched {
+                        Ok(()) => {
+                            let bytes = span.1 - span.0 + 1;
+                            downloads.update(&offer_id, |download| {
+                                download.done[index].insert(range);
+                                download.status.received_bytes += bytes;
+                                download.status.updated_at = chrono::Utc::now();
+                            });
+                            pacer.account(bytes).await;
+                        }
+                        Err(e) if attempts + 1 < MAX_RANGE_ATTEMPTS => {
+                            tracing::debug!("Range {} of {} failed, retrying: {}", range, path, e);
+                            queue.lock().unwrap().push_back((range, attempts + 1));
+                        }
+                        Err(e) => return Err(format!("Range {} kept failing: {}", range, e)),
+                    }
+                }
+            });
+        }
+        while let Some(result) = workers.join_next().await {
+            result.map_err(|e| e.to_string())??;
+        }
+
+        handle.sync_all().map_err(|e| e.to_string())?;
+        let target = available_path(&dir, &file.name);
+        std::fs::rename(&part, &target).map_err(|e| e.to_string())?;
+        downloads.update(offer_id, |download| download.next_file = index + 1);
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use tokio::net::TcpSocket;
+
+    /// Send a raw request from `from` and return the response's status line
+    async fn request_from(from: Ipv4Addr, server: SocketAddr, request: &str) -> String {
+        let socket = TcpSocket::new_v4().unwrap();
+        socket.bind(SocketAddr::new(from.into(), 0)).unwrap();
+        let mut stream = socket.connect(server).await.unwrap();
+        stream.write_all(request.as_bytes()).await.unwrap();
+        let mut response = Vec::new();
+        stream.read_to_end(&mut response).await.unwrap();
+        let response = String::from_utf8_lossy(&response);
+        response.lines().next().unwrap_or_default().to_string()
+    }
+
+    #[tokio::test(flavor = "multi_thread", worker_threads = 2)]
+    async fn test_loopback_pull_retries_a_failed_range() {
+        let root = std::env::temp_dir().join(format!("gosh-pull-{}", random_hex(4)));
+        let download_dir = root.join("received");
+        std::fs::create_dir_all(&download_dir).unwrap();
+        // Three ranges, the last one short
+        let content: Vec<u8> = (0..pull::RANGE_SIZE * 2 + 1234)
+            .map(|i| (i % 251) as u8)
+            .collect();
+        let source = root.join("payload.bin");
+        std::fs::write(&source, &content).unwrap();
+
+        let offer_id = random_hex(8);
+        let token = random_hex(16);
+        let published = Arc::new(RwLock::new(Published::default()));
+        published.write().unwrap().offers.insert(
+            offer_id.clone(),
+            Offer {
+                files: vec![source],
+                token: token.clone(),
+                peer: Ipv4Addr::LOCALHOST.into(),
+                expires: Instant::now() + OFFER_TTL,
+            },
+        );
+        let server = TcpListener::bind((Ipv4Addr::LOCALHOST, 0)).await.unwrap();
+        let server_at = server.local_addr().unwrap();
+        tokio::spawn(serve_offers(server, published.clone()));
+
+        // The token alone does not open the offer to another address
+        let stranger = format!("GET /offer/{}/0?token={} HTTP/1.1\r\n\r\n", offer_id, token);
+        let refused = request_from(Ipv4Addr::new(127, 0, 0, 2), server_at, &stranger).await;
+        assert!(refused.starts_with("HTTP/1.1 404"), "{}", refused);
+
+        // Cuts the first request off before it reaches the server
+        let front = TcpListener::bind((Ipv4Addr::LOCALHOST, 0)).await.unwrap();
+        let port = front.local_addr().unwrap().port();
+        let requests = Arc::new(AtomicUsize::new(0));
+        let seen = requests.clone();
+        tokio::spawn(async move {
+            while let Ok((mut client, _)) = front.accept().await {
+                if seen.fetch_add(1, Ordering::SeqCst) == 0 {
+                    continue;
+                }
+                tokio::spawn(async move {
+                    if let Ok(mut server) = TcpStream::connect(server_at).await {
+                        let _ = tokio::io::copy_bidirectional(&mut client, &mut server).await;
+                    }
+                });
+            }
+        });
+
+        let offer = PullOffer {
+            offer_id: offer_id.clone(),
+            token,
+            port,
+            files: vec![OfferFile {
+                name: "payload.bin".to_string(),
+                size: content.len() as u64,
+            }],
+        };
+        let downloads = Arc::new(Downloads::default());
+        downloads.insert(Download::new(
+            offer,
+            Ipv4Addr::LOCALHOST.into(),
+            "127.0.0.1".to_string(),
+            &download_dir,
+        ));
+        run_pull(downloads.clone(), offer_id.clone(), None).await;
+
+        let status = downloads.pulls.lock().unwrap()[&offer_id].status.clone();
+        assert_eq!(status.state, PullState::Complete, "{:?}", status.error);
+        assert_eq!(status.received_bytes, content.len() as u64);
+        assert_eq!(
+            std::fs::read(download_dir.join("payload.bin")).unwrap(),
+            content
+        );
+        // Three ranges, the one cut off, and the retire request
+        assert_eq!(requests.load(Ordering::SeqCst), 5);
+        assert!(published.read().unwrap().offers.is_empty());
+        std::fs::remove_dir_all(&root).unwrap();
+    }
+}
@@ -0,0 +1,707 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - QUIC relay transport
+//
+// The engine speaks HTTP over TCP. With the QUIC transport enabled, each
+// TCP connection the engine opens to a peer is carried as its own QUIC
+// stream instead: outbound through a relay listener on the peer's loopback
+// alias, inbound from the QUIC endpoint into the local engine port. Loss
+// on one stream no longer stalls the others, BBR keeps throughput up under
+// random loss where the engine's TCP backs off, reconnects to known peers
+// resume their TLS session, and connections survive a local interface
+// change. Early data is not accepted: a replayed stream would repeat an
+// engine request.
+//
+// Both ends present their device certificate and are pinned
+// trust-on-first-use against `KnownPeers`, and the cipher suite follows
+// the CPU: AES-GCM where AES instructions exist, ChaCha20-Poly1305
+// otherwise.
+//
+// QUIC encrypts in userspace, so kernel TLS and sendfile do not apply. The
+// relay instead moves quinn's own buffers without a bounce copy, and batches
+// UDP datagrams through GSO/GRO where the kernel offers them.
+
+use crate::identity::{
+    check_pin, crypto_provider, has_aes_hardware, local_identity, PeerCertificate,
+    PinnedCertificate,
+};
+use gosh_lan_transfer::GoshTransferEngine;
+use gosh_transfer_core::{KnownPeers, PeerAliases};
+use quinn::congestion::BbrConfig;
+use quinn::crypto::rustls::{QuicClientConfig, QuicServerConfig};
+use quinn::{
+    ClientConfig, Connection, Endpoint, IdleTimeout, RecvStream, SendStream, ServerConfig,
+    TransportConfig, VarInt,
+};
+use rustls::crypto::CryptoProvider;
+use rustls::pki_types::{CertificateDer, PrivateKeyDer};
+use rustls::server::ServerSessionMemoryCache;
+use serde::Serialize;
+use std::collections::{BTreeSet, HashMap};
+use std::io;
+use std::net::{Ipv4Addr, SocketAddr};
+use std::sync::atomic::{AtomicU16, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpSocket, TcpStream};
+use tokio::sync::Mutex;
+use tokio::task::JoinHandle;
+
+/// ALPN protocol id of the relay
+const ALPN: &[u8] = b"gosh-transfer/1";
+/// Resumable sessions kept per side; one per recently seen peer is plenty
+const SESSION_CACHE_SIZE: usize = 1024;
+/// How long to wait for a peer's QUIC endpoint before using plain HTTP
+const HANDSHAKE_TIMEOUT: Duration = Duration::from_millis(1500);
+/// How long a peer without a QUIC endpoint is sent plain HTTP before retrying
+const UNSUPPORTED_RETRY: Duration = Duration::from_secs(300);
+/// How often local addresses are checked for a change of network
+const INTERFACE_POLL: Duration = Duration::from_secs(5);
+/// Read size when moving engine output into a QUIC stream
+const RELAY_CHUNK: usize = 64 * 1024;
+
+/// Offloads available to the encrypted transport on this machine
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct TransportCapabilities {
+    /// Cipher suite preferred for this CPU
+    pub cipher: String,
+    /// AES instructions are available
+    pub aes_hardware: bool,
+    /// Datagrams per UDP send (GSO); 1 means no segmentation offload
+    pub send_segments: usize,
+    /// Datagrams per UDP receive (GRO); 1 means no receive offload
+    pub receive_segments: usize,
+}
+
+/// Probe the crypto and UDP offloads the QUIC transport will use
+pub fn capabilities() -> TransportCapabilities {
+    let aes_hardware = has_aes_hardware();
+    let cipher = if aes_hardware {
+        "AES-128-GCM"
+    } else {
+        "ChaCha20-Poly1305"
+    };
+
+    // quinn probes the same socket options when it opens its endpoints
+    let (send_segments, receive_segments) =
+        std::net::UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))
+            .and_then(|socket| quinn::udp::UdpSocketState::new((&socket).into()))
+            .map(|state| (state.max_gso_segments(), state.gro_segments()))
+            .unwrap_or((1, 1));
+
+    TransportCapabilities {
+        cipher: cipher.to_string(),
+        aes_hardware,
+        send_segments,
+        receive_segments,
+    }
+}
+
+/// Relay of engine connections to one peer over a single QUIC connection
+struct Relay {
+    connection: Connection,
+    local: SocketAddr,
+    task: JoinHandle<()>,
+}
+
+impl Drop for Relay {
+    fn drop(&mut self) {
+        self.task.abort();
+        self.connection.close(VarInt::from_u32(0), b"relay closed");
+    }
+}
+
+/// Counts a relayed stream while it lives
+struct LiveStream(Arc<AtomicUsize>);
+
+impl LiveStream {
+    fn new(streams: &Arc<AtomicUsize>) -> Self {
+        streams.fetch_add(1, Ordering::Relaxed);
+        Self(streams.clone())
+    }
+}
+
+impl Drop for LiveStream {
+    fn drop(&mut self) {
+        self.0.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+/// QUIC endpoints and per-peer relays
+pub struct QuicTransport {
+    client: Endpoint,
+    server: Endpoint,
+    aliases: Arc<PeerAliases>,
+    relays: Mutex<HashMap<SocketAddr, Relay>>,
+    unsupported: Mutex<HashMap<SocketAddr, Instant>>,
+    /// Engine port new inbound streams are handed to
+    engine_port: Arc<AtomicU16>,
+    /// Streams being relayed either way
+    streams: Arc<AtomicUsize>,
+    tasks: Vec<JoinHandle<()>>,
+}
+
+impl QuicTransport {
+    /// Listen on UDP `port` and relay incoming streams to the engine on TCP `engine_port`
+    pub fn start(
+        port: u16,
+        engine_port: u16,
+        aliases: Arc<PeerAliases>,
+        known_peers: Arc<KnownPeers>,
+    ) -> Result<Self, String> {
+        let provider = Arc::new(crypto_provider());
+
+        let server_addr = SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), port);
+        let (cert, key) = local_identity()?;
+        let server = Endpoint::server(
+            server_config(&provider, cert.clone(), key.clone_key())?,
+            server_addr,
+        )
+        .map_err(|e| format!("Failed to bind QUIC port {}: {}", port, e))?;
+
+        // Outbound connections use their own socket so it can be swapped on migration
+        let mut client = Endpoint::client(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))
+            .map_err(|e| format!("Failed to create QUIC client: {}", e))?;
+        client.set_default_client_config(client_config(&provider, known_peers.clone(), cert, key)?);
+
+        let engine_port = Arc::new(AtomicU16::new(engine_port));
+        let streams = Arc::new(AtomicUsize::new(0));
+        let tasks = vec![
+            tokio::spawn(Self::serve(
+                server.clone(),
+                engine_port.clone(),
+                aliases.clone(),
+                known_peers,
+                streams.clone(),
+            )),
+            tokio::spawn(Self::follow_interfaces(client.clone())),
+        ];
+
+        Ok(Self {
+            client,
+            server,
+            aliases,
+            relays: Mutex::new(HashMap::new()),
+            unsupported: Mutex::new(HashMap::new()),
+            engine_port,
+            streams,
+            tasks,
+        })
+    }
+
+    /// UDP port the endpoint listens on
+    pub fn port(&self) -> Option<u16> {
+        self.server.local_addr().ok().map(|addr| addr.port())
+    }
+
+    /// Hand new inbound streams to the engine on `port`; streams already
+    /// relayed stay with the engine they started on
+    pub fn set_engine_port(&self, port: u16) {
+        self.engine_port.store(port, Ordering::Relaxed);
+    }
+
+    /// Stop accepting connections, keeping the open ones until they end
+    pub fn retire(&self) {
+        self.server.set_server_config(None);
+    }
+
+    /// Streams being relayed either way
+    pub fn streams(&self) -> usize {
+        self.streams.load(Ordering::Relaxed)
+    }
+
+    /// Find where the engine should send to reach a peer.
+    ///
+    /// Returns the local relay address when the peer answers on QUIC, or
+    /// `None` when the engine should connect to the peer directly.
+    pub async fn route(&self, address: &str, port: u16) -> Option<SocketAddr> {
+        let peer = tokio::net::lookup_host((address, port))
+            .await
+            .ok()?
+            .find(SocketAddr::is_ipv4)?;
+
+        let mut relays = self.relays.lock().await;
+        if let Some(relay) = relays.get(&peer) {
+            if relay.connection.close_reason().is_none() {
+                return Some(relay.local);
+            }
+            relays.remove(&peer);
+        }
+
+        let mut unsupported = self.unsupported.lock().await;
+        if let Some(since) = unsupported.get(&peer) {
+            if since.elapsed() < UNSUPPORTED_RETRY {
+                return None;
+            }
+            unsupported.remove(&peer);
+        }
+
+        let connection = match self.connect(peer).await {
+            Ok(connection) => connection,
+            Err(e) => {
+                tracing::info!("No QUIC endpoint at {}, using HTTP: {}", peer, e);
+                unsupported.insert(peer, Instant::now());
+                return None;
+            }
+        };
+
+        let alias = self.aliases.alias_for(peer.ip());
+        match Self::start_relay(connection, alias, self.streams.clone()).await {
+            Ok(relay) => {
+                let local = relay.local;
+                relays.insert(peer, relay);
+                tracing::info!("Relaying transfers to {} over QUIC", peer);
+                Some(local)
+            }
+            Err(e) => {
+                tracing::warn!("Failed to start QUIC relay for {}: {}", peer, e);
+                None
+            }
+        }
+    }
+
+    async fn connect(&self, peer: SocketAddr) -> Result<Connection, String> {
+        // The peer's IP is the server name, so cached sessions and pins are per peer
+        let connecting = self
+            .client
+            .connect(peer, &peer.ip().to_string())
+            .map_err(|e| e.to_string())?;
+
+        tokio::time::timeout(HANDSHAKE_TIMEOUT, connecting)
+            .await
+            .map_err(|_| "handshake timed out".to_string())?
+            .map_err(|e| e.to_string())
+    }
+
+    /// Accept engine connections on the peer's alias and open a stream for each
+    async fn start_relay(
+        connection: Connection,
+        alias: Ipv4Addr,
+        streams: Arc<AtomicUsize>,
+    ) -> io::Result<Relay> {
+        let listener = TcpListener::bind(SocketAddr::new(alias.into(), 0)).await?;
+        let local = listener.local_addr()?;
+
+        let opener = connection.clone();
+        let task = tokio::spawn(async move {
+            while let Ok((stream, _)) = listener.accept().await {
+                let connection = opener.clone();
+                let live = LiveStream::new(&streams);
+                tokio::spawn(async move {
+                    let _live = live;
+                    let result = match connection.open_bi().await {
+                        Ok((send, recv)) => pump(stream, send, recv).await,
+                        Err(e) => Err(io::Error::new(io::ErrorKind::ConnectionAborted, e)),
+                    };
+                    if let Err(e) = result {
+                        tracing::debug!("Outbound QUIC stream ended: {}", e);
+                    }
+                });
+            }
+        });
+
+        Ok(Relay {
+            connection,
+            local,
+            task,
+        })
+    }
+
+    /// Hand each incoming stream to the engine from the peer's loopback alias
+    async fn serve(
+        endpoint: Endpoint,
+        engine_port: Arc<AtomicU16>,
+        aliases: Arc<PeerAliases>,
+        known_peers: Arc<KnownPeers>,
+        streams: Arc<AtomicUsize>,
+    ) {
+        while let Some(incoming) = endpoint.accept().await {
+            let (aliases, known_peers) = (aliases.clone(), known_peers.clone());
+            let (engine_port, streams) = (engine_port.clone(), streams.clone());
+            tokio::spawn(async move {
+                let connection = match incoming.await {
+                    Ok(connection) => connection,
+                    Err(e) => {
+                        tracing::debug!("Incoming QUIC handshake failed: {}", e);
+                        return;
+                    }
+                };
+                let peer = connection.remote_address().ip();
+                // The handshake required a certificate; whose it may be is checked here
+                let pinned = connection
+                    .peer_identity()
+                    .and_then(|identity| identity.downcast::<Vec<CertificateDer<'static>>>().ok())
+                    .and_then(|certs| {
+                        certs
+                            .first()
+                            .map(|cert| check_pin(&known_peers, peer, cert))
+                    })
+                    .unwrap_or(false);
+                if !pinned {
+                    connection.close(VarInt::from_u32(1), b"identity refused");
+                    return;
+                }
+                let source = aliases.alias_for(peer);
+
+                while let Ok((send, recv)) = connection.accept_bi().await {
+                    let live = LiveStream::new(&streams);
+                    let engine_port = engine_port.load(Ordering::Relaxed);
+                    tokio::spawn(async move {
+                        let _live = live;
+                        let result = async {
+                            let socket = TcpSocket::new_v4()?;
+                            socket.bind(SocketAddr::new(source.into(), 0))?;
+                            let engine = SocketAddr::new(Ipv4Addr::LOCALHOST.into(), engine_port);
+                            pump(socket.connect(engine).await?, send, recv).await
+                        }
+                        .await;
+                        if let Err(e) = result {
+                            tracing::debug!("Inbound QUIC stream ended: {}", e);
+                        }
+                    });
+                }
+            });
+        }
+    }
+
+    /// Move outbound connections to a fresh socket when local addresses change
+    async fn follow_interfaces(client: Endpoint) {
+        let mut known = local_addresses();
+        let mut ticker = tokio::time::interval(INTERFACE_POLL);
+        loop {
+            ticker.tick().await;
+            let current = local_addresses();
+            if current == known {
+                continue;
+            }
+            known = current;
+
+            let rebound =
+                std::net::UdpSocket::bind(SocketAddr::new(Ipv4Addr::UNSPECIFIED.into(), 0))
+                    .and_then(|socket| client.rebind(socket));
+            match rebound {
+                Ok(()) => tracing::info!("Network changed, migrated QUIC connections"),
+                Err(e) => tracing::warn!("Failed to migrate QUIC connections: {}", e),
+            }
+        }
+    }
+}
+
+impl Drop for QuicTransport {
+    fn drop(&mut self) {
+        for task in &self.tasks {
+            task.abort();
+        }
+        self.server.close(VarInt::from_u32(0), b"shutting down");
+        self.client.close(VarInt::from_u32(0), b"shutting down");
+    }
+}
+
+/// Copy both directions between an engine TCP connection and a QUIC stream.
+///
+/// Decrypted chunks are written to the engine straight from quinn's buffers,
+/// and engine output is handed to quinn as owned chunks, so neither
+/// direction goes through an intermediate copy buffer.
+async fn pump(stream: TcpStream, mut send: SendStream, mut recv: RecvStream) -> io::Result<()> {
+    stream.set_nodelay(true)?;
+    let (mut tcp_read, mut tcp_write) = stream.into_split();
+
+    let inbound = async {
+        while let Some(chunk) = recv
+            .read_chunk(usize::MAX, true)
+            .await
+            .map_err(io::Error::from)?
+        {
+            tcp_write.write_all(&chunk.bytes).await?;
+        }
+        tcp_write.shutdown().await
+    };
+    let outbound = async {
+        let mut buf = bytes::BytesMut::with_capacity(RELAY_CHUNK);
+        loop {
+            buf.reserve(RELAY_CHUNK);
+            if tcp_read.read_buf(&mut buf).await? == 0 {
+                break;
+            }
+            send.write_chunk(buf.split().freeze())
+                .await
+                .map_err(io::Error::from)?;
+        }
+        send.finish()
+            .map_err(|e| io::Error::new(io::ErrorKind::BrokenPipe, e))
+    };
+
+    tokio::try_join!(inbound, outbound)?;
+    Ok(())
+}
+
+fn local_addresses() -> BTreeSet<String> {
+    GoshTransferEngine::get_network_interfaces()
+        .into_iter()
+        .filter(|iface| !iface.is_loopback)
+        .map(|iface| iface.ip)
+        .collect()
+}
+
+fn transport_config() -> Arc<TransportConfig> {
+    let mut transport = TransportConfig::default();
+    // One stream per engine connection; chunk uploads run in parallel
+    transport.max_concurrent_bidi_streams(VarInt::from_u32(256));
+    // Windows sized for a few hundred Mbit/s at Wi-Fi/VPN round trips
+    transport.stream_receive_window(VarInt::from_u32(8 * 1024 * 1024));
+    transport.receive_window(VarInt::from_u32(32 * 1024 * 1024));
+    transport.send_window(32 * 1024 * 1024);
+    transport.keep_alive_interval(Some(Duration::from_secs(10)));
+    transport.max_idle_timeout(IdleTimeout::try_from(Duration::from_secs(60)).ok());
+    // Loss on Wi-Fi and VPN links is mostly random rather than congestion;
+    // BBR paces to measured bandwidth where CUBIC halves on every loss
+    transport.congestion_controller_factory(Arc::new(BbrConfig::default()));
+    Arc::new(transport)
+}
+
+fn server_config(
+    provider: &Arc<CryptoProvider>,
+    cert: CertificateDer<'static>,
+    key: PrivateKeyDer<'static>,
+) -> Result<ServerConfig, String> {
+    let mut crypto = rustls::ServerConfig::builder_with_provider(provider.clone())
+        .with_protocol_versions(&[&rustls::version::TLS13])
+        .map_err(|e| e.to_string())?
+        .with_client_cert_verifier(Arc::new(PeerCertificate::new(provider.clone())))
+        .with_single_cert(vec![cert], key)
+        .map_err(|e| e.to_string())?;
+    crypto.alpn_protocols = vec![ALPN.to_vec()];
+    // Without AES instructions, insist on our ChaCha20 preference
+    crypto.ignore_client_order = !has_aes_hardware();
+    crypto.session_storage = ServerSessionMemoryCache::new(SESSION_CACHE_SIZE);
+
+    let crypto = QuicServerConfig::try_from(crypto).map_err(|e| e.to_string())?;
+    let mut config = ServerConfig::with_crypto(Arc::new(crypto));
+    config.transport_config(transport_config());
+    Ok(config)
+}
+
+fn client_config(
+    provider: &Arc<CryptoProvider>,
+    known_peers: Arc<KnownPeers>,
+    cert: CertificateDer<'static>,
+    key: PrivateKeyDer<'static>,
+) -> Result<ClientConfig, String> {
+    let verifier = PinnedCertificate::new(provider.clone(), known_peers);
+    let mut crypto = rustls::ClientConfig::builder_with_provider(provider.clone())
+        .with_protocol_versions(&[&rustls::version::TLS13])
+        .map_err(|e| e.to_string())?
+        .dangerous()
+        .with_custom_certificate_verifier(Arc::new(verifier))
+        .with_client_auth_cert(vec![cert], key)
+        .map_err(|e| e.to_string())?;
+    crypto.alpn_protocols = vec![ALPN.to_vec()];
+    // Sessions are cached in memory, so reconnects to a known peer resume
+    crypto.resumption = rustls::client::Resumption::in_memory_sessions(SESSION_CACHE_SIZE);
+
+    let crypto = QuicClientConfig::try_from(crypto).map_err(|e| e.to_string())?;
+    let mut config = ClientConfig::new(Arc::new(crypto));
+    config.transport_config(transport_config());
+    Ok(config)
+}
+
+#[cfg(test)]
+mod tests {
+    // Roles of scripts/loss-bench.py, which runs each in its own network
+    // namespace and passes the settings through GOSH_BENCH_* variables, and
+    // a loopback run of every transport within one process
+    use super::*;
+    use crate::acceptors::Acceptors;
+    use crate::tls::TlsTransport;
+    use std::any::Any;
+
+    /// Transports the bench knows: plain TCP, TCP through the acceptors'
+    /// splice, TLS through the acceptors, and the QUIC relay
+    const TRANSPORTS: [&str; 4] = ["tcp", "relay", "tls", "quic"];
+
+    fn setting(name: &str) -> String {
+        std::env::var(name).unwrap_or_else(|_| panic!("{} is not set", name))
+    }
+
+    fn transport_on(port: u16, engine_port: u16) -> QuicTransport {
+        let known_peers = Arc::new(KnownPeers::new().unwrap());
+        QuicTransport::start(port, engine_port, Default::default(), known_peers).unwrap()
+    }
+
+    fn tls_transport() -> Arc<TlsTransport> {
+        let known_peers = Arc::new(KnownPeers::new().unwrap());
+        Arc::new(TlsTransport::new(Default::default(), known_peers).unwrap())
+    }
+
+    /// Listen on `port` through `transport`; returns the listener standing
+    /// in for the engine and whatever must stay alive in front of it
+    async fn receiver(transport: &str, port: u16) -> (TcpListener, Box<dyn Any>) {
+        if transport == "tcp" {
+            let listener = TcpListener::bind((Ipv4Addr::UNSPECIFIED, port))
+                .await
+                .unwrap();
+            return (listener, Box::new(()));
+        }
+        let sink = TcpListener::bind((Ipv4Addr::LOCALHOST, 0)).await.unwrap();
+        let sink_port = sink.local_addr().unwrap().port();
+        let front: Box<dyn Any> = match transport {
+            "relay" | "tls" => {
+                let acceptors = Acceptors::start(port, sink_port, Default::default())
+                    .await
+                    .unwrap();
+                if transport == "tls" {
+                    acceptors.set_tls(Some(tls_transport()));
+                }
+                Box::new(acceptors)
+            }
+            "quic" => Box::new(transport_on(port, sink_port)),
+            other => panic!("Unknown transport {}", other),
+        };
+        (sink, front)
+    }
+
+    /// Where to connect to reach a receiver at `peer`:`port` through `transport`
+    async fn sender(transport: &str, peer: &str, port: u16) -> (SocketAddr, Box<dyn Any>) {
+        match transport {
+            "tcp" | "relay" => (SocketAddr::new(peer.parse().unwrap(), port), Box::new(())),
+            "tls" => {
+                let transport = tls_transport();
+                let relay = transport.route(peer, port).await.expect("No TLS endpoint");
+                (relay, Box::new(transport))
+            }
+            "quic" => {
+                let transport = transport_on(port + 1, port + 2);
+                let relay = transport.route(peer, port).await.expect("No QUIC endpoint");
+                (relay, Box::new(transport))
+            }
+            other => panic!("Unknown transport {}", other),
+        }
+    }
+
+    /// Read one connection to its end and acknowledge it
+    async fn drain(listener: &TcpListener) {
+        let (mut stream, _) = listener.accept().await.unwrap();
+        let mut buf = vec![0u8; RELAY_CHUNK];
+        while stream.read(&mut buf).await.unwrap() > 0 {}
+        stream.write_all(b"ok").await.unwrap();
+        stream.shutdown().await.unwrap();
+    }
+
+    /// Stream `bytes` to `target` and return the seconds to its acknowledgement
+    async fn push(socket: TcpSocket, target: SocketAddr, bytes: u64) -> f64 {
+        let start = Instant::now();
+        let mut stream = socket.connect(target).await.unwrap();
+        let chunk = vec![0x5a; RELAY_CHUNK];
+        let mut sent = 0;
+        while sent < bytes {
+            stream.write_all(&chunk).await.unwrap();
+            sent += chunk.len() as u64;
+        }
+        stream.shutdown().await.unwrap();
+        let mut ack = Vec::new();
+        stream.read_to_end(&mut ack).await.unwrap();
+        assert_eq!(ack, b"ok");
+        start.elapsed().as_secs_f64()
+    }
+
+    /// Take one stream in place of the engine and acknowledge it once it ends
+    #[tokio::test(flavor = "multi_thread", worker_threads = 2)]
+    #[ignore]
+    async fn bench_receive() {
+        let port: u16 = setting("GOSH_BENCH_PORT").parse().unwrap();
+        let (listener, _front) = receiver(&setting("GOSH_BENCH_TRANSPORT"), port).await;
+        println!("bench: ready");
+
+        drain(&listener).await;
+        // The relay must stay up until the acknowledgement is through
+        std::future::pending::<()>().await;
+    }
+
+    /// Stream GOSH_BENCH_BYTES to the receiver and report the time to its acknowledgement
+    #[tokio::test(flavor = "multi_thread", worker_threads = 2)]
+    #[ignore]
+    async fn bench_send() {
+        let port: u16 = setting("GOSH_BENCH_PORT").parse().unwrap();
+        let bytes: u64 = setting("GOSH_BENCH_BYTES").parse().unwrap();
+        let peer = setting("GOSH_BENCH_PEER");
+        let (target, _relay) = sender(&setting("GOSH_BENCH_TRANSPORT"), &peer, port).await;
+
+        let socket = TcpSocket::new_v4().unwrap();
+        let congestion = std::env::var("GOSH_BENCH_TCP_CONGESTION").unwrap_or_default();
+        if !congestion.is_empty() {
+            socket2::SockRef::from(&socket)
+                .set_tcp_congestion(congestion.as_bytes())
+                .unwrap();
+        }
+
+        let seconds = push(socket, target, bytes).await;
+        let sent = bytes.div_ceil(RELAY_CHUNK as u64) * RELAY_CHUNK as u64;
+        println!("bench: sent {} in {:.3}", sent, seconds);
+    }
+
+    /// Every transport between two ends in this process, over loopback.
+    /// Both ends share the CPU, so this bounds what one core can encrypt
+    /// and relay rather than what a link carries. Run with a scratch
+    /// XDG_CONFIG_HOME, as it pins its own identity:
+    ///
+    ///   XDG_CONFIG_HOME=$(mktemp -d) cargo test --release -- --ignored --nocapture bench_loopback
+    #[tokio::test(flavor = "multi_thread")]
+    #[ignore]
+    async fn bench_loopback() {
+        let bytes: u64 = std::env::var("GOSH_BENCH_BYTES")
+            .map(|b| b.parse().unwrap())
+            .unwrap_or(1 << 30);
+        let base: u16 = std::env::var("GOSH_BENCH_PORT")
+            .map(|p| p.parse().unwrap())
+            .unwrap_or(53340);
+
+        for (index, transport) in TRANSPORTS.iter().enumerate() {
+            let port = base + 10 * index as u16;
+            let (listener, _front) = receiver(transport, port).await;
+            let sink = tokio::spawn(async move { drain(&listener).await });
+            let (target, _relay) = sender(transport, "127.0.0.1", port).await;
+
+            let seconds = push(TcpSocket::new_v4().unwrap(), target, bytes).await;
+            sink.await.unwrap();
+            println!(
+                "bench: {} {:.0} MiB/s",
+                transport,
+                bytes as f64 / seconds / (1 << 20) as f64
+            );
+        }
+    }
+
+    /// A retired endpoint refuses new connections and relays the streams it has
+    #[tokio::test(flavor = "multi_thread", worker_threads = 2)]
+    async fn test_retired_endpoint_keeps_its_streams() {
+        let engine = TcpListener::bind((Ipv4Addr::LOCALHOST, 0)).await.unwrap();
+        let receiver = transport_on(53381, engine.local_addr().unwrap().port());
+        let sender = transport_on(53382, 53383);
+        let relay = sender.route("127.0.0.1", 53381).await.unwrap();
+
+        let mut stream = TcpStream::connect(relay).await.unwrap();
+        stream.write_all(b"before").await.unwrap();
+        let (mut inbound, _) = engine.accept().await.unwrap();
+        let mut buf = [0u8; 6];
+        inbound.read_exact(&mut buf).await.unwrap();
+        assert_eq!(&buf, b"before");
+
+        receiver.retire();
+        assert_eq!(receiver.streams(), 1);
+        stream.write_all(b"after!").await.unwrap();
+        inbound.read_exact(&mut buf).await.unwrap();
+        assert_eq!(&buf, b"after!");
+
+        let late = transport_on(53384, 53385);
+        assert!(late.route("127.0.0.1", 53381).await.is_none());
+
+        drop(stream);
+        drop(inbound);
+        let deadline = Instant::now() + Duration::from_secs(5);
+        while receiver.streams() > 0 {
+            assert!(Instant::now() < deadline, "stream still counted");
+            tokio::time::sleep(Duration::from_millis(20)).await;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Address racing
+//
+// A favorite with several addresses is sent to through whichever answers
+// first. Connections are started in the favorite's ranked order, each one
+// a short stagger after the one before, or at once when every running
+// attempt has failed, so the preferred address wins unless it is down or
+// clearly slower. The race only picks the address; the engine then makes
+// its own connection to it.
+
+use std::io;
+use std::net::IpAddr;
+use std::time::Duration;
+use tokio::task::JoinSet;
+use tokio::time::Instant;
+
+/// Head start each address gets over the next
+const STAGGER: Duration = Duration::from_millis(250);
+
+/// How long one attempt may take, name lookup included
+const CONNECT_TIMEOUT: Duration = Duration::from_secs(3);
+
+/// The address that connected first
+#[derive(Debug)]
+pub struct Winner {
+    pub address: String,
+    /// IP the address resolved to
+    pub ip: IpAddr,
+    /// Time to connect, name lookup excluded
+    pub rtt: Duration,
+}
+
+/// Race connections to `port` at `candidates`, best first. Returns the
+/// winner, if any connected, and the addresses that failed before it did.
+pub async fn race(candidates: &[String], port: u16) -> (Option<Winner>, Vec<String>) {
+    let mut pending = candidates.to_vec().into_iter();
+    let mut attempts = JoinSet::new();
+    let mut failed = Vec::new();
+    let mut next_start = Instant::now();
+
+    loop {
+        if attempts.is_empty() || Instant::now() >= next_start {
+            if let Some(address) = pending.next() {
+                attempts.spawn(connect(address, port));
+                next_start = Instant::now() + STAGGER;
+                continue;
+            }
+            if attempts.is_empty() {
+                return (None, failed);
+            }
+        }
+
+        tokio::select! {
+            Some(done) = attempts.join_next() => match done {
+                Ok((address, Ok((ip, rtt)))) => {
+                    return (Some(Winner { address, ip, rtt }), failed);
+                }
+                Ok((address, Err(e))) => {
+                    tracing::debug!("Could not connect to {}:{}: {}", address, port, e);
+                    failed.push(address);
+                }
+                Err(e) => tracing::warn!("Connection attempt ended abnormally: {}", e),
+            },
+            _ = tokio::time::sleep_until(next_start), if pending.len() > 0 => {}
+        }
+    }
+}
+
+async fn connect(address: String, port: u16) -> (String, io::Result<(IpAddr, Duration)>) {
+    let attempt = async {
+        let target = tokio::net::lookup_host((address.as_str(), port))
+            .await?
+            .next()
+            .ok_or_else(|| io::Error::new(io::ErrorKind::NotFound, "no address found"))?;
+        let started = Instant::now();
+        tokio::net::TcpStream::connect(target).await?;
+        Ok((target.ip(), started.elapsed()))
+    };
+    let result = tokio::time::timeout(CONNECT_TIMEOUT, attempt)
+        .await
+        .unwrap_or_else(|_| Err(io::ErrorKind::TimedOut.into()));
+    (address, result)
+}
@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - File and directory sends
+//
+// Each send runs as its own task under a bridge-assigned id, so the command
+// loop stays free and a cancel never waits behind a long walk or send.
+// Large sends still go out one at a time. Cancelling fires the send's
+// token: walks and staging stop at their next entry, and the task drops
+// whatever it is awaiting, which closes the engine's connection.
+
+use crate::engine_bridge::{EngineBridge, SendRoute};
+use crate::outbox;
+use gosh_transfer_core::filter::{self, Walked};
+use gosh_transfer_core::{CancelToken, InFlightJournal, Outbox, QueuedSource};
+use serde::Serialize;
+use std::collections::HashMap;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use tokio::sync::Semaphore;
+
+/// Stage a send has reached
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize)]
+#[serde(rename_all = "lowercase")]
+pub enum SendStage {
+    /// Waiting behind another large send
+    Queued,
+    /// Walking and staging a filtered directory
+    Preparing,
+    Sending,
+}
+
+/// A running send, reported to the frontend
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct SendInfo {
+    pub id: String,
+    pub address: String,
+    pub stage: SendStage,
+    pub started_at: chrono::DateTime<chrono::Utc>,
+}
+
+/// Sends in progress, by id
+#[derive(Default)]
+pub struct ActiveSends {
+    sends: Mutex<HashMap<String, (SendInfo, CancelToken)>>,
+    next_id: AtomicU64,
+}
+
+impl ActiveSends {
+    /// Id for a send about to be queued
+    pub fn next_id(&self) -> String {
+        format!("send-{}", self.next_id.fetch_add(1, Ordering::Relaxed))
+    }
+
+    pub(crate) fn begin(&self, id: &str, address: &str) -> CancelToken {
+        let token = CancelToken::default();
+        let info = SendInfo {
+            id: id.to_string(),
+            address: address.to_string(),
+            stage: SendStage::Queued,
+            started_at: chrono::Utc::now(),
+        };
+        self.sends
+            .lock()
+            .unwrap()
+            .insert(id.to_string(), (info, token.clone()));
+        token
+    }
+
+    pub(crate) fn set_stage(&self, id: &str, stage: SendStage) {
+        if let Some((info, _)) = self.sends.lock().unwrap().get_mut(id) {
+            info.stage = stage;
+        }
+    }
+
+    pub(crate) fn end(&self, id: &str) {
+        self.sends.lock().unwrap().remove(id);
+    }
+
+    /// Cancel a send, returning false if no send has this id
+    pub fn cancel(&self, id: &str) -> bool {
+        match self.sends.lock().unwrap().get(id) {
+            Some((_, token)) => {
+                token.cancel();
+                true
+            }
+            None => false,
+        }
+    }
+
+    pub fn list(&self) -> Vec<SendInfo> {
+        let mut sends: Vec<SendInfo> = self
+            .sends
+            .lock()
+            .unwrap()
+            .values()
+            .map(|(info, _)| info.clone())
+            .collect();
+        sends.sort_by(|a, b| a.started_at.cmp(&b.started_at));
+        sends
+    }
+}
+
+/// What a send task needs from the bridge
+pub struct SendContext {
+    pub route: SendRoute,
+    pub outbox: Arc<Outbox>,
+    pub journal: Arc<InFlightJournal>,
+    pub sends: Arc<ActiveSends>,
+    /// Held by large sends so they go out one at a time
+    pub large_sends: Arc<Semaphore>,
+    /// Sends of regular files up to this many bytes do not wait for `large_sends`
+    pub skip_queue_max_bytes: u64,
+}
+
+/// Error of a send stopped through its token
+const CANCELLED: &str = "Cancelled";
+
+/// Removes a staged tree however the send ends
+pub(crate) struct Staged(pub(crate) PathBuf);
+
+impl Drop for Staged {
+    fn drop(&mut self) {
+        filter::remove_staged(&self.0);
+    }
+}
+
+/// Run a send to completion or cancellation. Sends to unreachable peers
+/// are queued in the outbox.
+pub async fn run(ctx: SendContext, id: String, address: String, port: u16, source: QueuedSource) {
+    let mut walked = Walked::default();
+    let result = track(
+        &ctx,
+        &id,
+        &address,
+        port,
+        &source,
+        source.clone(),
+        &mut walked,
+    )
+    .await;
+
+    match result {
+        Ok(()) => {}
+        Err(e) if e == CANCELLED => {}
+        Err(e) => {
+            tracing::error!("Send {} failed: {}", id, e);
+            let source = match source {
+                QueuedSource::Directory { path, filter, .. } => QueuedSource::Directory {
+                    path,
+                    filter,
+                    files: walked.files,
+                    stamps: Vec::new(),
+                },
+                source => source,
+            };
+            outbox::queue_if_unreachable(
+                &ctx.route,
+                &ctx.outbox,
+                address,
+                port,
+                source,
+                walked.dirs,
+                e,
+            )
+            .await;
+        }
+    }
+}
+
+/// Send one file of a chain with its manifest, reporting the outcome rather
+/// than queueing it. The journal keeps the file alone: the manifest is staged
+/// and gone after an exit, so a cut-off chain file is offered to its hop
+/// without continuing the chain.
+pub async fn run_chained(
+    ctx: &SendContext,
+    id: &str,
+    address: &str,
+    port: u16,
+    paths: Vec<PathBuf>,
+    manifest: PathBuf,
+) -> Result<(), String> {
+    let journaled = QueuedSource::Files {
+        paths: paths.clone(),
+    };
+    let mut paths = paths;
+    paths.push(manifest);
+    let source = QueuedSource::Files { paths };
+    track(
+        ctx,
+        id,
+        address,
+        port,
+        &source,
+        journaled,
+        &mut Walked::default(),
+    )
+    .await
+}
+
+/// Deliver `source` while it is listed as an active send and journaled as
+/// `journaled`, stopping when its token is cancelled
+async fn track(
+    ctx: &SendContext,
+    id: &str,
+    address: &str,
+    port: u16,
+    source: &QueuedSource,
+    journaled: QueuedSource,
+    walked: &mut Walked,
+) -> Result<(), String> {
+    let cancel = ctx.sends.begin(id, address);
+    let journal_id = ctx.journal.begin_send(address, port, journaled);
+
+    let result = tokio::select! {
+        result = deliver(ctx, id, address, port, source, &cancel, walked) => result,
+        _ = cancel.cancelled() => Err(CANCELLED.to_string()),
+    };
+    ctx.journal.end_send(&journal_id);
+    ctx.sends.end(id);
+
+    match result {
+        Err(_) if cancel.is_cancelled() => {
+            let elapsed = cancel.elapsed().unwrap_or_default();
+            tracing::info!("Send {} cancelled, stopped after {:?}", id, elapsed);
+            Err(CANCELLED.to_string())
+        }
+        result => result,
+    }
+}
+
+async fn deliver(
+    ctx: &SendContext,
+    id: &str,
+    address: &str,
+    port: u16,
+    source: &QueuedSource,
+    cancel: &CancelToken,
+    walked: &mut Walked,
+) -> Result<(), String> {
+    match source {
+        QueuedSource::Files { paths } => {
+            // Small payloads skip the line so they are not stuck behind large sends
+            let small = EngineBridge::is_small_send(paths, ctx.skip_queue_max_bytes).await;
+            let _permit = match small {
+                true => None,
+                false => Some(ctx.large_sends.acquire().await.map_err(|e| e.to_string())?),
+            };
+            ctx.sends.set_stage(id, SendStage::Sending);
+            ctx.route.send_files(address, port, paths.clone()).await
+        }
+        QueuedSource::Directory { path, filter, .. } => {
+            let _permit = ctx.large_sends.acquire().await.map_err(|e| e.to_string())?;
+            let staged = match filter.clone().filter(|f| !f.is_empty()) {
+                Some(filter) => {
+                    ctx.sends.set_stage(id, SendStage::Preparing);
+                    let (staged, tree) = EngineBridge::stage_filtered_directory(
+                        path.clone(),
+                        filter,
+                        cancel.clone(),
+                    )
+                    .await?;
+                    *walked = tree;
+                    Some(Staged(staged))
+                }
+                None => None,
+            };
+            ctx.sends.set_stage(id, SendStage::Sending);
+            let source = staged.as_ref().map_or(path.clone(), |s| s.0.clone());
+            ctx.route.send_directory(address, port, source).await
+        }
+    }
+}
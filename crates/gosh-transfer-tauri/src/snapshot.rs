@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Frontend snapshot
+//
+// In tray mode the window, and the frontend store with it, is destroyed
+// while the engine keeps running. The state the store builds from engine
+// events is mirrored here as the events go out, so a recreated window
+// restores everything with one command instead of waiting for the next
+// events to arrive.
+
+use crate::instance::LaunchRequest;
+use gosh_lan_transfer::{EngineEvent, TransferProgress};
+use gosh_transfer_core::{AppSettings, Favorite, HistoryEntry, NetworkInterface, PendingTransfer};
+use serde::Serialize;
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+#[derive(Default)]
+struct Inner {
+    server_port: Option<u16>,
+    /// Latest progress of each running transfer
+    active: HashMap<String, TransferProgress>,
+    page: Option<String>,
+    /// Paths and favorite from a launch, until the frontend picks them up
+    launch: Option<LaunchRequest>,
+}
+
+/// Event-derived frontend state, kept while no window exists
+#[derive(Default)]
+pub struct FrontendMirror {
+    inner: Mutex<Inner>,
+}
+
+impl FrontendMirror {
+    /// Apply an event the way the frontend store does
+    pub fn record(&self, event: &EngineEvent) {
+        let mut inner = self.inner.lock().unwrap();
+        match event {
+            EngineEvent::ServerStarted { port } => inner.server_port = Some(*port),
+            EngineEvent::ServerStopped => inner.server_port = None,
+            EngineEvent::PortChanged { new_port, .. } => inner.server_port = Some(*new_port),
+            EngineEvent::TransferProgress(progress) => {
+                inner
+                    .active
+                    .insert(progress.transfer_id.clone(), progress.clone());
+            }
+            EngineEvent::TransferComplete { transfer_id }
+            | EngineEvent::TransferFailed { transfer_id, .. } => {
+                inner.active.remove(transfer_id);
+            }
+            EngineEvent::TransferRequest(_) | EngineEvent::TransferRetry { .. } => {}
+        }
+    }
+
+    /// Drop a transfer the user cancelled, which sends no further event
+    pub fn forget(&self, transfer_id: &str) {
+        self.inner.lock().unwrap().active.remove(transfer_id);
+    }
+
+    /// Remember the page shown, to reopen the window on it
+    pub fn set_page(&self, page: String) {
+        self.inner.lock().unwrap().page = Some(page);
+    }
+
+    /// Hold a launch's request for the frontend, adding to any not yet taken
+    pub fn set_launch(&self, request: LaunchRequest) {
+        let mut inner = self.inner.lock().unwrap();
+        match &mut inner.launch {
+            Some(launch) => launch.merge(request),
+            None => inner.launch = Some(request),
+        }
+    }
+
+    pub fn take_launch(&self) -> Option<LaunchRequest> {
+        self.inner.lock().unwrap().launch.take()
+    }
+
+    pub fn server_port(&self) -> Option<u16> {
+        self.inner.lock().unwrap().server_port
+    }
+
+    pub fn active(&self) -> Vec<TransferProgress> {
+        self.inner
+            .lock()
+            .unwrap()
+            .active
+            .values()
+            .cloned()
+            .collect()
+    }
+
+    pub fn page(&self) -> Option<String> {
+        self.inner.lock().unwrap().page.clone()
+    }
+}
+
+/// Everything a new window loads on start, in one reply
+#[derive(Debug, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct FrontendSnapshot {
+    pub settings: AppSettings,
+    pub favorites: Vec<Favorite>,
+    pub history: Vec<HistoryEntry>,
+    pub interfaces: Vec<NetworkInterface>,
+    pub pending_transfers: Vec<PendingTransfer>,
+    pub active_transfers: Vec<TransferProgress>,
+    pub server_port: Option<u16>,
+    pub page: Option<String>,
+}
@@ -1,33 +1,66 @@
 // SPDX-License-Identifier: AGPL-3.0
 // Gosh Transfer Tauri - Application State
 
-use crate::engine_bridge::EngineBridge;
-use gosh_transfer_core::{FileFavoritesStore, SettingsStore, TransferHistory};
+use crate::engine_bridge::{BridgeOptions, EngineBridge};
+use crate::snapshot::FrontendMirror;
+use gosh_transfer_core::{
+    FileFavoritesStore, InFlightJournal, KnownPeers, Outbox, PeerAliases, SettingsStore,
+    TransferHistory,
+};
 use std::sync::Arc;
 
 /// Global application state managed by Tauri
 pub struct AppState {
     pub bridge: EngineBridge,
     pub settings: SettingsStore,
-    pub favorites: FileFavoritesStore,
+    pub favorites: Arc<FileFavoritesStore>,
     pub history: Arc<TransferHistory>,
+    pub known_peers: Arc<KnownPeers>,
+    pub outbox: Arc<Outbox>,
+    /// Frontend state kept while the window is closed in tray mode
+    pub frontend: FrontendMirror,
 }
 
 impl AppState {
-    /// Create new application state with all stores initialized
-    pub fn new() -> Result<Self, gosh_transfer_core::AppError> {
+    /// Create new application state with all stores initialized.
+    /// `socket_activated` is set when systemd passed in the listening sockets.
+    pub fn new(socket_activated: bool) -> Result<Self, gosh_transfer_core::AppError> {
         let settings = SettingsStore::new()?;
-        let favorites = FileFavoritesStore::new()?;
-        let history = Arc::new(TransferHistory::new()?);
+        let favorites = Arc::new(FileFavoritesStore::new()?);
+        let aliases = Arc::new(PeerAliases::default());
+        let history = Arc::new(TransferHistory::with_aliases(aliases.clone())?);
+        let known_peers = Arc::new(KnownPeers::new()?);
+        let outbox = Arc::new(Outbox::new()?);
+        let journal = Arc::new(InFlightJournal::new()?);
 
-        let config = settings.get().to_engine_config();
-        let bridge = EngineBridge::new(config, Some(history.clone()));
+        let current = settings.get();
+        if !current.log_filter.is_empty() {
+            if let Err(e) = crate::logging::set_filter(&current.log_filter) {
+                tracing::warn!("Ignoring saved log filter: {}", e);
+            }
+        }
+        let config = current.to_engine_config();
+        let mut options = BridgeOptions::from_settings(&current);
+        options.socket_activated = socket_activated;
+        let bridge = EngineBridge::new(
+            config,
+            options,
+            Some(history.clone()),
+            aliases,
+            known_peers.clone(),
+            outbox.clone(),
+            journal,
+            favorites.clone(),
+        );
 
         Ok(Self {
             bridge,
             settings,
             favorites,
             history,
+            known_peers,
+            outbox,
+            frontend: FrontendMirror::default(),
         })
     }
 }
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - TLS relay transport
+//
+// Encrypted mode carries each engine connection over a TLS 1.3 connection
+// of its own to the peer's transfer port. Outbound, the engine connects to
+// a relay listener on the peer's loopback alias, which opens a TLS
+// connection to the peer for every connection it accepts; inbound, the
+// acceptors on the transfer port finish the handshake and splice the
+// plaintext into the engine from the peer's alias. TCP keeps segmentation
+// and acknowledgements in the kernel, so on one core this moves several
+// times what the QUIC relay does.
+//
+// Both ends present their device certificate. The server's is checked
+// against its pin during the handshake, the client's once the handshake
+// is done, by the address it came from. Sessions are resumed; early data
+// is never sent.
+
+use crate::acceptors::RELAY_BUFFER;
+use crate::identity::{
+    check_pin, crypto_provider, has_aes_hardware, local_identity, PeerCertificate,
+    PinnedCertificate,
+};
+use gosh_transfer_core::{KnownPeers, PeerAliases};
+use rustls::pki_types::ServerName;
+use rustls::server::ServerSessionMemoryCache;
+use std::collections::HashMap;
+use std::io;
+use std::net::{IpAddr, SocketAddr};
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::io::{AsyncRead, AsyncWrite};
+use tokio::net::{TcpListener, TcpStream};
+use tokio::sync::Mutex;
+use tokio::task::JoinHandle;
+use tokio_rustls::{client, server, TlsAcceptor, TlsConnector};
+
+/// ALPN protocol id of the relay
+const ALPN: &[u8] = b"gosh-transfer-tls/1";
+/// Resumable sessions kept per side; one per recently seen peer is plenty
+const SESSION_CACHE_SIZE: usize = 1024;
+/// How long a TCP connect and handshake may take
+const HANDSHAKE_TIMEOUT: Duration = Duration::from_secs(3);
+
+/// Listener relaying engine connections to one peer
+struct Relay {
+    local: SocketAddr,
+    task: JoinHandle<()>,
+}
+
+impl Drop for Relay {
+    /// Stop accepting; relayed connections run until they end
+    fn drop(&mut self) {
+        self.task.abort();
+    }
+}
+
+/// TLS configuration of this device and its relays to peers
+pub struct TlsTransport {
+    connector: TlsConnector,
+    acceptor: TlsAcceptor,
+    aliases: Arc<PeerAliases>,
+    known_peers: Arc<KnownPeers>,
+    relays: Mutex<HashMap<SocketAddr, Relay>>,
+}
+
+impl TlsTransport {
+    pub fn new(aliases: Arc<PeerAliases>, known_peers: Arc<KnownPeers>) -> Result<Self, String> {
+        let provider = Arc::new(crypto_provider());
+        let (cert, key) = local_identity()?;
+
+        let mut server = rustls::ServerConfig::builder_with_provider(provider.clone())
+            .with_protocol_versions(&[&rustls::version::TLS13])
+            .map_err(|e| e.to_string())?
+            .with_client_cert_verifier(Arc::new(PeerCertificate::new(provider.clone())))
+            .with_single_cert(vec![cert.clone()], key.clone_key())
+            .map_err(|e| e.to_string())?;
+        server.alpn_protocols = vec![ALPN.to_vec()];
+        // Without AES instructions, insist on our ChaCha20 preference
+        server.ignore_client_order = !has_aes_hardware();
+        server.session_storage = ServerSessionMemoryCache::new(SESSION_CACHE_SIZE);
+
+        let verifier = PinnedCertificate::new(provider.clone(), known_peers.clone());
+        let mut client = rustls::ClientConfig::builder_with_provider(provider)
+            .with_protocol_versions(&[&rustls::version::TLS13])
+            .map_err(|e| e.to_string())?
+            .dangerous()
+            .with_custom_certificate_verifier(Arc::new(verifier))
+            .with_client_auth_cert(vec![cert], key)
+            .map_err(|e| e.to_string())?;
+        client.alpn_protocols = vec![ALPN.to_vec()];
+        client.resumption = rustls::client::Resumption::in_memory_sessions(SESSION_CACHE_SIZE);
+
+        Ok(Self {
+            connector: TlsConnector::from(Arc::new(client)),
+            acceptor: TlsAcceptor::from(Arc::new(server)),
+            aliases,
+            known_peers,
+            relays: Mutex::new(HashMap::new()),
+        })
+    }
+
+    /// Find where the engine should send to reach a peer.
+    ///
+    /// Returns the local relay address, or `None` when the peer does not
+    /// complete a handshake.
+    pub async fn route(&self, address: &str, port: u16) -> Option<SocketAddr> {
+        let peer = tokio::net::lookup_host((address, port))
+            .await
+            .ok()?
+            .find(SocketAddr::is_ipv4)?;
+
+        let mut relays = self.relays.lock().await;
+        if let Some(relay) = relays.get(&peer) {
+            return Some(relay.local);
+        }
+
+        // One handshake up front, so a peer without TLS fails here rather
+        // than inside the engine
+        if let Err(e) = connect(&self.connector, peer).await {
+            tracing::info!("No TLS handshake with {}: {}", peer, e);
+            return None;
+        }
+
+        let alias = self.aliases.alias_for(peer.ip());
+        let listener = match TcpListener::bind(SocketAddr::new(alias.into(), 0)).await {
+            Ok(listener) => listener,
+            Err(e) => {
+                tracing::warn!("Failed to start TLS relay for {}: {}", peer, e);
+                return None;
+            }
+        };
+        let local = listener.local_addr().ok()?;
+        let connector = self.connector.clone();
+        let task = tokio::spawn(async move {
+            while let Ok((engine, _)) = listener.accept().await {
+                let connector = connector.clone();
+                tokio::spawn(async move {
+                    let result = async {
+                        engine.set_nodelay(true)?;
+                        relay(engine, connect(&connector, peer).await?).await
+                    }
+                    .await;
+                    if let Err(e) = result {
+                        tracing::debug!("Outbound TLS connection ended: {}", e);
+                    }
+                });
+            }
+        });
+
+        relays.insert(peer, Relay { local, task });
+        tracing::info!("Relaying transfers to {} over TLS", peer);
+        Some(local)
+    }
+
+    /// Finish a peer's handshake and check its certificate against the pin
+    pub async fn accept(
+        &self,
+        stream: TcpStream,
+        peer: IpAddr,
+    ) -> io::Result<server::TlsStream<TcpStream>> {
+        stream.set_nodelay(true)?;
+        let stream = tokio::time::timeout(HANDSHAKE_TIMEOUT, self.acceptor.accept(stream))
+            .await
+            .map_err(|_| io::Error::from(io::ErrorKind::TimedOut))??;
+
+        let pinned = stream
+            .get_ref()
+            .1
+            .peer_certificates()
+            .and_then(|certs| certs.first())
+            .is_some_and(|cert| check_pin(&self.known_peers, peer, cert));
+        if !pinned {
+            return Err(io::Error::new(
+                io::ErrorKind::PermissionDenied,
+                "identity refused",
+            ));
+        }
+        Ok(stream)
+    }
+}
+
+/// Open a TLS connection to a peer, named by its IP so pins and cached
+/// sessions are per peer
+async fn connect(
+    connector: &TlsConnector,
+    peer: SocketAddr,
+) -> io::Result<client::TlsStream<TcpStream>> {
+    let attempt = async {
+        let stream = TcpStream::connect(peer).await?;
+        stream.set_nodelay(true)?;
+        connector
+            .connect(ServerName::IpAddress(peer.ip().into()), stream)
+            .await
+    };
+    tokio::time::timeout(HANDSHAKE_TIMEOUT, attempt)
+        .await
+        .map_err(|_| io::Error::from(io::ErrorKind::TimedOut))?
+}
+
+/// Copy both ways between an engine connection and a peer's
+pub async fn relay<A, B>(mut a: A, mut b: B) -> io::Result<()>
+where
+    A: AsyncRead + AsyncWrite + Unpin,
+    B: AsyncRead + AsyncWrite + Unpin,
+{
+    tokio::io::copy_bidirectional_with_sizes(&mut a, &mut b, RELAY_BUFFER, RELAY_BUFFER).await?;
+    Ok(())
+}
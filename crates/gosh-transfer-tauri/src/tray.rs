@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: AGPL-3.0
+// Gosh Transfer Tauri - Tray icon and window lifecycle
+//
+// With `trayMode` set, closing the window destroys it together with its
+// webview and the web process behind it, while the engine and stores keep
+// running. The tray icon opens a new window from the app config, which
+// restores its state from the frontend snapshot.
+
+use tauri::menu::{Menu, MenuItem};
+use tauri::tray::{MouseButton, MouseButtonState, TrayIconBuilder, TrayIconEvent};
+use tauri::{AppHandle, Manager, WebviewWindowBuilder};
+
+/// Label of the single app window
+const MAIN_WINDOW: &str = "main";
+
+/// Add the tray icon with its menu
+pub fn install(app: &AppHandle) -> tauri::Result<()> {
+    let open = MenuItem::with_id(app, "open", "Open Gosh Transfer", true, None::<&str>)?;
+    let quit = MenuItem::with_id(app, "quit", "Quit", true, None::<&str>)?;
+    let menu = Menu::with_items(app, &[&open, &quit])?;
+
+    let mut tray = TrayIconBuilder::with_id(MAIN_WINDOW)
+        .tooltip("Gosh Transfer")
+        .menu(&menu)
+        .on_menu_event(|app, event| match event.id().as_ref() {
+            "open" => show_window(app),
+            "quit" => app.exit(0),
+            _ => {}
+        })
+        .on_tray_icon_event(|tray, event| {
+            if let TrayIconEvent::Click {
+                button: MouseButton::Left,
+                button_state: MouseButtonState::Up,
+                ..
+            } = event
+            {
+                show_window(tray.app_handle());
+            }
+        });
+    if let Some(icon) = app.default_window_icon() {
+        tray = tray.icon(icon.clone());
+    }
+    tray.build(app)?;
+    Ok(())
+}
+
+/// Bring the window forward, creating it again if it was closed
+pub fn show_window(app: &AppHandle) {
+    if let Some(window) = app.get_webview_window(MAIN_WINDOW) {
+        let _ = window.unminimize();
+        let _ = window.show();
+        let _ = window.set_focus();
+        return;
+    }
+    let Some(config) = app.config().app.windows.first() else {
+        tracing::error!("No window configured");
+        return;
+    };
+    match WebviewWindowBuilder::from_config(app, config).and_then(|builder| builder.build()) {
+        Ok(window) => {
+            let _ = window.set_focus();
+            tracing::info!("Window reopened from tray");
+        }
+        Err(e) => tracing::error!("Failed to open window: {}", e),
+    }
+}
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: AGPL-3.0
+# Gosh Transfer - Transport throughput under loss and delay
+#
+# Joins two network namespaces with a userspace link that drops packets at
+# random and delays them in order, then runs the bench roles of quic.rs
+# across it once per transport and setting. Every transport crosses the
+# same link, so plain TCP is measured under exactly the loss QUIC sees.
+# netem would do the same job but is missing from many kernels; this needs
+# only TUN and network namespaces. Run as root:
+#
+#   sudo scripts/loss-bench.py --loss 0,1,2,5 --delay 0,20
+#
+# TCP runs once per congestion control in --tcp-congestion, set on the
+# sending socket: cubic is what most distributions ship, and the engine's
+# connections use the system's default, as does the TLS relay's own
+# connection to the peer.
+#
+# The bench roles are built with `cargo test --release`; pass --binary to
+# use an already built test binary instead.
+
+import argparse
+import ctypes
+import fcntl
+import heapq
+import json
+import os
+import random
+import select
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+TUNSETIFF = 0x400454CA
+IFF_TUN = 0x0001
+IFF_NO_PI = 0x1000
+CLONE_NEWNET = 0x40000000
+SENDER = ("gosh-bench-a", "10.77.0.1")
+RECEIVER = ("gosh-bench-b", "10.77.0.2")
+PORT = 53340
+
+
+def open_tun(ns, name):
+    """Create a TUN device inside a namespace, keeping its descriptor here"""
+    libc = ctypes.CDLL(None, use_errno=True)
+    home = os.open("/proc/self/ns/net", os.O_RDONLY)
+    target = os.open("/run/netns/" + ns, os.O_RDONLY)
+    try:
+        # A device moved between namespaces drops its descriptor, so the
+        # device is created from inside the namespace instead
+        if libc.setns(target, CLONE_NEWNET) != 0:
+            raise OSError(ctypes.get_errno(), "setns " + ns)
+        fd = os.open("/dev/net/tun", os.O_RDWR)
+        fcntl.ioctl(fd, TUNSETIFF, struct.pack("16sH", name.encode(), IFF_TUN | IFF_NO_PI))
+    finally:
+        libc.setns(home, CLONE_NEWNET)
+        os.close(home)
+        os.close(target)
+    return fd
+
+
+def ip(*args):
+    subprocess.run(["ip", *args], check=True)
+
+
+class Link:
+    """Moves packets between two TUN devices, dropping and delaying them"""
+
+    def __init__(self):
+        self.loss = 0.0
+        self.delay = 0.0
+        self.fds = {}
+        for ns, address in (SENDER, RECEIVER):
+            ip("netns", "add", ns)
+            fd = open_tun(ns, "tun0")
+            ip("-n", ns, "addr", "add", address + "/24", "dev", "tun0")
+            ip("-n", ns, "link", "set", "tun0", "up")
+            ip("-n", ns, "link", "set", "lo", "up")
+            self.fds[ns] = fd
+        a, b = self.fds[SENDER[0]], self.fds[RECEIVER[0]]
+        self.peer = {a: b, b: a}
+        threading.Thread(target=self.run, daemon=True).start()
+
+    def run(self):
+        queue = []
+        seq = 0
+        while True:
+            timeout = max(0.0, queue[0][0] - time.monotonic()) if queue else None
+            readable, _, _ = select.select(list(self.peer), [], [], timeout)
+            now = time.monotonic()
+            for fd in readable:
+                packet = os.read(fd, 65536)
+                # Each direction drops independently
+                if random.random() < self.loss:
+                    continue
+                seq += 1
+                heapq.heappush(queue, (now + self.delay, seq, self.peer[fd], packet))
+            while queue and queue[0][0] <= now:
+                _, _, fd, packet = heapq.heappop(queue)
+                try:
+                    os.write(fd, packet)
+                except OSError:
+                    pass
+
+    def close(self):
+        for ns in self.fds:
+            subprocess.run(["ip", "netns", "del", ns])
+
+
+def test_binary():
+    out = subprocess.run(
+        ["cargo", "test", "-p", "gosh-transfer-tauri", "--release", "--no-run",
+         "--message-format=json"],
+        check=True, capture_output=True, text=True,
+    ).stdout
+    for line in out.splitlines():
+        message = json.loads(line)
+        if message.get("reason") == "compiler-artifact" and message.get("executable") \
+                and message["target"]["name"] == "gosh-transfer-linux":
+            return message["executable"]
+    sys.exit("test binary not found")
+
+
+def role(binary, ns, test, env):
+    # Each side keeps its own identity and pins
+    env = dict(os.environ, XDG_CONFIG_HOME=tempfile.mkdtemp(prefix="gosh-bench-"), **env)
+    return subprocess.Popen(
+        ["ip", "netns", "exec", ns, binary, "--ignored", "--exact", "--nocapture",
+         "quic::tests::" + test],
+        env=env, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True,
+    )
+
+
+def measure(binary, transport, algorithm, size, limit):
+    env = {"GOSH_BENCH_TRANSPORT": transport, "GOSH_BENCH_PORT": str(PORT),
+           "GOSH_BENCH_BYTES": str(size), "GOSH_BENCH_PEER": RECEIVER[1],
+           "GOSH_BENCH_TCP_CONGESTION": algorithm or ""}
+    receiver = role(binary, RECEIVER[0], "bench_receive", env)
+    # The test harness prints its own status ahead of the roles' lines
+    for line in receiver.stdout:
+        if "bench: ready" in line:
+            break
+    sender = role(binary, SENDER[0], "bench_send", env)
+    try:
+        out, _ = sender.communicate(timeout=limit)
+    except subprocess.TimeoutExpired:
+        sender.kill()
+        out = ""
+    receiver.kill()
+    receiver.wait()
+    for line in out.splitlines():
+        if "bench: sent" in line:
+            # bench: sent <bytes> in <seconds>
+            _, sent, _, seconds = line.split("bench: ")[1].split()
+            return int(sent) / float(seconds) / (1 << 20)
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--loss", default="0,1,2,5", help="percent lost each way")
+    parser.add_argument("--delay", default="0,20", help="one-way delay in ms")
+    parser.add_argument("--transports", default="tcp,tls,quic")
+    parser.add_argument("--tcp-congestion", default="cubic,bbr")
+    parser.add_argument("--bytes", type=int, default=64 << 20)
+    parser.add_argument("--limit", type=float, default=120, help="seconds per run")
+    parser.add_argument("--binary")
+    args = parser.parse_args()
+
+    binary = args.binary or test_binary()
+    link = Link()
+    try:
+        print("| Transport | Loss each way | One-way delay | Throughput |")
+        print("|-----------|---------------|---------------|------------|")
+        for delay in args.delay.split(","):
+            for loss in args.loss.split(","):
+                link.loss = float(loss) / 100
+                link.delay = float(delay) / 1000
+                for transport in args.transports.split(","):
+                    variants = args.tcp_congestion.split(",") if transport == "tcp" else [None]
+                    for algorithm in variants:
+                        name = "%s (%s)" % (transport, algorithm) if algorithm else transport
+                        rate = measure(binary, transport, algorithm, args.bytes, args.limit)
+                        shown = "timed out" if rate is None else "%.2f MiB/s" % rate
+                        print("| %s | %s%% | %s ms | %s |" % (name, loss, delay, shown), flush=True)
+    finally:
+        link.close()
+
+
+if __name__ == "__main__":
+    main()
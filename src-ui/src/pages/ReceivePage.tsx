@@ -1,4 +1,4 @@
-import { useEffect } from 'react';
+import { useEffect, useState } from 'react';
 import {
   Wifi,
   Network,
@@ -8,6 +8,10 @@ import {
   Check,
   X,
   Loader2,
+  ListFilter,
+  Timer,
+  Download,
+  RotateCcw,
 } from 'lucide-react';
 import { useAppStore } from '../store';
 import {
@@ -44,6 +48,9 @@ function formatSpeed(bps: number): string {
   return `${formatBytes(bps)}/s`;
 }
 
+/// Minutes a one-click approval session lasts
+const SESSION_MINUTES = 15;
+
 export function ReceivePage() {
   const {
     settings,
@@ -53,11 +60,50 @@ export function ReceivePage() {
     loadInterfaces,
     acceptTransfer,
     rejectTransfer,
+    acceptTransferSelection,
     acceptAll,
     rejectAll,
     cancelTransfer,
+    approvalSessions,
+    loadApprovalSessions,
+    startApprovalSession,
+    revokeApprovalSession,
+    pulls,
+    loadPulls,
+    retryPull,
   } = useAppStore();
 
+  const [selectingId, setSelectingId] = useState<string | null>(null);
+  const [selectionPatterns, setSelectionPatterns] = useState('');
+
+  const handleAcceptSelection = async (id: string) => {
+    const patterns = selectionPatterns
+      .split(',')
+      .map((p) => p.trim())
+      .filter(Boolean);
+    if (!patterns.length) return;
+    await acceptTransferSelection(id, patterns);
+    setSelectingId(null);
+    setSelectionPatterns('');
+  };
+
+  const handleAcceptForSession = async (id: string, peerAddress: string) => {
+    await startApprovalSession(peerAddress, SESSION_MINUTES, null);
+    await acceptTransfer(id);
+  };
+
+  useEffect(() => {
+    loadApprovalSessions();
+    const interval = setInterval(loadApprovalSessions, 30000);
+    return () => clearInterval(interval);
+  }, [loadApprovalSessions]);
+
+  useEffect(() => {
+    loadPulls();
+    const interval = setInterval(loadPulls, 2000);
+    return () => clearInterval(interval);
+  }, [loadPulls]);
+
   useEffect(() => {
     loadInterfaces();
     const interval = setInterval(loadInterfaces, 5000);
@@ -157,6 +203,22 @@ export function ReceivePage() {
                     </p>
                   </div>
                   <div className="flex gap-2">
+                    <button
+                      onClick={() =>
+                        setSelectingId(selectingId === transfer.id ? null : transfer.id)
+                      }
+                      title="Choose files to receive"
+                      className="p-2 rounded-lg bg-gray-100 text-gray-700 hover:bg-gray-200 dark:bg-gray-600 dark:text-gray-300"
+                    >
+                      <ListFilter className="w-5 h-5" />
+                    </button>
+                    <button
+                      onClick={() => handleAcceptForSession(transfer.id, transfer.peer_address)}
+                      title={`Accept, and accept from this peer for ${SESSION_MINUTES} minutes`}
+                      className="p-2 rounded-lg bg-green-100 text-green-700 hover:bg-green-200 dark:bg-green-900/30 dark:text-green-400"
+                    >
+                      <Timer className="w-5 h-5" />
+                    </button>
                     <button
                       onClick={() => acceptTransfer(transfer.id)}
                       className="p-2 rounded-lg bg-green-100 text-green-700 hover:bg-green-200 dark:bg-green-900/30 dark:text-green-400"
@@ -172,6 +234,31 @@ export function ReceivePage() {
                   </div>
                 </div>
 
+                {selectingId === transfer.id && (
+                  <div className="mb-3">
+                    <div className="flex gap-2">
+                      <input
+                        type="text"
+                        value={selectionPatterns}
+                        onChange={(e) => setSelectionPatterns(e.target.value)}
+                        placeholder="Files or patterns, e.g. photos/, *.pdf"
+                        className="input flex-1"
+                        autoFocus
+                      />
+                      <button
+                        onClick={() => handleAcceptSelection(transfer.id)}
+                        className="btn btn-primary text-sm"
+                      >
+                        Accept Selected
+                      </button>
+                    </div>
+                    <p className="text-xs text-gray-500 mt-1">
+                      The sender still transfers every file and all of them are kept.
+                      Files outside the selection are only marked as skipped in history.
+                    </p>
+                  </div>
+                )}
+
                 <div className="text-sm text-gray-600 dark:text-gray-300">
                   {transfer.files.slice(0, 3).map((file, i) => (
                     <div key={i} className="truncate">
@@ -190,6 +277,44 @@ export function ReceivePage() {
         )}
       </div>
 
+      {/* Approval Sessions */}
+      {approvalSessions.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4">
+            Auto-Accepting
+          </h2>
+
+          <div className="space-y-2">
+            {approvalSessions.map((session) => (
+              <div
+                key={session.peerAddress}
+                className="flex items-center justify-between p-3 rounded-lg bg-gray-50 dark:bg-gray-700/50"
+              >
+                <div>
+                  <p className="font-medium text-gray-900 dark:text-white">
+                    {session.peerAddress}
+                  </p>
+                  <p className="text-sm text-gray-500 dark:text-gray-400">
+                    {session.expiresAt &&
+                      `Until ${new Date(session.expiresAt).toLocaleTimeString()}`}
+                    {session.expiresAt && session.remainingTransfers !== null && ' or '}
+                    {session.remainingTransfers !== null &&
+                      `${session.remainingTransfers} more transfer${session.remainingTransfers !== 1 ? 's' : ''}`}
+                    {' '}- {session.acceptedTransfers} accepted
+                  </p>
+                </div>
+                <button
+                  onClick={() => revokeApprovalSession(session.peerAddress)}
+                  className="btn btn-secondary text-sm"
+                >
+                  Revoke
+                </button>
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
+
       {/* Active Transfers */}
       {activeTransfers.size > 0 && (
         <div className="card p-4">
@@ -245,6 +370,44 @@ export function ReceivePage() {
           </div>
         </div>
       )}
+
+      {/* Pulls */}
+      {pulls.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4 flex items-center gap-2">
+            <Download className="w-5 h-5" />
+            Pulls
+          </h2>
+          <div className="space-y-2">
+            {pulls.map((pull) => (
+              <div
+                key={pull.offerId}
+                className="flex items-center justify-between p-3 rounded-lg bg-gray-50 dark:bg-gray-700/50 text-sm"
+              >
+                <div className="min-w-0">
+                  <p className="font-medium text-gray-900 dark:text-white truncate">
+                    {pull.files.join(', ')}
+                  </p>
+                  <p className="text-gray-500 dark:text-gray-400">
+                    {pull.peerAddress} · {formatBytes(pull.receivedBytes)} /{' '}
+                    {formatBytes(pull.totalBytes)} · {pull.state}
+                    {pull.error && ` · ${pull.error}`}
+                  </p>
+                </div>
+                {pull.state === 'failed' && (
+                  <button
+                    onClick={() => retryPull(pull.offerId)}
+                    className="btn btn-secondary text-sm flex items-center gap-1 ml-2"
+                  >
+                    <RotateCcw className="w-4 h-4" />
+                    Retry
+                  </button>
+                )}
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
     </div>
   );
 }
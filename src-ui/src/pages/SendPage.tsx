@@ -10,9 +10,19 @@ import {
   Check,
   X,
   Loader2,
+  Link2,
+  Radio,
+  Clock,
 } from 'lucide-react';
 import { useAppStore } from '../store';
-import type { Favorite } from '../types';
+import type { Favorite, FavoriteRoutes, TransferFilter } from '../types';
+
+function parsePatterns(value: string): string[] {
+  return value
+    .split(',')
+    .map((p) => p.trim())
+    .filter(Boolean);
+}
 
 export function SendPage() {
   const {
@@ -20,11 +30,28 @@ export function SendPage() {
     favorites,
     sendFiles,
     sendDirectory,
+    sendChain,
+    sendMulticast,
+    sendOffer,
+    loadChains,
+    chains,
+    loadOutbox,
+    cancelQueuedSend,
+    outbox,
+    loadSends,
+    cancelSend,
+    sends,
     resolveAddress,
     checkPeer,
     addFavorite,
     deleteFavorite,
     touchFavorite,
+    getFavoriteFilter,
+    setFavoriteFilter,
+    getFavoriteRoutes,
+    setFavoriteAddresses,
+    launchRequest,
+    clearLaunchRequest,
   } = useAppStore();
 
   const [destination, setDestination] = useState('');
@@ -36,6 +63,29 @@ export function SendPage() {
   const [sending, setSending] = useState(false);
   const [showAddFavorite, setShowAddFavorite] = useState(false);
   const [newFavoriteName, setNewFavoriteName] = useState('');
+  const [selectedFavoriteId, setSelectedFavoriteId] = useState<string | null>(null);
+  // Other addresses of the selected favorite, raced at send time
+  const [otherAddresses, setOtherAddresses] = useState('');
+  const [routes, setRoutes] = useState<FavoriteRoutes | null>(null);
+  const [excludePatterns, setExcludePatterns] = useState('');
+  const [includePatterns, setIncludePatterns] = useState('');
+  const [respectGitignore, setRespectGitignore] = useState(false);
+  // Publish the files for the receiver to fetch at its own pace
+  const [pullMode, setPullMode] = useState(false);
+  // Sending to several favorites at once: through a chain or by multicast
+  const [groupMode, setGroupMode] = useState<'chain' | 'multicast' | null>(null);
+  const [groupIds, setGroupIds] = useState<string[]>([]);
+
+  const currentFilter = (): TransferFilter | null => {
+    const filter: TransferFilter = {
+      include: parsePatterns(includePatterns),
+      exclude: parsePatterns(excludePatterns),
+      respectGitignore,
+    };
+    const empty =
+      !filter.include.length && !filter.exclude.length && !filter.respectGitignore;
+    return empty ? null : filter;
+  };
 
   // Resolve address when destination changes
   useEffect(() => {
@@ -93,17 +143,69 @@ export function SendPage() {
     setSelectedPaths((prev) => prev.filter((_, i) => i !== index));
   };
 
+  // Paths and favorite handed over by another launch
+  useEffect(() => {
+    if (!launchRequest) return;
+    clearLaunchRequest();
+    setSelectedPaths((prev) => [...prev, ...launchRequest.paths]);
+    const favorite = favorites.find(
+      (f) => f.id === launchRequest.favorite || f.name === launchRequest.favorite
+    );
+    if (favorite) {
+      handleSelectFavorite(favorite);
+    }
+  }, [launchRequest]);
+
+  useEffect(() => {
+    loadChains();
+    const timer = setInterval(loadChains, 2000);
+    return () => clearInterval(timer);
+  }, [loadChains]);
+
+  useEffect(() => {
+    loadOutbox();
+    const timer = setInterval(loadOutbox, 5000);
+    return () => clearInterval(timer);
+  }, [loadOutbox]);
+
+  useEffect(() => {
+    loadSends();
+    const timer = setInterval(loadSends, 1000);
+    return () => clearInterval(timer);
+  }, [loadSends]);
+
+  const handleSendGroup = async () => {
+    if (!groupIds.length || !selectedPaths.length) return;
+
+    setSending(true);
+    try {
+      if (groupMode === 'chain') {
+        await sendChain(groupIds, port, selectedPaths);
+      } else {
+        for (const path of selectedPaths) {
+          await sendMulticast(groupIds, port, path);
+        }
+      }
+      setSelectedPaths([]);
+    } finally {
+      setSending(false);
+    }
+  };
+
   const handleSend = async () => {
+    if (groupMode) return handleSendGroup();
     if (!resolvedIp || !selectedPaths.length) return;
 
     setSending(true);
     try {
-      // Check if it's a single directory
-      if (selectedPaths.length === 1) {
+      if (pullMode) {
+        await sendOffer(resolvedIp, port, selectedPaths);
+      } else if (selectedPaths.length === 1) {
+        // Check if it's a single directory
         const path = selectedPaths[0];
         // Simple heuristic: if path doesn't have extension, treat as directory
         // In production, you'd want to check this properly
-        await sendDirectory(resolvedIp, port, path);
+        await sendDirectory(resolvedIp, port, path, currentFilter());
       } else {
         await sendFiles(resolvedIp, port, selectedPaths);
       }
@@ -129,10 +231,44 @@ export function SendPage() {
     setShowAddFavorite(false);
   };
 
-  const handleSelectFavorite = (favorite: Favorite) => {
+  const handleSelectFavorite = async (favorite: Favorite) => {
+    if (groupMode) {
+      setGroupIds((prev) =>
+        prev.includes(favorite.id)
+          ? prev.filter((id) => id !== favorite.id)
+          : [...prev, favorite.id]
+      );
+      return;
+    }
     setDestination(favorite.address);
+    setSelectedFavoriteId(favorite.id);
+    const filter = await getFavoriteFilter(favorite.id);
+    setIncludePatterns(filter?.include.join(', ') ?? '');
+    setExcludePatterns(filter?.exclude.join(', ') ?? '');
+    setRespectGitignore(filter?.respectGitignore ?? false);
+    const favoriteRoutes = await getFavoriteRoutes(favorite.id);
+    setRoutes(favoriteRoutes);
+    setOtherAddresses(favoriteRoutes.addresses.join(', '));
+  };
+
+  const handleSaveFilter = async () => {
+    if (!selectedFavoriteId) return;
+    await setFavoriteFilter(selectedFavoriteId, currentFilter());
+  };
+
+  const handleSaveAddresses = async () => {
+    if (!selectedFavoriteId) return;
+    const addresses = otherAddresses
+      .split(',')
+      .map((a) => a.trim())
+      .filter((a) => a.length > 0);
+    await setFavoriteAddresses(selectedFavoriteId, addresses);
+    setRoutes(await getFavoriteRoutes(selectedFavoriteId));
   };
 
+  const lastWinner = routes?.lastWinner;
+  const lastRtt = lastWinner ? routes?.stats?.[lastWinner]?.rttMs : null;
+
   if (settings?.receiveOnly) {
     return (
       <div className="p-6">
@@ -201,16 +337,57 @@ export function SendPage() {
             <Star className="w-5 h-5" />
             Favorites
           </h2>
-          <button
-            onClick={() => setShowAddFavorite(true)}
-            className="btn btn-secondary text-sm flex items-center gap-1"
-            disabled={!destination.trim()}
-          >
-            <Plus className="w-4 h-4" />
-            Add
-          </button>
+          <div className="flex gap-2">
+            <button
+              onClick={() => {
+                setGroupMode(groupMode === 'chain' ? null : 'chain');
+                setGroupIds([]);
+              }}
+              className={`btn text-sm flex items-center gap-1 ${
+                groupMode === 'chain' ? 'btn-primary' : 'btn-secondary'
+              }`}
+              title="Send through favorites in order; each one forwards to the next"
+            >
+              <Link2 className="w-4 h-4" />
+              Chain
+            </button>
+            <button
+              onClick={() => {
+                setGroupMode(groupMode === 'multicast' ? null : 'multicast');
+                setGroupIds([]);
+              }}
+              className={`btn text-sm flex items-center gap-1 ${
+                groupMode === 'multicast' ? 'btn-primary' : 'btn-secondary'
+              }`}
+              title="Send each file once to all picked favorites on this subnet"
+            >
+              <Radio className="w-4 h-4" />
+              Multicast
+            </button>
+            <button
+              onClick={() => setShowAddFavorite(true)}
+              className="btn btn-secondary text-sm flex items-center gap-1"
+              disabled={!destination.trim()}
+            >
+              <Plus className="w-4 h-4" />
+              Add
+            </button>
+          </div>
         </div>
 
+        {groupMode === 'chain' && (
+          <p className="text-sm text-gray-500 dark:text-gray-400 mb-4">
+            Pick receivers in order. Each forwards files to the next, and must list the
+            previous one as a trusted host. Folders are not supported in a chain.
+          </p>
+        )}
+        {groupMode === 'multicast' && (
+          <p className="text-sm text-gray-500 dark:text-gray-400 mb-4">
+            Pick receivers on this subnet. Each must have multicast enabled in Settings.
+            Files are sent one at a time; folders are not supported.
+          </p>
+        )}
+
         {showAddFavorite && (
           <div className="flex gap-2 mb-4">
             <input
@@ -250,6 +427,11 @@ export function SendPage() {
               >
                 <div>
                   <p className="font-medium text-gray-900 dark:text-white">
+                    {groupMode && groupIds.includes(favorite.id) && (
+                      <span className="text-primary-600 dark:text-primary-400 mr-2">
+                        {groupIds.indexOf(favorite.id) + 1}.
+                      </span>
+                    )}
                     {favorite.name}
                   </p>
                   <p className="text-sm text-gray-500 dark:text-gray-400">
@@ -269,6 +451,29 @@ export function SendPage() {
             ))}
           </div>
         )}
+
+        {selectedFavoriteId && !groupMode && (
+          <div className="mt-4 space-y-2">
+            <div className="flex gap-3">
+              <input
+                type="text"
+                value={otherAddresses}
+                onChange={(e) => setOtherAddresses(e.target.value)}
+                placeholder="Also reachable at, e.g. 100.64.0.7, desk.tailnet.ts.net"
+                className="input flex-1"
+              />
+              <button onClick={handleSaveAddresses} className="btn btn-secondary text-sm">
+                Save Addresses
+              </button>
+            </div>
+            {lastWinner && (
+              <p className="text-xs text-gray-500 dark:text-gray-400">
+                Last reached at {lastWinner}
+                {lastRtt != null && ` (${lastRtt} ms to connect)`}
+              </p>
+            )}
+          </div>
+        )}
       </div>
 
       {/* Files */}
@@ -282,12 +487,61 @@ export function SendPage() {
             <File className="w-4 h-4" />
             Select Files
           </button>
-          <button onClick={handleSelectFolder} className="btn btn-secondary flex items-center gap-2">
+          <button
+            onClick={handleSelectFolder}
+            disabled={groupMode === 'chain'}
+            className="btn btn-secondary flex items-center gap-2"
+          >
             <FolderOpen className="w-4 h-4" />
             Select Folder
           </button>
         </div>
 
+        <div className="space-y-2 mb-4">
+          <input
+            type="text"
+            value={excludePatterns}
+            onChange={(e) => setExcludePatterns(e.target.value)}
+            placeholder="Exclude from folders, e.g. .git/, node_modules/, *.swp"
+            className="input"
+          />
+          <input
+            type="text"
+            value={includePatterns}
+            onChange={(e) => setIncludePatterns(e.target.value)}
+            placeholder="Only include (optional), e.g. *.rs, docs/"
+            className="input"
+          />
+          <div className="flex items-center justify-between">
+            <label className="flex items-center gap-2 text-sm text-gray-700 dark:text-gray-300">
+              <input
+                type="checkbox"
+                checked={respectGitignore}
+                onChange={(e) => setRespectGitignore(e.target.checked)}
+              />
+              Honour .gitignore
+            </label>
+            {!groupMode && (
+              <label
+                className="flex items-center gap-2 text-sm text-gray-700 dark:text-gray-300"
+                title="The receiver downloads the files in parallel ranges and retries failed ones. Files only; not encrypted."
+              >
+                <input
+                  type="checkbox"
+                  checked={pullMode}
+                  onChange={(e) => setPullMode(e.target.checked)}
+                />
+                Let the receiver pull
+              </label>
+            )}
+            {selectedFavoriteId && (
+              <button onClick={handleSaveFilter} className="btn btn-secondary text-sm">
+                Save Filter to Favorite
+              </button>
+            )}
+          </div>
+        </div>
+
         {selectedPaths.length > 0 ? (
           <div className="space-y-2">
             {selectedPaths.map((path, index) => (
@@ -317,7 +571,9 @@ export function SendPage() {
       {/* Send Button */}
       <button
         onClick={handleSend}
-        disabled={!peerReachable || !selectedPaths.length || sending}
+        disabled={
+          (groupMode ? !groupIds.length : !peerReachable) || !selectedPaths.length || sending
+        }
         className="btn btn-primary w-full flex items-center justify-center gap-2 py-3"
       >
         {sending ? (
@@ -328,10 +584,111 @@ export function SendPage() {
         ) : (
           <>
             <Send className="w-5 h-5" />
-            Send Files
+            {groupMode === 'chain' && `Send Through ${groupIds.length} Receiver(s)`}
+            {groupMode === 'multicast' && `Multicast to ${groupIds.length} Receiver(s)`}
+            {!groupMode && 'Send Files'}
           </>
         )}
       </button>
+
+      {/* Sends still walking, staging or sending */}
+      {sends.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4 flex items-center gap-2">
+            <Loader2 className="w-5 h-5 animate-spin" />
+            In Progress
+          </h2>
+          <div className="space-y-2">
+            {sends.map((send) => (
+              <div
+                key={send.id}
+                className="flex items-center justify-between p-3 rounded-lg bg-gray-50 dark:bg-gray-700/50 text-sm"
+              >
+                <p className="text-gray-900 dark:text-white">
+                  To {send.address} ·{' '}
+                  {send.stage === 'queued'
+                    ? 'waiting for another send'
+                    : send.stage === 'preparing'
+                      ? 'preparing files'
+                      : 'sending'}
+                </p>
+                <button
+                  onClick={() => cancelSend(send.id)}
+                  className="p-1 text-gray-400 hover:text-red-500 transition-colors ml-2"
+                  title="Cancel this send"
+                >
+                  <X className="w-4 h-4" />
+                </button>
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
+
+      {/* Sends queued for unreachable peers */}
+      {outbox.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4 flex items-center gap-2">
+            <Clock className="w-5 h-5" />
+            Waiting for Peers
+          </h2>
+          <div className="space-y-2">
+            {outbox.map((entry) => (
+              <div
+                key={entry.id}
+                className="flex items-center justify-between p-3 rounded-lg bg-gray-50 dark:bg-gray-700/50 text-sm"
+              >
+                <div className="min-w-0">
+                  <p className="font-medium text-gray-900 dark:text-white truncate">
+                    {entry.sources.join(', ')}
+                  </p>
+                  <p className="text-gray-500 dark:text-gray-400">
+                    To {entry.address} · next try{' '}
+                    {new Date(entry.nextProbeAt).toLocaleTimeString()}
+                    {entry.lastError && ` · ${entry.lastError}`}
+                  </p>
+                </div>
+                <button
+                  onClick={() => cancelQueuedSend(entry.id)}
+                  className="p-1 text-gray-400 hover:text-red-500 transition-colors ml-2"
+                  title="Cancel this send"
+                >
+                  <X className="w-4 h-4" />
+                </button>
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
+
+      {/* Chains */}
+      {chains.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4 flex items-center gap-2">
+            <Link2 className="w-5 h-5" />
+            Chains
+          </h2>
+          <div className="space-y-2">
+            {chains.map((chain) => (
+              <div
+                key={chain.chainId}
+                className="p-3 rounded-lg bg-gray-50 dark:bg-gray-700/50 text-sm"
+              >
+                <p className="font-medium text-gray-900 dark:text-white">
+                  {chain.hop === 0 ? 'Sent' : `Hop ${chain.hop}`} · {chain.chainId}
+                </p>
+                <p className="text-gray-500 dark:text-gray-400">
+                  {chain.hop > 0 && `${chain.receivedFiles}/${chain.totalFiles} received · `}
+                  {chain.nextHop
+                    ? `${chain.forwardedFiles}/${chain.totalFiles} to ${chain.nextHop}`
+                    : 'last hop'}
+                  {chain.failedFiles > 0 && ` · ${chain.failedFiles} failed`}
+                </p>
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
     </div>
   );
 }
@@ -1,14 +1,17 @@
 import { useState, useEffect } from 'react';
+import { invoke } from '@tauri-apps/api/core';
 import { open } from '@tauri-apps/plugin-dialog';
 import { FolderOpen, Save, Plus, X, Loader2 } from 'lucide-react';
 import { useAppStore } from '../store';
-import type { AppSettings } from '../types';
+import type { AppSettings, KnownPeer, TransportCapabilities } from '../types';
 
 export function SettingsPage() {
   const { settings, saveSettings } = useAppStore();
   const [localSettings, setLocalSettings] = useState<AppSettings | null>(null);
   const [saving, setSaving] = useState(false);
   const [newTrustedHost, setNewTrustedHost] = useState('');
+  const [knownPeers, setKnownPeers] = useState<KnownPeer[]>([]);
+  const [capabilities, setCapabilities] = useState<TransportCapabilities | null>(null);
 
   useEffect(() => {
     if (settings) {
@@ -16,6 +19,11 @@ export function SettingsPage() {
     }
   }, [settings]);
 
+  useEffect(() => {
+    invoke<KnownPeer[]>('list_known_peers').then(setKnownPeers);
+    invoke<TransportCapabilities>('get_transport_capabilities').then(setCapabilities);
+  }, []);
+
   if (!localSettings) {
     return (
       <div className="p-6 flex items-center justify-center">
@@ -59,6 +67,11 @@ export function SettingsPage() {
     });
   };
 
+  const handleForgetPeer = async (address: string) => {
+    await invoke('forget_known_peer', { address });
+    setKnownPeers(knownPeers.filter((p) => p.address !== address));
+  };
+
   const hasChanges = JSON.stringify(settings) !== JSON.stringify(localSettings);
 
   return (
@@ -85,7 +98,7 @@ export function SettingsPage() {
               max={65535}
             />
             <p className="text-xs text-gray-500 mt-1">
-              Changing the port requires a restart.
+              Transfers already running finish on the old port.
             </p>
           </div>
 
@@ -152,6 +165,63 @@ export function SettingsPage() {
             />
           </div>
 
+          <div className="flex items-center justify-between">
+            <div>
+              <label className="text-sm font-medium text-gray-700 dark:text-gray-300">
+                Join Multicast Sessions
+              </label>
+              <p className="text-xs text-gray-500">
+                Receive files multicast to this subnet by an accepted sender (unencrypted)
+              </p>
+            </div>
+            <input
+              type="checkbox"
+              checked={localSettings.multicastEnabled}
+              onChange={(e) =>
+                setLocalSettings({ ...localSettings, multicastEnabled: e.target.checked })
+              }
+              className="w-5 h-5 rounded border-gray-300 text-primary-600 focus:ring-primary-500"
+            />
+          </div>
+
+          <div>
+            <label className="block text-sm font-medium text-gray-700 dark:text-gray-300 mb-2">
+              Transport
+            </label>
+            <div className="flex gap-2">
+              {(['http', 'quic', 'encrypted'] as const).map((transport) => (
+                <button
+                  key={transport}
+                  onClick={() => setLocalSettings({ ...localSettings, transport })}
+                  className={`px-4 py-2 rounded-lg text-sm font-medium transition-colors ${
+                    localSettings.transport === transport
+                      ? 'bg-primary-100 text-primary-700 dark:bg-primary-900/30 dark:text-primary-400'
+                      : 'bg-gray-100 text-gray-600 hover:bg-gray-200 dark:bg-gray-700 dark:text-gray-300 dark:hover:bg-gray-600'
+                  }`}
+                >
+                  {transport === 'encrypted' ? 'Encrypted only' : transport.toUpperCase()}
+                </button>
+              ))}
+            </div>
+            <p className="text-xs text-gray-500 mt-1">
+              QUIC is encrypted and copes better with lossy Wi-Fi and VPN links. Peers
+              without QUIC are reached over HTTP automatically. Encrypted only sends and
+              receives over TLS and refuses unencrypted transfers in both directions.
+            </p>
+            {capabilities && localSettings.transport !== 'http' && (
+              <p className="text-xs text-gray-400 mt-1">
+                {capabilities.cipher}
+                {capabilities.aesHardware ? ' (hardware AES)' : ''}
+                {localSettings.transport === 'quic' &&
+                  ` · UDP offload: ${
+                    capabilities.sendSegments > 1 || capabilities.receiveSegments > 1
+                      ? `${capabilities.sendSegments} send / ${capabilities.receiveSegments} receive segments`
+                      : 'unavailable'
+                  }`}
+              </p>
+            )}
+          </div>
+
           <div>
             <label className="block text-sm font-medium text-gray-700 dark:text-gray-300 mb-1">
               Max Retries
@@ -186,6 +256,29 @@ export function SettingsPage() {
               placeholder="Unlimited"
             />
           </div>
+
+          <div>
+            <label className="block text-sm font-medium text-gray-700 dark:text-gray-300 mb-1">
+              Skip Queue Below (KB)
+            </label>
+            <input
+              type="number"
+              value={Math.round(localSettings.skipQueueMaxBytes / 1024)}
+              onChange={(e) =>
+                setLocalSettings({
+                  ...localSettings,
+                  skipQueueMaxBytes: Number(e.target.value) * 1024,
+                })
+              }
+              className="input w-32"
+              min={0}
+            />
+            <p className="text-xs text-gray-500 mt-1">
+              Files up to this size skip the queue and start at once instead of waiting
+              for a larger send to finish. They are sent no faster. Set to 0 to queue
+              every send.
+            </p>
+          </div>
         </div>
       </div>
 
@@ -234,6 +327,41 @@ export function SettingsPage() {
         )}
       </div>
 
+      {/* Known Peers */}
+      {knownPeers.length > 0 && (
+        <div className="card p-4">
+          <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4">
+            Known Peer Identities
+          </h2>
+          <p className="text-sm text-gray-500 dark:text-gray-400 mb-4">
+            Encrypted connections are refused if a peer&apos;s identity changes. Forget a
+            peer after reinstalling it.
+          </p>
+
+          <div className="space-y-2">
+            {knownPeers.map((peer) => (
+              <div
+                key={peer.address}
+                className="flex items-center justify-between p-2 rounded-lg bg-gray-50 dark:bg-gray-700/50"
+              >
+                <div className="min-w-0">
+                  <span className="text-sm text-gray-700 dark:text-gray-300">{peer.address}</span>
+                  <p className="text-xs text-gray-400 font-mono truncate">
+                    {peer.fingerprint.slice(0, 32)}
+                  </p>
+                </div>
+                <button
+                  onClick={() => handleForgetPeer(peer.address)}
+                  className="p-1 text-gray-400 hover:text-red-500 transition-colors"
+                >
+                  <X className="w-4 h-4" />
+                </button>
+              </div>
+            ))}
+          </div>
+        </div>
+      )}
+
       {/* Interface Filters */}
       <div className="card p-4">
         <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4">
@@ -316,6 +444,48 @@ export function SettingsPage() {
               className="w-5 h-5 rounded border-gray-300 text-primary-600 focus:ring-primary-500"
             />
           </div>
+
+          <div className="flex items-center justify-between">
+            <div>
+              <label className="text-sm font-medium text-gray-700 dark:text-gray-300">
+                Keep Running in Tray
+              </label>
+              <p className="text-xs text-gray-500">
+                Closing the window keeps receiving and frees the window's memory
+              </p>
+            </div>
+            <input
+              type="checkbox"
+              checked={localSettings.trayMode}
+              onChange={(e) =>
+                setLocalSettings({ ...localSettings, trayMode: e.target.checked })
+              }
+              className="w-5 h-5 rounded border-gray-300 text-primary-600 focus:ring-primary-500"
+            />
+          </div>
+        </div>
+      </div>
+
+      {/* Diagnostics */}
+      <div className="card p-4">
+        <h2 className="text-lg font-semibold text-gray-900 dark:text-white mb-4">
+          Diagnostics
+        </h2>
+
+        <div>
+          <label className="block text-sm font-medium text-gray-700 dark:text-gray-300 mb-1">
+            Log Levels
+          </label>
+          <input
+            type="text"
+            value={localSettings.logFilter}
+            onChange={(e) => setLocalSettings({ ...localSettings, logFilter: e.target.value })}
+            placeholder="gosh_transfer_tauri::acceptors=debug"
+            className="input w-full font-mono text-sm"
+          />
+          <p className="text-xs text-gray-500 mt-1">
+            Comma-separated module levels on top of the defaults. Applies immediately.
+          </p>
         </div>
       </div>
 
@@ -101,6 +101,9 @@ export function TransfersPage() {
                         {formatDate(record.timestamp)} -{' '}
                         {record.files.length} file{record.files.length !== 1 ? 's' : ''} -{' '}
                         {formatBytes(totalSize)}
+                        {record.skipped_files?.length
+                          ? ` - ${record.skipped_files.length} skipped`
+                          : ''}
                       </p>
 
                       {record.error && (
@@ -5,9 +5,20 @@ import type {
   AppSettings,
   NetworkInterface,
   Favorite,
+  FavoriteRoutes,
   PendingTransfer,
   TransferProgress,
   TransferRecord,
+  TransferActionResult,
+  TransferFilter,
+  SelectionSummary,
+  ApprovalSession,
+  ChainStatus,
+  PullStatus,
+  OutboxEntry,
+  SendInfo,
+  FrontendSnapshot,
+  LaunchRequest,
   EngineEvent,
 } from '../types';
 
@@ -23,6 +34,11 @@ interface AppState {
   pendingTransfers: PendingTransfer[];
   activeTransfers: Map<string, TransferProgress>;
   transferHistory: TransferRecord[];
+  approvalSessions: ApprovalSession[];
+  chains: ChainStatus[];
+  pulls: PullStatus[];
+  outbox: OutboxEntry[];
+  sends: SendInfo[];
 
   // Favorites
   favorites: Favorite[];
@@ -32,6 +48,8 @@ interface AppState {
 
   // UI state
   currentPage: 'send' | 'receive' | 'transfers' | 'settings' | 'about';
+  // Paths and favorite passed by a launch, until the Send page takes them
+  launchRequest: LaunchRequest | null;
 
   // Actions
   setCurrentPage: (page: AppState['currentPage']) => void;
@@ -42,19 +60,51 @@ interface AppState {
   updateFavorite: (id: string, name?: string, address?: string) => Promise<void>;
   deleteFavorite: (id: string) => Promise<void>;
   touchFavorite: (id: string) => Promise<void>;
+  getFavoriteFilter: (id: string) => Promise<TransferFilter | null>;
+  setFavoriteFilter: (id: string, filter: TransferFilter | null) => Promise<void>;
+  getFavoriteRoutes: (id: string) => Promise<FavoriteRoutes>;
+  setFavoriteAddresses: (id: string, addresses: string[]) => Promise<void>;
   loadHistory: () => Promise<void>;
   clearHistory: () => Promise<void>;
   loadInterfaces: () => Promise<void>;
   loadPendingTransfers: () => Promise<void>;
   acceptTransfer: (id: string) => Promise<void>;
   rejectTransfer: (id: string) => Promise<void>;
+  acceptTransferSelection: (id: string, patterns: string[]) => Promise<SelectionSummary>;
   acceptAll: () => Promise<void>;
   rejectAll: () => Promise<void>;
   cancelTransfer: (id: string) => Promise<void>;
-  sendFiles: (address: string, port: number, paths: string[]) => Promise<void>;
-  sendDirectory: (address: string, port: number, path: string) => Promise<void>;
+  acceptTransfers: (ids: string[]) => Promise<TransferActionResult[]>;
+  rejectTransfers: (ids: string[]) => Promise<TransferActionResult[]>;
+  cancelTransfers: (ids: string[]) => Promise<TransferActionResult[]>;
+  loadApprovalSessions: () => Promise<void>;
+  startApprovalSession: (
+    peerAddress: string,
+    minutes: number | null,
+    transfers: number | null
+  ) => Promise<ApprovalSession>;
+  revokeApprovalSession: (peerAddress: string) => Promise<void>;
+  sendFiles: (address: string, port: number, paths: string[]) => Promise<string>;
+  sendDirectory: (
+    address: string,
+    port: number,
+    path: string,
+    filter?: TransferFilter | null
+  ) => Promise<string>;
+  sendChain: (favoriteIds: string[], port: number, paths: string[]) => Promise<string>;
+  sendMulticast: (favoriteIds: string[], port: number, path: string) => Promise<string>;
+  loadChains: () => Promise<void>;
+  sendOffer: (address: string, port: number, paths: string[]) => Promise<string>;
+  loadPulls: () => Promise<void>;
+  retryPull: (offerId: string) => Promise<void>;
+  loadOutbox: () => Promise<void>;
+  cancelQueuedSend: (id: string) => Promise<void>;
+  loadSends: () => Promise<void>;
+  cancelSend: (id: string) => Promise<void>;
   resolveAddress: (address: string) => Promise<{ ip: string | null; error: string | null }>;
   checkPeer: (address: string, port: number) => Promise<boolean>;
+  takeLaunchRequest: () => Promise<void>;
+  clearLaunchRequest: () => void;
   initializeEventListener: () => Promise<void>;
 }
 
@@ -66,11 +116,21 @@ export const useAppStore = create<AppState>((set, get) => ({
   pendingTransfers: [],
   activeTransfers: new Map(),
   transferHistory: [],
+  approvalSessions: [],
+  chains: [],
+  pulls: [],
+  outbox: [],
+  sends: [],
   favorites: [],
   settings: null,
   currentPage: 'send',
+  launchRequest: null,
 
-  setCurrentPage: (page) => set({ currentPage: page }),
+  setCurrentPage: (page) => {
+    set({ currentPage: page });
+    // Kept by the backend so a window reopened from the tray shows it again
+    invoke('set_current_page', { page });
+  },
 
   loadSettings: async () => {
     const settings = await invoke<AppSettings>('get_settings');
@@ -108,6 +168,22 @@ export const useAppStore = create<AppState>((set, get) => ({
     await get().loadFavorites();
   },
 
+  getFavoriteFilter: async (id) => {
+    return invoke<TransferFilter | null>('get_favorite_filter', { id });
+  },
+
+  setFavoriteFilter: async (id, filter) => {
+    await invoke('set_favorite_filter', { id, filter });
+  },
+
+  getFavoriteRoutes: async (id) => {
+    return invoke<FavoriteRoutes>('get_favorite_routes', { id });
+  },
+
+  setFavoriteAddresses: async (id, addresses) => {
+    await invoke('set_favorite_addresses', { id, addresses });
+  },
+
   loadHistory: async () => {
     const transferHistory = await invoke<TransferRecord[]>('list_history');
     set({ transferHistory });
@@ -139,6 +215,19 @@ export const useAppStore = create<AppState>((set, get) => ({
     }));
   },
 
+  acceptTransferSelection: async (id, patterns) => {
+    const summary = await invoke<SelectionSummary>('accept_transfer_selection', {
+      transferId: id,
+      patterns,
+    });
+    if (summary.selectedFiles === 0) {
+      set((state) => ({
+        pendingTransfers: state.pendingTransfers.filter((t) => t.id !== id),
+      }));
+    }
+    return summary;
+  },
+
   acceptAll: async () => {
     await invoke('accept_all');
   },
@@ -157,12 +246,119 @@ export const useAppStore = create<AppState>((set, get) => ({
     });
   },
 
+  acceptTransfers: async (ids) => {
+    return invoke<TransferActionResult[]>('accept_transfers', { transferIds: ids });
+  },
+
+  rejectTransfers: async (ids) => {
+    const results = await invoke<TransferActionResult[]>('reject_transfers', {
+      transferIds: ids,
+    });
+    const rejected = new Set(results.filter((r) => r.ok).map((r) => r.id));
+    set((state) => ({
+      pendingTransfers: state.pendingTransfers.filter((t) => !rejected.has(t.id)),
+    }));
+    return results;
+  },
+
+  cancelTransfers: async (ids) => {
+    const results = await invoke<TransferActionResult[]>('cancel_transfers', {
+      transferIds: ids,
+    });
+    set((state) => {
+      const activeTransfers = new Map(state.activeTransfers);
+      results.filter((r) => r.ok).forEach((r) => activeTransfers.delete(r.id));
+      return { activeTransfers };
+    });
+    return results;
+  },
+
+  loadApprovalSessions: async () => {
+    const approvalSessions = await invoke<ApprovalSession[]>('list_approval_sessions');
+    set({ approvalSessions });
+  },
+
+  startApprovalSession: async (peerAddress, minutes, transfers) => {
+    const session = await invoke<ApprovalSession>('start_approval_session', {
+      peerAddress,
+      minutes,
+      transfers,
+    });
+    await get().loadApprovalSessions();
+    return session;
+  },
+
+  revokeApprovalSession: async (peerAddress) => {
+    await invoke('revoke_approval_session', { peerAddress });
+    set((state) => ({
+      approvalSessions: state.approvalSessions.filter((s) => s.peerAddress !== peerAddress),
+    }));
+  },
+
   sendFiles: async (address, port, paths) => {
-    await invoke('send_files', { address, port, paths });
+    const sendId = await invoke<string>('send_files', { address, port, paths });
+    await get().loadSends();
+    return sendId;
+  },
+
+  sendDirectory: async (address, port, path, filter) => {
+    const sendId = await invoke<string>('send_directory', {
+      address,
+      port,
+      path,
+      filter: filter ?? null,
+    });
+    await get().loadSends();
+    return sendId;
+  },
+
+  sendChain: async (favoriteIds, port, paths) => {
+    const chainId = await invoke<string>('send_chain', { favoriteIds, port, paths });
+    await get().loadChains();
+    return chainId;
+  },
+
+  sendMulticast: async (favoriteIds, port, path) => {
+    return invoke<string>('send_multicast', { favoriteIds, port, path });
+  },
+
+  loadChains: async () => {
+    const chains = await invoke<ChainStatus[]>('list_chains');
+    set({ chains });
+  },
+
+  sendOffer: async (address, port, paths) => {
+    return invoke<string>('send_offer', { address, port, paths });
+  },
+
+  loadPulls: async () => {
+    const pulls = await invoke<PullStatus[]>('list_pulls');
+    set({ pulls });
   },
 
-  sendDirectory: async (address, port, path) => {
-    await invoke('send_directory', { address, port, path });
+  retryPull: async (offerId) => {
+    await invoke('retry_pull', { offerId });
+    await get().loadPulls();
+  },
+
+  loadOutbox: async () => {
+    const outbox = await invoke<OutboxEntry[]>('list_outbox');
+    set({ outbox });
+  },
+
+  cancelQueuedSend: async (id) => {
+    await invoke('cancel_queued_send', { id });
+    await get().loadOutbox();
+  },
+
+  loadSends: async () => {
+    const sends = await invoke<SendInfo[]>('list_sends');
+    set({ sends });
+  },
+
+  cancelSend: async (id) => {
+    await invoke('cancel_transfer', { transferId: id });
+    await get().loadSends();
   },
 
   resolveAddress: async (address) => {
@@ -177,7 +373,22 @@ export const useAppStore = create<AppState>((set, get) => ({
     return invoke<boolean>('check_peer', { address, port });
   },
 
+  takeLaunchRequest: async () => {
+    const launchRequest = await invoke<LaunchRequest | null>('take_launch_request');
+    if (launchRequest) {
+      get().setCurrentPage('send');
+      set({ launchRequest });
+    }
+  },
+
+  clearLaunchRequest: () => set({ launchRequest: null }),
+
   initializeEventListener: async () => {
+    // Another launch handed over paths to send
+    await listen('launch-request', () => {
+      get().takeLaunchRequest();
+    });
+
     await listen<EngineEvent>('engine-event', (event) => {
       const engineEvent = event.payload;
 
@@ -244,14 +455,23 @@ export const useAppStore = create<AppState>((set, get) => ({
       }
     });
 
-    // Initialize by loading initial data
-    await Promise.all([
-      get().loadSettings(),
-      get().loadFavorites(),
-      get().loadHistory(),
-      get().loadInterfaces(),
-      get().loadPendingTransfers(),
-    ]);
+    // Initialize from one snapshot, which also restores a window reopened
+    // from the tray while transfers were running
+    const snapshot = await invoke<FrontendSnapshot>('get_snapshot');
+    set({
+      settings: snapshot.settings,
+      favorites: snapshot.favorites,
+      transferHistory: snapshot.history,
+      interfaces: snapshot.interfaces,
+      pendingTransfers: snapshot.pendingTransfers,
+      activeTransfers: new Map(snapshot.activeTransfers.map((p) => [p.transfer_id, p])),
+      serverRunning: snapshot.serverPort !== null,
+      serverPort: snapshot.serverPort,
+      ...(snapshot.page ? { currentPage: snapshot.page as AppState['currentPage'] } : {}),
+    });
+
+    // Paths this window was opened for
+    await get().takeLaunchRequest();
 
     // Server auto-starts in backend, but check status
     await invoke('initialize');
@@ -12,6 +12,12 @@ export interface AppSettings {
   retryDelayMs: number;
   bandwidthLimitBps: number | null;
   interfaceFilters: InterfaceFilters;
+  skipQueueMaxBytes: number;
+  transport: 'http' | 'quic' | 'encrypted';
+  multicastEnabled: boolean;
+  idleExitMinutes: number;
+  trayMode: boolean;
+  logFilter: string;
 }
 
 export interface InterfaceFilters {
@@ -36,6 +42,24 @@ export interface Favorite {
   last_used: string | null;
 }
 
+export interface RouteStats {
+  rttMs: number | null;
+  failures: number;
+  updatedAt: string;
+}
+
+export interface FavoriteRoutes {
+  addresses: string[];
+  stats?: Record<string, RouteStats>;
+  lastWinner: string | null;
+}
+
+export interface TransferFilter {
+  include: string[];
+  exclude: string[];
+  respectGitignore: boolean;
+}
+
 export interface TransferFile {
   name: string;
   size: number;
@@ -70,6 +94,96 @@ export interface TransferRecord {
   files: TransferFile[];
   status: TransferStatus;
   error: string | null;
+  skipped_files?: string[];
+}
+
+export interface TransferActionResult {
+  id: string;
+  ok: boolean;
+  error: string | null;
+}
+
+export interface ChainStatus {
+  chainId: string;
+  hop: number;
+  totalFiles: number;
+  receivedFiles: number;
+  forwardedFiles: number;
+  failedFiles: number;
+  nextHop: string | null;
+  updatedAt: string;
+}
+
+export interface PullStatus {
+  offerId: string;
+  peerAddress: string;
+  files: string[];
+  totalBytes: number;
+  receivedBytes: number;
+  state: 'running' | 'failed' | 'complete';
+  error: string | null;
+  updatedAt: string;
+}
+
+export interface SendInfo {
+  id: string;
+  address: string;
+  stage: 'queued' | 'preparing' | 'sending';
+  startedAt: string;
+}
+
+export interface LaunchRequest {
+  paths: string[];
+  favorite: string | null;
+  send: boolean;
+}
+
+export interface FrontendSnapshot {
+  settings: AppSettings;
+  favorites: Favorite[];
+  history: TransferRecord[];
+  interfaces: NetworkInterface[];
+  pendingTransfers: PendingTransfer[];
+  activeTransfers: TransferProgress[];
+  serverPort: number | null;
+  page: string | null;
+}
+
+export interface OutboxEntry {
+  id: string;
+  address: string;
+  port: number;
+  sources: string[];
+  queuedAt: string;
+  attempts: number;
+  nextProbeAt: string;
+  lastError: string | null;
+}
+
+export interface TransportCapabilities {
+  cipher: string;
+  aesHardware: boolean;
+  sendSegments: number;
+  receiveSegments: number;
+}
+
+export interface KnownPeer {
+  address: string;
+  fingerprint: string;
+}
+
+export interface ApprovalSession {
+  peerAddress: string;
+  startedAt: string;
+  expiresAt: string | null;
+  remainingTransfers: number | null;
+  acceptedTransfers: number;
+}
+
+export interface SelectionSummary {
+  selectedFiles: number;
+  skippedFiles: number;
+  skippedBytes: number;
 }
 
 export type TransferStatus = 'Pending' | 'InProgress' | 'Completed' | 'Failed' | 'Cancelled';